@@ -18,8 +18,19 @@
    2015/MAR/03  - First release (KTOWN)
 */
 
-/* Set the delay between fresh samples */
-#define BNO055_SAMPLERATE_DELAY_MS (16)
+/* Set the delay between fresh samples, the fusion output runs at 100 Hz */
+#define BNO055_SAMPLERATE_DELAY_MS (10)
+
+/* Set to 1 to send 11 byte binary frames instead of text lines, the driver
+   needs "hmdIMUserialBinaryPackets" : true then. Frame: AA 55, the fused
+   quaternion as int16 little endian (x16384), in the text output's w,y,z,x
+   order, then the 8 bit sum of those 8 bytes. */
+#define BINARY_OUTPUT 0
+
+/* Set to 1 to append the linear acceleration (gravity removed, m/s^2) to
+   every text line, in the same axis order as the quaternion: w,y,z,x,ay,az,ax.
+   The driver integrates it between camera poses ("positionUpsampling"). */
+#define LINEAR_ACCEL_OUTPUT 1
 
 // Check I2C device address and correct line below (by default address is 0x29 or 0x28)
 //                                   id, address
@@ -73,11 +84,34 @@ void loop(void)
   // - VECTOR_LINEARACCEL   - m/s^2
   // - VECTOR_GRAVITY       - m/s^2
   imu::Quaternion quat = bno.getQuat(); 
+#if BINARY_OUTPUT
+  /* same axis order as the text output: w, y, z, x */
+  double values[4] = { quat.w(), quat.y(), quat.z(), quat.x() };
+  uint8_t frame[11] = { 0xAA, 0x55 };
+  uint8_t sum = 0;
+  for (int i = 0; i < 4; i++) {
+    int16_t raw = (int16_t)(values[i] * 16384.0 + (values[i] < 0 ? -0.5 : 0.5));
+    frame[2 + 2 * i] = raw & 0xff;
+    frame[3 + 2 * i] = (raw >> 8) & 0xff;
+    sum += frame[2 + 2 * i] + frame[3 + 2 * i];
+  }
+  frame[10] = sum;
+  Serial.write(frame, sizeof(frame));
+#else
 
   Serial.print(quat.w(), 4);  Serial.print(","); // Print quaternion w
   Serial.print(quat.y(), 4);  Serial.print(","); // Print quaternion x
   Serial.print(quat.z(), 4);  Serial.print(","); // Print quaternion y
+#if LINEAR_ACCEL_OUTPUT
+  Serial.print(quat.x(), 4);  Serial.print(",");  // Print quaternion z
+  imu::Vector<3> accel = bno.getVector(Adafruit_BNO055::VECTOR_LINEARACCEL);
+  Serial.print(accel.y(), 3); Serial.print(",");
+  Serial.print(accel.z(), 3); Serial.print(",");
+  Serial.print(accel.x(), 3); Serial.println();
+#else
   Serial.print(quat.x(), 4);  Serial.println();   // Print quaternion z
+#endif
+#endif
   
   delay(BNO055_SAMPLERATE_DELAY_MS);
 }
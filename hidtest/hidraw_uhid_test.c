@@ -0,0 +1,229 @@
+/*******************************************************
+ Relativty hidraw backend test.
+
+ Creates a virtual HID device through /dev/uhid that looks like the
+ Relativty HMD (vid 0x1209, pid 0x0009 by default) and streams 64-byte
+ MPU DMP quaternion reports at a configurable rate. The hidraw backend in
+ source/hid_linux.c is then used to enumerate, open and poll the device,
+ and every report is checked for loss, reordering and corruption.
+
+ Needs the uhid kernel module and write access to /dev/uhid, exits with
+ 77 (skipped) when either is missing.
+
+ Build and run:
+   gcc -std=c99 -O2 -Iinclude source/hid_linux.c hidtest/hidraw_uhid_test.c \
+       -lpthread -o hidraw_uhid_test
+   sudo ./hidraw_uhid_test [rate_hz=1000] [count=5000]
+********************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/uhid.h>
+
+#include "hidapi/hidapi.h"
+#include "hidapi/hidapi_hidraw.h"
+
+#define TEST_VID 0x1209
+#define TEST_PID 0x0009
+#define REPORT_LEN 64
+#define EXIT_SKIP 77
+
+/* Vendor defined collection with a single 64 byte input report and no
+   report id, the same shape as the Relativty HMD firmware. */
+static const unsigned char report_descriptor[] = {
+	0x06, 0x00, 0xff, /* Usage Page (Vendor Defined 0xFF00) */
+	0x09, 0x01,       /* Usage (0x01) */
+	0xa1, 0x01,       /* Collection (Application) */
+	0x15, 0x00,       /*   Logical Minimum (0) */
+	0x26, 0xff, 0x00, /*   Logical Maximum (255) */
+	0x75, 0x08,       /*   Report Size (8) */
+	0x95, 0x40,       /*   Report Count (64) */
+	0x09, 0x01,       /*   Usage (0x01) */
+	0x81, 0x02,       /*   Input (Data,Var,Abs) */
+	0x95, 0x40,       /*   Report Count (64) */
+	0x09, 0x01,       /*   Usage (0x01) */
+	0x91, 0x02,       /*   Output (Data,Var,Abs) */
+	0xc0,             /* End Collection */
+};
+
+struct injector {
+	int uhid_fd;
+	unsigned rate_hz;
+	unsigned count;
+};
+
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+	ssize_t ret = write(fd, ev, sizeof(*ev));
+	if (ret < 0) {
+		perror("write /dev/uhid");
+		return -1;
+	}
+	return 0;
+}
+
+/* DMP packets carry the quaternion as big endian Q14 at bytes 1, 5, 9 and
+   13. The sequence number goes into bytes 60..63 to detect loss. */
+static void make_dmp_report(unsigned char *report, uint32_t seq)
+{
+	int16_t q[4];
+	int i;
+
+	q[0] = 16384;
+	q[1] = (int16_t) (seq % 4096);
+	q[2] = (int16_t) -(int16_t) (seq % 2048);
+	q[3] = 0;
+
+	memset(report, 0, REPORT_LEN);
+	for (i = 0; i < 4; i++) {
+		report[1 + 4*i] = (unsigned char) ((uint16_t) q[i] >> 8);
+		report[2 + 4*i] = (unsigned char) ((uint16_t) q[i] & 0xff);
+	}
+	report[60] = (unsigned char) (seq >> 24);
+	report[61] = (unsigned char) (seq >> 16);
+	report[62] = (unsigned char) (seq >> 8);
+	report[63] = (unsigned char) seq;
+}
+
+static void *inject_reports(void *arg)
+{
+	struct injector *inj = (struct injector*) arg;
+	struct uhid_event ev;
+	struct timespec next;
+	long period_ns = 1000000000L / (long) inj->rate_hz;
+	uint32_t seq;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (seq = 0; seq < inj->count; seq++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = UHID_INPUT2;
+		ev.u.input2.size = REPORT_LEN;
+		make_dmp_report(ev.u.input2.data, seq);
+		if (uhid_write(inj->uhid_fd, &ev))
+			break;
+
+		next.tv_nsec += period_ns;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	return NULL;
+}
+
+static hid_device *open_when_ready(void)
+{
+	int attempt;
+	hid_device *handle;
+
+	/* The hidraw node shows up asynchronously after UHID_CREATE2. */
+	for (attempt = 0; attempt < 200; attempt++) {
+		handle = hid_open(TEST_VID, TEST_PID, NULL);
+		if (handle)
+			return handle;
+		usleep(10000);
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	struct injector inj;
+	struct uhid_event ev;
+	pthread_t thread;
+	hid_device *handle;
+	unsigned char buf[REPORT_LEN];
+	uint32_t expected = 0;
+	unsigned received = 0, lost = 0, reordered = 0, corrupt = 0;
+	struct pollfd pfd;
+	int res;
+
+	inj.rate_hz = argc > 1 ? (unsigned) atoi(argv[1]) : 1000;
+	inj.count = argc > 2 ? (unsigned) atoi(argv[2]) : 5000;
+	if (inj.rate_hz == 0)
+		inj.rate_hz = 1000;
+
+	inj.uhid_fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+	if (inj.uhid_fd < 0) {
+		fprintf(stderr, "SKIP: cannot open /dev/uhid: %s\n", strerror(errno));
+		return EXIT_SKIP;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	strcpy((char*) ev.u.create2.name, "Relativty test HMD");
+	strcpy((char*) ev.u.create2.uniq, "relativty-uhid");
+	memcpy(ev.u.create2.rd_data, report_descriptor, sizeof(report_descriptor));
+	ev.u.create2.rd_size = sizeof(report_descriptor);
+	ev.u.create2.bus = BUS_USB;
+	ev.u.create2.vendor = TEST_VID;
+	ev.u.create2.product = TEST_PID;
+	if (uhid_write(inj.uhid_fd, &ev))
+		return 1;
+
+	if (hid_init())
+		return 1;
+
+	handle = open_when_ready();
+	if (!handle) {
+		fprintf(stderr, "FAIL: virtual device never showed up in hid_enumerate\n");
+		return 1;
+	}
+	hid_set_nonblocking(handle, 1);
+
+	pthread_create(&thread, NULL, inject_reports, &inj);
+
+	pfd.fd = hid_hidraw_get_fd(handle);
+	pfd.events = POLLIN;
+	while (received + lost < inj.count) {
+		if (poll(&pfd, 1, 1000) <= 0)
+			break;
+
+		/* Drain everything that is queued before polling again. */
+		while ((res = hid_read(handle, buf, sizeof(buf))) > 0) {
+			uint32_t seq = ((uint32_t) buf[60] << 24) | ((uint32_t) buf[61] << 16) |
+			               ((uint32_t) buf[62] << 8) | buf[63];
+			int16_t w = (int16_t) ((buf[1] << 8) | buf[2]);
+
+			if (res != REPORT_LEN || w != 16384)
+				corrupt++;
+			if (seq < expected)
+				reordered++;
+			else
+				lost += seq - expected;
+			expected = seq + 1;
+			received++;
+		}
+		if (res < 0) {
+			fprintf(stderr, "FAIL: hid_read: %ls\n", hid_error(handle));
+			break;
+		}
+	}
+
+	pthread_join(thread, NULL);
+	hid_close(handle);
+	hid_exit();
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	uhid_write(inj.uhid_fd, &ev);
+	close(inj.uhid_fd);
+
+	printf("rate %u Hz: sent %u, received %u, lost %u, reordered %u, corrupt %u\n",
+		inj.rate_hz, inj.count, received, lost, reordered, corrupt);
+
+	return (received == inj.count && corrupt == 0 && reordered == 0) ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_CLOCK_H
+#define RELATIVTY_CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace Relativty {
+	// Host monotonic time in nanoseconds. steady_clock is QueryPerformanceCounter
+	// on Windows and CLOCK_MONOTONIC on Linux, the same clocks serial::Timestamp
+	// uses, so serial receive stamps and driver stamps can be compared directly.
+	inline int64_t MonotonicNowNs() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+#endif // RELATIVTY_CLOCK_H
@@ -0,0 +1,106 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_CONTROLCHANNEL_H
+#define RELATIVTY_CONTROLCHANNEL_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "Relativty_StopSignal.h"
+
+namespace Relativty {
+	// What the control channel asks of the pose pipeline. Each request is
+	// taken by the thread that owns the state it changes, between two poses,
+	// so a pose is computed entirely before or entirely after it.
+	enum class ControlRequest : uint32_t {
+		Recenter = 1u << 0,     // apply_tracker_pose, the next headset pose becomes straight ahead
+		CalibrateImu = 1u << 1  // the serial IMU loop, sends the firmware "C\n"
+	};
+
+	class ControlRequests {
+	public:
+		void Post(ControlRequest request) { this->pending.fetch_or(static_cast<uint32_t>(request)); }
+
+		// true once per Post, however often it was posted meanwhile. Costs a
+		// relaxed load on the hot path while nothing is pending.
+		bool Take(ControlRequest request) {
+			const uint32_t bit = static_cast<uint32_t>(request);
+			return (this->pending.load(std::memory_order_relaxed) & bit) != 0 && (this->pending.fetch_and(~bit) & bit) != 0;
+		}
+
+		void Clear() { this->pending = 0; }
+
+	private:
+		std::atomic<uint32_t> pending{ 0 };
+	};
+
+	// Answers one command line with zero or more lines of output in reply,
+	// or returns false with reply saying why. The channel adds the status line.
+	typedef bool (*ControlHandler)(void* context, const std::string& command, std::string& reply);
+
+	struct ControlSink {
+		ControlHandler handle;
+		void* context;
+	};
+
+	// \\.\pipe\<name> on Windows. Elsewhere a Unix socket, <name> itself if it
+	// holds a '/', else <name>.sock in $XDG_RUNTIME_DIR or /tmp.
+	std::string ControlEndpointPath(const std::string& name);
+
+	// Local control interface of the driver, a named pipe on Windows and a
+	// Unix socket elsewhere, only reachable from this machine. A client
+	// connects, writes one command line and reads the reply: the handler's
+	// output followed by a status line, "ok" or "error: <why>". The channel
+	// closes the connection once the client has gone or after kClientTimeoutMs.
+	// Clients are served one at a time on the channel's own thread.
+	class ControlChannel {
+	public:
+		static const int kClientTimeoutMs = 1000;
+		static const size_t kMaxCommandLen = 512;
+
+		ControlChannel() = default;
+		ControlChannel(const ControlChannel&) = delete;
+		ControlChannel& operator=(const ControlChannel&) = delete;
+		~ControlChannel() { this->Stop(); }
+
+		// false if the endpoint cannot be created, problem says why
+		bool Start(const std::string& name, const ControlSink& sink, std::string& problem);
+		void Stop();
+
+		const std::string& Path() const { return this->path; }
+		uint64_t Commands() const { return this->commands; }
+
+	private:
+		void serveThreaded();
+		void serveClient(const std::string& received, std::string& reply);
+
+		ControlSink sink = {};
+		std::string path;
+		StopSignal stop;
+		std::thread worker;
+		std::atomic<uint64_t> commands{ 0 };
+#ifdef _WIN32
+		HANDLE pipe = INVALID_HANDLE_VALUE;
+#else
+		int listener = -1;
+#endif
+	};
+}
+
+#endif // RELATIVTY_CONTROLCHANNEL_H
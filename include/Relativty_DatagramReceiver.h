@@ -0,0 +1,141 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_DATAGRAMRECEIVER_H
+#define RELATIVTY_DATAGRAMRECEIVER_H
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+// WinSock2.h has to come before any Windows.h
+#include <WinSock2.h>
+#include <MSWSock.h>
+#include <mstcpip.h>
+#include <Windows.h>
+#else
+#include <ctime>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "Relativty_Clock.h"
+#include "Relativty_StopSignal.h"
+
+namespace Relativty {
+	// Receives datagrams together with the time the network stack took them
+	// in, so the caller can tell how long each one sat in the socket before
+	// its thread got to it: the wakeup latency under load, where a timed wait
+	// never times out. Uses SIO_TIMESTAMPING (Windows 10 2004 and later,
+	// stamps in QueryPerformanceCounter ticks like steady_clock) or
+	// SO_TIMESTAMPNS (CLOCK_REALTIME). Without them every datagram comes
+	// with a queued time of -1.
+	class DatagramReceiver {
+	public:
+		explicit DatagramReceiver(SOCKET socket) : sock(socket) {
+#ifdef _WIN32
+			DWORD bytes = 0;
+			GUID recvMsgId = WSAID_WSARECVMSG;
+			if (WSAIoctl(this->sock, SIO_GET_EXTENSION_FUNCTION_POINTER, &recvMsgId, sizeof(recvMsgId),
+			             &this->recvMsg, sizeof(this->recvMsg), &bytes, NULL, NULL) != 0)
+				this->recvMsg = NULL;
+			TIMESTAMPING_CONFIG config = {};
+			config.Flags = TIMESTAMPING_FLAG_RX;
+			this->stamped = this->recvMsg != NULL
+				&& WSAIoctl(this->sock, SIO_TIMESTAMPING, &config, sizeof(config), NULL, 0, &bytes, NULL, NULL) == 0;
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			this->ticksPerSecond = frequency.QuadPart;
+#else
+			const int on = 1;
+			this->stamped = setsockopt(this->sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+#endif
+		}
+
+		// true if the stack stamps the datagrams
+		bool Stamped() const { return this->stamped; }
+
+		// recvfrom() with the time the datagram waited in the socket, -1 if
+		// the stack did not stamp it
+		int Receive(char* buffer, int length, sockaddr_in& from, int64_t& queuedNs) {
+			queuedNs = -1;
+			if (!this->stamped) {
+#ifdef _WIN32
+				int fromLen = sizeof(from);
+#else
+				socklen_t fromLen = sizeof(from);
+#endif
+				return recvfrom(this->sock, buffer, length, 0, reinterpret_cast<sockaddr*>(&from), &fromLen);
+			}
+#ifdef _WIN32
+			WSABUF data = { static_cast<ULONG>(length), buffer };
+			char control[WSA_CMSG_SPACE(sizeof(UINT64))];
+			WSAMSG message = {};
+			message.name = reinterpret_cast<LPSOCKADDR>(&from);
+			message.namelen = sizeof(from);
+			message.lpBuffers = &data;
+			message.dwBufferCount = 1;
+			message.Control.buf = control;
+			message.Control.len = sizeof(control);
+			DWORD received = 0;
+			if (this->recvMsg(this->sock, &message, &received, NULL, NULL) == SOCKET_ERROR)
+				return SOCKET_ERROR;
+			for (WSACMSGHDR* header = WSA_CMSG_FIRSTHDR(&message); header != NULL; header = WSA_CMSG_NXTHDR(&message, header)) {
+				if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SO_TIMESTAMP) {
+					UINT64 ticks;
+					std::memcpy(&ticks, WSA_CMSG_DATA(header), sizeof(ticks));
+					const int64_t seconds = static_cast<int64_t>(ticks) / this->ticksPerSecond;
+					const int64_t rest = static_cast<int64_t>(ticks) % this->ticksPerSecond;
+					queuedNs = MonotonicNowNs() - (seconds * 1000000000LL + rest * 1000000000LL / this->ticksPerSecond);
+				}
+			}
+			return static_cast<int>(received);
+#else
+			iovec data = { buffer, static_cast<size_t>(length) };
+			alignas(cmsghdr) char control[CMSG_SPACE(sizeof(timespec))];
+			msghdr message = {};
+			message.msg_name = &from;
+			message.msg_namelen = sizeof(from);
+			message.msg_iov = &data;
+			message.msg_iovlen = 1;
+			message.msg_control = control;
+			message.msg_controllen = sizeof(control);
+			const ssize_t received = recvmsg(this->sock, &message, 0);
+			if (received < 0)
+				return -1;
+			for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+				if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPNS) {
+					timespec arrival, now;
+					std::memcpy(&arrival, CMSG_DATA(header), sizeof(arrival));
+					clock_gettime(CLOCK_REALTIME, &now);
+					queuedNs = (now.tv_sec - arrival.tv_sec) * 1000000000LL + (now.tv_nsec - arrival.tv_nsec);
+				}
+			}
+			return static_cast<int>(received);
+#endif
+		}
+
+	private:
+		SOCKET sock;
+		bool stamped = false;
+#ifdef _WIN32
+		LPFN_WSARECVMSG recvMsg = NULL;
+		int64_t ticksPerSecond = 1;
+#endif
+	};
+}
+
+#endif // RELATIVTY_DATAGRAMRECEIVER_H
@@ -0,0 +1,237 @@
+#pragma once
+
+#ifndef RELATIVTY_DISTORTION_H
+#define RELATIVTY_DISTORTION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define RELATIVTY_DISTORTION_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RELATIVTY_DISTORTION_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define RELATIVTY_DISTORTION_NEON
+#endif
+
+namespace Relativty {
+  // Radial lens model from
+  // https://github.com/HelenXR/openvr_survivor/blob/master/src/head_mount_display_device.cc
+  //
+  // The original form is
+  //   rr = |d|, r2 = rr * (1 + k1 rr^2 + k2 rr^4), theta = atan2(d.u, d.v)
+  //   h = (sin(theta) * r2 * zoomW, cos(theta) * r2 * zoomH)
+  // with d = (u, v) - 0.5. Since sin(theta) = d.u / rr and cos(theta) = d.v / rr
+  // that is just d scaled by r2 / rr = 1 + k1 rr^2 + k2 rr^4, no sqrt or trig.
+  struct RadialDistortionModel {
+    float k1;
+    float k2;
+    float zoomWidth;
+    float zoomHeight;
+
+    void Evaluate(float fU, float fV, float *pfX, float *pfY) const {
+      const float du = fU - 0.5f;
+      const float dv = fV - 0.5f;
+      const float rr2 = du * du + dv * dv;
+      const float scale = 1.0f + rr2 * (k1 + k2 * rr2);
+      *pfX = du * scale * zoomWidth + 0.5f;
+      *pfY = dv * scale * zoomHeight + 0.5f;
+    }
+
+    // Same as Evaluate for unCount points, 8 (AVX) or 4 (SSE2, NEON) at a time.
+    // Inputs and outputs are separate arrays so whole mesh rows vectorize.
+    void EvaluateBatch(const float *pfU, const float *pfV, size_t unCount,
+                       float *pfX, float *pfY) const {
+      size_t i = 0;
+#if defined(RELATIVTY_DISTORTION_AVX)
+      const __m256 half = _mm256_set1_ps(0.5f);
+      const __m256 one = _mm256_set1_ps(1.0f);
+      const __m256 vk1 = _mm256_set1_ps(k1);
+      const __m256 vk2 = _mm256_set1_ps(k2);
+      const __m256 zw = _mm256_set1_ps(zoomWidth);
+      const __m256 zh = _mm256_set1_ps(zoomHeight);
+      for (; i + 8 <= unCount; i += 8) {
+        const __m256 du = _mm256_sub_ps(_mm256_loadu_ps(pfU + i), half);
+        const __m256 dv = _mm256_sub_ps(_mm256_loadu_ps(pfV + i), half);
+        const __m256 rr2 = _mm256_add_ps(_mm256_mul_ps(du, du), _mm256_mul_ps(dv, dv));
+        const __m256 scale = _mm256_add_ps(one, _mm256_mul_ps(rr2,
+            _mm256_add_ps(vk1, _mm256_mul_ps(vk2, rr2))));
+        _mm256_storeu_ps(pfX + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(du, scale), zw), half));
+        _mm256_storeu_ps(pfY + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(dv, scale), zh), half));
+      }
+#elif defined(RELATIVTY_DISTORTION_SSE2)
+      const __m128 half = _mm_set1_ps(0.5f);
+      const __m128 one = _mm_set1_ps(1.0f);
+      const __m128 vk1 = _mm_set1_ps(k1);
+      const __m128 vk2 = _mm_set1_ps(k2);
+      const __m128 zw = _mm_set1_ps(zoomWidth);
+      const __m128 zh = _mm_set1_ps(zoomHeight);
+      for (; i + 4 <= unCount; i += 4) {
+        const __m128 du = _mm_sub_ps(_mm_loadu_ps(pfU + i), half);
+        const __m128 dv = _mm_sub_ps(_mm_loadu_ps(pfV + i), half);
+        const __m128 rr2 = _mm_add_ps(_mm_mul_ps(du, du), _mm_mul_ps(dv, dv));
+        const __m128 scale = _mm_add_ps(one, _mm_mul_ps(rr2,
+            _mm_add_ps(vk1, _mm_mul_ps(vk2, rr2))));
+        _mm_storeu_ps(pfX + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(du, scale), zw), half));
+        _mm_storeu_ps(pfY + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(dv, scale), zh), half));
+      }
+#elif defined(RELATIVTY_DISTORTION_NEON)
+      const float32x4_t half = vdupq_n_f32(0.5f);
+      const float32x4_t one = vdupq_n_f32(1.0f);
+      const float32x4_t vk1 = vdupq_n_f32(k1);
+      const float32x4_t vk2 = vdupq_n_f32(k2);
+      const float32x4_t zw = vdupq_n_f32(zoomWidth);
+      const float32x4_t zh = vdupq_n_f32(zoomHeight);
+      for (; i + 4 <= unCount; i += 4) {
+        const float32x4_t du = vsubq_f32(vld1q_f32(pfU + i), half);
+        const float32x4_t dv = vsubq_f32(vld1q_f32(pfV + i), half);
+        const float32x4_t rr2 = vaddq_f32(vmulq_f32(du, du), vmulq_f32(dv, dv));
+        const float32x4_t scale = vaddq_f32(one, vmulq_f32(rr2,
+            vaddq_f32(vk1, vmulq_f32(vk2, rr2))));
+        vst1q_f32(pfX + i, vaddq_f32(vmulq_f32(vmulq_f32(du, scale), zw), half));
+        vst1q_f32(pfY + i, vaddq_f32(vmulq_f32(vmulq_f32(dv, scale), zh), half));
+      }
+#endif
+      for (; i < unCount; i++)
+        Evaluate(pfU[i], pfV[i], pfX + i, pfY + i);
+    }
+  };
+
+  enum EDistortionChannel {
+    DistortionChannel_Red = 0,
+    DistortionChannel_Green = 1,
+    DistortionChannel_Blue = 2,
+    DistortionChannel_Count = 3
+  };
+
+  // One radial model per colour channel, cheap lenses bend red and blue by
+  // visibly different amounts (lateral chromatic aberration). Outputs are
+  // 6 floats red x/y, green x/y, blue x/y, the layout of
+  // vr::DistortionCoordinates_t.
+  struct ChromaticDistortionModel {
+    RadialDistortionModel channels[DistortionChannel_Count];
+
+    void Evaluate(float fU, float fV, float pfOut[6]) const {
+      for (int c = 0; c < DistortionChannel_Count; c++)
+        channels[c].Evaluate(fU, fV, pfOut + 2 * c, pfOut + 2 * c + 1);
+    }
+
+    // ppfX[c] / ppfY[c] receive unCount results for channel c
+    void EvaluateBatch(const float *pfU, const float *pfV, size_t unCount,
+                       float *const ppfX[DistortionChannel_Count],
+                       float *const ppfY[DistortionChannel_Count]) const {
+      for (int c = 0; c < DistortionChannel_Count; c++)
+        channels[c].EvaluateBatch(pfU, pfV, unCount, ppfX[c], ppfY[c]);
+    }
+  };
+
+  // The model sampled on a regular grid over [0, 1]^2, looked up with bilinear
+  // interpolation. The compositor queries ComputeDistortion once per vertex of
+  // its distortion mesh, so the grid is built once when the display component
+  // is created and every query after that is a fixed cost independent of how
+  // expensive the model is.
+  class DistortionLut {
+  public:
+    // 129 nodes per axis keeps the interpolation error around 3e-5 in texture
+    // coordinates for the coefficients the driver ships with (well under a
+    // tenth of a pixel on a 1080p panel), at 400KB for the three channels.
+    static constexpr uint32_t k_unDefaultGridSize = 129;
+    static constexpr uint32_t k_unFloatsPerNode = 2 * DistortionChannel_Count;
+
+    DistortionLut() : m_unGridSize(0), m_pNodes(nullptr) {}
+
+    void Build(const ChromaticDistortionModel &model,
+               uint32_t unGridSize = k_unDefaultGridSize) {
+      m_unGridSize = (std::max)(unGridSize, uint32_t(2));
+      m_Model = model;
+      m_vNodes.resize(size_t(m_unGridSize) * m_unGridSize * k_unFloatsPerNode);
+
+      // evaluate a whole row per channel with the batch path, then interleave
+      std::vector<float> u(m_unGridSize), v(m_unGridSize);
+      std::vector<float> out(size_t(m_unGridSize) * k_unFloatsPerNode);
+      float *ppfX[DistortionChannel_Count];
+      float *ppfY[DistortionChannel_Count];
+      for (int c = 0; c < DistortionChannel_Count; c++) {
+        ppfX[c] = &out[size_t(2 * c) * m_unGridSize];
+        ppfY[c] = &out[size_t(2 * c + 1) * m_unGridSize];
+      }
+
+      const float step = 1.0f / float(m_unGridSize - 1);
+      for (uint32_t x = 0; x < m_unGridSize; x++)
+        u[x] = x * step;
+      float *node = m_vNodes.data();
+      for (uint32_t y = 0; y < m_unGridSize; y++) {
+        std::fill(v.begin(), v.end(), y * step);
+        model.EvaluateBatch(u.data(), v.data(), m_unGridSize, ppfX, ppfY);
+        for (uint32_t x = 0; x < m_unGridSize; x++) {
+          for (int c = 0; c < DistortionChannel_Count; c++) {
+            node[2 * c] = ppfX[c][x];
+            node[2 * c + 1] = ppfY[c][x];
+          }
+          node += k_unFloatsPerNode;
+        }
+      }
+      m_pNodes = m_vNodes.data();
+    }
+
+    // Uses nodes someone else owns, e.g. a mapped DistortionCache. They must
+    // hold GridSize()^2 * k_unFloatsPerNode floats laid out like Build's and
+    // outlive the table.
+    void Attach(const ChromaticDistortionModel &model, uint32_t unGridSize,
+                const float *pNodes) {
+      m_vNodes.clear();
+      m_vNodes.shrink_to_fit();
+      m_Model = model;
+      m_unGridSize = unGridSize;
+      m_pNodes = pNodes;
+    }
+
+    bool IsBuilt() const { return m_unGridSize != 0; }
+
+    uint32_t GridSize() const { return m_unGridSize; }
+
+    size_t NodeCount() const { return size_t(m_unGridSize) * m_unGridSize; }
+
+    const float *Nodes() const { return m_pNodes; }
+
+    void Lookup(float fU, float fV, float pfOut[k_unFloatsPerNode]) const {
+      // SteamVR only asks for [0, 1], anything else goes to the exact model
+      if (!(fU >= 0.0f && fU <= 1.0f && fV >= 0.0f && fV <= 1.0f)) {
+        m_Model.Evaluate(fU, fV, pfOut);
+        return;
+      }
+
+      const float last = float(m_unGridSize - 1);
+      const float gx = fU * last;
+      const float gy = fV * last;
+      const uint32_t x0 = (std::min)(uint32_t(gx), m_unGridSize - 2);
+      const uint32_t y0 = (std::min)(uint32_t(gy), m_unGridSize - 2);
+      const float tx = gx - float(x0);
+      const float ty = gy - float(y0);
+
+      const float *n00 = m_pNodes + (size_t(y0) * m_unGridSize + x0) * k_unFloatsPerNode;
+      const float *n01 = n00 + k_unFloatsPerNode;
+      const float *n10 = n00 + size_t(m_unGridSize) * k_unFloatsPerNode;
+      const float *n11 = n10 + k_unFloatsPerNode;
+
+      for (uint32_t c = 0; c < k_unFloatsPerNode; c++) {
+        const float top = n00[c] + (n01[c] - n00[c]) * tx;
+        const float bottom = n10[c] + (n11[c] - n10[c]) * tx;
+        pfOut[c] = top + (bottom - top) * ty;
+      }
+    }
+
+  private:
+    uint32_t m_unGridSize;
+    ChromaticDistortionModel m_Model;
+    std::vector<float> m_vNodes; // k_unFloatsPerNode per node, row major, v outer
+    const float *m_pNodes;       // m_vNodes or attached storage
+  };
+}
+
+#endif // RELATIVTY_DISTORTION_H
@@ -0,0 +1,246 @@
+#pragma once
+
+#ifndef RELATIVTY_DISTORTIONCACHE_H
+#define RELATIVTY_DISTORTIONCACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Relativty_Distortion.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Relativty {
+  // On disk form of a DistortionLut grid so the next SteamVR start can map it
+  // instead of evaluating the model again:
+  //
+  //   DistortionCacheHeader | gridSize^2 * k_unFloatsPerNode floats
+  //
+  // The header carries a hash of everything the grid depends on (the lens
+  // settings, grid size and format version) and a checksum of the payload.
+  // A file that does not match in any way is ignored and rewritten.
+  struct DistortionCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t settingsHash;
+    uint32_t gridSize;
+    uint32_t floatsPerNode;
+    uint64_t payloadChecksum;
+  };
+
+  class DistortionCache {
+  public:
+    static constexpr uint32_t k_unVersion = 1;
+
+    DistortionCache() = default;
+    DistortionCache(const DistortionCache &) = delete;
+    DistortionCache &operator=(const DistortionCache &) = delete;
+    ~DistortionCache() { Close(); }
+
+    // FNV-1a over the raw bytes of the inputs, floats are hashed bitwise
+    static uint64_t HashSettings(const ChromaticDistortionModel &model, uint32_t unGridSize) {
+      uint64_t hash = 14695981039346656037ull;
+      hash = Fnv1a(hash, &k_unVersion, sizeof(k_unVersion));
+      hash = Fnv1a(hash, &unGridSize, sizeof(unGridSize));
+      for (int c = 0; c < DistortionChannel_Count; c++) {
+        const RadialDistortionModel &channel = model.channels[c];
+        hash = Fnv1a(hash, &channel.k1, sizeof(channel.k1));
+        hash = Fnv1a(hash, &channel.k2, sizeof(channel.k2));
+        hash = Fnv1a(hash, &channel.zoomWidth, sizeof(channel.zoomWidth));
+        hash = Fnv1a(hash, &channel.zoomHeight, sizeof(channel.zoomHeight));
+      }
+      return hash;
+    }
+
+    // %LOCALAPPDATA%\Relativty\distortion.cache, or ~/.cache/relativty on other systems
+    static std::string DefaultPath() {
+#ifdef _WIN32
+      char *base = nullptr;
+      size_t len = 0;
+      if (_dupenv_s(&base, &len, "LOCALAPPDATA") != 0 || base == nullptr)
+        return std::string();
+      std::string dir = std::string(base) + "\\Relativty";
+      free(base);
+      CreateDirectoryA(dir.c_str(), NULL);
+      return dir + "\\distortion.cache";
+#else
+      const char *base = getenv("HOME");
+      if (base == nullptr)
+        return std::string();
+      std::string dir = std::string(base) + "/.cache";
+      mkdir(dir.c_str(), 0755);
+      dir += "/relativty";
+      mkdir(dir.c_str(), 0755);
+      return dir + "/distortion.cache";
+#endif
+    }
+
+    // Maps the file and checks it against settingsHash. On success Nodes()
+    // stays valid until Close() or destruction.
+    bool Open(const std::string &path, uint64_t settingsHash, uint32_t unGridSize) {
+      Close();
+      const size_t payloadFloats = size_t(unGridSize) * unGridSize * DistortionLut::k_unFloatsPerNode;
+      const size_t expectedSize = sizeof(DistortionCacheHeader) + payloadFloats * sizeof(float);
+      if (path.empty() || !Map(path, expectedSize))
+        return false;
+
+      const DistortionCacheHeader *header = static_cast<const DistortionCacheHeader *>(m_pView);
+      const float *nodes = reinterpret_cast<const float *>(header + 1);
+      if (std::memcmp(header->magic, "RDLC", 4) != 0 || header->version != k_unVersion ||
+          header->settingsHash != settingsHash || header->gridSize != unGridSize ||
+          header->floatsPerNode != DistortionLut::k_unFloatsPerNode ||
+          header->payloadChecksum != Checksum(nodes, payloadFloats)) {
+        Close();
+        return false;
+      }
+
+      m_pNodes = nodes;
+      return true;
+    }
+
+    const float *Nodes() const { return m_pNodes; }
+
+    void Close() {
+      m_pNodes = nullptr;
+      if (m_pView == nullptr)
+        return;
+#ifdef _WIN32
+      UnmapViewOfFile(m_pView);
+      CloseHandle(m_hMapping);
+      CloseHandle(m_hFile);
+      m_hMapping = NULL;
+      m_hFile = INVALID_HANDLE_VALUE;
+#else
+      munmap(m_pView, m_unViewSize);
+#endif
+      m_pView = nullptr;
+      m_unViewSize = 0;
+    }
+
+    // Writes to a temporary file and renames it over path, so a crash half way
+    // leaves either the old cache or none, never a torn one.
+    static bool Write(const std::string &path, uint64_t settingsHash, const DistortionLut &lut) {
+      if (path.empty() || !lut.IsBuilt())
+        return false;
+
+      DistortionCacheHeader header;
+      std::memcpy(header.magic, "RDLC", 4);
+      header.version = k_unVersion;
+      header.settingsHash = settingsHash;
+      header.gridSize = lut.GridSize();
+      header.floatsPerNode = DistortionLut::k_unFloatsPerNode;
+      const size_t payloadBytes = lut.NodeCount() * DistortionLut::k_unFloatsPerNode * sizeof(float);
+      header.payloadChecksum = Checksum(lut.Nodes(), lut.NodeCount() * DistortionLut::k_unFloatsPerNode);
+
+      const std::string tmp = path + ".tmp";
+      FILE *file = fopen(tmp.c_str(), "wb");
+      if (file == nullptr)
+        return false;
+      const bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                           fwrite(lut.Nodes(), 1, payloadBytes, file) == payloadBytes;
+      if (fclose(file) != 0 || !written) {
+        remove(tmp.c_str());
+        return false;
+      }
+#ifdef _WIN32
+      if (!MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+      if (rename(tmp.c_str(), path.c_str()) != 0) {
+#endif
+        remove(tmp.c_str());
+        return false;
+      }
+      return true;
+    }
+
+  private:
+    static uint64_t Fnv1a(uint64_t hash, const void *data, size_t size) {
+      const uint8_t *bytes = static_cast<const uint8_t *>(data);
+      for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+      }
+      return hash;
+    }
+
+    // FNV-1a style but a 64 bit word per step, byte wise hashing of the payload
+    // would cost more than rebuilding the grid
+    static uint64_t Checksum(const float *pfData, size_t unCount) {
+      const uint8_t *bytes = reinterpret_cast<const uint8_t *>(pfData);
+      const size_t size = unCount * sizeof(float);
+      uint64_t hash = 14695981039346656037ull;
+      size_t i = 0;
+      for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+      }
+      return Fnv1a(hash, bytes + i, size - i);
+    }
+
+    bool Map(const std::string &path, size_t expectedSize) {
+#ifdef _WIN32
+      m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (m_hFile == INVALID_HANDLE_VALUE)
+        return false;
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(m_hFile, &size) || uint64_t(size.QuadPart) != expectedSize) {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+        return false;
+      }
+      m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (m_hMapping == NULL) {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+        return false;
+      }
+      m_pView = MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+      if (m_pView == nullptr) {
+        CloseHandle(m_hMapping);
+        CloseHandle(m_hFile);
+        m_hMapping = NULL;
+        m_hFile = INVALID_HANDLE_VALUE;
+        return false;
+      }
+#else
+      const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+        return false;
+      struct stat st;
+      if (fstat(fd, &st) != 0 || size_t(st.st_size) != expectedSize) {
+        close(fd);
+        return false;
+      }
+      void *view = mmap(nullptr, expectedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (view == MAP_FAILED)
+        return false;
+      m_pView = view;
+#endif
+      m_unViewSize = expectedSize;
+      return true;
+    }
+
+    const float *m_pNodes = nullptr;
+    void *m_pView = nullptr;
+    size_t m_unViewSize = 0;
+#ifdef _WIN32
+    HANDLE m_hFile = INVALID_HANDLE_VALUE;
+    HANDLE m_hMapping = NULL;
+#endif
+  };
+}
+
+#endif // RELATIVTY_DISTORTIONCACHE_H
@@ -5,7 +5,7 @@
 // it under the terms of the GNU General Public License as published by
 // the Free Software Foundation, either version 3 of the License, or
 // (at your option) any later version.
-// 
+//
 // This program is distributed in the hope that it will be useful,
 // but WITHOUT ANY WARRANTY; without even the implied warranty of
 // MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
@@ -16,4 +16,29 @@
 #pragma once
 #pragma warning(disable:4996)
 
-void startPythonTrackingClient_threaded(std::string PyPath);
\ No newline at end of file
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Relativty_PoseStream.h"
+
+namespace Relativty {
+	// Where the built in "relativty" Python module delivers poses. submit is
+	// called on the tracker's thread with the GIL released, poses are in the
+	// order the tracker produced them.
+	struct PythonPoseSink {
+		void (*submit)(void* context, const TrackerPose* poses, size_t count);
+		void* context;
+		const std::atomic<bool>* running; // relativty.running(), the tracker returns once it turns false
+	};
+}
+
+// Imports PyModule from PyPath, instantiates the class of the same name and
+// calls its run() method, which is expected to loop until relativty.running()
+// returns False. Blocks until then.
+void startPythonTrackingClient_threaded(std::string PyPath, std::string PyModule, Relativty::PythonPoseSink sink);
+
+// Raises SystemExit in the running tracker, for one that does not return
+// after relativty.running() turned False. Takes effect the next time the
+// tracker executes Python code, a call blocked in C finishes first.
+void interruptPythonTrackingClient();
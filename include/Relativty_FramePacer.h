@@ -0,0 +1,207 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_FRAMEPACER_H
+#define RELATIVTY_FRAMEPACER_H
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace Relativty {
+	// When poses reach SteamVR: as soon as one arrives (Event, the original
+	// behaviour) or once per display frame from ServerDriver::RunFrame,
+	// predicted to when that frame is lit (Frame).
+	enum class PublishMode {
+		Event,
+		Frame
+	};
+
+	inline bool ParsePublishMode(const std::string& name, PublishMode& mode) {
+		if (name == "event")
+			mode = PublishMode::Event;
+		else if (name == "frame")
+			mode = PublishMode::Frame;
+		else
+			return false;
+		return true;
+	}
+
+	// The display's frame grid on the MonotonicNowNs clock. Its phase comes
+	// from vsync times the compositor reports (NoteVsync). Until one is known
+	// the first BeginFrame is taken as the middle of a frame, so RunFrame
+	// calls that jitter by less than half a period stay one per frame.
+	class FrameClock {
+	public:
+		void Reset(double displayFrequency, double secondsFromVsyncToPhotons) {
+			this->periodNs = static_cast<int64_t>(1e9 / displayFrequency);
+			this->vsyncToPhotonsNs = static_cast<int64_t>(secondsFromVsyncToPhotons * 1e9);
+			this->anchorNs = 0;
+			this->lastVsyncNs = 0;
+			this->frames.store(0, std::memory_order_relaxed);
+			this->framesMissed.store(0, std::memory_order_relaxed);
+		}
+
+		void NoteVsync(int64_t vsyncNs) {
+			this->anchorNs = vsyncNs;
+		}
+
+		// True on the first call after a vsync, once per display frame. photonNs
+		// is when the frame being rendered now is lit: the next vsync plus
+		// secondsFromVsyncToPhotons.
+		bool BeginFrame(int64_t nowNs, int64_t& photonNs) {
+			if (this->anchorNs == 0)
+				this->anchorNs = nowNs - this->periodNs / 2;
+			int64_t sinceAnchor = nowNs - this->anchorNs;
+			int64_t frame = sinceAnchor / this->periodNs;
+			if (sinceAnchor < 0 && frame * this->periodNs != sinceAnchor)
+				frame--; // round towards the past for an anchor slightly ahead of now
+			const int64_t vsyncNs = this->anchorNs + frame * this->periodNs;
+			// half a period of slack, the anchor moves a little with every reported vsync
+			if (this->lastVsyncNs != 0 && vsyncNs - this->lastVsyncNs < this->periodNs / 2)
+				return false;
+			if (this->lastVsyncNs != 0) {
+				const int64_t elapsed = (vsyncNs - this->lastVsyncNs + this->periodNs / 2) / this->periodNs;
+				if (elapsed > 1)
+					this->framesMissed.fetch_add(static_cast<uint64_t>(elapsed - 1), std::memory_order_relaxed);
+			}
+			this->lastVsyncNs = vsyncNs;
+			this->frames.fetch_add(1, std::memory_order_relaxed);
+			photonNs = vsyncNs + this->periodNs + this->vsyncToPhotonsNs;
+			return true;
+		}
+
+		int64_t PeriodNs() const { return this->periodNs; }
+		// frames with a BeginFrame, and frames that passed without one (RunFrame ran late),
+		// readable from any thread
+		uint64_t Frames() const { return this->frames.load(std::memory_order_relaxed); }
+		uint64_t FramesMissed() const { return this->framesMissed.load(std::memory_order_relaxed); }
+
+	private:
+		int64_t periodNs = 16666667;
+		int64_t vsyncToPhotonsNs = 0;
+		int64_t anchorNs = 0;
+		int64_t lastVsyncNs = 0;
+		std::atomic<uint64_t> frames{ 0 };
+		std::atomic<uint64_t> framesMissed{ 0 };
+	};
+
+	// How evenly one device's poses reach SteamVR, kept the same way in both
+	// publish modes so they can be compared: the interval between
+	// TrackedDevicePoseUpdated calls against the display period, and in
+	// Frame mode how many tracker poses each frame had to choose from (what
+	// Event mode would have pushed in that frame) and how far ahead the
+	// published pose was predicted. One thread records at a time, any thread
+	// may read a report.
+	class PublishPacing {
+	public:
+		void Reset(int64_t displayPeriodNs) {
+			this->periodNs = displayPeriodNs;
+			this->lastNs = 0;
+			store(this->published, 0);
+			store(this->intervalSumNs, 0);
+			this->intervalSumSq.store(0.0, std::memory_order_relaxed);
+			store(this->intervalMaxNs, 0);
+			store(this->bursts, 0);
+			store(this->gaps, 0);
+			store(this->frames, 0);
+			store(this->framesWithoutPose, 0);
+			store(this->framesWithBurst, 0);
+			store(this->horizonSumNs, 0);
+		}
+
+		void Published(int64_t nowNs) {
+			add(this->published, 1);
+			if (this->lastNs != 0) {
+				const int64_t interval = nowNs - this->lastNs;
+				add(this->intervalSumNs, static_cast<uint64_t>(interval));
+				const double ms = interval / 1e6;
+				this->intervalSumSq.store(this->intervalSumSq.load(std::memory_order_relaxed) + ms * ms, std::memory_order_relaxed);
+				if (static_cast<uint64_t>(interval) > this->intervalMaxNs.load(std::memory_order_relaxed))
+					store(this->intervalMaxNs, static_cast<uint64_t>(interval));
+				if (interval < this->periodNs / 2)
+					add(this->bursts, 1);
+				else if (interval > this->periodNs * 3 / 2)
+					add(this->gaps, 1);
+			}
+			this->lastNs = nowNs;
+		}
+
+		// Frame mode, once per published frame
+		void Frame(uint32_t newPoses, int64_t horizonNs) {
+			add(this->frames, 1);
+			if (newPoses == 0)
+				add(this->framesWithoutPose, 1);
+			else if (newPoses > 1)
+				add(this->framesWithBurst, 1);
+			add(this->horizonSumNs, static_cast<uint64_t>(horizonNs > 0 ? horizonNs : 0));
+		}
+
+		uint64_t Published() const { return this->published.load(std::memory_order_relaxed); }
+		uint64_t Bursts() const { return this->bursts.load(std::memory_order_relaxed); }
+		uint64_t Gaps() const { return this->gaps.load(std::memory_order_relaxed); }
+
+		// "900 poses, every 11.1 ms (sd 0.3, max 13.0), 0 < half a frame, 2 > 1.5 frames;
+		//  900 frames, 310 without a new pose, 0 with several, predicted 18.2 ms ahead"
+		std::string Report() const {
+			const uint64_t count = this->Published();
+			if (count < 2)
+				return std::to_string(count) + " poses";
+			const double intervals = static_cast<double>(count - 1);
+			const double meanMs = this->intervalSumNs.load(std::memory_order_relaxed) / 1e6 / intervals;
+			const double variance = this->intervalSumSq.load(std::memory_order_relaxed) / intervals - meanMs * meanMs;
+			char line[256];
+			int length = snprintf(line, sizeof(line), "%llu poses, every %.1f ms (sd %.1f, max %.1f), %llu < half a frame, %llu > 1.5 frames",
+				static_cast<unsigned long long>(count), meanMs, std::sqrt(variance > 0 ? variance : 0),
+				this->intervalMaxNs.load(std::memory_order_relaxed) / 1e6,
+				static_cast<unsigned long long>(this->Bursts()), static_cast<unsigned long long>(this->Gaps()));
+			const uint64_t frameCount = this->frames.load(std::memory_order_relaxed);
+			if (frameCount > 0 && length > 0 && length < static_cast<int>(sizeof(line))) {
+				snprintf(line + length, sizeof(line) - length, "; %llu frames, %llu without a new pose, %llu with several, predicted %.1f ms ahead",
+					static_cast<unsigned long long>(frameCount),
+					static_cast<unsigned long long>(this->framesWithoutPose.load(std::memory_order_relaxed)),
+					static_cast<unsigned long long>(this->framesWithBurst.load(std::memory_order_relaxed)),
+					this->horizonSumNs.load(std::memory_order_relaxed) / 1e6 / frameCount);
+			}
+			return line;
+		}
+
+	private:
+		static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+		static void store(std::atomic<uint64_t>& counter, uint64_t value) {
+			counter.store(value, std::memory_order_relaxed);
+		}
+
+		int64_t periodNs = 16666667;
+		int64_t lastNs = 0;
+		std::atomic<uint64_t> published{ 0 };
+		std::atomic<uint64_t> intervalSumNs{ 0 };
+		std::atomic<double> intervalSumSq{ 0.0 }; // ms^2
+		std::atomic<uint64_t> intervalMaxNs{ 0 };
+		std::atomic<uint64_t> bursts{ 0 };
+		std::atomic<uint64_t> gaps{ 0 };
+		std::atomic<uint64_t> frames{ 0 };
+		std::atomic<uint64_t> framesWithoutPose{ 0 };
+		std::atomic<uint64_t> framesWithBurst{ 0 };
+		std::atomic<uint64_t> horizonSumNs{ 0 };
+	};
+}
+
+#endif // RELATIVTY_FRAMEPACER_H
@@ -16,79 +16,106 @@
 #pragma once
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <WinSock2.h>
+#include "Relativty_StopSignal.h"
 #include "hidapi/hidapi.h"
 #include "openvr_driver.h"
 #include "Relativty_components.h"
 #include "Relativty_base_device.h"
+#include "Relativty_PoseHistory.h"
+#include "Relativty_ImuCodec.h"
+#include "Relativty_EmbeddedPython.h"
+#include "Relativty_TrackerSupervisor.h"
+#include "Relativty_HmdConfig.h"
+#include "Relativty_Rcu.h"
+#include "Relativty_WakeupStats.h"
+#include "Relativty_ReportClock.h"
+#include "Relativty_Workers.h"
+#include "Relativty_TrackingMonitor.h"
+#include "Relativty_FramePacer.h"
+#include "Relativty_PosePredictor.h"
+#include "Relativty_PositionUpsampler.h"
+#include "Relativty_RelocalizationBlender.h"
+#include "Relativty_ControlChannel.h"
+#include "Relativty_PoseRecorder.h"
 #include "serial/serial.h"
 
 namespace Relativty {
+	class TrackerHub;
+
 	class HMDDriver : public RelativtyDevice<false>
 	{
 	public:
-		HMDDriver(std::string myserial);
+		// poses for other device ids in the stream go to trackers
+		HMDDriver(std::string myserial, TrackerHub* trackers);
 		~HMDDriver() = default;
 
 		void frameUpdate();
 		inline void setProperties();
 
+		// ServerDriver::RunFrame, publishes once per display frame in Frame mode
+		void RunFrame(int64_t nowNs);
+
 		// Inherited from RelativtyDevice, to be overridden
 		virtual vr::EVRInitError Activate(uint32_t unObjectId);
 		virtual void Deactivate();
+		virtual void DebugRequest(const char* pchRequest, char* pchResponseBuffer, uint32_t unResponseBufferSize);
 
 	private:
-		int32_t m_iPid;
-		int32_t m_iVid;
-		
-		bool isMPUSerial;
+		// current settings snapshot, replaced as a whole when the settings file changes
+		RcuCell<HmdConfig> config;
+		std::string settings_path;
+		std::thread config_watch_thread_worker;
+		void config_watch_threaded();
 
-		bool m_bIMUpktIsDMP;
+		// set by Deactivate, every worker loop below waits on it
+		StopSignal stop_signal;
 
-		std::string COMPORT;
-
-		float SecondsFromVsyncToPhotons;
-		float DisplayFrequency;
-		float IPD;
-		float HeadToEyeDepth;
+		bool isMPUSerial;
 
 		vr::DriverPose_t lastPose = {0};
 		hid_device* handle;
 		serial::Serial relativ;
 
 		std::atomic<float> quat[4];
-		std::atomic<bool> retrieve_quaternion_isOn = false;
 		std::atomic<bool> new_quaternion_avaiable = false;
 
-		std::atomic<float> qconj[4] = {1, 0, 0, 0};
-		void calibrate_quaternion();
+		// conjugate of the rotation the recenter command saw, later ones are taken relative to it
+		std::mutex calibration_mutex;
+		Quatf recenter_offset = QuatIdentity();
+		Quatf calibrate_quaternion(const Quatf& measured);
 
 		std::thread retrieve_quaternion_thread_worker;
-		void retrieve_device_quaternion_packet_threaded();
-
-		std::atomic<float> vector_xyz[3];
-		std::atomic<bool> retrieve_vector_isOn = false;
-		std::atomic<bool> new_vector_avaiable = false;
-		bool start_tracking_server = false;
-		SOCKET sock, sock_receive;
-		float upperBound;
-		float lowerBound;
-
-		float normalizeMinX;
-		float normalizeMinY;
-		float normalizeMinZ;
+		// instantiated once per ImuFormat, Activate picks the one the settings ask for
+		template<ImuFormat Format> void retrieve_device_quaternion_packet_threaded();
 
-		float normalizeMaxX;
-		float normalizeMaxY;
-		float normalizeMaxZ;
+		static constexpr uint64_t kImuHistory = 256;
+		SampleHistory<ImuSample, kImuHistory> imu_history;
+		// every ingest loop hands its samples to imu_history through here
+		void push_imu(const ImuSample& sample);
 
-		float scalesCoordinateMeterX;
-		float scalesCoordinateMeterY;
-		float scalesCoordinateMeterZ;
+		HidIngestStats hid_stats;
+		ReportClock hid_report_clock; // IMU thread only
 
-		float offsetCoordinateX;
-		float offsetCoordinateY;
-		float offsetCoordinateZ;
+		std::atomic<float> vector_xyz[3];
+		std::atomic<float> vector_quat[4]; // as the tracker sent it, before recentering, in the frame of vector_xyz
+		std::atomic<uint64_t> vector_flow_id = 0; // trace flow from the tracker input to the pose it ends up in
+		void apply_tracker_pose(const TrackerPose& pose);
+		// takes the tracker's relocalization jumps out of the headset position,
+		// fed by apply_tracker_pose, so by one ingest thread at a time
+		RelocalizationBlender relocalization;
+		const HmdConfig* relocalization_config = nullptr; // the snapshot relocalization was configured from
+		// the headset's poses to apply_tracker_pose, the others to trackers
+		void route_poses(const TrackerPose* poses, size_t count);
+		// The UDP listener and the embedded Python tracker both route poses.
+		// Uncontended with one source; with both running, their poses reach
+		// apply_tracker_pose one at a time.
+		std::mutex route_mutex;
+		TrackerHub* trackers;
+		std::atomic<uint64_t> udp_malformed_lines = 0;
+		SOCKET sock, sock_receive;
 
 		std::atomic<bool> serverNotReady = true;
 		std::thread retrieve_vector_thread_worker;
@@ -97,8 +124,54 @@ namespace Relativty {
 
 		std::thread update_pose_thread_worker;
 		void update_pose_threaded();
-
-		std::string PyPath;
+		// apply_tracker_pose wakes update_pose_threaded with every new pose
+		PoseSignal pose_signal;
+		std::atomic<int64_t> vector_signal_ns = 0;
+		// arrival of the newest camera pose, with the newest IMU sample it decides the tracking state
+		std::atomic<int64_t> last_camera_ns = 0;
+		TrackingMonitor tracking_monitor;
+		// Fills in the position between camera poses while tracking, when
+		// the IMU sends its acceleration. The pose thread feeds it and, while
+		// upsampling_active, also feeds pose_predictor instead of apply_tracker_pose.
+		PositionUpsampler position_upsampler;
+		bool upsampling_enabled = false;
+		std::atomic<bool> upsampling_active = false;
+
+		// m_Pose belongs to the pose thread. In Frame mode it hands every
+		// update to RunFrame through measured_poses and RunFrame publishes.
+		PublishMode publish_mode = PublishMode::Event;
+		SampleHistory<vr::DriverPose_t, 4> measured_poses;
+		// guards pose_predictor between the ingest threads and RunFrame
+		std::mutex predictor_mutex;
+		PosePredictor pose_predictor;
+		FrameClock frame_clock;
+		PublishPacing publish_pacing;
+		std::atomic<bool> frame_publishing = false;
+		uint64_t vsync_clock_mismatches = 0;
+		void publish_frame(int64_t photonNs, int64_t nowNs);
+		std::string publish_report();
+
+		std::atomic<bool> python_tracker_isOn = false;
+		std::atomic<bool> python_tracker_exited = true;
 		std::thread startPythonTrackingClient_worker;
+		static void submit_python_poses(void* context, const TrackerPose* poses, size_t count);
+
+		// external tracker process, restarted when it exits or its poses stop
+		TrackerSupervisor tracker_supervisor;
+
+		// how late each driver thread ran after its wait ended, see thread_report()
+		WakeupStats imu_wakeup;
+		WakeupStats udp_wakeup;
+		WakeupStats pose_wakeup;
+		std::string thread_report();
+
+		// local control interface, see handle_control. What it asks of the
+		// pipeline goes through control_requests.
+		ControlChannel control_channel;
+		ControlRequests control_requests;
+		bool imu_takes_commands = false; // only the text serial firmware reads "C\n"
+		PoseRecorder pose_recorder;
+		static bool handle_control(void* context, const std::string& command, std::string& reply);
+		std::string stats_report();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,139 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_HMDCONFIG_H
+#define RELATIVTY_HMDCONFIG_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Relativty {
+	// Everything the "Relativty_hmd" settings section configures, loaded in
+	// one pass and validated as a whole. Published as an immutable snapshot
+	// (see RcuCell); a reload produces a new HmdConfig instead of changing one.
+	// Defaults match resources/settings/default.vrsettings.
+	struct HmdConfig {
+		// display, applied at Activate
+		float secondsFromVsyncToPhotons = 0.011f;
+		float displayFrequency = 60.0f;
+		float IPDmeters = 0.063f;
+
+		// position calibration of the TCP position stream, reloaded live
+		float upperBound = 1.0f;
+		float lowerBound = -1.0f;
+		float normalizeMinX = -200.0f;
+		float normalizeMinY = -45.0f;
+		float normalizeMinZ = -40.0f;
+		float normalizeMaxX = 0.5f;
+		float normalizeMaxY = 55.0f;
+		float normalizeMaxZ = 70.0f;
+		float scalesCoordinateMeterX = 0.5f;
+		float scalesCoordinateMeterY = 0.8f;
+		float scalesCoordinateMeterZ = 0.8f;
+		float offsetCoordinateX = -5.0f;
+		float offsetCoordinateY = 0.0f;
+		float offsetCoordinateZ = 0.0f;
+
+		// devices and helpers, applied at Activate
+		bool startTrackingServer = true;
+		int32_t hmdPid = 9;
+		int32_t hmdVid = 4617;
+		bool hmdIMUdmpPackets = true;
+		bool hmdIMUserialBinaryPackets = false;
+		bool isMPUSerial = false;
+		std::string COMPORT;
+		std::string PyPath;
+		std::string PyModule;
+		std::string tracePath;
+
+		std::string trackerCommand;
+		int32_t trackerStallTimeoutMs = 2000;
+		int32_t trackerStartupGraceMs = 15000;
+		int32_t trackerCpuMask = 0;
+		int32_t trackerPriority = 0;
+
+		// pose staleness budgets, see TrackingMonitor, reloaded live
+		int32_t cameraStaleMs = 150;
+		int32_t imuStaleMs = 50;
+		int32_t disconnectAfterMs = 3000;
+
+		// position between camera poses from the IMU's linear acceleration,
+		// used when the IMU sends it, and how much older a camera pose is than
+		// its arrival, see PositionUpsampler
+		bool positionUpsampling = true;
+		int32_t cameraLatencyMs = 0;
+
+		// how fast the head may move (m/s) before a step in the tracker's
+		// position counts as a relocalization jump, and how long such a jump
+		// is blended over, 0 for not at all, see RelocalizationBlender;
+		// reloaded live
+		float maxHeadSpeed = 4.0f;
+		int32_t relocalizationBlendMs = 500;
+
+		// roles of the tracker ids in the pose stream, "1:left_hand, 2:right_hand",
+		// see ParseTrackerRoles
+		std::string trackerRoles;
+
+		// when poses reach SteamVR, "event" or "frame", and how far ahead a
+		// pose may be predicted in frame mode, see PublishMode
+		std::string publishMode = "event";
+		int32_t maxPredictionMs = 50;
+
+		// driver threads: scheduling class ("normal", "fifo" or "rr"), priority
+		// and CPU mask, see ThreadSchedConfig
+		std::string imuThreadSched = "normal";
+		int32_t imuThreadPriority = 0;
+		int32_t imuThreadCpuMask = 0;
+		std::string udpThreadSched = "normal";
+		int32_t udpThreadPriority = 0;
+		int32_t udpThreadCpuMask = 0;
+		std::string poseThreadSched = "normal";
+		int32_t poseThreadPriority = 0;
+		int32_t poseThreadCpuMask = 0;
+
+		// name of the local control pipe / socket (see ControlChannel), empty
+		// turns the channel off
+		std::string controlChannel = "relativty_control";
+	};
+
+	// Reads every key of the section from vr::VRSettings(), keys that are
+	// missing keep their default. Invalid values are replaced by the default
+	// and described in problems.
+	void LoadHmdConfig(HmdConfig& config, std::vector<std::string>& problems);
+
+	// Sets one field from a settings file value (numbers and booleans as
+	// written in the JSON, strings already unescaped). False if the key is
+	// unknown or the value has the wrong type, config is untouched then.
+	bool SetHmdSetting(HmdConfig& config, const std::string& key, const std::string& value, std::string& problem);
+
+	// true for the keys that take effect without a restart: the TCP position
+	// calibration, the staleness budgets and the relocalization blending
+	bool IsLiveHmdSetting(const std::string& key);
+
+	// Checks ranges and relations (min below max, non zero scales...). Each
+	// invalid field is reset to its value in fallback and described in
+	// problems. Returns true if nothing had to be reset.
+	bool ValidateHmdConfig(HmdConfig& config, const HmdConfig& fallback, std::vector<std::string>& problems);
+
+	// Collects the scalar members of the "Relativty_hmd" object in the text of
+	// a .vrsettings file. False if the text is not well formed JSON, which is
+	// also what a file caught half way through being saved looks like.
+	bool ParseHmdSettingsSection(const std::string& text, std::map<std::string, std::string>& values);
+}
+
+#endif // RELATIVTY_HMDCONFIG_H
@@ -0,0 +1,217 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_IMUCODEC_H
+#define RELATIVTY_IMUCODEC_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace Relativty {
+	// Packet layouts the HMD firmwares send. The format is picked once in
+	// HMDDriver::Activate and the ingest loop is instantiated per codec, so
+	// decoding a packet never branches on the format.
+	enum class ImuFormat {
+		MpuDmpQ14,     // HID, MPU6050/9250 DMP quaternion, big endian Q14
+		Mpu9250Float,  // HID, MPU9250 fusion firmware, packed little endian floats
+		Bno055Ascii,   // serial, "w,y,z,x\n" lines from MICROCONTROLLER/tinypico_bno055.ino
+		Bno055Binary   // serial, 11 byte frames, same firmware built with BINARY_OUTPUT
+	};
+
+	enum class ImuTransport {
+		Hid,
+		SerialLine,
+		SerialFrame
+	};
+
+	// Every codec provides
+	//   transport     where the packets come from
+	//   packetLen     report or frame size in bytes (0 for line based formats)
+	//   name          for the log
+	//   decode()      packet -> quaternion in the order the driver uses it,
+	//                 false if the packet is not a valid orientation sample
+	// Bno055Ascii also decodes the linear acceleration some lines carry.
+	template<ImuFormat Format>
+	struct ImuCodec;
+
+	template<>
+	struct ImuCodec<ImuFormat::MpuDmpQ14> {
+		static constexpr ImuTransport transport = ImuTransport::Hid;
+		static constexpr size_t packetLen = 64;
+		static constexpr const char* name = "MPU DMP Q14";
+
+		static bool decode(const uint8_t* packet, size_t len, float quat[4]) {
+			if (len < 15)
+				return false;
+			for (int i = 0; i < 4; i++) {
+				const int16_t raw = static_cast<int16_t>((packet[1 + 4 * i] << 8) | packet[2 + 4 * i]);
+				quat[i] = static_cast<float>(raw) * (1.0f / 16384.0f);
+			}
+			return true;
+		}
+	};
+
+	template<>
+	struct ImuCodec<ImuFormat::Mpu9250Float> {
+		static constexpr ImuTransport transport = ImuTransport::Hid;
+		static constexpr size_t packetLen = 64;
+		static constexpr const char* name = "MPU9250 float";
+
+		// layout of the report, see the pak struct the driver used to cast to
+		static constexpr size_t quatOffset = 1;
+
+		static bool decode(const uint8_t* packet, size_t len, float quat[4]) {
+			if (len < quatOffset + 4 * sizeof(float))
+				return false;
+			std::memcpy(quat, packet + quatOffset, 4 * sizeof(float));
+			// a report garbled on the bus must not reach the pose as NaN
+			return std::isfinite(quat[0]) && std::isfinite(quat[1]) && std::isfinite(quat[2]) && std::isfinite(quat[3]);
+		}
+	};
+
+	template<>
+	struct ImuCodec<ImuFormat::Bno055Ascii> {
+		static constexpr ImuTransport transport = ImuTransport::SerialLine;
+		static constexpr size_t packetLen = 0;
+		static constexpr const char* name = "BNO055 ASCII";
+		static constexpr float maxAccel = 160.0f; // m/s^2, the BNO055 saturates at 16 g
+
+		// The firmware prints four comma separated floats with 4 decimals,
+		// built with LINEAR_ACCEL_OUTPUT three more for the linear acceleration
+		// in m/s^2, with the axes in the same order as the quaternion's:
+		//   w,y,z,x            or   w,y,z,x,ay,az,ax
+		// Status lines ("C:..." calibration, "D:..." info) are rejected here
+		// and handled by the caller.
+		static bool decode(const uint8_t* packet, size_t len, float quat[4]) {
+			float accel[3];
+			bool hasAccel;
+			return decode(packet, len, quat, accel, hasAccel);
+		}
+
+		static bool decode(const uint8_t* packet, size_t len, float quat[4], float accel[3], bool& hasAccel) {
+			const char* cursor = reinterpret_cast<const char*>(packet);
+			const char* end = cursor + len;
+			hasAccel = false;
+			for (int i = 0; i < 4; i++) {
+				float value;
+				if (!parseFixed(cursor, end, value))
+					return false;
+				// the firmware never sends anything outside [-1, 1]
+				if (value > 1.0f || value < -1.0f)
+					return false;
+				quat[i] = value;
+				if (i < 3) {
+					if (cursor == end || *cursor != ',')
+						return false;
+					cursor++;
+				}
+			}
+			if (cursor != end && *cursor == ',') {
+				for (int i = 0; i < 3; i++) {
+					cursor++; // the ',' before every value
+					if (!parseFixed(cursor, end, accel[i]) || accel[i] > maxAccel || accel[i] < -maxAccel)
+						return false;
+					if (i < 2 && (cursor == end || *cursor != ','))
+						return false;
+				}
+				hasAccel = true;
+			}
+			return cursor == end || *cursor == '\r' || *cursor == '\n';
+		}
+
+		// [-]digits[.digits], no exponent, no locale, no allocation
+		static bool parseFixed(const char*& cursor, const char* end, float& out) {
+			bool negative = false;
+			if (cursor != end && (*cursor == '-' || *cursor == '+')) {
+				negative = *cursor == '-';
+				cursor++;
+			}
+			const char* start = cursor;
+			int32_t mantissa = 0;
+			int32_t scale = 1;
+			while (cursor != end && *cursor >= '0' && *cursor <= '9') {
+				if (mantissa < 100000000)
+					mantissa = mantissa * 10 + (*cursor - '0');
+				cursor++;
+			}
+			if (cursor != end && *cursor == '.') {
+				cursor++;
+				while (cursor != end && *cursor >= '0' && *cursor <= '9') {
+					if (scale < 100000000) {
+						mantissa = mantissa * 10 + (*cursor - '0');
+						scale *= 10;
+					}
+					cursor++;
+				}
+			}
+			if (cursor == start)
+				return false;
+			out = static_cast<float>(mantissa) / static_cast<float>(scale);
+			if (negative)
+				out = -out;
+			return true;
+		}
+	};
+
+	template<>
+	struct ImuCodec<ImuFormat::Bno055Binary> {
+		static constexpr ImuTransport transport = ImuTransport::SerialFrame;
+		static constexpr size_t packetLen = 11;
+		static constexpr const char* name = "BNO055 binary";
+
+		// AA 55 | four int16 little endian, 1 LSB = 1/16384 like the QUA_DATA
+		// registers, same component order as the ASCII lines | sum of the 8 data bytes
+		static constexpr uint8_t sync0 = 0xAA;
+		static constexpr uint8_t sync1 = 0x55;
+
+		static bool decode(const uint8_t* packet, size_t len, float quat[4]) {
+			if (len < packetLen || packet[0] != sync0 || packet[1] != sync1)
+				return false;
+			if (checksum(packet + 2) != packet[10])
+				return false;
+			for (int i = 0; i < 4; i++) {
+				const int16_t raw = static_cast<int16_t>(packet[2 + 2 * i] | (packet[3 + 2 * i] << 8));
+				quat[i] = static_cast<float>(raw) * (1.0f / 16384.0f);
+			}
+			return true;
+		}
+
+		static void encode(const float quat[4], uint8_t packet[packetLen]) {
+			packet[0] = sync0;
+			packet[1] = sync1;
+			for (int i = 0; i < 4; i++) {
+				float scaled = quat[i] * 16384.0f;
+				scaled += scaled < 0 ? -0.5f : 0.5f;
+				const uint16_t raw = static_cast<uint16_t>(static_cast<int16_t>(scaled));
+				packet[2 + 2 * i] = static_cast<uint8_t>(raw & 0xff);
+				packet[3 + 2 * i] = static_cast<uint8_t>(raw >> 8);
+			}
+			packet[10] = checksum(packet + 2);
+		}
+
+		static uint8_t checksum(const uint8_t* data) {
+			uint8_t sum = 0;
+			for (int i = 0; i < 8; i++)
+				sum += data[i];
+			return sum;
+		}
+	};
+}
+
+#endif // RELATIVTY_IMUCODEC_H
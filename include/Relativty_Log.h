@@ -0,0 +1,84 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_LOG_H
+#define RELATIVTY_LOG_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "openvr_driver.h"
+
+// Calls below this level are compiled out, arguments and all. Build with
+// RELATIVTY_LOG_MIN_LEVEL=0 to get the per packet debug output back.
+#ifndef RELATIVTY_LOG_MIN_LEVEL
+#define RELATIVTY_LOG_MIN_LEVEL 1
+#endif
+
+namespace Relativty {
+	enum class LogLevel : int {
+		Debug = 0,
+		Info = 1,
+		Warning = 2,
+		Error = 3
+	};
+
+	// Asynchronous front end for vr::VRDriverLog(). Every thread formats into
+	// its own single producer ring, a background thread drains all rings and
+	// does the blocking Log() calls. Writers never take a lock and never wait:
+	// when a ring is full the line is dropped and counted.
+	//
+	// Before Start() and after Stop() lines go straight to DriverLog, so the
+	// macros are safe to use anywhere.
+	namespace AsyncLog {
+		void Start(vr::IVRDriverLog* driverLog);
+		void Stop(); // flushes everything queued so far
+
+		void Write(LogLevel level, uint32_t suppressed, const char* format, ...);
+
+		// lines lost to full rings, reported by the stats command and at Deactivate
+		uint64_t DroppedLines();
+
+		// One per call site, lets a line through at most once per interval and
+		// counts what it held back so the next line can say so.
+		struct RateLimit {
+			std::atomic<int64_t> nextNs{ 0 };
+			std::atomic<uint32_t> suppressed{ 0 };
+
+			// true if the caller may log now, suppressedOut is how many were skipped since
+			bool Allow(int64_t intervalNs, uint32_t& suppressedOut);
+		};
+	}
+}
+
+#define RELATIVTY_LOG(level, format, ...)                                                       \
+	do {                                                                                        \
+		if constexpr (static_cast<int>(Relativty::LogLevel::level) >= RELATIVTY_LOG_MIN_LEVEL)  \
+			Relativty::AsyncLog::Write(Relativty::LogLevel::level, 0, format, ##__VA_ARGS__);   \
+	} while (0)
+
+#define RELATIVTY_LOG_EVERY_MS(level, intervalMs, format, ...)                                  \
+	do {                                                                                        \
+		if constexpr (static_cast<int>(Relativty::LogLevel::level) >= RELATIVTY_LOG_MIN_LEVEL) { \
+			static Relativty::AsyncLog::RateLimit relativtyLogLimit;                            \
+			uint32_t relativtyLogSuppressed;                                                    \
+			if (relativtyLogLimit.Allow(int64_t(intervalMs) * 1000000, relativtyLogSuppressed)) \
+				Relativty::AsyncLog::Write(Relativty::LogLevel::level, relativtyLogSuppressed,  \
+				                           format, ##__VA_ARGS__);                              \
+		}                                                                                       \
+	} while (0)
+
+#endif // RELATIVTY_LOG_H
@@ -0,0 +1,113 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_POSEHISTORY_H
+#define RELATIVTY_POSEHISTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace Relativty {
+	// one IMU orientation reading, stamped with the host time it was received
+	struct ImuSample {
+		int64_t timestampNs;
+		float quat[4];  // w, x, y, z
+		float accel[3]; // linear acceleration without gravity, m/s^2 in the IMU's own axes
+		bool hasAccel;  // only the text serial firmware sends accel
+	};
+
+	// Fixed size ring of the most recent samples, written by exactly one ingest
+	// thread and read by any number of threads without locks. Every slot is
+	// guarded by a sequence counter (odd while being written) and its payload
+	// is stored as relaxed atomic words, so readers never see a torn sample.
+	template<typename Sample, size_t Capacity>
+	class SampleHistory {
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+		static_assert(std::is_trivially_copyable<Sample>::value, "Sample must be trivially copyable");
+		static_assert(sizeof(Sample) % sizeof(uint32_t) == 0, "Sample size must be a multiple of 4");
+
+	public:
+		// producer side, only ever called from the owning ingest thread
+		void push(const Sample& sample) {
+			const uint64_t index = this->written.load(std::memory_order_relaxed);
+			Slot& slot = this->slots[index & (Capacity - 1)];
+
+			uint32_t words[kWords];
+			std::memcpy(words, &sample, sizeof(Sample));
+
+			const uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+			slot.seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			for (size_t i = 0; i < kWords; i++)
+				slot.words[i].store(words[i], std::memory_order_relaxed);
+			slot.seq.store(seq + 2, std::memory_order_release);
+
+			this->written.store(index + 1, std::memory_order_release);
+		}
+
+		// total number of samples pushed so far, the newest one has index count() - 1
+		uint64_t count() const {
+			return this->written.load(std::memory_order_acquire);
+		}
+
+		// copies sample number index, false if it was never written or already overwritten
+		bool get(uint64_t index, Sample& out) const {
+			const Slot& slot = this->slots[index & (Capacity - 1)];
+			uint32_t words[kWords];
+			for (;;) {
+				const uint64_t written_now = this->count();
+				if (index >= written_now || written_now - index > Capacity)
+					return false;
+
+				const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+				if (seq & 1)
+					continue; // writer is in the middle of this slot
+				for (size_t i = 0; i < kWords; i++)
+					words[i] = slot.words[i].load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.seq.load(std::memory_order_relaxed) != seq)
+					continue;
+				// the slot may have been reused for index + Capacity meanwhile
+				if (this->count() - index > Capacity)
+					return false;
+
+				std::memcpy(&out, words, sizeof(Sample));
+				return true;
+			}
+		}
+
+		bool latest(Sample& out) const {
+			const uint64_t written_now = this->count();
+			return written_now != 0 && this->get(written_now - 1, out);
+		}
+
+	private:
+		static constexpr size_t kWords = sizeof(Sample) / sizeof(uint32_t);
+
+		struct Slot {
+			std::atomic<uint64_t> seq{ 0 };
+			std::atomic<uint32_t> words[kWords] = {};
+		};
+
+		Slot slots[Capacity];
+		std::atomic<uint64_t> written{ 0 };
+	};
+}
+
+#endif // RELATIVTY_POSEHISTORY_H
@@ -0,0 +1,121 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_POSEPREDICTOR_H
+#define RELATIVTY_POSEPREDICTOR_H
+
+#include <cstdint>
+
+#include "Relativty_PoseStream.h"
+#include "Relativty_Quaternion.h"
+
+namespace Relativty {
+	// a pose extrapolated to some time, with the velocities it was extrapolated with
+	struct PredictedPose {
+		float position[3];
+		float rotation[4];        // w, x, y, z
+		float velocity[3];        // m/s
+		float angularVelocity[3]; // rad/s, axis times rate
+		int64_t horizonNs;        // how far past the newest pose it was extrapolated
+		uint32_t newPoses;        // poses added since the previous Predict
+	};
+
+	// Constant velocity extrapolation of the recent poses of one device. The
+	// velocities are taken between the newest pose and the oldest one within
+	// kWindowNs, so the camera's jitter is averaged over a few frames. Not
+	// thread safe, the owner serialises Add and Predict.
+	class PosePredictor {
+	public:
+		static const int kHistory = 8;
+		static constexpr int64_t kWindowNs = 100000000;
+
+		void Reset(int64_t maxHorizonNs) {
+			this->maxHorizon = maxHorizonNs;
+			this->count = 0;
+			this->added = 0;
+		}
+
+		void Add(const TrackerPose& pose) {
+			this->history[this->count % kHistory] = pose;
+			this->count++;
+			this->added++;
+		}
+
+		bool Empty() const { return this->count == 0; }
+
+		// False until a pose was added. With a single pose, or none within the
+		// window, the newest pose is returned as is.
+		bool Predict(int64_t targetNs, PredictedPose& out) {
+			if (this->count == 0)
+				return false;
+			const TrackerPose& newest = this->history[(this->count - 1) % kHistory];
+			const TrackerPose* oldest = nullptr;
+			const uint64_t available = this->count < kHistory ? this->count : kHistory;
+			for (uint64_t back = 1; back < available; back++) {
+				const TrackerPose& candidate = this->history[(this->count - 1 - back) % kHistory];
+				if (newest.timestampNs - candidate.timestampNs > kWindowNs)
+					break;
+				oldest = &candidate;
+			}
+
+			for (int i = 0; i < 3; i++) {
+				out.position[i] = newest.position[i];
+				out.velocity[i] = 0;
+				out.angularVelocity[i] = 0;
+			}
+			for (int i = 0; i < 4; i++)
+				out.rotation[i] = newest.rotation[i];
+			out.newPoses = this->added;
+			this->added = 0;
+
+			int64_t horizon = targetNs - newest.timestampNs;
+			if (horizon < 0)
+				horizon = 0;
+			if (horizon > this->maxHorizon)
+				horizon = this->maxHorizon;
+			out.horizonNs = horizon;
+			if (oldest == nullptr || newest.timestampNs <= oldest->timestampNs)
+				return true;
+
+			const float span = static_cast<float>(newest.timestampNs - oldest->timestampNs) * 1e-9f;
+			const float ahead = static_cast<float>(horizon) * 1e-9f;
+			for (int i = 0; i < 3; i++) {
+				out.velocity[i] = (newest.position[i] - oldest->position[i]) / span;
+				out.position[i] = newest.position[i] + out.velocity[i] * ahead;
+			}
+
+			// rotation from oldest to newest in the world frame, as a rotation vector
+			Quatf delta = QuatMultiply(QuatLoad(newest.rotation), QuatConjugate(QuatLoad(oldest->rotation)));
+			if (!QuatNormalize(delta))
+				return true;
+			const Vec3f rate = Vec3Scale(QuatLog(delta), 1.0f / span);
+			Vec3Store(rate, out.angularVelocity);
+
+			Quatf rotation = QuatMultiply(QuatExp(Vec3Scale(rate, ahead)), QuatLoad(newest.rotation));
+			QuatNormalize(rotation);
+			QuatStore(rotation, out.rotation);
+			return true;
+		}
+
+	private:
+		TrackerPose history[kHistory];
+		uint64_t count = 0;
+		uint32_t added = 0;
+		int64_t maxHorizon = 50000000;
+	};
+}
+
+#endif // RELATIVTY_POSEPREDICTOR_H
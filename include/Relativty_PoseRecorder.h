@@ -0,0 +1,128 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_POSERECORDER_H
+#define RELATIVTY_POSERECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "Relativty_PoseHistory.h"
+#include "Relativty_PoseStream.h"
+
+namespace Relativty {
+	// Writes the poses the tracker sends to a file, as they arrive and before
+	// any calibration, in the datagram format with the arrival time in ns
+	// after the seventh number:
+	//
+	//   @<id> [!] x y z qw qz qx qy <timestampNs>
+	//
+	// and the IMU samples in between as comments, the acceleration only if
+	// the IMU sends it:
+	//
+	//   #imu <timestampNs> qw qx qy qz [ax ay az]
+	//
+	// ParsePoseDatagram reads that back, trackertest/pose_simulator replays it
+	// with --trajectory file:<path> and trackertest/position_upsampler_test
+	// evaluates PositionUpsampler on it. Record() costs a relaxed load
+	// while nothing is recorded; while recording it formats into a buffered
+	// FILE under a mutex, so the poses of one call stay together.
+	class PoseRecorder {
+	public:
+		PoseRecorder() = default;
+		PoseRecorder(const PoseRecorder&) = delete;
+		PoseRecorder& operator=(const PoseRecorder&) = delete;
+		~PoseRecorder() { this->Stop(); }
+
+		// ends a recording still running first; false if path cannot be created
+		bool Start(const std::string& path) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->close();
+			this->file = std::fopen(path.c_str(), "w");
+			if (this->file == nullptr)
+				return false;
+			this->path = path;
+			this->poses = 0;
+			this->recording.store(true, std::memory_order_release);
+			return true;
+		}
+
+		// poses written by the recording it ended, 0 if none was running
+		uint64_t Stop() {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			const uint64_t written = this->file != nullptr ? this->poses : 0;
+			this->close();
+			return written;
+		}
+
+		bool Recording() const { return this->recording.load(std::memory_order_relaxed); }
+
+		// the file being written, or the last one written
+		std::string Path() {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->path;
+		}
+
+		void Record(const TrackerPose* batch, size_t count) {
+			if (!this->recording.load(std::memory_order_relaxed))
+				return;
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (this->file == nullptr)
+				return; // stopped since the check above
+			for (size_t i = 0; i < count; i++) {
+				const TrackerPose& pose = batch[i];
+				// rotation in the w z x y order ParsePoseDatagram expects
+				std::fprintf(this->file, "@%u%s %.6f %.6f %.6f %.6f %.6f %.6f %.6f %lld\n", pose.device, (pose.flags & kPoseReset) ? " !" : "",
+					pose.position[0], pose.position[1], pose.position[2],
+					pose.rotation[0], pose.rotation[3], pose.rotation[1], pose.rotation[2],
+					static_cast<long long>(pose.timestampNs));
+			}
+			this->poses += count;
+		}
+
+		void RecordImu(const ImuSample& sample) {
+			if (!this->recording.load(std::memory_order_relaxed))
+				return;
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (this->file == nullptr)
+				return;
+			std::fprintf(this->file, "#imu %lld %.5f %.5f %.5f %.5f", static_cast<long long>(sample.timestampNs),
+				sample.quat[0], sample.quat[1], sample.quat[2], sample.quat[3]);
+			if (sample.hasAccel)
+				std::fprintf(this->file, " %.4f %.4f %.4f", sample.accel[0], sample.accel[1], sample.accel[2]);
+			std::fputc('\n', this->file);
+		}
+
+	private:
+		void close() {
+			this->recording.store(false, std::memory_order_release);
+			if (this->file != nullptr)
+				std::fclose(this->file);
+			this->file = nullptr;
+		}
+
+		std::atomic<bool> recording{ false };
+		std::mutex mutex;
+		std::FILE* file = nullptr;
+		std::string path;
+		uint64_t poses = 0;
+	};
+}
+
+#endif // RELATIVTY_POSERECORDER_H
@@ -0,0 +1,203 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_POSESTREAM_H
+#define RELATIVTY_POSESTREAM_H
+
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace Relativty {
+	// Device ids of the pose stream: 0 is the headset, 1 to kMaxTrackers are
+	// the controllers and body trackers (TrackerDevice).
+	const uint32_t kHeadsetDevice = 0;
+	const uint32_t kMaxTrackers = 16;
+
+	// TrackerPose::flags
+	const uint32_t kPoseReset = 1u; // the tracker reset or relocalized its map before this pose
+
+	// one pose from the tracker, over UDP or from the embedded Python tracker
+	struct TrackerPose {
+		int64_t timestampNs; // MonotonicNowNs() clock, relativty.now_ns() on the Python side
+		float position[3];
+		float rotation[4]; // w, x, y, z
+		uint32_t device;   // kHeadsetDevice or a tracker id
+		uint32_t flags = 0; // kPoseReset
+	};
+
+	// What a tracker id stands for, set with the trackerRoles setting. Hands
+	// are added as controllers, the rest as generic trackers.
+	enum class TrackerRole : int {
+		Tracker,
+		LeftHand,
+		RightHand,
+		Waist,
+		Chest,
+		LeftFoot,
+		RightFoot,
+		Count
+	};
+
+	inline const char* TrackerRoleName(TrackerRole role) {
+		switch (role) {
+		case TrackerRole::Tracker: return "tracker";
+		case TrackerRole::LeftHand: return "left_hand";
+		case TrackerRole::RightHand: return "right_hand";
+		case TrackerRole::Waist: return "waist";
+		case TrackerRole::Chest: return "chest";
+		case TrackerRole::LeftFoot: return "left_foot";
+		case TrackerRole::RightFoot: return "right_foot";
+		default: return "?";
+		}
+	}
+
+	// "1:left_hand, 2:right_hand, 5:waist", ids that are not listed are plain
+	// trackers. roles[i] is the role of tracker id i + 1. False with problem
+	// set, and roles untouched, if any entry is malformed.
+	inline bool ParseTrackerRoles(const std::string& text, TrackerRole roles[kMaxTrackers], std::string& problem) {
+		TrackerRole parsed[kMaxTrackers];
+		for (uint32_t i = 0; i < kMaxTrackers; i++)
+			parsed[i] = TrackerRole::Tracker;
+
+		size_t pos = 0;
+		while (pos < text.size()) {
+			size_t end = text.find(',', pos);
+			if (end == std::string::npos)
+				end = text.size();
+			std::string entry = text.substr(pos, end - pos);
+			pos = end + 1;
+			entry.erase(0, entry.find_first_not_of(" \t"));
+			entry.erase(entry.find_last_not_of(" \t") + 1);
+			if (entry.empty())
+				continue;
+
+			const size_t colon = entry.find(':');
+			char* idEnd = nullptr;
+			const unsigned long id = std::strtoul(entry.c_str(), &idEnd, 10);
+			if (colon == std::string::npos || idEnd != entry.c_str() + colon || colon == 0 || id < 1 || id > kMaxTrackers) {
+				problem = "trackerRoles entry \"" + entry + "\" must be <id>:<role> with an id from 1 to " + std::to_string(kMaxTrackers);
+				return false;
+			}
+			std::string name = entry.substr(colon + 1);
+			name.erase(0, name.find_first_not_of(" \t"));
+			int found = -1;
+			for (int role = 0; role < static_cast<int>(TrackerRole::Count); role++) {
+				if (name == TrackerRoleName(static_cast<TrackerRole>(role)))
+					found = role;
+			}
+			if (found < 0) {
+				problem = "trackerRoles entry \"" + entry + "\" has an unknown role, use tracker, left_hand, right_hand, waist, chest, left_foot or right_foot";
+				return false;
+			}
+			parsed[id - 1] = static_cast<TrackerRole>(found);
+		}
+
+		for (uint32_t i = 0; i < kMaxTrackers; i++)
+			roles[i] = parsed[i];
+		return true;
+	}
+
+	// Pose datagrams are text, one pose per line:
+	//
+	//   x y z qw qz qx qy          the headset, what the tracker always sent
+	//   @<id> x y z qw qz qx qy    device <id>, 0 being the headset again
+	//
+	// so one datagram can carry the poses of every device seen in a camera
+	// frame. A '!' before the numbers ("! x y z ..." or "@<id> ! x y z ...")
+	// sets kPoseReset, the tracker's way to say it relocalized. Lines
+	// starting with '#' are comments (PoseRecorder keeps the IMU samples
+	// there). Lines that do not parse are counted in malformed and skipped,
+	// anything after the seventh number is ignored (trackertest/pose_simulator
+	// puts a sequence number and send time there).
+	// Returns the number of poses written to out, at most capacity.
+	inline size_t ParsePoseDatagram(const char* text, size_t length, int64_t nowNs, TrackerPose* out, size_t capacity, uint32_t& malformed) {
+		size_t count = 0;
+		const char* const end = text + length;
+		const char* line = text;
+		while (line < end && count < capacity) {
+			const char* lineEnd = line;
+			while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\0')
+				lineEnd++;
+			// strtof needs a terminated copy, a line is short
+			char buffer[256];
+			const size_t lineLength = static_cast<size_t>(lineEnd - line);
+			const char* next = lineEnd < end && *lineEnd == '\0' ? end : lineEnd + 1;
+			if (lineLength >= sizeof(buffer)) {
+				malformed++;
+				line = next;
+				continue;
+			}
+			for (size_t i = 0; i < lineLength; i++)
+				buffer[i] = line[i];
+			buffer[lineLength] = '\0';
+			line = next;
+
+			char* cursor = buffer;
+			while (std::isspace(static_cast<unsigned char>(*cursor)))
+				cursor++;
+			if (*cursor == '\0' || *cursor == '#')
+				continue;
+
+			TrackerPose pose;
+			pose.timestampNs = nowNs;
+			pose.device = kHeadsetDevice;
+			if (*cursor == '@') {
+				char* idEnd = nullptr;
+				const unsigned long id = std::strtoul(cursor + 1, &idEnd, 10);
+				if (idEnd == cursor + 1 || id > kMaxTrackers) {
+					malformed++;
+					continue;
+				}
+				pose.device = static_cast<uint32_t>(id);
+				cursor = idEnd;
+			}
+			while (std::isspace(static_cast<unsigned char>(*cursor)))
+				cursor++;
+			if (*cursor == '!') {
+				pose.flags |= kPoseReset;
+				cursor++;
+			}
+
+			float values[7];
+			bool valid = true;
+			for (int i = 0; i < 7 && valid; i++) {
+				char* valueEnd = nullptr;
+				values[i] = std::strtof(cursor, &valueEnd);
+				valid = valueEnd != cursor && std::isfinite(values[i]);
+				cursor = valueEnd;
+			}
+			if (!valid) {
+				malformed++;
+				continue;
+			}
+			pose.position[0] = values[0];
+			pose.position[1] = values[1];
+			pose.position[2] = values[2];
+			pose.rotation[0] = values[3];
+			pose.rotation[1] = values[5];
+			pose.rotation[2] = values[6];
+			pose.rotation[3] = values[4];
+			out[count++] = pose;
+		}
+		return count;
+	}
+}
+
+#endif // RELATIVTY_POSESTREAM_H
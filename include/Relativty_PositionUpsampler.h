@@ -0,0 +1,260 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_POSITIONUPSAMPLER_H
+#define RELATIVTY_POSITIONUPSAMPLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "Relativty_Quaternion.h"
+
+namespace Relativty {
+	struct UpsamplingSettings {
+		int64_t cameraLatencyNs = 0;     // how much older a camera pose is than its arrival
+		float correctionSpeed = 0.25f;   // m/s the output may move toward a camera pose on top of the motion
+		float velocityGain = 0.4f;       // share of a camera pose's innovation taken as velocity error
+		int64_t maxCoastNs = 150000000;  // with no camera pose for this long the position is held
+		float snapDistance = 0.3f;       // a camera pose further than this from the estimate is jumped to
+	};
+
+	// Dead reckoning of the headset position between camera poses. The IMU's
+	// linear acceleration (gravity removed, in its own axes) is rotated into
+	// the tracker's frame and integrated into velocity and position at the IMU
+	// rate. Every camera pose then moves the estimate by its innovation, the
+	// camera position minus the estimate at the time the camera saw it, and a
+	// share of the innovation corrects the velocity. The output does not jump
+	// with the estimate: the difference is worked off at correctionSpeed at
+	// most, so the path stays smooth and still lands on the camera's within a
+	// few IMU samples.
+	//
+	// The IMU to tracker rotation is taken at every camera pose from the two
+	// rotations, like the IMU only fallback of the pose thread does, so the
+	// IMU is assumed to sit in the headset without a mounting rotation. Not
+	// thread safe, one thread feeds it; the counters can be read from any.
+	class PositionUpsampler {
+	public:
+		static const int kHistory = 32;                       // estimates kept for cameraLatencyNs, 320 ms at 100 Hz
+		static constexpr float kVelocityTimeConstantS = 1.0f; // velocity leaks away so a biased accelerometer cannot run off
+		static constexpr float kMaxStepS = 0.05f;             // a longer IMU gap is integrated as this
+		static constexpr float kMinFixIntervalS = 0.01f;
+
+		void Reset(const UpsamplingSettings& limits) {
+			this->settings = limits;
+			this->Restart();
+			this->imuSteps.store(0, std::memory_order_relaxed);
+			this->fixes.store(0, std::memory_order_relaxed);
+			this->snaps.store(0, std::memory_order_relaxed);
+			this->innovations.store(0, std::memory_order_relaxed);
+			this->coastStops.store(0, std::memory_order_relaxed);
+			this->innovationSumUm.store(0, std::memory_order_relaxed);
+			this->innovationMaxUm.store(0, std::memory_order_relaxed);
+		}
+
+		// new limits after a settings reload, the estimate is kept
+		void Configure(const UpsamplingSettings& limits) {
+			this->settings = limits;
+		}
+
+		// forgets the estimate, the next camera pose is taken as is
+		void Restart() {
+			this->anchored = false;
+			this->aligned = false;
+			this->haveImu = false;
+			this->coasting = false;
+			this->velocity = Vec3f{ 0, 0, 0 };
+			this->correction = Vec3f{ 0, 0, 0 };
+			this->historyCount = 0;
+		}
+
+		// true once a camera pose has anchored the estimate and an IMU sample aligned the frames
+		bool Ready() const { return this->anchored && this->aligned; }
+
+		// a camera pose of the headset, position in meters in the tracker's frame
+		void Camera(int64_t nowNs, const Vec3f& position, const Quatf& rotation) {
+			if (this->haveImu) {
+				Quatf imuToTracker = QuatMultiply(rotation, QuatConjugate(this->imuRotation));
+				if (QuatNormalize(imuToTracker)) {
+					this->alignment = imuToTracker;
+					this->aligned = true;
+				}
+			}
+			this->fixes.fetch_add(1, std::memory_order_relaxed);
+			this->drain(nowNs);
+			if (!this->anchored) {
+				this->snapTo(nowNs, position);
+				return;
+			}
+
+			const Vec3f innovation = Vec3Sub(position, this->estimateAt(nowNs - this->settings.cameraLatencyNs));
+			const float distance = Vec3Length(innovation);
+			const uint64_t distanceUm = static_cast<uint64_t>(distance * 1e6f);
+			this->innovations.fetch_add(1, std::memory_order_relaxed);
+			this->innovationSumUm.fetch_add(distanceUm, std::memory_order_relaxed);
+			if (distanceUm > this->innovationMaxUm.load(std::memory_order_relaxed))
+				this->innovationMaxUm.store(distanceUm, std::memory_order_relaxed);
+			if (distance > this->settings.snapDistance) {
+				this->snaps.fetch_add(1, std::memory_order_relaxed);
+				this->snapTo(nowNs, position);
+				return;
+			}
+
+			const Vec3f shown = this->Position();
+			this->estimate = Vec3Add(this->estimate, innovation);
+			for (int i = 0; i < this->historyCount; i++)
+				this->history[i].position = Vec3Add(this->history[i].position, innovation);
+			float sinceFix = static_cast<float>(nowNs - this->lastFixNs) * 1e-9f;
+			if (sinceFix < kMinFixIntervalS)
+				sinceFix = kMinFixIntervalS;
+			this->velocity = Vec3Add(this->velocity, Vec3Scale(innovation, this->settings.velocityGain / sinceFix));
+			this->correction = Vec3Sub(shown, this->estimate);
+			this->lastFixNs = nowNs;
+			this->coasting = false;
+		}
+
+		// an IMU sample, rotation as ImuSample::quat and its linear acceleration
+		void Imu(int64_t nowNs, const Quatf& rotation, const Vec3f& acceleration) {
+			this->imuRotation = rotation;
+			const bool first = !this->haveImu;
+			this->haveImu = true;
+			const int64_t previousNs = this->lastImuNs;
+			this->lastImuNs = nowNs;
+			if (first || !this->Ready() || nowNs <= previousNs)
+				return;
+
+			float dt = static_cast<float>(nowNs - previousNs) * 1e-9f;
+			if (dt > kMaxStepS)
+				dt = kMaxStepS;
+			if (nowNs - this->lastFixNs > this->settings.maxCoastNs) {
+				// the camera is gone, don't let the position wander off on the IMU alone
+				if (!this->coasting)
+					this->coastStops.fetch_add(1, std::memory_order_relaxed);
+				this->coasting = true;
+				this->velocity = Vec3f{ 0, 0, 0 };
+			}
+			else {
+				const Vec3f world = QuatRotate(QuatMultiply(this->alignment, rotation), acceleration);
+				this->velocity = Vec3Scale(Vec3Add(this->velocity, Vec3Scale(world, dt)), 1.0f / (1.0f + dt / kVelocityTimeConstantS));
+				this->estimate = Vec3Add(this->estimate, Vec3Scale(this->velocity, dt));
+			}
+			this->drain(nowNs);
+			this->remember(nowNs);
+			this->imuSteps.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// what to show, the estimate with what is left of the last corrections
+		Vec3f Position() const { return Vec3Add(this->estimate, this->correction); }
+		Vec3f Velocity() const { return this->velocity; }
+
+		uint64_t ImuSteps() const { return this->imuSteps.load(std::memory_order_relaxed); }
+		uint64_t Fixes() const { return this->fixes.load(std::memory_order_relaxed); }
+		uint64_t Snaps() const { return this->snaps.load(std::memory_order_relaxed); }
+
+		// How far the dead reckoning had drifted from the camera when each
+		// camera pose came in, the online measure of its error.
+		std::string Report() const {
+			const uint64_t measured = this->innovations.load(std::memory_order_relaxed);
+			char report[192];
+			snprintf(report, sizeof(report), "%llu imu steps, %llu camera poses, innovation mean %.1f mm max %.1f mm, %llu snaps, %llu coast stops",
+				static_cast<unsigned long long>(this->ImuSteps()), static_cast<unsigned long long>(this->Fixes()),
+				measured > 0 ? static_cast<double>(this->innovationSumUm.load(std::memory_order_relaxed)) / 1000.0 / static_cast<double>(measured) : 0.0,
+				static_cast<double>(this->innovationMaxUm.load(std::memory_order_relaxed)) / 1000.0,
+				static_cast<unsigned long long>(this->Snaps()), static_cast<unsigned long long>(this->coastStops.load(std::memory_order_relaxed)));
+			return report;
+		}
+
+	private:
+		struct Estimate {
+			int64_t timestampNs;
+			Vec3f position;
+		};
+
+		void snapTo(int64_t nowNs, const Vec3f& position) {
+			this->estimate = position;
+			this->velocity = Vec3f{ 0, 0, 0 };
+			this->correction = Vec3f{ 0, 0, 0 };
+			this->historyCount = 0;
+			this->anchored = true;
+			this->coasting = false;
+			this->lastFixNs = nowNs;
+			this->drainedNs = nowNs;
+			this->remember(nowNs);
+		}
+
+		// the correction shrinks by correctionSpeed, in a straight line toward 0
+		void drain(int64_t nowNs) {
+			const float elapsed = static_cast<float>(nowNs - this->drainedNs) * 1e-9f;
+			this->drainedNs = nowNs;
+			if (elapsed <= 0)
+				return;
+			const float left = Vec3Length(this->correction);
+			const float step = this->settings.correctionSpeed * elapsed;
+			this->correction = left <= step ? Vec3f{ 0, 0, 0 } : Vec3Scale(this->correction, 1.0f - step / left);
+		}
+
+		void remember(int64_t nowNs) {
+			if (this->historyCount == kHistory) {
+				for (int i = 1; i < kHistory; i++)
+					this->history[i - 1] = this->history[i];
+				this->historyCount--;
+			}
+			this->history[this->historyCount++] = Estimate{ nowNs, this->estimate };
+		}
+
+		// the estimate at timeNs, interpolated between the two around it
+		Vec3f estimateAt(int64_t timeNs) const {
+			if (this->historyCount == 0 || timeNs >= this->history[this->historyCount - 1].timestampNs)
+				return this->estimate;
+			if (timeNs <= this->history[0].timestampNs)
+				return this->history[0].position;
+			int after = this->historyCount - 1;
+			while (this->history[after - 1].timestampNs > timeNs)
+				after--;
+			const Estimate& a = this->history[after - 1];
+			const Estimate& b = this->history[after];
+			const float t = static_cast<float>(timeNs - a.timestampNs) / static_cast<float>(b.timestampNs - a.timestampNs);
+			return Vec3Add(a.position, Vec3Scale(Vec3Sub(b.position, a.position), t));
+		}
+
+		UpsamplingSettings settings;
+		bool anchored = false;
+		bool aligned = false;
+		bool haveImu = false;
+		bool coasting = false;
+		Quatf alignment = QuatIdentity();
+		Quatf imuRotation = QuatIdentity();
+		Vec3f estimate = { 0, 0, 0 };
+		Vec3f velocity = { 0, 0, 0 };
+		Vec3f correction = { 0, 0, 0 };
+		int64_t lastFixNs = 0;
+		int64_t lastImuNs = 0;
+		int64_t drainedNs = 0;
+		Estimate history[kHistory];
+		int historyCount = 0;
+
+		std::atomic<uint64_t> imuSteps{ 0 };
+		std::atomic<uint64_t> fixes{ 0 };
+		std::atomic<uint64_t> snaps{ 0 };
+		std::atomic<uint64_t> innovations{ 0 };
+		std::atomic<uint64_t> coastStops{ 0 };
+		std::atomic<uint64_t> innovationSumUm{ 0 };
+		std::atomic<uint64_t> innovationMaxUm{ 0 };
+	};
+}
+
+#endif // RELATIVTY_POSITIONUPSAMPLER_H
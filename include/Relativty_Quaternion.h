@@ -0,0 +1,361 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_QUATERNION_H
+#define RELATIVTY_QUATERNION_H
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RELATIVTY_QUATERNION_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define RELATIVTY_QUATERNION_NEON
+#endif
+
+namespace Relativty {
+	// Rotations are quaternions in w, x, y, z order, the layout of
+	// ImuSample::quat, TrackerPose::rotation and vr::HmdQuaternion_t.
+	// Rotation vectors (QuatExp, QuatLog, angular velocities) are the axis
+	// times the angle in radians.
+	struct Vec3f {
+		float x, y, z;
+	};
+
+	struct Quatf {
+		float w, x, y, z;
+	};
+
+	// rotation first, then the translation
+	struct Pose {
+		Vec3f position;
+		Quatf rotation;
+	};
+
+	constexpr Vec3f Vec3Add(const Vec3f& a, const Vec3f& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	constexpr Vec3f Vec3Sub(const Vec3f& a, const Vec3f& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	constexpr Vec3f Vec3Scale(const Vec3f& v, float s) { return { v.x * s, v.y * s, v.z * s }; }
+	constexpr float Vec3Dot(const Vec3f& a, const Vec3f& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	constexpr Vec3f Vec3Cross(const Vec3f& a, const Vec3f& b) {
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	inline float Vec3Length(const Vec3f& v) { return std::sqrt(Vec3Dot(v, v)); }
+
+	constexpr Vec3f Vec3Load(const float v[3]) { return { v[0], v[1], v[2] }; }
+
+	inline void Vec3Store(const Vec3f& v, float out[3]) {
+		out[0] = v.x;
+		out[1] = v.y;
+		out[2] = v.z;
+	}
+
+	constexpr Quatf QuatIdentity() { return { 1, 0, 0, 0 }; }
+
+	constexpr Quatf QuatLoad(const float q[4]) { return { q[0], q[1], q[2], q[3] }; }
+
+	inline void QuatStore(const Quatf& q, float out[4]) {
+		out[0] = q.w;
+		out[1] = q.x;
+		out[2] = q.y;
+		out[3] = q.z;
+	}
+
+	// Hamilton product, a applied after b
+	constexpr Quatf QuatMultiply(const Quatf& a, const Quatf& b) {
+		return {
+			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+			a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+		};
+	}
+
+	// the inverse for unit quaternions
+	constexpr Quatf QuatConjugate(const Quatf& q) { return { q.w, -q.x, -q.y, -q.z }; }
+
+	constexpr float QuatDot(const Quatf& a, const Quatf& b) { return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	// v turned by the unit quaternion q, q v q* without building the products
+	constexpr Vec3f QuatRotate(const Quatf& q, const Vec3f& v) {
+		const Vec3f u = { q.x, q.y, q.z };
+		const Vec3f t = Vec3Scale(Vec3Cross(u, v), 2.0f);
+		return Vec3Add(Vec3Add(v, Vec3Scale(t, q.w)), Vec3Cross(u, t));
+	}
+
+	// false (and q untouched) for a zero or non finite quaternion
+	inline bool QuatNormalize(Quatf& q) {
+		const float norm = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+		if (!(norm > 1e-6f) || !std::isfinite(norm))
+			return false;
+		q.w /= norm;
+		q.x /= norm;
+		q.y /= norm;
+		q.z /= norm;
+		return true;
+	}
+
+	// the unit quaternion turning by |r| radians about r
+	inline Quatf QuatExp(const Vec3f& r) {
+		const float angle = Vec3Length(r);
+		if (angle < 1e-6f) {
+			Quatf q = { 1, r.x * 0.5f, r.y * 0.5f, r.z * 0.5f };
+			QuatNormalize(q);
+			return q;
+		}
+		const float s = std::sin(angle * 0.5f) / angle;
+		return { std::cos(angle * 0.5f), r.x * s, r.y * s, r.z * s };
+	}
+
+	// the rotation vector of the unit quaternion q, the short way round
+	inline Vec3f QuatLog(const Quatf& q) {
+		const float sign = q.w < 0 ? -1.0f : 1.0f;
+		const Vec3f v = { q.x * sign, q.y * sign, q.z * sign };
+		const float sinHalf = Vec3Length(v);
+		if (sinHalf < 1e-6f)
+			return Vec3Scale(v, 2.0f);
+		return Vec3Scale(v, 2.0f * std::atan2(sinHalf, q.w * sign) / sinHalf);
+	}
+
+	// a + (b - a) t normalized, the short way round. Cheaper than QuatSlerp
+	// and close to it for the small steps filters take, but the rate is not
+	// constant over t.
+	inline Quatf QuatNlerp(const Quatf& a, const Quatf& b, float t) {
+		const float s = QuatDot(a, b) < 0 ? -t : t;
+		Quatf q = {
+			a.w + (b.w * s - a.w * t), a.x + (b.x * s - a.x * t),
+			a.y + (b.y * s - a.y * t), a.z + (b.z * s - a.z * t)
+		};
+		return QuatNormalize(q) ? q : a;
+	}
+
+	// constant rate from a (t = 0) to b (t = 1), the short way round
+	inline Quatf QuatSlerp(const Quatf& a, const Quatf& b, float t) {
+		float cosAngle = QuatDot(a, b);
+		const float sign = cosAngle < 0 ? -1.0f : 1.0f;
+		cosAngle *= sign;
+		if (cosAngle > 0.9995f)
+			return QuatNlerp(a, b, t); // sin(angle) too small to divide by
+		const float angle = std::acos(cosAngle);
+		const float inverseSin = 1.0f / std::sin(angle);
+		const float wa = std::sin((1 - t) * angle) * inverseSin;
+		const float wb = std::sin(t * angle) * inverseSin * sign;
+		return { a.w * wa + b.w * wb, a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb };
+	}
+
+	constexpr Pose PoseIdentity() { return { { 0, 0, 0 }, QuatIdentity() }; }
+
+	constexpr Vec3f PoseTransform(const Pose& p, const Vec3f& point) {
+		return Vec3Add(QuatRotate(p.rotation, point), p.position);
+	}
+
+	// a applied after b
+	constexpr Pose PoseCompose(const Pose& a, const Pose& b) {
+		return { PoseTransform(a, b.position), QuatMultiply(a.rotation, b.rotation) };
+	}
+
+	constexpr Pose PoseInverse(const Pose& p) {
+		const Quatf inverse = QuatConjugate(p.rotation);
+		return { Vec3Scale(QuatRotate(inverse, p.position), -1.0f), inverse };
+	}
+
+	// The same on float[4] in w, x, y, z order, for the ImuSample and
+	// TrackerPose storage. out may alias either input.
+
+	inline void QuatMultiply(const float a[4], const float b[4], float out[4]) {
+		QuatStore(QuatMultiply(QuatLoad(a), QuatLoad(b)), out);
+	}
+
+	inline void QuatConjugate(const float q[4], float out[4]) {
+		QuatStore(QuatConjugate(QuatLoad(q)), out);
+	}
+
+	inline bool QuatNormalize(float q[4]) {
+		Quatf normalized = QuatLoad(q);
+		if (!QuatNormalize(normalized))
+			return false;
+		QuatStore(normalized, q);
+		return true;
+	}
+
+	// Batch versions for filters and replays, 4 quaternions at a time with
+	// SSE2 or NEON and the scalar functions above for the rest. Results
+	// match the scalar functions up to rounding. out may alias the inputs.
+
+#if defined(RELATIVTY_QUATERNION_SSE2)
+	// four quaternions as one register per component
+	struct QuatLanes {
+		__m128 w, x, y, z;
+	};
+
+	inline QuatLanes QuatLanesLoad(const Quatf* q) {
+		QuatLanes lanes = {
+			_mm_loadu_ps(&q[0].w), _mm_loadu_ps(&q[1].w), _mm_loadu_ps(&q[2].w), _mm_loadu_ps(&q[3].w)
+		};
+		_MM_TRANSPOSE4_PS(lanes.w, lanes.x, lanes.y, lanes.z);
+		return lanes;
+	}
+
+	inline void QuatLanesStore(QuatLanes lanes, Quatf* q) {
+		_MM_TRANSPOSE4_PS(lanes.w, lanes.x, lanes.y, lanes.z);
+		_mm_storeu_ps(&q[0].w, lanes.w);
+		_mm_storeu_ps(&q[1].w, lanes.x);
+		_mm_storeu_ps(&q[2].w, lanes.y);
+		_mm_storeu_ps(&q[3].w, lanes.z);
+	}
+
+	inline QuatLanes QuatLanesMultiply(const QuatLanes& a, const QuatLanes& b) {
+		return {
+			_mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(a.w, b.w), _mm_mul_ps(a.x, b.x)), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z)),
+			_mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.x), _mm_mul_ps(a.x, b.w)), _mm_mul_ps(a.y, b.z)), _mm_mul_ps(a.z, b.y)),
+			_mm_add_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(a.w, b.y), _mm_mul_ps(a.x, b.z)), _mm_mul_ps(a.y, b.w)), _mm_mul_ps(a.z, b.x)),
+			_mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(a.w, b.z), _mm_mul_ps(a.x, b.y)), _mm_mul_ps(a.y, b.x)), _mm_mul_ps(a.z, b.w))
+		};
+	}
+
+	// lanes that QuatNormalize would reject take their value from fallback
+	inline QuatLanes QuatLanesNormalize(const QuatLanes& q, const QuatLanes& fallback) {
+		const __m128 norm = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(q.w, q.w), _mm_mul_ps(q.x, q.x)),
+			_mm_mul_ps(q.y, q.y)), _mm_mul_ps(q.z, q.z)));
+		// norm - norm is 0 unless norm is infinite or NaN
+		const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(norm, _mm_set1_ps(1e-6f)), _mm_cmpeq_ps(_mm_sub_ps(norm, norm), _mm_setzero_ps()));
+		const __m128 divisor = _mm_or_ps(_mm_and_ps(valid, norm), _mm_andnot_ps(valid, _mm_set1_ps(1.0f)));
+		return {
+			_mm_or_ps(_mm_and_ps(valid, _mm_div_ps(q.w, divisor)), _mm_andnot_ps(valid, fallback.w)),
+			_mm_or_ps(_mm_and_ps(valid, _mm_div_ps(q.x, divisor)), _mm_andnot_ps(valid, fallback.x)),
+			_mm_or_ps(_mm_and_ps(valid, _mm_div_ps(q.y, divisor)), _mm_andnot_ps(valid, fallback.y)),
+			_mm_or_ps(_mm_and_ps(valid, _mm_div_ps(q.z, divisor)), _mm_andnot_ps(valid, fallback.z))
+		};
+	}
+
+	// QuatNlerp lane by lane
+	inline QuatLanes QuatLanesNlerp(const QuatLanes& a, const QuatLanes& b, float t) {
+		const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.w), _mm_mul_ps(a.x, b.x)), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+		const __m128 vt = _mm_set1_ps(t);
+		const __m128 s = _mm_xor_ps(vt, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f)));
+		const QuatLanes q = {
+			_mm_add_ps(a.w, _mm_sub_ps(_mm_mul_ps(b.w, s), _mm_mul_ps(a.w, vt))),
+			_mm_add_ps(a.x, _mm_sub_ps(_mm_mul_ps(b.x, s), _mm_mul_ps(a.x, vt))),
+			_mm_add_ps(a.y, _mm_sub_ps(_mm_mul_ps(b.y, s), _mm_mul_ps(a.y, vt))),
+			_mm_add_ps(a.z, _mm_sub_ps(_mm_mul_ps(b.z, s), _mm_mul_ps(a.z, vt)))
+		};
+		return QuatLanesNormalize(q, a);
+	}
+#elif defined(RELATIVTY_QUATERNION_NEON)
+	struct QuatLanes {
+		float32x4_t w, x, y, z;
+	};
+
+	inline QuatLanes QuatLanesLoad(const Quatf* q) {
+		const float32x4x4_t lanes = vld4q_f32(&q[0].w);
+		return { lanes.val[0], lanes.val[1], lanes.val[2], lanes.val[3] };
+	}
+
+	inline void QuatLanesStore(const QuatLanes& lanes, Quatf* q) {
+		const float32x4x4_t interleaved = { { lanes.w, lanes.x, lanes.y, lanes.z } };
+		vst4q_f32(&q[0].w, interleaved);
+	}
+
+	inline QuatLanes QuatLanesMultiply(const QuatLanes& a, const QuatLanes& b) {
+		return {
+			vsubq_f32(vsubq_f32(vsubq_f32(vmulq_f32(a.w, b.w), vmulq_f32(a.x, b.x)), vmulq_f32(a.y, b.y)), vmulq_f32(a.z, b.z)),
+			vsubq_f32(vaddq_f32(vaddq_f32(vmulq_f32(a.w, b.x), vmulq_f32(a.x, b.w)), vmulq_f32(a.y, b.z)), vmulq_f32(a.z, b.y)),
+			vaddq_f32(vaddq_f32(vsubq_f32(vmulq_f32(a.w, b.y), vmulq_f32(a.x, b.z)), vmulq_f32(a.y, b.w)), vmulq_f32(a.z, b.x)),
+			vaddq_f32(vsubq_f32(vaddq_f32(vmulq_f32(a.w, b.z), vmulq_f32(a.x, b.y)), vmulq_f32(a.y, b.x)), vmulq_f32(a.z, b.w))
+		};
+	}
+
+	inline QuatLanes QuatLanesNormalize(const QuatLanes& q, const QuatLanes& fallback) {
+		const float32x4_t norm = vsqrtq_f32(vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(q.w, q.w), vmulq_f32(q.x, q.x)),
+			vmulq_f32(q.y, q.y)), vmulq_f32(q.z, q.z)));
+		const uint32x4_t valid = vandq_u32(vcgtq_f32(norm, vdupq_n_f32(1e-6f)), vceqq_f32(vsubq_f32(norm, norm), vdupq_n_f32(0.0f)));
+		const float32x4_t divisor = vbslq_f32(valid, norm, vdupq_n_f32(1.0f));
+		return {
+			vbslq_f32(valid, vdivq_f32(q.w, divisor), fallback.w), vbslq_f32(valid, vdivq_f32(q.x, divisor), fallback.x),
+			vbslq_f32(valid, vdivq_f32(q.y, divisor), fallback.y), vbslq_f32(valid, vdivq_f32(q.z, divisor), fallback.z)
+		};
+	}
+
+	inline QuatLanes QuatLanesNlerp(const QuatLanes& a, const QuatLanes& b, float t) {
+		const float32x4_t dot = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(a.w, b.w), vmulq_f32(a.x, b.x)), vmulq_f32(a.y, b.y)), vmulq_f32(a.z, b.z));
+		const float32x4_t vt = vdupq_n_f32(t);
+		const float32x4_t s = vbslq_f32(vcltq_f32(dot, vdupq_n_f32(0.0f)), vnegq_f32(vt), vt);
+		const QuatLanes q = {
+			vaddq_f32(a.w, vsubq_f32(vmulq_f32(b.w, s), vmulq_f32(a.w, vt))),
+			vaddq_f32(a.x, vsubq_f32(vmulq_f32(b.x, s), vmulq_f32(a.x, vt))),
+			vaddq_f32(a.y, vsubq_f32(vmulq_f32(b.y, s), vmulq_f32(a.y, vt))),
+			vaddq_f32(a.z, vsubq_f32(vmulq_f32(b.z, s), vmulq_f32(a.z, vt)))
+		};
+		return QuatLanesNormalize(q, a);
+	}
+#endif
+
+	// out[i] = a[i] b[i]
+	inline void QuatMultiplyBatch(const Quatf* a, const Quatf* b, Quatf* out, size_t count) {
+		size_t i = 0;
+#if defined(RELATIVTY_QUATERNION_SSE2) || defined(RELATIVTY_QUATERNION_NEON)
+		for (; i + 4 <= count; i += 4)
+			QuatLanesStore(QuatLanesMultiply(QuatLanesLoad(a + i), QuatLanesLoad(b + i)), out + i);
+#endif
+		for (; i < count; i++)
+			out[i] = QuatMultiply(a[i], b[i]);
+	}
+
+	// out[i] = a q[i], e.g. one fixed offset applied to a run of IMU samples
+	inline void QuatMultiplyBatch(const Quatf& a, const Quatf* q, Quatf* out, size_t count) {
+		size_t i = 0;
+#if defined(RELATIVTY_QUATERNION_SSE2)
+		const QuatLanes left = { _mm_set1_ps(a.w), _mm_set1_ps(a.x), _mm_set1_ps(a.y), _mm_set1_ps(a.z) };
+#elif defined(RELATIVTY_QUATERNION_NEON)
+		const QuatLanes left = { vdupq_n_f32(a.w), vdupq_n_f32(a.x), vdupq_n_f32(a.y), vdupq_n_f32(a.z) };
+#endif
+#if defined(RELATIVTY_QUATERNION_SSE2) || defined(RELATIVTY_QUATERNION_NEON)
+		for (; i + 4 <= count; i += 4)
+			QuatLanesStore(QuatLanesMultiply(left, QuatLanesLoad(q + i)), out + i);
+#endif
+		for (; i < count; i++)
+			out[i] = QuatMultiply(a, q[i]);
+	}
+
+	// QuatNormalize on each, the ones it rejects are left as they are
+	inline void QuatNormalizeBatch(Quatf* q, size_t count) {
+		size_t i = 0;
+#if defined(RELATIVTY_QUATERNION_SSE2) || defined(RELATIVTY_QUATERNION_NEON)
+		for (; i + 4 <= count; i += 4) {
+			const QuatLanes lanes = QuatLanesLoad(q + i);
+			QuatLanesStore(QuatLanesNormalize(lanes, lanes), q + i);
+		}
+#endif
+		for (; i < count; i++)
+			QuatNormalize(q[i]);
+	}
+
+	// out[i] = QuatNlerp(a[i], b[i], t), one smoothing step of a filter bank
+	inline void QuatNlerpBatch(const Quatf* a, const Quatf* b, float t, Quatf* out, size_t count) {
+		size_t i = 0;
+#if defined(RELATIVTY_QUATERNION_SSE2) || defined(RELATIVTY_QUATERNION_NEON)
+		for (; i + 4 <= count; i += 4)
+			QuatLanesStore(QuatLanesNlerp(QuatLanesLoad(a + i), QuatLanesLoad(b + i), t), out + i);
+#endif
+		for (; i < count; i++)
+			out[i] = QuatNlerp(a[i], b[i], t);
+	}
+}
+
+#endif // RELATIVTY_QUATERNION_H
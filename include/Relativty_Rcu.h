@@ -0,0 +1,64 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_RCU_H
+#define RELATIVTY_RCU_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Relativty {
+	// Read-copy-update cell for rarely changing, immutable snapshots. Readers
+	// do a single acquire load and never block or take a reference count.
+	// Writers publish a complete new version. Old versions are kept alive
+	// until reclaim() is called at a point where no reader can still hold
+	// one (e.g. after the reader threads are joined); settings change rarely
+	// and by hand, so the retired list stays tiny.
+	template<typename T>
+	class RcuCell {
+	public:
+		RcuCell() = default;
+		RcuCell(const RcuCell&) = delete;
+		RcuCell& operator=(const RcuCell&) = delete;
+
+		// valid until the next reclaim(), nullptr before the first publish
+		const T* read() const {
+			return this->current.load(std::memory_order_acquire);
+		}
+
+		void publish(std::unique_ptr<const T> version) {
+			std::lock_guard<std::mutex> lock(this->writerMutex);
+			this->current.store(version.get(), std::memory_order_release);
+			this->versions.push_back(std::move(version));
+		}
+
+		// frees every version except the current one, no reader may be running
+		void reclaim() {
+			std::lock_guard<std::mutex> lock(this->writerMutex);
+			if (this->versions.size() > 1)
+				this->versions.erase(this->versions.begin(), this->versions.end() - 1);
+		}
+
+	private:
+		std::atomic<const T*> current{ nullptr };
+		std::mutex writerMutex;
+		std::vector<std::unique_ptr<const T>> versions;
+	};
+}
+
+#endif // RELATIVTY_RCU_H
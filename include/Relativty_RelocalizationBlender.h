@@ -0,0 +1,165 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_RELOCALIZATIONBLENDER_H
+#define RELATIVTY_RELOCALIZATIONBLENDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "Relativty_Quaternion.h"
+
+namespace Relativty {
+	struct RelocalizationSettings {
+		float maxSpeed = 4.0f;          // m/s, a position further from the last one than this allows jumped
+		float minJump = 0.05f;          // m, a smaller step is never taken for a jump, however short the interval
+		int64_t blendNs = 500000000;    // how long a jump takes to be worked off, 0 shows it as it came
+	};
+
+	// Hides the jumps of the tracker's position when it relocalizes, i.e.
+	// corrects its map and moves the headset's position with it. A pose is
+	// taken for a jump when the tracker flags it (kPoseReset) or when it is
+	// further from the previous one than the head can move in between. The
+	// jump, less the motion the last velocity accounts for, goes into an
+	// offset added to every position after it, and the offset eases to zero
+	// over blendNs (smoothstep, so the output gains no velocity step at
+	// either end). The offset only depends on time, the motion in the
+	// tracker's positions reaches the output in the same pose, with no
+	// filtering lag. A jump while one is still blended adds to what is left.
+	// Not thread safe, one thread feeds it; the counters can be read from any.
+	class RelocalizationBlender {
+	public:
+		static constexpr float kMinIntervalS = 0.005f; // poses arriving bunched together are judged over this
+		static constexpr float kMaxCarryS = 0.1f;      // the last velocity is not carried across a longer gap
+		static constexpr float kVelocitySmoothing = 0.5f;
+
+		void Reset(const RelocalizationSettings& limits) {
+			this->settings = limits;
+			this->Restart();
+			this->jumps.store(0, std::memory_order_relaxed);
+			this->flagged.store(0, std::memory_order_relaxed);
+			this->jumpSumUm.store(0, std::memory_order_relaxed);
+			this->jumpMaxUm.store(0, std::memory_order_relaxed);
+			this->offsetUm.store(0, std::memory_order_relaxed);
+		}
+
+		// new limits after a settings reload; what is left of a jump being
+		// blended is eased out over the new blendNs from nowNs
+		void Configure(const RelocalizationSettings& limits, int64_t nowNs) {
+			this->offset = this->offsetAt(nowNs);
+			this->blendStartNs = nowNs;
+			this->settings = limits;
+		}
+
+		// forgets the previous pose, the next one is taken as it comes
+		void Restart() {
+			this->havePrevious = false;
+			this->velocity = Vec3f{ 0, 0, 0 };
+			this->offset = Vec3f{ 0, 0, 0 };
+			this->offsetUm.store(0, std::memory_order_relaxed);
+		}
+
+		// A position from the tracker, reset if the tracker flagged it; returns
+		// the position to show.
+		Vec3f Apply(int64_t nowNs, const Vec3f& position, bool reset) {
+			if (!this->havePrevious) {
+				this->havePrevious = true;
+				this->previous = position;
+				this->previousNs = nowNs;
+				return position;
+			}
+
+			float interval = static_cast<float>(nowNs - this->previousNs) * 1e-9f;
+			if (interval < kMinIntervalS)
+				interval = kMinIntervalS;
+			const Vec3f step = Vec3Sub(position, this->previous);
+			const float distance = Vec3Length(step);
+			if (reset || (distance > this->settings.minJump && distance > this->settings.maxSpeed * interval)) {
+				// the head kept moving meanwhile, only the rest of the step is the tracker's doing
+				const Vec3f motion = Vec3Scale(this->velocity, interval < kMaxCarryS ? interval : kMaxCarryS);
+				const Vec3f jump = Vec3Sub(step, motion);
+				this->offset = Vec3Sub(this->offsetAt(nowNs), jump);
+				this->blendStartNs = nowNs;
+				this->count(Vec3Length(jump), reset);
+			}
+			else {
+				const Vec3f measured = Vec3Scale(step, 1.0f / interval);
+				this->velocity = Vec3Add(this->velocity, Vec3Scale(Vec3Sub(measured, this->velocity), kVelocitySmoothing));
+			}
+			this->previous = position;
+			this->previousNs = nowNs;
+
+			const Vec3f left = this->offsetAt(nowNs);
+			this->offsetUm.store(static_cast<uint64_t>(Vec3Length(left) * 1e6f), std::memory_order_relaxed);
+			return Vec3Add(position, left);
+		}
+
+		uint64_t Jumps() const { return this->jumps.load(std::memory_order_relaxed); }
+		uint64_t Flagged() const { return this->flagged.load(std::memory_order_relaxed); }
+
+		// "2 jumps (1 flagged by the tracker), mean 310.0 mm max 520.0 mm, 41.3 mm left to blend"
+		std::string Report() const {
+			const uint64_t seen = this->Jumps();
+			char report[160];
+			snprintf(report, sizeof(report), "%llu jumps (%llu flagged by the tracker), mean %.1f mm max %.1f mm, %.1f mm left to blend",
+				static_cast<unsigned long long>(seen), static_cast<unsigned long long>(this->Flagged()),
+				seen > 0 ? static_cast<double>(this->jumpSumUm.load(std::memory_order_relaxed)) / 1000.0 / static_cast<double>(seen) : 0.0,
+				static_cast<double>(this->jumpMaxUm.load(std::memory_order_relaxed)) / 1000.0,
+				static_cast<double>(this->offsetUm.load(std::memory_order_relaxed)) / 1000.0);
+			return report;
+		}
+
+	private:
+		// what is left of the offset at timeNs
+		Vec3f offsetAt(int64_t timeNs) const {
+			const int64_t elapsed = timeNs - this->blendStartNs;
+			if (this->settings.blendNs <= 0 || elapsed >= this->settings.blendNs)
+				return Vec3f{ 0, 0, 0 };
+			if (elapsed <= 0)
+				return this->offset;
+			const float u = static_cast<float>(elapsed) / static_cast<float>(this->settings.blendNs);
+			return Vec3Scale(this->offset, 1.0f - u * u * (3.0f - 2.0f * u));
+		}
+
+		void count(float magnitude, bool reset) {
+			const uint64_t magnitudeUm = static_cast<uint64_t>(magnitude * 1e6f);
+			this->jumps.fetch_add(1, std::memory_order_relaxed);
+			if (reset)
+				this->flagged.fetch_add(1, std::memory_order_relaxed);
+			this->jumpSumUm.fetch_add(magnitudeUm, std::memory_order_relaxed);
+			if (magnitudeUm > this->jumpMaxUm.load(std::memory_order_relaxed))
+				this->jumpMaxUm.store(magnitudeUm, std::memory_order_relaxed);
+		}
+
+		RelocalizationSettings settings;
+		bool havePrevious = false;
+		Vec3f previous = { 0, 0, 0 };
+		int64_t previousNs = 0;
+		Vec3f velocity = { 0, 0, 0 };
+		Vec3f offset = { 0, 0, 0 };
+		int64_t blendStartNs = 0;
+
+		std::atomic<uint64_t> jumps{ 0 };
+		std::atomic<uint64_t> flagged{ 0 };
+		std::atomic<uint64_t> jumpSumUm{ 0 };
+		std::atomic<uint64_t> jumpMaxUm{ 0 };
+		std::atomic<uint64_t> offsetUm{ 0 };
+	};
+}
+
+#endif // RELATIVTY_RELOCALIZATIONBLENDER_H
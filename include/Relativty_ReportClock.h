@@ -0,0 +1,76 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_REPORTCLOCK_H
+#define RELATIVTY_REPORTCLOCK_H
+
+#include <cstdint>
+
+namespace Relativty {
+	// Timestamps for reports drained from a device queue in one go. Only the
+	// newest was read as it arrived; the ones queued behind it came in a
+	// report period apart before that. The period is learnt from two wakeups
+	// in a row that each found a single report, both read as they came in;
+	// until it is known the older reports get -1, no time. Stamps never go back past the
+	// previous drain's newest one. Not thread safe, owned by the reading thread.
+	class ReportClock {
+	public:
+		// a wait timed out, the stream stopped and the next gap is no period
+		void Gap() {
+			this->newestNs = 0;
+			this->single = false;
+		}
+
+		// stamps, oldest first, for count reports drained at nowNs
+		void Stamp(int64_t nowNs, uint32_t count, int64_t* stamps) {
+			if (count == 0)
+				return;
+			if (count == 1 && this->single && nowNs > this->newestNs) {
+				const int64_t gapNs = nowNs - this->newestNs;
+				this->periodNs = this->periodNs == 0 ? gapNs : this->periodNs + (gapNs - this->periodNs) / 8;
+			}
+			// the drain took more reports than the period fits in since the
+			// last one, spread them evenly after it instead
+			const bool squeeze = count > 1 && this->periodNs != 0 && this->newestNs != 0
+				&& nowNs - static_cast<int64_t>(count - 1) * this->periodNs <= this->newestNs;
+			for (uint32_t i = 0; i < count; i++) {
+				const int64_t behind = static_cast<int64_t>(count - 1 - i);
+				if (behind == 0)
+					stamps[i] = nowNs;
+				else if (squeeze)
+					stamps[i] = this->newestNs + (nowNs - this->newestNs) * (i + 1) / count;
+				else if (this->periodNs == 0)
+					stamps[i] = -1;
+				else
+					stamps[i] = nowNs - behind * this->periodNs;
+			}
+			this->newestNs = nowNs;
+			this->single = count == 1;
+		}
+
+		// 0 until two wakeups in a row found a single report
+		int64_t PeriodNs() const {
+			return this->periodNs;
+		}
+
+	private:
+		int64_t newestNs = 0;
+		int64_t periodNs = 0;
+		bool single = false; // the last drain took one report, its stamp is an arrival
+	};
+}
+
+#endif // RELATIVTY_REPORTCLOCK_H
@@ -19,6 +19,7 @@
 
 #include "openvr_driver.h"
 #include "Relativty_HMDDriver.hpp"
+#include "Relativty_TrackerDevice.h"
 
 namespace Relativty {
 	class ServerDriver : public vr::IServerTrackedDeviceProvider
@@ -35,6 +36,8 @@ namespace Relativty {
 		static void Log(std::string log);
 	private:
 		HMDDriver* HMDDriver = nullptr;
+		// controllers and body trackers, fed by the headset's pose stream
+		TrackerHub* Trackers = nullptr;
 	};
 }
 
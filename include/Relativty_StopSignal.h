@@ -0,0 +1,176 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_STOPSIGNAL_H
+#define RELATIVTY_STOPSIGNAL_H
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef _WIN32
+// WinSock2.h has to come before any Windows.h
+#include <WinSock2.h>
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace Relativty {
+	// One stop request shared by all worker loops of a device. Request() sets
+	// a flag for loops that poll and signals a kernel object (a manual reset
+	// event on Windows, an eventfd elsewhere) so loops blocked in a wait wake
+	// up at once instead of at their next timeout. Reset() arms it again for
+	// the next Activate.
+	class StopSignal {
+	public:
+		StopSignal() {
+#ifdef _WIN32
+			this->event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+#else
+			this->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+		}
+		~StopSignal() {
+#ifdef _WIN32
+			if (this->event != nullptr)
+				CloseHandle(this->event);
+#else
+			if (this->fd >= 0)
+				close(this->fd);
+#endif
+		}
+		StopSignal(const StopSignal&) = delete;
+		StopSignal& operator=(const StopSignal&) = delete;
+
+		void Request() {
+			this->requested.store(true, std::memory_order_release);
+#ifdef _WIN32
+			SetEvent(this->event);
+#else
+			const uint64_t one = 1;
+			(void)!write(this->fd, &one, sizeof(one));
+#endif
+		}
+
+		// only while no worker is running
+		void Reset() {
+			this->requested.store(false, std::memory_order_release);
+#ifdef _WIN32
+			ResetEvent(this->event);
+#else
+			uint64_t count;
+			(void)!read(this->fd, &count, sizeof(count));
+#endif
+		}
+
+		bool Requested() const {
+			return this->requested.load(std::memory_order_acquire);
+		}
+
+		// interruptible sleep, true if it was cut short by a stop request
+		bool WaitFor(uint32_t timeoutMs) const {
+			if (this->Requested())
+				return true;
+#ifdef _WIN32
+			WaitForSingleObject(this->event, timeoutMs);
+#else
+			pollfd wake = { this->fd, POLLIN, 0 };
+			poll(&wake, 1, static_cast<int>(timeoutMs));
+#endif
+			return this->Requested();
+		}
+
+#ifdef _WIN32
+		HANDLE Handle() const { return this->event; }
+#else
+		int Fd() const { return this->fd; }
+#endif
+
+	private:
+		std::atomic<bool> requested{ false };
+#ifdef _WIN32
+		HANDLE event = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+
+	enum class SocketWait {
+		Readable,
+		Timeout,
+		Stopped
+	};
+
+#ifndef _WIN32
+	typedef int SOCKET;
+#endif
+
+	// Waits for a datagram on a socket or for the StopSignal, whichever comes
+	// first. On Windows the socket is tied to an event with WSAEventSelect,
+	// which also makes it non blocking, so recv* can still fail with
+	// WSAEWOULDBLOCK after a Readable and should just go round again.
+	class SocketWaiter {
+	public:
+		SocketWaiter(SOCKET socket, const StopSignal& stopSignal) : sock(socket), stop(stopSignal) {
+#ifdef _WIN32
+			this->readable = WSACreateEvent();
+			WSAEventSelect(this->sock, this->readable, FD_READ);
+#endif
+		}
+		~SocketWaiter() {
+#ifdef _WIN32
+			WSAEventSelect(this->sock, nullptr, 0);
+			WSACloseEvent(this->readable);
+#endif
+		}
+		SocketWaiter(const SocketWaiter&) = delete;
+		SocketWaiter& operator=(const SocketWaiter&) = delete;
+
+		SocketWait Wait(uint32_t timeoutMs) {
+			if (this->stop.Requested())
+				return SocketWait::Stopped;
+#ifdef _WIN32
+			const WSAEVENT events[2] = { this->stop.Handle(), this->readable };
+			const DWORD woken = WSAWaitForMultipleEvents(2, events, FALSE, timeoutMs, FALSE);
+			if (woken == WSA_WAIT_EVENT_0 || this->stop.Requested())
+				return SocketWait::Stopped;
+			if (woken != WSA_WAIT_EVENT_0 + 1)
+				return SocketWait::Timeout;
+			// resets the event, FD_READ is recorded again while data is left
+			WSANETWORKEVENTS network;
+			WSAEnumNetworkEvents(this->sock, this->readable, &network);
+			return SocketWait::Readable;
+#else
+			pollfd fds[2] = { { this->stop.Fd(), POLLIN, 0 }, { this->sock, POLLIN, 0 } };
+			const int ready = poll(fds, 2, static_cast<int>(timeoutMs));
+			if (this->stop.Requested())
+				return SocketWait::Stopped;
+			return ready > 0 && (fds[1].revents & POLLIN) ? SocketWait::Readable : SocketWait::Timeout;
+#endif
+		}
+
+	private:
+		SOCKET sock;
+		const StopSignal& stop;
+#ifdef _WIN32
+		WSAEVENT readable;
+#endif
+	};
+}
+
+#endif // RELATIVTY_STOPSIGNAL_H
@@ -0,0 +1,174 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_THREADTUNING_H
+#define RELATIVTY_THREADTUNING_H
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Relativty {
+	// Coarse priority levels that map onto both the Windows classes and nice
+	// values, so settings stay portable.
+	enum class SchedPriority : int {
+		BelowNormal = -1,
+		Normal = 0,
+		AboveNormal = 1,
+		High = 2
+	};
+
+	inline SchedPriority ClampSchedPriority(int value) {
+		if (value < -1)
+			return SchedPriority::BelowNormal;
+		if (value > 2)
+			return SchedPriority::High;
+		return static_cast<SchedPriority>(value);
+	}
+
+#ifndef _WIN32
+	inline int NiceForPriority(SchedPriority priority) {
+		switch (priority) {
+		case SchedPriority::BelowNormal: return 5;
+		case SchedPriority::AboveNormal: return -5;
+		case SchedPriority::High: return -10;
+		default: return 0;
+		}
+	}
+#endif
+
+	// Restricts the calling thread to the CPUs set in mask (bit n = CPU n).
+	// A zero mask leaves the thread alone. Returns false if the OS refused.
+	inline bool PinCurrentThread(uint64_t mask) {
+		if (mask == 0)
+			return true;
+#ifdef _WIN32
+		return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(mask)) != 0;
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < 64; cpu++) {
+			if (mask & (uint64_t(1) << cpu))
+				CPU_SET(cpu, &set);
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+	}
+
+	// Raising above normal needs CAP_SYS_NICE on Linux, expect false without it.
+	inline bool SetCurrentThreadPriority(SchedPriority priority) {
+#ifdef _WIN32
+		int level = THREAD_PRIORITY_NORMAL;
+		switch (priority) {
+		case SchedPriority::BelowNormal: level = THREAD_PRIORITY_BELOW_NORMAL; break;
+		case SchedPriority::AboveNormal: level = THREAD_PRIORITY_ABOVE_NORMAL; break;
+		case SchedPriority::High: level = THREAD_PRIORITY_HIGHEST; break;
+		default: break;
+		}
+		return SetThreadPriority(GetCurrentThread(), level) != 0;
+#else
+		// Linux keeps a nice value per thread, addressed by its tid
+		const id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+		return setpriority(PRIO_PROCESS, tid, NiceForPriority(priority)) == 0;
+#endif
+	}
+
+	// Scheduling class for a driver thread. Fifo and RoundRobin are the Linux
+	// real-time policies; on Windows both register the thread with MMCSS
+	// ("Pro Audio" task), which is as close as a user mode driver gets.
+	enum class SchedClass {
+		Normal,
+		Fifo,
+		RoundRobin
+	};
+
+	// "normal", "fifo" or "rr", false for anything else
+	inline bool ParseSchedClass(const std::string& name, SchedClass& out) {
+		if (name == "normal" || name.empty())
+			out = SchedClass::Normal;
+		else if (name == "fifo")
+			out = SchedClass::Fifo;
+		else if (name == "rr")
+			out = SchedClass::RoundRobin;
+		else
+			return false;
+		return true;
+	}
+
+	inline const char* SchedClassName(SchedClass schedClass) {
+		switch (schedClass) {
+		case SchedClass::Fifo: return "fifo";
+		case SchedClass::RoundRobin: return "rr";
+		default: return "normal";
+		}
+	}
+
+	// Real-time priorities run 1 (lowest) to 99, as on Linux.
+	static constexpr int kMinRealtimePriority = 1;
+	static constexpr int kMaxRealtimePriority = 99;
+
+	struct ThreadSchedConfig {
+		SchedClass schedClass = SchedClass::Normal;
+		// Normal: a SchedPriority level (-1..2). Fifo/RoundRobin: 1..99, on
+		// Windows 1-32 is MMCSS normal, 33-65 high and 66-99 critical.
+		int priority = 0;
+		uint64_t cpuMask = 0; // 0 leaves the affinity alone
+	};
+
+	// Names the calling thread for debuggers and profilers. Linux keeps 15
+	// characters, Windows needs 10 1607 or later (silently skipped before).
+	void SetCurrentThreadName(const char* name);
+
+	// Applies a ThreadSchedConfig to the calling thread for the lifetime of the
+	// object and undoes the MMCSS registration / real-time policy when it goes
+	// out of scope, so declare it first thing in the thread function. Whatever
+	// the OS refused is described by Problems(); the thread keeps running with
+	// what it got (usually normal scheduling, real-time needs CAP_SYS_NICE or
+	// RLIMIT_RTPRIO on Linux).
+	class ScopedThreadSched {
+	public:
+		ScopedThreadSched(const char* name, const ThreadSchedConfig& config);
+		~ScopedThreadSched();
+		ScopedThreadSched(const ScopedThreadSched&) = delete;
+		ScopedThreadSched& operator=(const ScopedThreadSched&) = delete;
+
+		const std::string& Problems() const { return this->problems; }
+		// what the thread actually runs with, e.g. "fifo 80, cpu mask 0x4"
+		const std::string& Achieved() const { return this->achieved; }
+
+	private:
+		std::string problems;
+		std::string achieved;
+#ifdef _WIN32
+		HANDLE mmcssHandle = nullptr;
+#else
+		bool realtime = false;
+		int previousPolicy = SCHED_OTHER;
+		sched_param previousParam = {};
+#endif
+	};
+}
+
+#endif // RELATIVTY_THREADTUNING_H
@@ -0,0 +1,86 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_TRACE_H
+#define RELATIVTY_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Relativty {
+	// Flight recorder for what the driver threads are doing. Every thread
+	// records into its own fixed size buffer (the oldest events are
+	// overwritten), nothing is written anywhere until Dump() is called. A
+	// thread gets its buffer with its first event, the buffers of exited
+	// threads are handed to the next ones.
+	// Open the output in chrome://tracing or https://ui.perfetto.dev.
+	//
+	// Event names must be string literals, only the pointer is stored.
+	namespace Trace {
+		extern std::atomic<bool> g_enabled;
+
+		inline bool IsEnabled() { return g_enabled.load(std::memory_order_relaxed); }
+		void Enable(bool enabled);
+
+		// Costs nothing while tracing is off, the name is kept for the
+		// thread's buffer should it record later.
+		void SetThreadName(const char* name);
+
+		void Begin(const char* name);
+		void End();
+		void Counter(const char* name, double value);
+
+		// Flows draw an arrow from the slice FlowBegin was called in to the
+		// slice FlowEnd was called in with the same id, e.g. from the UDP
+		// datagram to the pose update it produced.
+		uint64_t NewFlowId();
+		void FlowBegin(const char* name, uint64_t id);
+		void FlowEnd(const char* name, uint64_t id);
+
+		// buffers allocated so far, the most threads ever recording at once
+		size_t BufferCount();
+
+		// ".json" gives Chrome trace event JSON, anything else Perfetto protobuf
+		bool Dump(const std::string& path);
+		bool DumpChromeJson(const std::string& path);
+		bool DumpPerfetto(const std::string& path);
+
+		class Scope {
+		public:
+			explicit Scope(const char* name) : active(IsEnabled()) {
+				if (this->active)
+					Begin(name);
+			}
+			~Scope() {
+				if (this->active)
+					End();
+			}
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			bool active;
+		};
+	}
+}
+
+#define RELATIVTY_TRACE_CONCAT_(a, b) a##b
+#define RELATIVTY_TRACE_CONCAT(a, b) RELATIVTY_TRACE_CONCAT_(a, b)
+#define RELATIVTY_TRACE_SCOPE(name) Relativty::Trace::Scope RELATIVTY_TRACE_CONCAT(relativtyTraceScope, __LINE__)(name)
+
+#endif // RELATIVTY_TRACE_H
@@ -0,0 +1,133 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_TRACKERDEVICE_H
+#define RELATIVTY_TRACKERDEVICE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "openvr_driver.h"
+#include "Relativty_base_device.h"
+#include "Relativty_FramePacer.h"
+#include "Relativty_PosePredictor.h"
+#include "Relativty_PoseStream.h"
+#include "Relativty_TrackingMonitor.h"
+
+namespace Relativty {
+	// publishing settings shared by all trackers, see HmdConfig
+	struct TrackerPublishing {
+		PublishMode mode = PublishMode::Event;
+		int64_t maxPredictionNs = 50000000;
+		int64_t displayPeriodNs = 16666667;
+	};
+
+	// A controller or body tracker fed by the pose stream (device ids 1 to
+	// kMaxTrackers). It has no thread of its own: in Event mode a pose is
+	// applied and published on the thread that received it, in Frame mode
+	// PublishFrame publishes a prediction once per display frame. Either way
+	// ServerDriver::RunFrame ages it so a tracker that stops reporting goes
+	// lost.
+	class TrackerDevice final : public RelativtyDevice<true>
+	{
+	public:
+		TrackerDevice(uint32_t id, TrackerRole role, const TrackingBudgets& budgets, const TrackerPublishing& publishing);
+		~TrackerDevice() = default;
+
+		// Inherited from RelativtyDevice
+		virtual vr::EVRInitError Activate(vr::TrackedDeviceIndex_t unObjectId);
+		virtual void Deactivate();
+		virtual void DebugRequest(const char* pchRequest, char* pchResponseBuffer, uint32_t unResponseBufferSize);
+
+		// controller for the hands, generic tracker for the rest
+		vr::ETrackedDeviceClass DeviceClass() const;
+
+		// any ingest thread
+		void SubmitPose(const TrackerPose& pose);
+		// ServerDriver::RunFrame, publishes a change of tracking state in Event mode
+		void Refresh(int64_t nowNs);
+		// ServerDriver::RunFrame in Frame mode, once per display frame
+		void PublishFrame(int64_t photonNs, int64_t nowNs);
+		// any thread, after a settings reload
+		void SetBudgets(const TrackingBudgets& budgets);
+
+		std::string Report() const;
+
+	private:
+		// m_Pose changes and the PublishPose that follows are made under
+		// publish_mutex so SteamVR sees them in order whichever thread makes
+		// them. GetPose reads the published pose without it.
+		void publish_locked(TrackingState state, int64_t nowNs);
+
+		const uint32_t id;
+		const TrackerRole role;
+		const PublishMode publish_mode;
+		std::mutex publish_mutex;
+		int64_t last_pose_ns = 0;
+		TrackingMonitor tracking_monitor;
+		PosePredictor pose_predictor;
+		PublishPacing publish_pacing;
+		std::atomic<uint64_t> poses_received = 0;
+	};
+
+	// The TrackerDevices of the pose stream, created the first time a pose
+	// for their id arrives. Submit finds a device without a lock, the pose
+	// then goes in under that device's publish_mutex, which only its own
+	// Refresh and PublishFrame from RunFrame contend for. No lock is shared
+	// between trackers, so any number of them share the ingest thread of
+	// the headset.
+	class TrackerHub
+	{
+	public:
+		TrackerHub() = default;
+		~TrackerHub();
+		TrackerHub(const TrackerHub&) = delete;
+		TrackerHub& operator=(const TrackerHub&) = delete;
+
+		// trackerRoles as validated by HmdConfig, applies to devices created afterwards
+		void Configure(const std::string& roles, const TrackingBudgets& budgets, const TrackerPublishing& publishing);
+		// staleness budgets after a settings reload, for every device
+		void SetBudgets(const TrackingBudgets& budgets);
+
+		// any ingest thread, pose.device from 1 to kMaxTrackers
+		void Submit(const TrackerPose& pose);
+
+		// ServerDriver::RunFrame: adds the devices poses were seen for and ages the others
+		void RunFrame(int64_t nowNs);
+		// Frame mode, every tracker once per display frame
+		void PublishFrame(int64_t photonNs, int64_t nowNs);
+		void ProcessEvent(const vr::VREvent_t& event);
+
+		std::string Report() const;
+
+	private:
+		void add_device(uint32_t index);
+
+		std::atomic<TrackerDevice*> devices[kMaxTrackers] = {};
+		std::atomic<bool> wanted[kMaxTrackers] = {};
+		std::atomic<uint64_t> poses_before_added = 0;
+		std::atomic<uint64_t> poses_unknown_device = 0;
+
+		mutable std::mutex config_mutex;
+		TrackerRole roles[kMaxTrackers] = {};
+		TrackingBudgets budgets;
+		TrackerPublishing publishing;
+	};
+}
+
+#endif // RELATIVTY_TRACKERDEVICE_H
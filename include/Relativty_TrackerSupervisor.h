@@ -0,0 +1,97 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_TRACKERSUPERVISOR_H
+#define RELATIVTY_TRACKERSUPERVISOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Relativty_ThreadTuning.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+namespace Relativty {
+	struct TrackerSupervisorConfig {
+		std::string command; // run through cmd.exe / sh -c, empty disables the supervisor
+		int64_t stallTimeoutMs = 2000; // pose silence that counts as a hang
+		int64_t startupGraceMs = 15000; // time a fresh tracker gets before its first pose
+		int64_t backoffMinMs = 500;
+		int64_t backoffMaxMs = 30000;
+		int64_t healthyResetMs = 60000; // a run this long resets the backoff
+		uint64_t cpuMask = 0; // 0 leaves the affinity alone
+		SchedPriority priority = SchedPriority::Normal;
+	};
+
+	// Keeps the external tracker process running. A supervisor thread starts
+	// the configured command, restarts it with exponential backoff when it
+	// exits, and kills and restarts it when no pose arrives for stallTimeoutMs.
+	// The pose ingest path reports every pose through NotePose().
+	class TrackerSupervisor {
+	public:
+		TrackerSupervisor() = default;
+		TrackerSupervisor(const TrackerSupervisor&) = delete;
+		TrackerSupervisor& operator=(const TrackerSupervisor&) = delete;
+		~TrackerSupervisor() { Stop(); }
+
+		void Start(const TrackerSupervisorConfig& config);
+		void Stop(); // terminates the tracker and waits for it
+
+		// called from the ingest threads, lock free
+		void NotePose(int64_t nowNs) { this->lastPoseNs.store(nowNs, std::memory_order_relaxed); }
+
+		bool IsRunning() const { return this->running; }
+		uint64_t Launches() const { return this->launches; }
+		uint64_t Crashes() const { return this->crashes; }
+		uint64_t Stalls() const { return this->stalls; }
+
+	private:
+		void superviseThreaded();
+		bool launch();
+		bool hasExited(int& exitCode);
+		void terminate();
+		bool waitStop(int64_t ms); // true if Stop() was called meanwhile
+
+		TrackerSupervisorConfig config;
+		std::thread worker;
+		std::atomic<bool> running{ false };
+		std::mutex stopMutex;
+		std::condition_variable stopWake;
+
+		std::atomic<int64_t> lastPoseNs{ 0 };
+		std::atomic<uint64_t> launches{ 0 };
+		std::atomic<uint64_t> crashes{ 0 };
+		std::atomic<uint64_t> stalls{ 0 };
+
+#ifdef _WIN32
+		HANDLE process = NULL;
+		HANDLE job = NULL; // the tracker dies with the driver even if SteamVR is killed
+		bool jobLimits = false; // the job sets the priority class and affinity of the processes in it
+#else
+		pid_t pid = -1;
+#endif
+	};
+}
+
+#endif // RELATIVTY_TRACKERSUPERVISOR_H
@@ -0,0 +1,156 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_TRACKINGMONITOR_H
+#define RELATIVTY_TRACKINGMONITOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace Relativty {
+	enum class TrackingState : int {
+		Uninitialized, // nothing received yet since Activate
+		Tracking,      // camera poses are fresh
+		ImuOnly,       // camera stalled, rotation from the IMU, position frozen
+		Lost,          // neither is fresh, the pose is invalid
+		Disconnected,  // nothing at all for disconnectNs
+		Count
+	};
+
+	inline const char* TrackingStateName(TrackingState state) {
+		switch (state) {
+		case TrackingState::Uninitialized: return "uninitialized";
+		case TrackingState::Tracking: return "tracking";
+		case TrackingState::ImuOnly: return "imu only";
+		case TrackingState::Lost: return "lost";
+		case TrackingState::Disconnected: return "disconnected";
+		default: return "?";
+		}
+	}
+
+	struct TrackingBudgets {
+		int64_t cameraStaleNs = 150000000; // camera pose older than this: fall back to the IMU
+		int64_t imuStaleNs = 50000000;     // IMU sample older than this: tracking lost
+		int64_t disconnectNs = 3000000000; // nothing newer than this: device disconnected
+	};
+
+	// Decides the tracking state from the age of the newest camera pose and
+	// IMU sample and keeps how long was spent in each state. Updated by the
+	// pose thread only, the counters can be read from any thread.
+	class TrackingMonitor {
+	public:
+		void Reset(const TrackingBudgets& limits, int64_t nowNs) {
+			this->budgets = limits;
+			this->startNs = nowNs;
+			this->lastUpdateNs = nowNs;
+			this->state.store(TrackingState::Uninitialized, std::memory_order_relaxed);
+			for (int i = 0; i < kStates; i++) {
+				this->timeInStateNs[i].store(0, std::memory_order_relaxed);
+				this->entries[i].store(0, std::memory_order_relaxed);
+			}
+			this->entries[static_cast<int>(TrackingState::Uninitialized)].store(1, std::memory_order_relaxed);
+		}
+
+		// new budgets after a settings reload, the state and its times are kept;
+		// the thread that calls Update
+		void SetBudgets(const TrackingBudgets& limits) {
+			this->budgets = limits;
+		}
+
+		// lastCameraNs / lastImuNs are 0 while nothing was received
+		TrackingState Update(int64_t nowNs, int64_t lastCameraNs, int64_t lastImuNs) {
+			const TrackingState previous = this->State();
+			this->timeInStateNs[static_cast<int>(previous)].fetch_add(nowNs - this->lastUpdateNs, std::memory_order_relaxed);
+			this->lastUpdateNs = nowNs;
+
+			const TrackingState next = this->classify(nowNs, lastCameraNs, lastImuNs);
+			if (next != previous) {
+				this->entries[static_cast<int>(next)].fetch_add(1, std::memory_order_relaxed);
+				this->state.store(next, std::memory_order_relaxed);
+			}
+			return next;
+		}
+
+		TrackingState State() const {
+			return this->state.load(std::memory_order_relaxed);
+		}
+
+		// how long until the state changes if no new sample arrives, -1 if it will not
+		int64_t NextChangeInNs(int64_t nowNs, int64_t lastCameraNs, int64_t lastImuNs) const {
+			int64_t next = -1;
+			auto consider = [&](int64_t sampleNs, int64_t budgetNs) {
+				if (sampleNs == 0 || nowNs - sampleNs > budgetNs)
+					return;
+				const int64_t in = sampleNs + budgetNs - nowNs + 1;
+				next = next < 0 ? in : (std::min)(next, in);
+			};
+			consider(lastCameraNs, this->budgets.cameraStaleNs);
+			consider(lastImuNs, this->budgets.imuStaleNs);
+			consider((std::max)(lastCameraNs, lastImuNs), this->budgets.disconnectNs);
+			if (lastCameraNs == 0 && lastImuNs == 0)
+				consider(this->startNs, this->budgets.disconnectNs);
+			return next;
+		}
+
+		// time spent in a state so far, not counting the time since the last Update
+		int64_t TimeInStateNs(TrackingState which) const {
+			return this->timeInStateNs[static_cast<int>(which)].load(std::memory_order_relaxed);
+		}
+
+		uint64_t Entries(TrackingState which) const {
+			return this->entries[static_cast<int>(which)].load(std::memory_order_relaxed);
+		}
+
+		// "now tracking; tracking 812.4 s (3x), imu only 1.2 s (2x), ..."
+		std::string Report() const {
+			std::string report = std::string("now ") + TrackingStateName(this->State());
+			char part[96];
+			for (int i = 0; i < kStates; i++) {
+				const TrackingState which = static_cast<TrackingState>(i);
+				snprintf(part, sizeof(part), "%s %s %.1f s (%llux)", i == 0 ? ";" : ",", TrackingStateName(which),
+					static_cast<double>(this->TimeInStateNs(which)) / 1e9, static_cast<unsigned long long>(this->Entries(which)));
+				report += part;
+			}
+			return report;
+		}
+
+	private:
+		static constexpr int kStates = static_cast<int>(TrackingState::Count);
+
+		TrackingState classify(int64_t nowNs, int64_t lastCameraNs, int64_t lastImuNs) const {
+			if (lastCameraNs != 0 && nowNs - lastCameraNs <= this->budgets.cameraStaleNs)
+				return TrackingState::Tracking;
+			if (lastImuNs != 0 && nowNs - lastImuNs <= this->budgets.imuStaleNs)
+				return TrackingState::ImuOnly;
+			const int64_t newestNs = (std::max)(lastCameraNs, lastImuNs);
+			if (newestNs == 0)
+				return nowNs - this->startNs <= this->budgets.disconnectNs ? TrackingState::Uninitialized : TrackingState::Disconnected;
+			return nowNs - newestNs <= this->budgets.disconnectNs ? TrackingState::Lost : TrackingState::Disconnected;
+		}
+
+		TrackingBudgets budgets;
+		int64_t startNs = 0;
+		int64_t lastUpdateNs = 0;
+		std::atomic<TrackingState> state{ TrackingState::Uninitialized };
+		std::atomic<int64_t> timeInStateNs[kStates] = {};
+		std::atomic<uint64_t> entries[kStates] = {};
+	};
+}
+
+#endif // RELATIVTY_TRACKINGMONITOR_H
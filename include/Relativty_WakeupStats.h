@@ -0,0 +1,102 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_WAKEUPSTATS_H
+#define RELATIVTY_WAKEUPSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace Relativty {
+	// How late a thread ran after it became runnable: the time from a timed
+	// wait's deadline, or from the moment another thread signalled it, to the
+	// first instruction after the wait. Kept as a power of two histogram in
+	// microseconds so recording is a few relaxed atomic adds and the owning
+	// thread never blocks; any thread may read a report.
+	class WakeupStats {
+	public:
+		static constexpr int kBuckets = 24; // the last bucket collects everything from 2^23 us (~8 s) up
+
+		void Record(int64_t latencyNs) {
+			if (latencyNs < 0)
+				latencyNs = 0;
+			const uint64_t us = static_cast<uint64_t>(latencyNs) / 1000;
+			int bucket = 0;
+			while (bucket < kBuckets - 1 && (us >> (bucket + 1)) != 0)
+				bucket++;
+			this->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+			this->count.fetch_add(1, std::memory_order_relaxed);
+			this->totalNs.fetch_add(static_cast<uint64_t>(latencyNs), std::memory_order_relaxed);
+			uint64_t previous = this->maxNs.load(std::memory_order_relaxed);
+			while (static_cast<uint64_t>(latencyNs) > previous
+				&& !this->maxNs.compare_exchange_weak(previous, static_cast<uint64_t>(latencyNs), std::memory_order_relaxed)) {
+			}
+		}
+
+		uint64_t Count() const {
+			return this->count.load(std::memory_order_relaxed);
+		}
+
+		uint64_t MaxNs() const {
+			return this->maxNs.load(std::memory_order_relaxed);
+		}
+
+		// upper edge of the bucket holding the given fraction of the samples, in us
+		uint64_t PercentileUs(double fraction) const {
+			uint64_t counts[kBuckets];
+			uint64_t total = 0;
+			for (int i = 0; i < kBuckets; i++) {
+				counts[i] = this->buckets[i].load(std::memory_order_relaxed);
+				total += counts[i];
+			}
+			if (total == 0)
+				return 0;
+			const uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(total - 1)) + 1;
+			uint64_t seen = 0;
+			for (int i = 0; i < kBuckets; i++) {
+				seen += counts[i];
+				if (seen >= rank)
+					return uint64_t(1) << (i + 1);
+			}
+			return uint64_t(1) << kBuckets;
+		}
+
+		// "412 wakeups, mean 35 us, p50 < 32 us, p99 < 256 us, max 1203 us"
+		std::string Report() const {
+			const uint64_t samples = this->Count();
+			if (samples == 0)
+				return "no wakeups measured";
+			char line[160];
+			snprintf(line, sizeof(line), "%llu wakeups, mean %llu us, p50 < %llu us, p99 < %llu us, max %llu us",
+				static_cast<unsigned long long>(samples),
+				static_cast<unsigned long long>(this->totalNs.load(std::memory_order_relaxed) / samples / 1000),
+				static_cast<unsigned long long>(this->PercentileUs(0.5)),
+				static_cast<unsigned long long>(this->PercentileUs(0.99)),
+				static_cast<unsigned long long>(this->MaxNs() / 1000));
+			return line;
+		}
+
+	private:
+		std::atomic<uint64_t> buckets[kBuckets] = {};
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> totalNs{ 0 };
+		std::atomic<uint64_t> maxNs{ 0 };
+	};
+}
+
+#endif // RELATIVTY_WAKEUPSTATS_H
@@ -0,0 +1,356 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#ifndef RELATIVTY_WORKERS_H
+#define RELATIVTY_WORKERS_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Relativty_Clock.h"
+#include "Relativty_DatagramReceiver.h"
+#include "Relativty_ImuCodec.h"
+#include "Relativty_Log.h"
+#include "Relativty_PoseHistory.h"
+#include "Relativty_ReportClock.h"
+#include "Relativty_StopSignal.h"
+#include "Relativty_Trace.h"
+#include "Relativty_WakeupStats.h"
+#include "serial/serial.h"
+
+// The waiting and stopping half of HMDDriver's worker threads: how each one
+// blocks, what wakes it, and how Deactivate gets it out. HMDDriver supplies
+// what happens with the data, trackertest/shutdown_test.cpp and
+// bno055_serial_test.cpp run the same loops against a pty and a socket.
+namespace Relativty {
+	// Every wait below has a timeout of at most 100 ms and also ends on the
+	// StopSignal, so one Request() gets all workers out in parallel.
+	static constexpr uint32_t kHidWaitMs = 100;
+	static constexpr uint32_t kSerialWaitMs = 100;
+	static constexpr uint32_t kUdpWaitMs = 100;
+	static constexpr uint32_t kPoseWaitMs = 100;
+	static constexpr uint32_t kSettingsPollMs = 250;
+	// a worker that takes longer than this to stop is logged as stuck
+	static constexpr int64_t kShutdownBudgetMs = 500;
+
+	static constexpr size_t kHidReportLen = 64;
+	// input reports buffered by the HID layer, see HidD_SetNumInputBuffers in
+	// hid.c (hidraw queues as many), a drain that reaches it means reports
+	// were dropped
+	static constexpr uint32_t kHidInputQueueLen = 64;
+	// a serial line longer than this without a line ending is not our protocol
+	static constexpr size_t kSerialLineMax = 512;
+	// a datagram carries a line per device, "@16 " plus seven floats each
+	static constexpr int kDatagramLen = 2048;
+
+	// HID ingest counters, every wakeup drains all queued reports
+	struct HidIngestStats {
+		std::atomic<uint64_t> reportsRead{ 0 };
+		std::atomic<uint64_t> reportsLate{ 0 };    // already queued behind an earlier report when we woke up
+		std::atomic<uint64_t> queueOverflows{ 0 }; // wakeups that found the input queue full, reports were dropped
+		std::atomic<uint64_t> readErrors{ 0 };
+		std::atomic<uint32_t> queueDepthLast{ 0 };
+		std::atomic<uint32_t> queueDepthMax{ 0 };
+	};
+
+	// The IMU readers hand what they read to a sink with
+	//   void Sample(const ImuSample& sample)            a decoded sample
+	//   void Rejected(const uint8_t* data, size_t size) a line or frame the codec refused
+	//   bool TakeCommand(std::string& command)          text to send before the next serial read
+	//   void Lost()                                     the serial port threw, it is retried
+	// HID readers only use the first two.
+
+	// One wakeup of the HID reader: waits up to kHidWaitMs for the first
+	// report, then takes everything that queued up behind it without
+	// blocking, stamped by clock. read is hid_read_timeout for the device.
+	template<ImuFormat Format, typename Read, typename Sink>
+	void DrainHidReports(Read& read, const StopSignal& stop, WakeupStats& wakeup, ReportClock& clock, HidIngestStats& stats, Sink& sink) {
+		using Codec = ImuCodec<Format>;
+		uint8_t packet_buffer[kHidReportLen];
+		// decoded first and handed over once the drain knows how many queued up, see ReportClock
+		ImuSample samples[kHidInputQueueLen];
+		bool decoded[kHidInputQueueLen];
+		int64_t stamps[kHidInputQueueLen];
+		uint32_t depth = 0;
+		int64_t newestNs = 0;
+
+		const int64_t waitStartNs = MonotonicNowNs();
+		int result = read(packet_buffer, kHidReportLen, static_cast<int>(kHidWaitMs));
+		if (result == 0) {
+			// an idle device, the timeout measures how late this thread wakes up
+			wakeup.Record(MonotonicNowNs() - waitStartNs - kHidWaitMs * 1000000LL);
+			clock.Gap();
+		}
+		RELATIVTY_TRACE_SCOPE("hid_drain");
+		while (result > 0) {
+			newestNs = MonotonicNowNs();
+			samples[depth].hasAccel = false;
+			decoded[depth] = Codec::decode(packet_buffer, static_cast<size_t>(result), samples[depth].quat);
+			if (!decoded[depth])
+				sink.Rejected(packet_buffer, static_cast<size_t>(result));
+			depth++;
+			if (depth == kHidInputQueueLen)
+				break; // the rest is for the next call, which finds it without waiting
+
+			result = read(packet_buffer, kHidReportLen, 0);
+		}
+
+		clock.Stamp(newestNs, depth, stamps);
+		for (uint32_t i = 0; i < depth; i++) {
+			// a report queued before the period is known has no time, leave it out
+			if (!decoded[i] || stamps[i] < 0)
+				continue;
+			samples[i].timestampNs = stamps[i];
+			sink.Sample(samples[i]);
+		}
+
+		if (depth > 0) {
+			Trace::Counter("hid_queue_depth", depth);
+			stats.reportsRead += depth;
+			stats.reportsLate += depth - 1;
+			stats.queueDepthLast = depth;
+			if (depth > stats.queueDepthMax)
+				stats.queueDepthMax = depth;
+			if (depth >= kHidInputQueueLen)
+				stats.queueOverflows++;
+		}
+
+		if (result < 0) {
+			// an unplugged device fails on every call, don't flood the log with it
+			stats.readErrors++;
+			RELATIVTY_LOG_EVERY_MS(Warning, 1000, "Thread1: Issue while trying to read USB (%llu errors so far)",
+				static_cast<unsigned long long>(stats.readErrors.load()));
+			stop.WaitFor(kHidWaitMs);
+		}
+	}
+
+	// The HID IMU thread until stop.
+	template<ImuFormat Format, typename Read, typename Sink>
+	void ReadHidImu(Read& read, const StopSignal& stop, WakeupStats& wakeup, ReportClock& clock, HidIngestStats& stats, Sink& sink) {
+		while (!stop.Requested())
+			DrainHidReports<Format>(read, stop, wakeup, clock, stats, sink);
+	}
+
+	// Reads the serial IMU until stop or an exception from the port. Reads
+	// give up after the port's timeout (kSerialWaitMs, set at Activate), a
+	// read that returns nothing is an idle IMU and measures how late this
+	// thread wakes up.
+	template<ImuFormat Format, typename Sink>
+	void ReadSerialPackets(serial::Serial& port, const StopSignal& stop, WakeupStats& wakeup, Sink& sink) {
+		using Codec = ImuCodec<Format>;
+		ImuSample sample;
+		sample.hasAccel = false;
+		serial::Timestamp stamp;
+
+		if constexpr (Codec::transport == ImuTransport::SerialLine) {
+			std::string last_recv, partial, command;
+			while (port.isOpen() && !stop.Requested()) {
+				if (sink.TakeCommand(command))
+					port.write(command);
+				// a read that timed out returns the start of a line, the next one appends the rest
+				const size_t had = partial.size();
+				const int64_t waitStartNs = MonotonicNowNs();
+				port.readline(partial, stamp);
+				if (partial.size() == had)
+					wakeup.Record(MonotonicNowNs() - waitStartNs - kSerialWaitMs * 1000000LL);
+				if (partial.empty() || partial.back() != '\n') {
+					if (partial.size() > kSerialLineMax)
+						partial.clear(); // no line ending in sight, not our protocol
+					continue;
+				}
+				last_recv.swap(partial);
+				partial.clear();
+				if (last_recv.size() <= 3 || last_recv[0] == 0)
+					continue;
+				RELATIVTY_TRACE_SCOPE("serial_line");
+
+				const uint8_t* line = reinterpret_cast<const uint8_t*>(last_recv.data());
+				if (Codec::decode(line, last_recv.size(), sample.quat, sample.accel, sample.hasAccel)) {
+					sample.timestampNs = stamp.last_byte_ns;
+					sink.Sample(sample);
+				}
+				else {
+					sink.Rejected(line, last_recv.size()); // status lines too
+				}
+			}
+		}
+		else {
+			uint8_t frame[Codec::packetLen];
+			while (port.isOpen() && !stop.Requested()) {
+				// hunt for the two sync bytes, then read the rest of the frame in one go
+				const int64_t waitStartNs = MonotonicNowNs();
+				if (port.read(frame, 1) != 1) {
+					wakeup.Record(MonotonicNowNs() - waitStartNs - kSerialWaitMs * 1000000LL);
+					continue;
+				}
+				if (frame[0] != Codec::sync0)
+					continue;
+				if (port.read(frame + 1, 1) != 1 || frame[1] != Codec::sync1)
+					continue;
+				if (port.read(frame + 2, Codec::packetLen - 2, stamp) != Codec::packetLen - 2)
+					continue;
+				RELATIVTY_TRACE_SCOPE("serial_frame");
+
+				if (Codec::decode(frame, Codec::packetLen, sample.quat)) {
+					sample.timestampNs = stamp.last_byte_ns;
+					sink.Sample(sample);
+				}
+				else {
+					sink.Rejected(frame, Codec::packetLen);
+				}
+			}
+		}
+	}
+
+	// The serial IMU thread until stop. A port that throws (an unplugged
+	// adapter) or is closed is retried every kSerialWaitMs.
+	template<ImuFormat Format, typename Sink>
+	void ReadSerialImu(serial::Serial& port, const StopSignal& stop, WakeupStats& wakeup, Sink& sink) {
+		while (!stop.Requested()) {
+			try {
+				ReadSerialPackets<Format>(port, stop, wakeup, sink);
+				if (!port.isOpen())
+					stop.WaitFor(kSerialWaitMs);
+			}
+			catch (...) {
+				sink.Lost();
+				stop.WaitFor(kSerialWaitMs);
+			}
+		}
+	}
+
+	// The UDP server loop until stop: waits for a datagram or the stop, then
+	// hands it to handle(char* message, int length, sockaddr_in& from), NUL
+	// terminated. With an idle tracker the timeout measures how late this
+	// thread wakes up, under load the time each datagram waited in the socket
+	// where the network stack stamps them.
+	template<typename Handle>
+	void ServeDatagrams(SOCKET sock, const StopSignal& stop, WakeupStats& wakeup, Handle& handle) {
+		SocketWaiter waiter(sock, stop);
+		DatagramReceiver receiver(sock);
+		if (!receiver.Stamped())
+			RELATIVTY_LOG(Info, "UDP SERVER: no receive timestamps from the network stack, wakeup latency only measured while idle");
+		sockaddr_in client;
+		char message[kDatagramLen];
+		while (!stop.Requested()) {
+			RELATIVTY_LOG(Debug, "UDP SERVER: Waiting for data...");
+			const int64_t waitStartNs = MonotonicNowNs();
+			const SocketWait woken = waiter.Wait(kUdpWaitMs);
+			if (woken == SocketWait::Stopped)
+				break;
+			if (woken == SocketWait::Timeout) {
+				wakeup.Record(MonotonicNowNs() - waitStartNs - kUdpWaitMs * 1000000LL);
+				continue;
+			}
+
+			int64_t queued_ns;
+			const int message_len = receiver.Receive(message, kDatagramLen - 1, client, queued_ns);
+			if (message_len < 0) {
+#ifdef _WIN32
+				const int error = WSAGetLastError();
+				if (error != WSAEWOULDBLOCK)
+#else
+				const int error = errno;
+				if (error != EAGAIN && error != EWOULDBLOCK)
+#endif
+					RELATIVTY_LOG_EVERY_MS(Error, 1000, "UDP SERVER: recvfrom() failed (%d)", error);
+				continue;
+			}
+			message[message_len] = 0;
+			if (queued_ns >= 0)
+				wakeup.Record(queued_ns);
+			RELATIVTY_TRACE_SCOPE("udp_packet");
+			handle(message, message_len, client);
+		}
+	}
+
+	// Hands new poses to the pose thread. Post() from the ingest threads,
+	// Wait() on the pose thread until a pose, the stop or the timeout, and
+	// Take() to see whether a pose came. Deactivate calls Wake() after
+	// stop.Request() so a Wait() that checked the stop just before returns.
+	class PoseSignal {
+	public:
+		void Post() {
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->pending = true;
+			}
+			this->signal.notify_one();
+		}
+
+		// false once stop is requested
+		bool Wait(const StopSignal& stop, int64_t timeoutMs) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->signal.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+				[&] { return this->pending.load() || stop.Requested(); });
+			return !stop.Requested();
+		}
+
+		bool Take() {
+			return this->pending.exchange(false);
+		}
+
+		void Wake() {
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+			}
+			this->signal.notify_all();
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable signal;
+		std::atomic<bool> pending{ false };
+	};
+
+	// Polls path's modification time every kSettingsPollMs until stop and
+	// calls changed() when it moves; a change changed() returns false for
+	// (a file caught half way through a save) is looked at again next poll.
+	template<typename Changed>
+	void WatchFile(const std::string& path, const StopSignal& stop, Changed changed) {
+		std::error_code error;
+		std::filesystem::file_time_type seen = std::filesystem::last_write_time(path, error);
+		while (!stop.WaitFor(kSettingsPollMs)) {
+			const std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+			if (error || modified == seen)
+				continue;
+			if (changed())
+				seen = modified;
+		}
+	}
+
+	// Joins a worker after stop.Request() at stopNs, logs it if it took more
+	// than kShutdownBudgetMs. Returns how long after stopNs it was joined.
+	inline int64_t JoinWorker(std::thread& worker, const char* name, int64_t stopNs) {
+		if (!worker.joinable())
+			return 0;
+		worker.join();
+		const int64_t tookMs = (MonotonicNowNs() - stopNs) / 1000000;
+		if (tookMs > kShutdownBudgetMs)
+			RELATIVTY_LOG(Warning, "Thread0: %s took %lld ms to stop, budget is %lld ms", name, static_cast<long long>(tookMs),
+				static_cast<long long>(kShutdownBudgetMs));
+		return tookMs;
+	}
+}
+
+#endif // RELATIVTY_WORKERS_H
@@ -3,10 +3,16 @@
 #ifndef VR_DEVICE_BASE_H
 #define VR_DEVICE_BASE_H
 
+#include <thread>
+
 #include "driverlog.h"
 
 
 #include "Relativty_components.h"
+#include "Relativty_TrackingMonitor.h"
+#include "Relativty_PosePredictor.h"
+#include "Relativty_PoseHistory.h"
+#include "Relativty_Quaternion.h"
 
 namespace Relativty {
   inline vr::HmdQuaternion_t HmdQuaternion_Init(double w, double x, double y,
@@ -19,6 +25,10 @@ namespace Relativty {
     return quat;
   }
 
+  inline vr::HmdQuaternion_t ToHmdQuaternion(const Quatf &q) {
+    return HmdQuaternion_Init(q.w, q.x, q.y, q.z);
+  }
+
   static const char *const k_pch_Driver_Section = "driver_Relativty";
   static const char *const k_pch_Driver_PoseTimeOffset_Float = "PoseTimeOffset";
   static const char *const k_pch_Driver_UpdateUrl_String = "ManualUpdateURL";
@@ -29,6 +39,30 @@ namespace Relativty {
     return false; // true steamvr will signal an update, false not
   }
 
+  // result, poseIsValid and deviceIsConnected for a TrackingMonitor state, shared by every device that ages its poses
+  inline void SetPoseTrackingState(vr::DriverPose_t &pose, TrackingState state) {
+    switch (state) {
+      case TrackingState::Tracking: pose.result = vr::TrackingResult_Running_OK; break;
+      case TrackingState::ImuOnly: pose.result = vr::TrackingResult_Fallback_RotationOnly; break;
+      case TrackingState::Uninitialized: pose.result = vr::TrackingResult_Uninitialized; break;
+      default: pose.result = vr::TrackingResult_Running_OutOfRange; break;
+    }
+    pose.poseIsValid = state == TrackingState::Tracking || state == TrackingState::ImuOnly;
+    pose.deviceIsConnected = state != TrackingState::Disconnected;
+  }
+
+  // puts a pose predicted photonAheadNs into the future in place of the measured one. The offset tells
+  // SteamVR the pose already is for that time. Only the linear velocity is passed on, the angular one
+  // stays 0 so SteamVR's own extrapolation cannot turn the rotation a second time.
+  inline void ApplyPrediction(vr::DriverPose_t &pose, const PredictedPose &predicted, int64_t photonAheadNs) {
+    for (int i = 0; i < 3; i++) {
+      pose.vecPosition[i] = predicted.position[i];
+      pose.vecVelocity[i] = predicted.velocity[i];
+    }
+    pose.qRotation = ToHmdQuaternion(QuatLoad(predicted.rotation));
+    pose.poseTimeOffset += static_cast<double>(photonAheadNs) * 1e-9;
+  }
+
   // should be publicly inherited
   template<bool UseHaptics>
   class RelativtyDevice: public vr::ITrackedDeviceServerDriver {
@@ -62,6 +96,7 @@ namespace Relativty {
       m_Pose.vecPosition[1] = 0.;
       m_Pose.vecPosition[2] = 0.;
       m_Pose.willDriftInYaw = true;
+      m_PublishedPoses.push(m_Pose);
     }
 
     ~RelativtyDevice(){
@@ -106,6 +141,9 @@ namespace Relativty {
         m_ulPropertyContainer, vr::Prop_Firmware_ManualUpdateURL_String,
         m_sUpdateUrl.c_str());
 
+      // whatever the derived constructor made of m_Pose, until the first PublishPose
+      m_PublishedPoses.push(m_Pose);
+
       bool shouldUpdate = _checkForDeviceUpdates(m_sSerialNumber);
 
       if (shouldUpdate)
@@ -138,7 +176,17 @@ namespace Relativty {
         pchResponseBuffer[0] = 0;
     }
 
-    virtual vr::DriverPose_t GetPose() { return m_Pose; }
+    virtual vr::DriverPose_t GetPose() { return PublishedPose(); }
+
+    // the pose SteamVR was last handed, a consistent copy from any thread without locks
+    vr::DriverPose_t PublishedPose() const {
+      vr::DriverPose_t pose;
+      // only fails if PublishPose lapped all the slots meanwhile, give the
+      // publishing thread the core instead of spinning against it
+      while (!m_PublishedPoses.latest(pose))
+        std::this_thread::yield();
+      return pose;
+    }
 
     void *GetComponent(const char *pchComponentNameAndVersion) {
       // don't touch this
@@ -162,7 +210,7 @@ namespace Relativty {
           case vr::VREvent_Input_HapticVibration: {
             if (vrEvent.data.hapticVibration.componentHandle == m_compHaptic) {
                 // haptic!
-                DriverLog("%s haptic event: %f, %f, %f\n", m_sSerialNumber, vrEvent.data.hapticVibration.fDurationSeconds,
+                DriverLog("%s haptic event: %f, %f, %f\n", m_sSerialNumber.c_str(), vrEvent.data.hapticVibration.fDurationSeconds,
                           vrEvent.data.hapticVibration.fFrequency, vrEvent.data.hapticVibration.fAmplitude);
             }
           } break;
@@ -179,13 +227,22 @@ namespace Relativty {
     std::string m_sRenderModelPath; // path to the device's render model, should be populated in the constructor of the derived class
     std::string m_sBindPath; // path to the device's input bindings, should be populated in the constructor of the derived class
 
-    vr::DriverPose_t m_Pose; // device's pose, use this at runtime
+    vr::DriverPose_t m_Pose; // device's pose, use this at runtime, from one thread at a time
+
+    // hands pose to SteamVR and makes it what GetPose returns. Calls must not overlap, the buffer behind it has
+    // a single writer; readers copy the newest slot under its sequence counter and never see a torn pose.
+    void PublishPose(const vr::DriverPose_t &pose) {
+      m_PublishedPoses.push(pose);
+      if (m_unObjectId != vr::k_unTrackedDeviceIndexInvalid)
+        vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_unObjectId, pose, sizeof(vr::DriverPose_t));
+    }
 
     std::shared_ptr<RelativtyExtendedDisplayComponent> m_spExtDisplayComp;
 
   private:
     // openvr api stuff that i don't trust you with
     float m_fPoseTimeOffset; // time offset of the pose, set trough the config
+    SampleHistory<vr::DriverPose_t, 4> m_PublishedPoses; // written by PublishPose, read by GetPose
     vr::VRInputComponentHandle_t m_compHaptic; // haptics, used if UseHaptics is true
 
     std::string m_sUpdateUrl; // url to which steamvr will redirect if checkForDeviceUpdates returns true on Activate, set trough the config
@@ -3,6 +3,9 @@
 #ifndef RELATIVTY_COMPONENTS_H
 #define RELATIVTY_COMPONENTS_H
 
+#include "Relativty_Distortion.h"
+#include "Relativty_DistortionCache.h"
+
 namespace Relativty {
   static const char *const k_pch_ExtDisplay_Section = "Relativty_extendedDisplay";
   static const char *const k_pch_ExtDisplay_WindowX_Int32 = "windowX";
@@ -13,11 +16,22 @@ namespace Relativty {
   static const char *const k_pch_ExtDisplay_RenderHeight_Int32 = "renderHeight";
   static const char *const k_pch_ExtDisplay_DistortionK1_Float = "DistortionK1";
   static const char *const k_pch_ExtDisplay_DistortionK2_Float = "DistortionK2";
+  // per colour channel overrides, default to DistortionK1/K2 when missing
+  static const char *const k_pch_ExtDisplay_DistortionK1Red_Float = "DistortionK1Red";
+  static const char *const k_pch_ExtDisplay_DistortionK2Red_Float = "DistortionK2Red";
+  static const char *const k_pch_ExtDisplay_DistortionK1Green_Float = "DistortionK1Green";
+  static const char *const k_pch_ExtDisplay_DistortionK2Green_Float = "DistortionK2Green";
+  static const char *const k_pch_ExtDisplay_DistortionK1Blue_Float = "DistortionK1Blue";
+  static const char *const k_pch_ExtDisplay_DistortionK2Blue_Float = "DistortionK2Blue";
   static const char *const k_pch_ExtDisplay_ZoomWidth_Float = "ZoomWidth";
   static const char *const k_pch_ExtDisplay_ZoomHeight_Float = "ZoomHeight";
   static const char *const k_pch_ExtDisplay_EyeGapOffset_Int = "EyeGapOffsetPx";
   static const char *const k_pch_ExtDisplay_IsDisplayReal_Bool = "IsDisplayRealDisplay";
   static const char *const k_pch_ExtDisplay_IsDisplayOnDesktop_bool = "IsDisplayOnDesktop";
+  // sample the lens model into a grid once, cached on disk, instead of
+  // evaluating it per query. The trig free model is exact and cheaper than the
+  // bilinear lookup on x86, so this only pays off for costlier lens models
+  static const char *const k_pch_ExtDisplay_UseDistortionLut_Bool = "UseDistortionLut";
 
 
   static const bool g_bRelativtyExtDisplayComp_doLensStuff = true;
@@ -64,15 +78,50 @@ namespace Relativty {
       m_bIsDisplayOnDesktop = vr::VRSettings()->GetBool(k_pch_ExtDisplay_Section,
                                                  k_pch_ExtDisplay_IsDisplayOnDesktop_bool);
 
+      // off when missing
+      m_bUseDistortionLut = vr::VRSettings()->GetBool(k_pch_ExtDisplay_Section,
+                                                 k_pch_ExtDisplay_UseDistortionLut_Bool);
+
+      const char *const channelKeys[DistortionChannel_Count][2] = {
+          {k_pch_ExtDisplay_DistortionK1Red_Float, k_pch_ExtDisplay_DistortionK2Red_Float},
+          {k_pch_ExtDisplay_DistortionK1Green_Float, k_pch_ExtDisplay_DistortionK2Green_Float},
+          {k_pch_ExtDisplay_DistortionK1Blue_Float, k_pch_ExtDisplay_DistortionK2Blue_Float}};
+      for (int c = 0; c < DistortionChannel_Count; c++) {
+        RadialDistortionModel &channel = m_DistortionModel.channels[c];
+        channel.k1 = GetFloatOr(channelKeys[c][0], m_fDistortionK1);
+        channel.k2 = GetFloatOr(channelKeys[c][1], m_fDistortionK2);
+        channel.zoomWidth = m_fZoomWidth;
+        channel.zoomHeight = m_fZoomHeight;
+      }
+      if (g_bRelativtyExtDisplayComp_doLensStuff && m_bUseDistortionLut) {
+        // the grid only depends on the lens settings, reuse the one the last
+        // start left behind when they are unchanged
+        const std::string cachePath = DistortionCache::DefaultPath();
+        const uint64_t settingsHash = DistortionCache::HashSettings(
+            m_DistortionModel, DistortionLut::k_unDefaultGridSize);
+        if (m_DistortionCache.Open(cachePath, settingsHash, DistortionLut::k_unDefaultGridSize)) {
+          m_DistortionLut.Attach(m_DistortionModel, DistortionLut::k_unDefaultGridSize,
+                                 m_DistortionCache.Nodes());
+        } else {
+          m_DistortionLut.Build(m_DistortionModel);
+          DistortionCache::Write(cachePath, settingsHash, m_DistortionLut);
+        }
+      }
+
 
       #ifdef DRIVERLOG_H
       DriverLog("Extended display component created\n");
       DriverLog("distortion koeffs: k1=%f, k2=%f\n", m_fDistortionK1, m_fDistortionK2);
+      DriverLog("distortion koeffs red: k1=%f, k2=%f, green: k1=%f, k2=%f, blue: k1=%f, k2=%f\n",
+                m_DistortionModel.channels[DistortionChannel_Red].k1, m_DistortionModel.channels[DistortionChannel_Red].k2,
+                m_DistortionModel.channels[DistortionChannel_Green].k1, m_DistortionModel.channels[DistortionChannel_Green].k2,
+                m_DistortionModel.channels[DistortionChannel_Blue].k1, m_DistortionModel.channels[DistortionChannel_Blue].k2);
       DriverLog("render target: %dx%d\n", m_nRenderWidth, m_nRenderHeight);
       DriverLog("window target: %dx%d\n", m_nWindowWidth, m_nWindowHeight);
       DriverLog("eye gap offset: %d", m_iEyeGapOff);
       DriverLog("is display real: %d", (int)m_bIsDisplayReal);
       DriverLog("is display on desktop: %d", (int)m_bIsDisplayOnDesktop);
+      DriverLog("distortion lookup table: %d", (int)m_bUseDistortionLut);
       #else
       vr::VRDriverLog()->Log("Extended display component created\n");
       #endif
@@ -123,27 +172,20 @@ namespace Relativty {
       vr::DistortionCoordinates_t coordinates;
 
       if constexpr(g_bRelativtyExtDisplayComp_doLensStuff) {
-        // Distortion for lens implementation from
-        // https://github.com/HelenXR/openvr_survivor/blob/master/src/head_mount_display_device.cc
-        float hX;
-        float hY;
-        double rr;
-        double r2;
-        double theta;
-
-        rr = sqrt((fU - 0.5f) * (fU - 0.5f) + (fV - 0.5f) * (fV - 0.5f));
-        r2 = rr * (1 + m_fDistortionK1 * (rr * rr) +
-                   m_fDistortionK2 * (rr * rr * rr * rr));
-        theta = atan2(fU - 0.5f, fV - 0.5f);
-        hX = float(sin(theta) * r2) * m_fZoomWidth;
-        hY = float(cos(theta) * r2) * m_fZoomHeight;
-
-        coordinates.rfBlue[0] = hX + 0.5f;
-        coordinates.rfBlue[1] = hY + 0.5f;
-        coordinates.rfGreen[0] = hX + 0.5f;
-        coordinates.rfGreen[1] = hY + 0.5f;
-        coordinates.rfRed[0] = hX + 0.5f;
-        coordinates.rfRed[1] = hY + 0.5f;
+        float out[DistortionLut::k_unFloatsPerNode];
+
+        if (m_bUseDistortionLut) {
+          m_DistortionLut.Lookup(fU, fV, out);
+        } else {
+          m_DistortionModel.Evaluate(fU, fV, out);
+        }
+
+        coordinates.rfRed[0] = out[0];
+        coordinates.rfRed[1] = out[1];
+        coordinates.rfGreen[0] = out[2];
+        coordinates.rfGreen[1] = out[3];
+        coordinates.rfBlue[0] = out[4];
+        coordinates.rfBlue[1] = out[5];
       } else {
         coordinates.rfBlue[0] = fU;
         coordinates.rfBlue[1] = fV;
@@ -159,6 +201,13 @@ namespace Relativty {
     const char* GetComponentNameAndVersion() {return vr::IVRDisplayComponent_Version;}
 
   private:
+    static float GetFloatOr(const char *pchSettingsKey, float fDefault) {
+      vr::EVRSettingsError error = vr::VRSettingsError_None;
+      const float value = vr::VRSettings()->GetFloat(k_pch_ExtDisplay_Section,
+                                                     pchSettingsKey, &error);
+      return error == vr::VRSettingsError_None ? value : fDefault;
+    }
+
     int32_t m_nWindowX;
     int32_t m_nWindowY;
     int32_t m_nWindowWidth;
@@ -169,12 +218,17 @@ namespace Relativty {
 
     bool m_bIsDisplayReal;
     bool m_bIsDisplayOnDesktop;
+    bool m_bUseDistortionLut;
 
 
     float m_fDistortionK1;
     float m_fDistortionK2;
     float m_fZoomWidth;
     float m_fZoomHeight;
+
+    ChromaticDistortionModel m_DistortionModel;
+    DistortionCache m_DistortionCache; // must outlive m_DistortionLut when attached
+    DistortionLut m_DistortionLut;
   };
 
 }
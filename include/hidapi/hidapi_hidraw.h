@@ -0,0 +1,52 @@
+/*******************************************************
+ HIDAPI - Multi-Platform library for
+ communication with HID devices.
+
+ Linux hidraw specific extensions to hidapi.h.
+
+ At the discretion of the user of this library,
+ this software may be licensed under the terms of the
+ GNU General Public License v3, a BSD-Style license, or the
+ original HIDAPI license as outlined in the LICENSE.txt,
+ LICENSE-gpl3.txt, LICENSE-bsd.txt, and LICENSE-orig.txt
+ files located at the root of the source distribution.
+ These files may also be found in the public source
+ code repository located at:
+        https://github.com/libusb/hidapi .
+********************************************************/
+
+/** @file
+ * @defgroup API hidapi API
+ */
+
+#ifndef HIDAPI_HIDRAW_H__
+#define HIDAPI_HIDRAW_H__
+
+#include "hidapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+		/** @brief Get the hidraw file descriptor of an open device.
+
+			The descriptor is always in O_NONBLOCK mode and becomes
+			readable (POLLIN) whenever an input report is queued, so it
+			can be added to a poll()/epoll set alongside other
+			descriptors, e.g. a wake-up eventfd. Reports are then fetched
+			with hid_read_timeout(dev, data, length, 0). Do not close the
+			descriptor, it is owned by @p dev.
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+
+			@returns
+				The file descriptor, or -1 if @p dev is NULL.
+		*/
+		int HID_API_EXPORT_CALL hid_hidraw_get_fd(hid_device *dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
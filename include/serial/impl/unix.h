@@ -57,9 +57,9 @@ class MillisecondTimer {
 public:
   MillisecondTimer(const uint32_t millis);         
   int64_t remaining();
+  static timespec timespec_now();
 
 private:
-  static timespec timespec_now();
   timespec expiry;
 };
 
@@ -176,6 +176,18 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  void
+  setTimestamping (bool enabled);
+
+  bool
+  getTimestamping () const;
+
+  int64_t
+  getLastReadTime () const;
+
+  uint32_t
+  getByteTime () const;
+
   void
   readLock ();
 
@@ -203,6 +215,9 @@ private:
   unsigned long baudrate_;    // Baudrate
   uint32_t byte_time_ns_;     // Nanoseconds to transmit/receive a single byte
 
+  bool timestamping_;         // Sample the clock after reads returning data
+  int64_t last_read_ns_;      // Monotonic time of the last read returning data
+
   parity_t parity_;           // Parity
   bytesize_t bytesize_;       // Size of the bytes
   stopbits_t stopbits_;       // Stop Bits
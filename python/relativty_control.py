@@ -0,0 +1,132 @@
+# Client for the driver's control channel ("controlChannel" in the
+# Relativty_hmd section). Sends one command and prints the reply:
+#
+#   python relativty_control.py recenter
+#   python relativty_control.py record start C:/poses.txt
+#   python relativty_control.py stats
+#
+# On Windows, --hotkeys instead watches the keyboard and sends recenter on R
+# and calibrate_imu on Ctrl+Shift+I, the keys the driver used to poll itself.
+# The exit status is 0 when the driver answered ok.
+
+import argparse
+import os
+import socket
+import sys
+import time
+
+DEFAULT_NAME = 'relativty_control'
+TIMEOUT_S = 2.0
+
+
+def endpoint_path(name):
+    # same rules as ControlEndpointPath in the driver
+    if os.name == 'nt':
+        return '\\\\.\\pipe\\' + name
+    if '/' in name:
+        return name
+    return os.path.join(os.environ.get('XDG_RUNTIME_DIR') or '/tmp', name + '.sock')
+
+
+def send(name, command):
+    """Returns (ok, output lines) for one command."""
+    request = (command.strip() + '\n').encode()
+    path = endpoint_path(name)
+    if os.name == 'nt':
+        deadline = time.monotonic() + TIMEOUT_S
+        while True:
+            try:
+                pipe = open(path, 'r+b', buffering=0)
+                break
+            except OSError:
+                # the single pipe instance is busy with another client
+                if time.monotonic() > deadline:
+                    raise
+                time.sleep(0.05)
+        with pipe:
+            pipe.write(request)
+            received = b''
+            while not received.endswith(b'\n') or not _status(received):
+                chunk = pipe.read(4096)
+                if not chunk:
+                    break
+                received += chunk
+    else:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+            client.settimeout(TIMEOUT_S)
+            client.connect(path)
+            client.sendall(request)
+            received = b''
+            while True:
+                chunk = client.recv(4096)
+                if not chunk:
+                    break
+                received += chunk
+    lines = received.decode(errors='replace').splitlines()
+    if not lines:
+        return False, ['error: no reply']
+    return lines[-1] == 'ok', lines[:-1] if lines[-1] == 'ok' else lines
+
+
+def _status(received):
+    last = received.decode(errors='replace').splitlines()[-1]
+    return last == 'ok' or last.startswith('error: ')
+
+
+def hotkeys(name):
+    import ctypes
+    user32 = ctypes.windll.user32
+    VK_SHIFT, VK_CONTROL, VK_R, VK_I = 0x10, 0x11, 0x52, 0x49
+
+    def down(key):
+        return user32.GetAsyncKeyState(key) & 0x8000 != 0
+
+    held = set()
+    print('R recenters, Ctrl+Shift+I asks for the IMU calibration status, Ctrl+C quits')
+    while True:
+        chords = {
+            'recenter': down(VK_R) and not down(VK_CONTROL),
+            'calibrate_imu': down(VK_I) and down(VK_CONTROL) and down(VK_SHIFT),
+        }
+        for command, pressed in chords.items():
+            # once per press, not for as long as the key is held
+            if pressed and command not in held:
+                try:
+                    ok, lines = send(name, command)
+                    print('\n'.join(lines))
+                except OSError as error:
+                    print('%s: %s' % (command, error))
+                held.add(command)
+            elif not pressed:
+                held.discard(command)
+        time.sleep(0.02)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Relativty driver control channel client')
+    parser.add_argument('--name', default=DEFAULT_NAME, help='controlChannel of the driver')
+    parser.add_argument('--hotkeys', action='store_true', help='send commands on key presses (Windows)')
+    parser.add_argument('command', nargs='*', help='help, recenter, calibrate_imu, stats, record start <path>, record stop')
+    args = parser.parse_args()
+
+    if args.hotkeys:
+        if os.name != 'nt':
+            parser.error('--hotkeys needs Windows')
+        try:
+            hotkeys(args.name)
+        except KeyboardInterrupt:
+            return 0
+    if not args.command:
+        parser.error('no command given')
+
+    try:
+        ok, lines = send(args.name, ' '.join(args.command))
+    except OSError as error:
+        print('cannot reach the driver at %s: %s' % (endpoint_path(args.name), error), file=sys.stderr)
+        return 2
+    print('\n'.join(lines))
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
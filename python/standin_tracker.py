@@ -0,0 +1,72 @@
+# Stand-in for the inside-out tracker, for checking the embedded Python pose
+# path without a camera. Point the driver at it with
+#
+#   "PyPath" : "<repo>/python",
+#   "PyModule" : "standin_tracker",
+#
+# in the Relativty_hmd section. The headset then circles the origin at head
+# height, turning to face along its path, with trackers 1 and 2 held at hand
+# height to its left and right ("trackerRoles" : "1:left_hand, 2:right_hand"
+# makes them controllers).
+
+import math
+import time
+from array import array
+
+import relativty
+
+RATE_HZ = 90.0
+RADIUS_M = 0.5
+PERIOD_S = 8.0
+HEIGHT_M = 1.6
+BATCH = 4  # every other second, deliver poses in batches through the buffer interface
+HANDS = ((1, -0.25), (2, 0.25))  # tracker id, sideways offset from the head in m
+HAND_DROP_M = 0.5
+
+
+def pose_at(t):
+    angle = 2.0 * math.pi * t / PERIOD_S
+    position = (RADIUS_M * math.cos(angle), HEIGHT_M, RADIUS_M * math.sin(angle))
+    half = -0.5 * angle  # yaw about +y
+    rotation = (math.cos(half), 0.0, math.sin(half), 0.0)
+    return position, rotation
+
+
+def hand_at(t, offset):
+    (x, y, z), rotation = pose_at(t)
+    angle = 2.0 * math.pi * t / PERIOD_S
+    # sideways is along the radius, the headset faces along the circle
+    return (x + offset * math.cos(angle), y - HAND_DROP_M, z + offset * math.sin(angle)), rotation
+
+
+class standin_tracker:
+    def __init__(self):
+        self.submitted = 0
+
+    def run(self):
+        start = relativty.now_ns()
+        period_ns = int(1e9 / RATE_HZ)
+        next_ns = start
+        batch = array('d')
+        while relativty.running():
+            now = relativty.now_ns()
+            position, rotation = pose_at((now - start) * 1e-9)
+
+            if int((now - start) * 1e-9) % 2:
+                batch.extend((now,) + position + rotation)
+                if len(batch) == 8 * BATCH:
+                    self.submitted += relativty.submit_poses(batch)
+                    batch = array('d')
+            else:
+                relativty.submit_pose(now, position, rotation)
+                self.submitted += 1
+            for device, offset in HANDS:
+                hand_position, hand_rotation = hand_at((now - start) * 1e-9, offset)
+                relativty.submit_pose(now, hand_position, hand_rotation, device)
+
+            next_ns += period_ns
+            delay = next_ns - relativty.now_ns()
+            if delay > 0:
+                time.sleep(delay * 1e-9)
+            else:
+                next_ns = relativty.now_ns()
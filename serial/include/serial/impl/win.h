@@ -165,6 +165,18 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  void
+  setTimestamping (bool enabled);
+
+  bool
+  getTimestamping () const;
+
+  int64_t
+  getLastReadTime () const;
+
+  uint32_t
+  getByteTime () const;
+
   void
   readLock ();
 
@@ -188,6 +200,10 @@ private:
 
   Timeout timeout_;           // Timeout for read operations
   unsigned long baudrate_;    // Baudrate
+  uint32_t byte_time_ns_;     // Nanoseconds to transmit/receive a single byte
+
+  bool timestamping_;         // Sample the clock after reads returning data
+  int64_t last_read_ns_;      // QueryPerformanceCounter time of the last read
 
   parity_t parity_;           // Parity
   bytesize_t bytesize_;       // Size of the bytes
@@ -141,6 +141,25 @@ struct Timeout {
   {}
 };
 
+/*!
+ * Structure describing when a line or frame was received by the host. Times
+ * are in nanoseconds on the host monotonic clock (CLOCK_MONOTONIC on Unix,
+ * QueryPerformanceCounter on Windows). Both fields are zero when timestamping
+ * is disabled or nothing was read.
+ *
+ * \see Serial::setTimestamping
+ */
+struct Timestamp {
+  /*! Time at which the read returning the last byte of the line completed. */
+  int64_t last_byte_ns;
+  /*! Estimate of when the first byte arrived, derived from the last byte
+   *  time minus the transmission time of the line at the current baudrate.
+   */
+  int64_t first_byte_ns;
+
+  Timestamp () : last_byte_ns(0), first_byte_ns(0) {}
+};
+
 /*!
  * Class that provides a portable serial port interface.
  */
@@ -305,6 +324,26 @@ public:
   std::string
   read (size_t size = 1);
 
+  /*! Read a fixed size frame from the serial port into a given buffer and
+   *  report when it was received.
+   *
+   * Behaves like Serial::read, additionally filling in the host receive
+   * time of the frame when timestamping is enabled.
+   *
+   * \param buffer An uint8_t array of at least the requested size.
+   * \param size A size_t defining how many bytes to be read.
+   * \param stamp A serial::Timestamp reference receiving the receive time.
+   *
+   * \return A size_t representing the number of bytes read.
+   *
+   * \see Serial::setTimestamping
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   */
+  size_t
+  read (uint8_t *buffer, size_t size, Timestamp &stamp);
+
   /*! Reads in a line or until a given delimiter has been processed.
    *
    * Reads from the serial port until a single line has been read.
@@ -321,6 +360,27 @@ public:
   size_t
   readline (std::string &buffer, size_t size = 65536, std::string eol = "\n");
 
+  /*! Reads in a line and reports when it was received.
+   *
+   * Behaves like Serial::readline, additionally filling in the host receive
+   * time of the line when timestamping is enabled.
+   *
+   * \param buffer A std::string reference used to store the data.
+   * \param stamp A serial::Timestamp reference receiving the receive time.
+   * \param size A maximum length of a line, defaults to 65536 (2^16)
+   * \param eol A string to match against for the EOL.
+   *
+   * \return A size_t representing the number of bytes read.
+   *
+   * \see Serial::setTimestamping
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   */
+  size_t
+  readline (std::string &buffer, Timestamp &stamp, size_t size = 65536,
+            std::string eol = "\n");
+
   /*! Reads in a line or until a given delimiter has been processed.
    *
    * Reads from the serial port until a single line has been read.
@@ -353,6 +413,25 @@ public:
   std::vector<std::string>
   readlines (size_t size = 65536, std::string eol = "\n");
 
+  /*! Reads in multiple lines until the serial port times out and reports
+   *  when each of them was received.
+   *
+   * \param stamps A std::vector of serial::Timestamp that is filled with one
+   * entry per returned line.
+   * \param size A maximum length of combined lines, defaults to 65536 (2^16)
+   * \param eol A string to match against for the EOL.
+   *
+   * \return A vector<string> containing the lines.
+   *
+   * \see Serial::setTimestamping
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   */
+  std::vector<std::string>
+  readlines (std::vector<Timestamp> &stamps, size_t size = 65536,
+             std::string eol = "\n");
+
   /*! Write a string to the serial port.
    *
    * \param data A const reference containing the data to be written
@@ -586,6 +665,25 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  /*! Enables or disables host receive timestamps.
+   *
+   * When enabled every read that returns data samples the host monotonic
+   * clock, which is then reported through the serial::Timestamp overloads
+   * of read, readline and readlines. Disabled by default so that plain reads
+   * do not pay for the clock query.
+   *
+   * \param enabled true to capture receive timestamps.
+   */
+  void
+  setTimestamping (bool enabled);
+
+  /*! Gets whether host receive timestamps are captured.
+   *
+   * \see Serial::setTimestamping
+   */
+  bool
+  getTimestamping () const;
+
   /*! Flush the input and output buffers */
   void
   flush ();
@@ -663,6 +761,16 @@ private:
   // Read common function
   size_t
   read_ (uint8_t *buffer, size_t size);
+  // Readline common function
+  size_t
+  readline_ (std::string &buffer, size_t size, const std::string &eol);
+  // Readlines common function, stamps may be NULL
+  std::vector<std::string>
+  readlines_ (size_t size, const std::string &eol,
+              std::vector<Timestamp> *stamps);
+  // Timestamp of the last length bytes read
+  Timestamp
+  stamp_ (size_t length) const;
   // Write common function
   size_t
   write_ (const uint8_t *data, size_t length);
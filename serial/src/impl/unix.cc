@@ -96,6 +96,12 @@ MillisecondTimer::timespec_now ()
   return time;
 }
 
+static int64_t
+timespec_to_ns (const timespec &time)
+{
+  return static_cast<int64_t> (time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
 timespec
 timespec_from_ms (const uint32_t millis)
 {
@@ -110,8 +116,9 @@ Serial::SerialImpl::SerialImpl (const string &port, unsigned long baudrate,
                                 parity_t parity, stopbits_t stopbits,
                                 flowcontrol_t flowcontrol)
   : port_ (port), fd_ (-1), is_open_ (false), xonxoff_ (false), rtscts_ (false),
-    baudrate_ (baudrate), parity_ (parity),
-    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol)
+    baudrate_ (baudrate), timestamping_ (false), last_read_ns_ (0),
+    parity_ (parity), bytesize_ (bytesize), stopbits_ (stopbits),
+    flowcontrol_ (flowcontrol)
 {
   pthread_mutex_init(&this->read_mutex, NULL);
   pthread_mutex_init(&this->write_mutex, NULL);
@@ -553,6 +560,9 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
     ssize_t bytes_read_now = ::read (fd_, buf, size);
     if (bytes_read_now > 0) {
       bytes_read = bytes_read_now;
+      if (timestamping_) {
+        last_read_ns_ = timespec_to_ns (MillisecondTimer::timespec_now ());
+      }
     }
   }
 
@@ -590,6 +600,9 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
         throw SerialException ("device reports readiness to read but "
                                "returned no data (device disconnected?)");
       }
+      if (timestamping_) {
+        last_read_ns_ = timespec_to_ns (MillisecondTimer::timespec_now ());
+      }
       // Update bytes_read
       bytes_read += static_cast<size_t> (bytes_read_now);
       // If bytes_read == size then we have read everything we need
@@ -806,6 +819,31 @@ Serial::SerialImpl::getFlowcontrol () const
   return flowcontrol_;
 }
 
+void
+Serial::SerialImpl::setTimestamping (bool enabled)
+{
+  timestamping_ = enabled;
+  last_read_ns_ = 0;
+}
+
+bool
+Serial::SerialImpl::getTimestamping () const
+{
+  return timestamping_;
+}
+
+int64_t
+Serial::SerialImpl::getLastReadTime () const
+{
+  return last_read_ns_;
+}
+
+uint32_t
+Serial::SerialImpl::getByteTime () const
+{
+  return byte_time_ns_;
+}
+
 void
 Serial::SerialImpl::flush ()
 {
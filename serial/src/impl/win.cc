@@ -31,12 +31,25 @@ _prefix_port_if_needed(const wstring &input)
   return input;
 }
 
+inline int64_t
+_performance_counter_ns ()
+{
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  // Split the conversion to avoid overflowing the multiplication
+  int64_t seconds = counter.QuadPart / frequency.QuadPart;
+  int64_t remainder = counter.QuadPart % frequency.QuadPart;
+  return seconds * 1000000000 + (remainder * 1000000000) / frequency.QuadPart;
+}
+
 Serial::SerialImpl::SerialImpl (const string &port, unsigned long baudrate,
                                 bytesize_t bytesize,
                                 parity_t parity, stopbits_t stopbits,
                                 flowcontrol_t flowcontrol)
   : port_ (port.begin(), port.end()), fd_ (INVALID_HANDLE_VALUE), is_open_ (false),
-    baudrate_ (baudrate), parity_ (parity),
+    baudrate_ (baudrate), byte_time_ns_ (0), timestamping_ (false),
+    last_read_ns_ (0), parity_ (parity),
     bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol)
 {
   if (port_.empty () == false)
@@ -272,6 +285,16 @@ Serial::SerialImpl::reconfigurePort ()
   if (!SetCommTimeouts(fd_, &timeouts)) {
     THROW (IOException, "Error setting timeouts.");
   }
+
+  // Update byte_time_ based on the new settings.
+  uint32_t bit_time_ns = static_cast<uint32_t> (1e9 / baudrate_);
+  byte_time_ns_ = bit_time_ns * (1 + bytesize_ + parity_ + stopbits_);
+
+  // Compensate for the stopbits_one_point_five enum being equal to int 3,
+  // and not 1.5.
+  if (stopbits_ == stopbits_one_point_five) {
+    byte_time_ns_ += static_cast<uint32_t> ((1.5 - stopbits_one_point_five) * bit_time_ns);
+  }
 }
 
 void
@@ -339,6 +362,9 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
     ss << "Error while reading from the serial port: " << GetLastError();
     THROW (IOException, ss.str().c_str());
   }
+  if (timestamping_ && bytes_read > 0) {
+    last_read_ns_ = _performance_counter_ns ();
+  }
   return (size_t) (bytes_read);
 }
 
@@ -459,6 +485,31 @@ Serial::SerialImpl::getFlowcontrol () const
   return flowcontrol_;
 }
 
+void
+Serial::SerialImpl::setTimestamping (bool enabled)
+{
+  timestamping_ = enabled;
+  last_read_ns_ = 0;
+}
+
+bool
+Serial::SerialImpl::getTimestamping () const
+{
+  return timestamping_;
+}
+
+int64_t
+Serial::SerialImpl::getLastReadTime () const
+{
+  return last_read_ns_;
+}
+
+uint32_t
+Serial::SerialImpl::getByteTime () const
+{
+  return byte_time_ns_;
+}
+
 void
 Serial::SerialImpl::flush ()
 {
@@ -25,6 +25,7 @@ using std::size_t;
 using std::string;
 
 using serial::Serial;
+using serial::Timestamp;
 using serial::SerialException;
 using serial::IOException;
 using serial::bytesize_t;
@@ -174,9 +175,17 @@ Serial::read (size_t size)
 }
 
 size_t
-Serial::readline (string &buffer, size_t size, string eol)
+Serial::read (uint8_t *buffer, size_t size, Timestamp &stamp)
 {
   ScopedReadLock lock(this->pimpl_);
+  size_t bytes_read = this->pimpl_->read (buffer, size);
+  stamp = this->stamp_ (bytes_read);
+  return bytes_read;
+}
+
+size_t
+Serial::readline_ (string &buffer, size_t size, const string &eol)
+{
   size_t eol_len = eol.length ();
   uint8_t *buffer_ = static_cast<uint8_t*>
                               (alloca (size * sizeof (uint8_t)));
@@ -201,6 +210,22 @@ Serial::readline (string &buffer, size_t size, string eol)
   return read_so_far;
 }
 
+size_t
+Serial::readline (string &buffer, size_t size, string eol)
+{
+  ScopedReadLock lock(this->pimpl_);
+  return this->readline_ (buffer, size, eol);
+}
+
+size_t
+Serial::readline (string &buffer, Timestamp &stamp, size_t size, string eol)
+{
+  ScopedReadLock lock(this->pimpl_);
+  size_t read_so_far = this->readline_ (buffer, size, eol);
+  stamp = this->stamp_ (read_so_far);
+  return read_so_far;
+}
+
 string
 Serial::readline (size_t size, string eol)
 {
@@ -210,9 +235,8 @@ Serial::readline (size_t size, string eol)
 }
 
 vector<string>
-Serial::readlines (size_t size, string eol)
+Serial::readlines_ (size_t size, const string &eol, vector<Timestamp> *stamps)
 {
-  ScopedReadLock lock(this->pimpl_);
   std::vector<std::string> lines;
   size_t eol_len = eol.length ();
   uint8_t *buffer_ = static_cast<uint8_t*>
@@ -227,6 +251,7 @@ Serial::readlines (size_t size, string eol)
         lines.push_back (
           string (reinterpret_cast<const char*> (buffer_ + start_of_line),
             read_so_far - start_of_line));
+        if (stamps) stamps->push_back (stamp_ (read_so_far - start_of_line));
       }
       break; // Timeout occured on reading 1 byte
     }
@@ -237,6 +262,7 @@ Serial::readlines (size_t size, string eol)
       lines.push_back(
         string(reinterpret_cast<const char*> (buffer_ + start_of_line),
           read_so_far - start_of_line));
+      if (stamps) stamps->push_back (stamp_ (read_so_far - start_of_line));
       start_of_line = read_so_far;
     }
     if (read_so_far == size) {
@@ -244,6 +270,7 @@ Serial::readlines (size_t size, string eol)
         lines.push_back(
           string(reinterpret_cast<const char*> (buffer_ + start_of_line),
             read_so_far - start_of_line));
+        if (stamps) stamps->push_back (stamp_ (read_so_far - start_of_line));
       }
       break; // Reached the maximum read length
     }
@@ -251,6 +278,36 @@ Serial::readlines (size_t size, string eol)
   return lines;
 }
 
+vector<string>
+Serial::readlines (size_t size, string eol)
+{
+  ScopedReadLock lock(this->pimpl_);
+  return this->readlines_ (size, eol, NULL);
+}
+
+vector<string>
+Serial::readlines (vector<Timestamp> &stamps, size_t size, string eol)
+{
+  ScopedReadLock lock(this->pimpl_);
+  stamps.clear ();
+  return this->readlines_ (size, eol, &stamps);
+}
+
+serial::Timestamp
+Serial::stamp_ (size_t length) const
+{
+  Timestamp stamp;
+  if (length == 0 || !pimpl_->getTimestamping ()) {
+    return stamp;
+  }
+  stamp.last_byte_ns = pimpl_->getLastReadTime ();
+  // The last byte finished arriving when the read returned, so the first
+  // byte started length byte times earlier.
+  stamp.first_byte_ns = stamp.last_byte_ns
+    - static_cast<int64_t> (pimpl_->getByteTime ()) * static_cast<int64_t> (length);
+  return stamp;
+}
+
 size_t
 Serial::write (const string &data)
 {
@@ -367,6 +424,19 @@ Serial::getFlowcontrol () const
   return pimpl_->getFlowcontrol ();
 }
 
+void
+Serial::setTimestamping (bool enabled)
+{
+  ScopedReadLock lock(this->pimpl_);
+  pimpl_->setTimestamping (enabled);
+}
+
+bool
+Serial::getTimestamping () const
+{
+  return pimpl_->getTimestamping ();
+}
+
 void Serial::flush ()
 {
   ScopedReadLock rlock(this->pimpl_);
@@ -0,0 +1,185 @@
+/* Throughput and latency benchmarks for serial::Serial over a pty pair.
+ *
+ * The traffic mimics the IMU firmware: short ASCII quaternion lines, one
+ * after the other. Besides lines per second every benchmark reports the
+ * number of read syscalls issued per line (from /proc/self/io) and the
+ * latency benchmark reports p50/p90/p99 in microseconds.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "serial/serial.h"
+#include "../pty_pair.h"
+
+#include <time.h>
+
+using serial::Serial;
+using serial::Timeout;
+
+namespace {
+
+const std::string kImuLine = "0.9998,0.0123,-0.0040,0.0150\n";
+
+int64_t
+now_ns ()
+{
+  timespec time;
+  clock_gettime (CLOCK_MONOTONIC, &time);
+  return static_cast<int64_t> (time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// Number of read-like syscalls issued by the process so far.
+int64_t
+read_syscalls ()
+{
+  std::ifstream io ("/proc/self/io");
+  std::string key;
+  int64_t value;
+  while (io >> key >> value) {
+    if (key == "syscr:")
+      return value;
+  }
+  return 0;
+}
+
+double
+percentile (std::vector<int64_t> &samples, double p)
+{
+  if (samples.empty ())
+    return 0;
+  size_t index = static_cast<size_t> (p * (samples.size () - 1));
+  std::nth_element (samples.begin (), samples.begin () + index, samples.end ());
+  return static_cast<double> (samples[index]);
+}
+
+// Streams state.max_iterations IMU lines while the benchmark reads them back.
+void
+BM_Readline (benchmark::State &state)
+{
+  PtyPair pty;
+  Serial port (pty.slaveName (), 115200, Timeout::simpleTimeout (250));
+  const int64_t lines = static_cast<int64_t> (state.max_iterations);
+  std::thread writer ([&pty, lines]() {
+    for (int64_t i = 0; i < lines; i++)
+      pty.writeAll (kImuLine);
+  });
+
+  std::string line;
+  int64_t syscalls_before = read_syscalls ();
+  for (auto _ : state) {
+    line.clear ();
+    port.readline (line);
+    benchmark::DoNotOptimize (line);
+  }
+  int64_t syscalls = read_syscalls () - syscalls_before;
+  writer.join ();
+
+  state.SetItemsProcessed (state.iterations ());
+  state.SetBytesProcessed (state.iterations () * kImuLine.size ());
+  state.counters["read_syscalls_per_line"] =
+    static_cast<double> (syscalls) / state.iterations ();
+}
+BENCHMARK (BM_Readline)->UseRealTime ();
+
+// Same traffic as BM_Readline but with receive timestamps enabled.
+void
+BM_ReadlineTimestamped (benchmark::State &state)
+{
+  PtyPair pty;
+  Serial port (pty.slaveName (), 115200, Timeout::simpleTimeout (250));
+  port.setTimestamping (true);
+  const int64_t lines = static_cast<int64_t> (state.max_iterations);
+  std::thread writer ([&pty, lines]() {
+    for (int64_t i = 0; i < lines; i++)
+      pty.writeAll (kImuLine);
+  });
+
+  std::string line;
+  serial::Timestamp stamp;
+  for (auto _ : state) {
+    line.clear ();
+    port.readline (line, stamp);
+    benchmark::DoNotOptimize (stamp);
+  }
+  writer.join ();
+
+  state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (BM_ReadlineTimestamped)->UseRealTime ();
+
+// Bursts of state.range(0) lines drained with a single readlines call.
+void
+BM_Readlines (benchmark::State &state)
+{
+  PtyPair pty;
+  Serial port (pty.slaveName (), 115200, Timeout (1, 0, 0, 250, 0));
+  const int burst = static_cast<int> (state.range (0));
+  std::string data;
+  for (int i = 0; i < burst; i++)
+    data += kImuLine;
+
+  int64_t lines = 0;
+  int64_t syscalls = 0;
+  for (auto _ : state) {
+    pty.writeAll (data);
+    int64_t syscalls_before = read_syscalls ();
+    std::vector<std::string> got = port.readlines (data.size ());
+    syscalls += read_syscalls () - syscalls_before;
+    lines += static_cast<int64_t> (got.size ());
+  }
+
+  state.SetItemsProcessed (lines);
+  state.counters["read_syscalls_per_line"] =
+    lines ? static_cast<double> (syscalls) / lines : 0;
+}
+BENCHMARK (BM_Readlines)->Arg (8)->Arg (64)->UseRealTime ();
+
+// Write one line, wait for it on the other end: end to end latency.
+void
+BM_ReadlineLatency (benchmark::State &state)
+{
+  PtyPair pty;
+  Serial port (pty.slaveName (), 115200, Timeout::simpleTimeout (250));
+  std::vector<int64_t> samples;
+  samples.reserve (static_cast<size_t> (state.max_iterations));
+
+  std::string line;
+  for (auto _ : state) {
+    line.clear ();
+    int64_t start = now_ns ();
+    pty.writeAll (kImuLine);
+    port.readline (line);
+    samples.push_back (now_ns () - start);
+  }
+
+  state.SetItemsProcessed (state.iterations ());
+  state.counters["p50_us"] = percentile (samples, 0.50) / 1e3;
+  state.counters["p90_us"] = percentile (samples, 0.90) / 1e3;
+  state.counters["p99_us"] = percentile (samples, 0.99) / 1e3;
+}
+BENCHMARK (BM_ReadlineLatency)->UseRealTime ();
+
+// Write path: the driver sends "C\n" to the firmware to start calibration.
+void
+BM_Write (benchmark::State &state)
+{
+  PtyPair pty;
+  Serial port (pty.slaveName (), 115200, Timeout::simpleTimeout (250));
+  char sink[256];
+  for (auto _ : state) {
+    port.write (kImuLine);
+    pty.readSome (sink, sizeof (sink), 250);
+  }
+  state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (BM_Write)->UseRealTime ();
+
+}  // namespace
+
+BENCHMARK_MAIN ();
@@ -0,0 +1,105 @@
+/* Pseudo-terminal helper shared by the pty based tests and benchmarks.
+ *
+ * Opens a master with posix_openpt and exposes the name of the slave side,
+ * which serial::Serial can open like any other tty. Whatever is written to
+ * the master shows up as received data on the serial port and vice versa,
+ * so no loop back hardware is needed.
+ */
+
+#ifndef SERIAL_TESTS_PTY_PAIR_H
+#define SERIAL_TESTS_PTY_PAIR_H
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <string>
+
+class PtyPair {
+public:
+  PtyPair () : master_fd_(-1) {
+    master_fd_ = posix_openpt (O_RDWR | O_NOCTTY);
+    if (master_fd_ == -1 || grantpt (master_fd_) == -1
+        || unlockpt (master_fd_) == -1) {
+      perror ("posix_openpt");
+      exit (127);
+    }
+    char name[128];
+    if (ptsname_r (master_fd_, name, sizeof (name)) != 0) {
+      perror ("ptsname_r");
+      exit (127);
+    }
+    slave_name_ = name;
+  }
+
+  ~PtyPair () {
+    close ();
+  }
+
+  /*! Closes the master side early, the slave then reads as a device that
+   *  was unplugged. Safe to call more than once.
+   */
+  void close () {
+    if (master_fd_ != -1)
+      ::close (master_fd_);
+    master_fd_ = -1;
+  }
+
+  /*! File descriptor of the master side, the "device" end of the link. */
+  int master () const { return master_fd_; }
+
+  /*! Path of the slave side, to be opened by serial::Serial. */
+  const std::string &slaveName () const { return slave_name_; }
+
+  /*! Writes the whole buffer to the master side, retrying short writes. */
+  bool writeAll (const void *data, size_t length) {
+    const char *p = static_cast<const char*> (data);
+    while (length > 0) {
+      ssize_t n = ::write (master_fd_, p, length);
+      if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+          pollfd pfd = { master_fd_, POLLOUT, 0 };
+          poll (&pfd, 1, 100);
+          continue;
+        }
+        return false;
+      }
+      p += n;
+      length -= static_cast<size_t> (n);
+    }
+    return true;
+  }
+
+  bool writeAll (const std::string &data) {
+    return writeAll (data.data (), data.size ());
+  }
+
+  /*! Reads up to size bytes from the master side, waiting at most
+   *  timeout_ms for the first byte. Returns the number of bytes read.
+   */
+  size_t readSome (void *buffer, size_t size, int timeout_ms) {
+    pollfd pfd = { master_fd_, POLLIN, 0 };
+    if (poll (&pfd, 1, timeout_ms) <= 0)
+      return 0;
+    ssize_t n = ::read (master_fd_, buffer, size);
+    return n > 0 ? static_cast<size_t> (n) : 0;
+  }
+
+private:
+  // Disable copy constructors
+  PtyPair (const PtyPair&);
+  PtyPair& operator= (const PtyPair&);
+
+  int master_fd_;
+  std::string slave_name_;
+};
+
+#endif // defined(__linux__)
+
+#endif // SERIAL_TESTS_PTY_PAIR_H
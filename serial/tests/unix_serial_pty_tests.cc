@@ -0,0 +1,161 @@
+/* Loop back tests for serial::Serial over a pseudo-terminal pair.
+ *
+ * Unlike unix_serial_tests.cc these drive the line oriented API the driver
+ * uses for the IMU (readline/readlines) and need nothing but a Linux box.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "serial/serial.h"
+#include "pty_pair.h"
+
+#include <time.h>
+
+using namespace serial;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+int64_t
+now_ms ()
+{
+  timespec time;
+  clock_gettime (CLOCK_MONOTONIC, &time);
+  return static_cast<int64_t> (time.tv_sec) * 1000 + time.tv_nsec / 1000000;
+}
+
+class SerialPtyTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    port = new Serial(pty.slaveName(), 115200, Timeout::simpleTimeout(100));
+    ASSERT_TRUE(port->isOpen());
+  }
+
+  virtual void TearDown() {
+    port->close();
+    delete port;
+  }
+
+  PtyPair pty;
+  Serial * port;
+};
+
+TEST_F(SerialPtyTests, readWorks) {
+  pty.writeAll("abcdef");
+  EXPECT_EQ(port->read(3), string("abc"));
+  EXPECT_EQ(port->read(3), string("def"));
+}
+
+TEST_F(SerialPtyTests, readIntoVector) {
+  pty.writeAll("\x01\x02\x03", 3);
+  vector<uint8_t> buffer;
+  EXPECT_EQ(port->read(buffer, 3), 3u);
+  ASSERT_EQ(buffer.size(), 3u);
+  EXPECT_EQ(buffer[2], 3);
+}
+
+TEST_F(SerialPtyTests, readlineWorks) {
+  pty.writeAll("0.9998,0.0123,-0.0040,0.0150\nC:3,3,3,3\n");
+  EXPECT_EQ(port->readline(), string("0.9998,0.0123,-0.0040,0.0150\n"));
+  EXPECT_EQ(port->readline(), string("C:3,3,3,3\n"));
+}
+
+TEST_F(SerialPtyTests, readlineCustomEol) {
+  pty.writeAll("a\r\nb\r\n");
+  EXPECT_EQ(port->readline(65536, "\r\n"), string("a\r\n"));
+  EXPECT_EQ(port->readline(65536, "\r\n"), string("b\r\n"));
+}
+
+TEST_F(SerialPtyTests, readlineStopsAtMaxSize) {
+  pty.writeAll("abcdefgh\n");
+  EXPECT_EQ(port->readline(4), string("abcd"));
+  EXPECT_EQ(port->readline(), string("efgh\n"));
+}
+
+TEST_F(SerialPtyTests, readlineTimesOutOnPartialLine) {
+  pty.writeAll("1.0,0.0");
+  int64_t start = now_ms();
+  string line = port->readline();
+  int64_t elapsed = now_ms() - start;
+  EXPECT_EQ(line, string("1.0,0.0"));
+  EXPECT_GE(elapsed, 90);
+  EXPECT_LT(elapsed, 500);
+}
+
+TEST_F(SerialPtyTests, readTimesOutWhenIdle) {
+  int64_t start = now_ms();
+  EXPECT_EQ(port->read(16), string(""));
+  EXPECT_GE(now_ms() - start, 90);
+}
+
+TEST_F(SerialPtyTests, readlinesReturnsAllPendingLines) {
+  pty.writeAll("a\nbb\nccc\ndd");
+  vector<string> lines = port->readlines();
+  ASSERT_EQ(lines.size(), 4u);
+  EXPECT_EQ(lines[0], string("a\n"));
+  EXPECT_EQ(lines[2], string("ccc\n"));
+  EXPECT_EQ(lines[3], string("dd"));
+}
+
+TEST_F(SerialPtyTests, writeWorks) {
+  EXPECT_EQ(port->write("C\n"), 2u);
+  char buffer[8];
+  EXPECT_EQ(pty.readSome(buffer, sizeof(buffer), 250), 2u);
+  EXPECT_EQ(string(buffer, 2), string("C\n"));
+}
+
+TEST_F(SerialPtyTests, streamedLinesArriveInOrder) {
+  const int count = 2000;
+  std::thread writer([this, count]() {
+    for (int i = 0; i < count; i++) {
+      pty.writeAll(std::to_string(i) + ",0.0000,0.0000,0.0000\n");
+    }
+  });
+  int received = 0;
+  for (int i = 0; i < count; i++) {
+    string line = port->readline();
+    if (line.empty())
+      break;
+    EXPECT_EQ(line, std::to_string(i) + ",0.0000,0.0000,0.0000\n");
+    received++;
+  }
+  writer.join();
+  EXPECT_EQ(received, count);
+}
+
+TEST_F(SerialPtyTests, stampedLinesCarryTheirOwnArrival) {
+  port->setTimestamping(true);
+  std::thread writer([this]() {
+    pty.writeAll("0.9998,0.0123,-0.0040,0.0150\n");
+    struct timespec gap = { 0, 50 * 1000000 };
+    nanosleep(&gap, NULL);
+    pty.writeAll("0.9997,0.0124,-0.0041,0.0151\n");
+  });
+  string first, second;
+  Timestamp first_stamp, second_stamp;
+  port->readline(first, first_stamp);
+  port->readline(second, second_stamp);
+  writer.join();
+  EXPECT_EQ(second, string("0.9997,0.0124,-0.0041,0.0151\n"));
+  EXPECT_GT(first_stamp.last_byte_ns, 0);
+  EXPECT_LT(first_stamp.first_byte_ns, first_stamp.last_byte_ns);
+  // the second line's stamp is its own read, not the first one's
+  EXPECT_GE(second_stamp.last_byte_ns - first_stamp.last_byte_ns, 40 * 1000000LL);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  try {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+  } catch (std::exception &e) {
+    std::cerr << "Unhandled Exception: " << e.what() << std::endl;
+  }
+  return 1;
+}
@@ -103,6 +103,58 @@ TEST_F(SerialTests, partialRead) {
   EXPECT_EQ(r, string("abc\n"));
 }
 
+TEST_F(SerialTests, readlineTimestampDisabled) {
+  write(master_fd, "abc\n", 4);
+  string r;
+  Timestamp stamp;
+  port1->readline(r, stamp);
+  EXPECT_EQ(r, string("abc\n"));
+  EXPECT_EQ(stamp.last_byte_ns, 0);
+  EXPECT_EQ(stamp.first_byte_ns, 0);
+}
+
+TEST_F(SerialTests, readlineTimestampWorks) {
+  port1->setTimestamping(true);
+  timespec before;
+  clock_gettime(CLOCK_MONOTONIC, &before);
+  write(master_fd, "1.0,0.0,0.0,0.0\n", 16);
+  string r;
+  Timestamp stamp;
+  port1->readline(r, stamp);
+  timespec after;
+  clock_gettime(CLOCK_MONOTONIC, &after);
+
+  EXPECT_EQ(r, string("1.0,0.0,0.0,0.0\n"));
+  EXPECT_GE(stamp.last_byte_ns, before.tv_sec * 1000000000LL + before.tv_nsec);
+  EXPECT_LE(stamp.last_byte_ns, after.tv_sec * 1000000000LL + after.tv_nsec);
+  // 16 bytes of 10 bits each at 115200 baud take about 1.39ms on the wire.
+  EXPECT_NEAR(stamp.last_byte_ns - stamp.first_byte_ns, 16 * 10 * 1e9 / 115200, 2000);
+}
+
+TEST_F(SerialTests, readlinesTimestampPerLine) {
+  port1->setTimestamping(true);
+  write(master_fd, "a\nbb\nccc", 8);
+  std::vector<Timestamp> stamps;
+  std::vector<string> lines = port1->readlines(stamps);
+  ASSERT_EQ(lines.size(), 3u);
+  ASSERT_EQ(stamps.size(), 3u);
+  EXPECT_EQ(lines[2], string("ccc"));
+  EXPECT_LE(stamps[0].last_byte_ns, stamps[1].last_byte_ns);
+  EXPECT_LE(stamps[1].last_byte_ns, stamps[2].last_byte_ns);
+  EXPECT_LT(stamps[2].first_byte_ns, stamps[2].last_byte_ns);
+}
+
+TEST_F(SerialTests, readFrameTimestampWorks) {
+  port1->setTimestamping(true);
+  write(master_fd, "\x01\x02\x03\x04", 4);
+  uint8_t frame[4];
+  Timestamp stamp;
+  EXPECT_EQ(port1->read(frame, 4, stamp), 4u);
+  EXPECT_EQ(frame[3], 4);
+  EXPECT_GT(stamp.last_byte_ns, 0);
+  EXPECT_LT(stamp.first_byte_ns, stamp.last_byte_ns);
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
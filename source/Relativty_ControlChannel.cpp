@@ -0,0 +1,285 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Relativty_ControlChannel.h"
+#include "Relativty_Clock.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	int64_t remainingMs(int64_t deadlineNs) {
+		const int64_t left = (deadlineNs - Relativty::MonotonicNowNs()) / 1000000;
+		return left > 0 ? left : 0;
+	}
+
+	// the command up to the first line end, without surrounding blanks
+	std::string trimCommand(const std::string& received) {
+		std::string command = received.substr(0, received.find('\n'));
+		const size_t first = command.find_first_not_of(" \t\r");
+		if (first == std::string::npos)
+			return std::string();
+		return command.substr(first, command.find_last_not_of(" \t\r") - first + 1);
+	}
+
+#ifdef _WIN32
+	// one overlapped read or write on the pipe, given up on Stop or at the deadline
+	bool pipeIo(HANDLE pipe, OVERLAPPED& overlapped, bool write, void* data, DWORD length, DWORD& done,
+		const Relativty::StopSignal& stop, int64_t deadlineNs) {
+		done = 0;
+		ResetEvent(overlapped.hEvent);
+		const BOOL finished = write ? WriteFile(pipe, data, length, nullptr, &overlapped) : ReadFile(pipe, data, length, nullptr, &overlapped);
+		if (!finished && GetLastError() != ERROR_IO_PENDING)
+			return false;
+		const HANDLE events[2] = { stop.Handle(), overlapped.hEvent };
+		if (WaitForMultipleObjects(2, events, FALSE, static_cast<DWORD>(remainingMs(deadlineNs))) != WAIT_OBJECT_0 + 1) {
+			CancelIo(pipe);
+			GetOverlappedResult(pipe, &overlapped, &done, TRUE);
+			return false;
+		}
+		return GetOverlappedResult(pipe, &overlapped, &done, FALSE) != FALSE;
+	}
+#else
+	// false once the client hung up, Stop was called or the deadline passed
+	bool waitClient(int client, short events, const Relativty::StopSignal& stop, int64_t deadlineNs) {
+		pollfd fds[2] = { { stop.Fd(), POLLIN, 0 }, { client, events, 0 } };
+		const int ready = poll(fds, 2, static_cast<int>(remainingMs(deadlineNs)));
+		return ready > 0 && !stop.Requested() && (fds[1].revents & (events | POLLHUP | POLLERR)) != 0;
+	}
+#endif
+}
+
+std::string Relativty::ControlEndpointPath(const std::string& name) {
+#ifdef _WIN32
+	return "\\\\.\\pipe\\" + name;
+#else
+	if (name.find('/') != std::string::npos)
+		return name;
+	const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+	return std::string(runtimeDir != nullptr && runtimeDir[0] != 0 ? runtimeDir : "/tmp") + "/" + name + ".sock";
+#endif
+}
+
+bool Relativty::ControlChannel::Start(const std::string& name, const ControlSink& sink, std::string& problem) {
+	if (this->worker.joinable()) {
+		problem = "already listening on " + this->path;
+		return false;
+	}
+	this->sink = sink;
+	this->path = ControlEndpointPath(name);
+	this->stop.Reset();
+
+#ifdef _WIN32
+	// FIRST_PIPE_INSTANCE fails if anyone else owns the name, a second driver or a process squatting on it
+	this->pipe = CreateNamedPipeA(this->path.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 4096, 4096, 0, nullptr);
+	if (this->pipe == INVALID_HANDLE_VALUE) {
+		problem = "cannot create " + this->path + " (error " + std::to_string(GetLastError()) + "), is another driver running?";
+		return false;
+	}
+#else
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (this->path.size() >= sizeof(address.sun_path)) {
+		problem = this->path + " is too long for a Unix socket";
+		return false;
+	}
+	this->path.copy(address.sun_path, this->path.size());
+
+	// a socket file left behind by a driver that crashed is replaced, a live one is not
+	const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	const bool taken = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+	if (probe >= 0)
+		close(probe);
+	if (taken) {
+		problem = "another driver is listening on " + this->path;
+		return false;
+	}
+	// bind() creates the socket file under the process umask, which is not
+	// ours to change while other vrserver threads create files. So it is
+	// bound in a private 0700 directory next to path, where nobody else can
+	// connect, narrowed to 0600 there and only then renamed into place, which
+	// also replaces a stale socket file in one step.
+	const size_t slash = this->path.rfind('/');
+	std::string privateDir = (slash == std::string::npos ? std::string(".") : this->path.substr(0, slash)) + "/.relativty-XXXXXX";
+	const std::string privateName = "/control.sock";
+	if (privateDir.size() + privateName.size() >= sizeof(address.sun_path)) {
+		problem = this->path + " is too long for a Unix socket";
+		return false;
+	}
+	if (mkdtemp(&privateDir[0]) == nullptr) {
+		problem = "cannot create a private directory next to " + this->path + ": " + std::strerror(errno);
+		return false;
+	}
+	const std::string privatePath = privateDir + privateName;
+	sockaddr_un privateAddress = {};
+	privateAddress.sun_family = AF_UNIX;
+	privatePath.copy(privateAddress.sun_path, privatePath.size());
+
+	this->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	const bool listening = this->listener >= 0
+		&& bind(this->listener, reinterpret_cast<sockaddr*>(&privateAddress), sizeof(privateAddress)) == 0
+		&& chmod(privatePath.c_str(), S_IRUSR | S_IWUSR) == 0
+		&& listen(this->listener, 4) == 0
+		&& rename(privatePath.c_str(), this->path.c_str()) == 0;
+	const int error = errno;
+	unlink(privatePath.c_str()); // only still there if a step failed
+	rmdir(privateDir.c_str());
+	if (!listening) {
+		problem = "cannot listen on " + this->path + ": " + std::strerror(error);
+		if (this->listener >= 0)
+			close(this->listener);
+		this->listener = -1;
+		return false;
+	}
+#endif
+
+	this->worker = std::thread(&ControlChannel::serveThreaded, this);
+	return true;
+}
+
+void Relativty::ControlChannel::Stop() {
+	if (!this->worker.joinable())
+		return;
+	this->stop.Request();
+	this->worker.join();
+#ifdef _WIN32
+	CloseHandle(this->pipe);
+	this->pipe = INVALID_HANDLE_VALUE;
+#else
+	close(this->listener);
+	this->listener = -1;
+	unlink(this->path.c_str());
+#endif
+}
+
+// received holds the command line, or kMaxCommandLen bytes without a line end
+void Relativty::ControlChannel::serveClient(const std::string& received, std::string& reply) {
+	this->commands++;
+	if (received.size() > kMaxCommandLen && received.find('\n') > kMaxCommandLen) {
+		reply = "error: command longer than " + std::to_string(kMaxCommandLen) + " bytes\n";
+		return;
+	}
+	const std::string command = trimCommand(received);
+	std::string output;
+	if (command.empty()) {
+		reply = "error: empty command\n";
+		return;
+	}
+	if (!this->sink.handle(this->sink.context, command, output)) {
+		reply = "error: " + output + "\n";
+		return;
+	}
+	if (!output.empty() && output.back() != '\n')
+		output += '\n';
+	reply = output + "ok\n";
+}
+
+void Relativty::ControlChannel::serveThreaded() {
+	char buffer[kMaxCommandLen + 1];
+#ifdef _WIN32
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	while (!this->stop.Requested()) {
+		ResetEvent(overlapped.hEvent);
+		if (!ConnectNamedPipe(this->pipe, &overlapped)) {
+			const DWORD error = GetLastError();
+			if (error == ERROR_IO_PENDING) {
+				const HANDLE events[2] = { this->stop.Handle(), overlapped.hEvent };
+				DWORD ignored;
+				if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+					CancelIo(this->pipe);
+					GetOverlappedResult(this->pipe, &overlapped, &ignored, TRUE);
+					break;
+				}
+				if (!GetOverlappedResult(this->pipe, &overlapped, &ignored, FALSE)) {
+					DisconnectNamedPipe(this->pipe);
+					continue;
+				}
+			}
+			else if (error != ERROR_PIPE_CONNECTED) {
+				this->stop.WaitFor(100);
+				continue;
+			}
+		}
+
+		const int64_t deadlineNs = MonotonicNowNs() + kClientTimeoutMs * 1000000LL;
+		std::string received;
+		DWORD got = 0;
+		while (received.find('\n') == std::string::npos && received.size() <= kMaxCommandLen
+			&& pipeIo(this->pipe, overlapped, false, buffer, sizeof(buffer), got, this->stop, deadlineNs) && got > 0)
+			received.append(buffer, got);
+		if (!received.empty() && !this->stop.Requested()) {
+			std::string reply;
+			this->serveClient(received, reply);
+			DWORD written;
+			pipeIo(this->pipe, overlapped, true, &reply[0], static_cast<DWORD>(reply.size()), written, this->stop, deadlineNs);
+			// disconnecting drops what the client has not read yet, wait for it to close its end
+			while (pipeIo(this->pipe, overlapped, false, buffer, sizeof(buffer), got, this->stop, deadlineNs)) {}
+		}
+		DisconnectNamedPipe(this->pipe);
+	}
+	CloseHandle(overlapped.hEvent);
+#else
+	while (!this->stop.Requested()) {
+		pollfd fds[2] = { { this->stop.Fd(), POLLIN, 0 }, { this->listener, POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+			this->stop.WaitFor(100);
+			continue;
+		}
+		if (this->stop.Requested())
+			break;
+		if (!(fds[1].revents & POLLIN))
+			continue;
+		const int client = accept4(this->listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (client < 0)
+			continue;
+
+		// a client that connects and says nothing holds the channel for kClientTimeoutMs at most
+		const int64_t deadlineNs = MonotonicNowNs() + kClientTimeoutMs * 1000000LL;
+		std::string received;
+		bool ended = false; // the client shut down its side, what came so far is the command
+		while (received.find('\n') == std::string::npos && received.size() <= kMaxCommandLen && waitClient(client, POLLIN, this->stop, deadlineNs)) {
+			const ssize_t got = recv(client, buffer, sizeof(buffer), 0);
+			if (got <= 0) {
+				ended = got == 0;
+				break;
+			}
+			received.append(buffer, static_cast<size_t>(got));
+		}
+		if ((received.find('\n') != std::string::npos || ended || received.size() > kMaxCommandLen) && !received.empty() && !this->stop.Requested()) {
+			std::string reply;
+			this->serveClient(received, reply);
+			size_t sent = 0;
+			while (sent < reply.size() && waitClient(client, POLLOUT, this->stop, deadlineNs)) {
+				const ssize_t wrote = send(client, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+				if (wrote <= 0)
+					break;
+				sent += static_cast<size_t>(wrote);
+			}
+		}
+		close(client);
+	}
+#endif
+}
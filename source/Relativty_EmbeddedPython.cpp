@@ -5,7 +5,7 @@
 // it under the terms of the GNU General Public License as published by
 // the Free Software Foundation, either version 3 of the License, or
 // (at your option) any later version.
-// 
+//
 // This program is distributed in the hope that it will be useful,
 // but WITHOUT ANY WARRANTY; without even the implied warranty of
 // MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
@@ -16,49 +16,270 @@
 #pragma comment(lib, "Ws2_32.lib")
 #pragma comment(lib, "User32.lib")
 #pragma comment (lib, "Setupapi.lib")
+#define PY_SSIZE_T_CLEAN
 #include <C:\Program Files\Python310\include\Python.h>
 
-#include <iostream>
-#include <filesystem>
+#include <cstring>
 #include <string>
-#include "Relativty_ServerDriver.hpp"
+#include "Relativty_EmbeddedPython.h"
+#include "Relativty_Clock.h"
+#include "Relativty_Log.h"
 
-namespace fs = std::filesystem;
+// The built in "relativty" module the tracker script imports to hand poses
+// to the driver without going through UDP:
+//
+//   relativty.now_ns()                    driver clock, use it for timestamps
+//   relativty.running()                   False once the driver wants the tracker to return
+//   relativty.submit_pose(ts, pos, quat[, device[, reset]])
+//                                         ts in ns (0 = now), pos (x, y, z), quat (w, x, y, z),
+//                                         device 0 (the headset, default) or a tracker id,
+//                                         reset True for the first pose after the tracker
+//                                         relocalized (kPoseReset)
+//   relativty.submit_poses(buffer[, device])
+//                                         C contiguous float64 rows of
+//                                         (ts, x, y, z, qw, qx, qy, qz), e.g. a
+//                                         numpy (N, 8) array or array('d'),
+//                                         read in place, returns the row count;
+//                                         rows cannot carry reset, hand that pose
+//                                         to submit_pose
+namespace {
+	// only read or written with the GIL held
+	Relativty::PythonPoseSink g_sink = {};
+	// Python's id of the thread running the tracker, 0 while none runs
+	unsigned long g_trackerThreadId = 0;
 
-void startPythonTrackingClient_threaded(std::string PyPath) {
-	PyObject* module, * dict, * python_class, * sample_object;
-	_putenv_s("PYTHONPATH", "D:/CODE/PYTHONPATH/");
-	Py_Initialize();
+	const size_t kDoublesPerRow = 8;
 
-	module = PyImport_ImportModule("foobar");
-	if (module == nullptr)
-	{
-		std::cout << "Failed to import module.";
-		//return 1;
+	bool sinkAvailable() {
+		if (g_sink.submit == nullptr) {
+			PyErr_SetString(PyExc_RuntimeError, "relativty: no driver is accepting poses");
+			return false;
+		}
+		return true;
+	}
+
+	bool validDevice(unsigned int device) {
+		if (device > Relativty::kMaxTrackers) {
+			PyErr_Format(PyExc_ValueError, "device must be 0 (the headset) to %u", Relativty::kMaxTrackers);
+			return false;
+		}
+		return true;
+	}
+
+	bool readFloats(PyObject* object, float* out, Py_ssize_t count, const char* what) {
+		PyObject* sequence = PySequence_Fast(object, what);
+		if (sequence == nullptr)
+			return false;
+		if (PySequence_Fast_GET_SIZE(sequence) != count) {
+			PyErr_Format(PyExc_ValueError, "%s must have %zd elements", what, count);
+			Py_DECREF(sequence);
+			return false;
+		}
+		PyObject** items = PySequence_Fast_ITEMS(sequence);
+		for (Py_ssize_t i = 0; i < count; i++) {
+			const double value = PyFloat_AsDouble(items[i]);
+			if (value == -1.0 && PyErr_Occurred()) {
+				Py_DECREF(sequence);
+				return false;
+			}
+			out[i] = static_cast<float>(value);
+		}
+		Py_DECREF(sequence);
+		return true;
+	}
+
+	PyObject* relativty_now_ns(PyObject*, PyObject*) {
+		return PyLong_FromLongLong(Relativty::MonotonicNowNs());
+	}
+
+	PyObject* relativty_running(PyObject*, PyObject*) {
+		return PyBool_FromLong(g_sink.running != nullptr && g_sink.running->load());
+	}
+
+	PyObject* relativty_submit_pose(PyObject*, PyObject* args) {
+		long long timestamp;
+		PyObject* position;
+		PyObject* rotation;
+		unsigned int device = Relativty::kHeadsetDevice;
+		int reset = 0;
+		if (!PyArg_ParseTuple(args, "LOO|Ip:submit_pose", &timestamp, &position, &rotation, &device, &reset) || !validDevice(device))
+			return nullptr;
+
+		Relativty::TrackerPose pose;
+		if (!readFloats(position, pose.position, 3, "pos") || !readFloats(rotation, pose.rotation, 4, "quat"))
+			return nullptr;
+		if (!sinkAvailable())
+			return nullptr;
+		pose.timestampNs = timestamp != 0 ? timestamp : Relativty::MonotonicNowNs();
+		pose.device = device;
+		pose.flags = reset ? Relativty::kPoseReset : 0;
+
+		const Relativty::PythonPoseSink sink = g_sink;
+		Py_BEGIN_ALLOW_THREADS
+		sink.submit(sink.context, &pose, 1);
+		Py_END_ALLOW_THREADS
+		Py_RETURN_NONE;
+	}
+
+	PyObject* relativty_submit_poses(PyObject*, PyObject* args) {
+		PyObject* object;
+		unsigned int device = Relativty::kHeadsetDevice;
+		if (!PyArg_ParseTuple(args, "O|I:submit_poses", &object, &device) || !validDevice(device))
+			return nullptr;
+		Py_buffer view;
+		if (PyObject_GetBuffer(object, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+			return nullptr;
+
+		// native or little endian doubles only, anything else would need a copy
+		const char* format = view.format != nullptr ? view.format : "B";
+		if (format[0] == '@' || format[0] == '=' || format[0] == '<')
+			format++;
+		if (std::strcmp(format, "d") != 0 || view.itemsize != sizeof(double) ||
+		    view.len % (kDoublesPerRow * sizeof(double)) != 0) {
+			PyBuffer_Release(&view);
+			PyErr_SetString(PyExc_ValueError, "submit_poses expects float64 rows of (ts, x, y, z, qw, qx, qy, qz)");
+			return nullptr;
+		}
+		if (!sinkAvailable()) {
+			PyBuffer_Release(&view);
+			return nullptr;
+		}
+
+		// the exported view keeps the buffer alive and unresizable, so it can be
+		// read without the GIL
+		const Relativty::PythonPoseSink sink = g_sink;
+		const double* rows = static_cast<const double*>(view.buf);
+		const size_t count = size_t(view.len) / (kDoublesPerRow * sizeof(double));
+		Py_BEGIN_ALLOW_THREADS
+		Relativty::TrackerPose poses[32];
+		const int64_t now = Relativty::MonotonicNowNs();
+		for (size_t done = 0; done < count;) {
+			const size_t chunk = (count - done) < 32 ? (count - done) : 32;
+			for (size_t i = 0; i < chunk; i++) {
+				const double* row = rows + (done + i) * kDoublesPerRow;
+				poses[i].timestampNs = row[0] != 0 ? static_cast<int64_t>(row[0]) : now;
+				for (int j = 0; j < 3; j++)
+					poses[i].position[j] = static_cast<float>(row[1 + j]);
+				for (int j = 0; j < 4; j++)
+					poses[i].rotation[j] = static_cast<float>(row[4 + j]);
+				poses[i].device = device;
+			}
+			sink.submit(sink.context, poses, chunk);
+			done += chunk;
+		}
+		Py_END_ALLOW_THREADS
+
+		PyBuffer_Release(&view);
+		return PyLong_FromSize_t(count);
+	}
+
+	PyMethodDef g_methods[] = {
+		{ "now_ns", relativty_now_ns, METH_NOARGS, "Driver monotonic clock in nanoseconds." },
+		{ "running", relativty_running, METH_NOARGS, "False once the driver wants the tracker to stop." },
+		{ "submit_pose", relativty_submit_pose, METH_VARARGS, "submit_pose(ts_ns, (x, y, z), (w, x, y, z)[, device[, reset]])" },
+		{ "submit_poses", relativty_submit_poses, METH_VARARGS, "submit_poses(buffer of float64 rows (ts, x, y, z, qw, qx, qy, qz)[, device]) -> count" },
+		{ nullptr, nullptr, 0, nullptr }
+	};
+
+	PyModuleDef g_module = { PyModuleDef_HEAD_INIT, "relativty", "Relativty driver pose input.", -1, g_methods };
+
+	PyObject* PyInit_relativty() {
+		return PyModule_Create(&g_module);
+	}
+
+	// the tracker runs inside SteamVR, nobody sees stderr, so send the exception to the driver log
+	void logPythonError(const std::string& what) {
+		PyObject *type, *value, *traceback;
+		PyErr_Fetch(&type, &value, &traceback);
+		std::string message = what;
+		if (value != nullptr) {
+			PyObject* text = PyObject_Str(value);
+			const char* utf8 = text != nullptr ? PyUnicode_AsUTF8(text) : nullptr;
+			if (utf8 != nullptr)
+				message += std::string(": ") + utf8;
+			Py_XDECREF(text);
+		}
+		PyErr_Clear();
+		Py_XDECREF(type);
+		Py_XDECREF(value);
+		Py_XDECREF(traceback);
+		RELATIVTY_LOG(Error, "Python: %s", message.c_str());
 	}
+}
 
-	dict = PyModule_GetDict(module);
-	if (dict == nullptr)
+void startPythonTrackingClient_threaded(std::string PyPath, std::string PyModule, Relativty::PythonPoseSink sink) {
+	PyObject* module, * python_class, * sample_object, * result;
+
+	// the interpreter is kept across Activate/Deactivate, extension modules
+	// like numpy do not survive being finalized and initialized again
+	if (!Py_IsInitialized()) {
+		PyImport_AppendInittab("relativty", PyInit_relativty);
+		Py_Initialize();
+		PyEval_SaveThread(); // every entry below takes the GIL through PyGILState_Ensure
+	}
+	PyGILState_STATE gil = PyGILState_Ensure();
+	g_sink = sink;
+	g_trackerThreadId = PyThread_get_thread_ident();
+
+	// the interpreter outlives Activate, the path is only added the first time
+	PyObject* sys_path = PySys_GetObject("path"); // borrowed
+	PyObject* tracker_path = PyUnicode_FromString(PyPath.c_str());
+	const int listed = sys_path != nullptr && tracker_path != nullptr ? PySequence_Contains(sys_path, tracker_path) : -1;
+	if (listed < 0 || (listed == 0 && PyList_Insert(sys_path, 0, tracker_path) != 0))
+		logPythonError("Failed to add " + PyPath + " to sys.path");
+	Py_XDECREF(tracker_path);
+
+	module = PyImport_ImportModule(PyModule.c_str());
+	if (module == nullptr)
 	{
-		std::cout << "Failed to get module dict.";
-		//return 1;
+		logPythonError("Failed to import module " + PyModule);
+		g_sink = {};
+		g_trackerThreadId = 0;
+		PyGILState_Release(gil);
+		return;
 	}
-	Py_DECREF(module);
 
-	python_class = PyDict_GetItemString(dict, "foobar");
+	python_class = PyObject_GetAttrString(module, PyModule.c_str());
+	Py_DECREF(module);
 	if (python_class == nullptr)
 	{
-		std::cout << "Failed to get class.";
-		//return 1;
+		logPythonError("Failed to get class " + PyModule);
+		g_sink = {};
+		g_trackerThreadId = 0;
+		PyGILState_Release(gil);
+		return;
 	}
-	Py_DECREF(dict);
 
 	sample_object = PyObject_CallObject(python_class, nullptr);
+	Py_DECREF(python_class);
 	if (sample_object == nullptr)
 	{
-		std::cout << "Failed to instantiate object.";
-		//return 1;
+		logPythonError("Failed to instantiate object");
+		g_sink = {};
+		g_trackerThreadId = 0;
+		PyGILState_Release(gil);
+		return;
 	}
-	Py_DECREF(python_class);
 
-}
\ No newline at end of file
+	RELATIVTY_LOG(Info, "Python: tracker %s started", PyModule.c_str());
+	result = PyObject_CallMethod(sample_object, "run", nullptr);
+	if (result == nullptr)
+		logPythonError("Tracker stopped with an exception");
+	else
+		RELATIVTY_LOG(Info, "Python: tracker %s stopped", PyModule.c_str());
+	Py_XDECREF(result);
+	Py_DECREF(sample_object);
+
+	g_sink = {};
+	g_trackerThreadId = 0;
+	PyGILState_Release(gil);
+}
+
+void interruptPythonTrackingClient() {
+	if (!Py_IsInitialized())
+		return;
+	PyGILState_STATE gil = PyGILState_Ensure();
+	if (g_trackerThreadId != 0)
+		PyThreadState_SetAsyncExc(g_trackerThreadId, PyExc_SystemExit);
+	PyGILState_Release(gil);
+}
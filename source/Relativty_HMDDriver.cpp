@@ -15,7 +15,6 @@
 
 #pragma comment(lib, "Ws2_32.lib")
 #pragma comment (lib, "Setupapi.lib")
-#pragma comment(lib, "User32.lib")
 
 #include <atomic>
 #include <WinSock2.h>
@@ -31,53 +30,99 @@
 #include "Relativty_EmbeddedPython.h"
 #include "Relativty_components.h"
 #include "Relativty_base_device.h"
-
-
+#include "Relativty_Clock.h"
+#include "Relativty_DatagramReceiver.h"
+#include "Relativty_Log.h"
+#include "Relativty_Trace.h"
+#include "Relativty_Quaternion.h"
+#include "Relativty_TrackerDevice.h"
+#include "Relativty_Workers.h"
+
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
 
 #include <vector>
-#define BUFLEN 512
 #define PORT 50000
 
+// the worker waits and their budget are in Relativty_Workers.h
+// pose thread period while the rotation comes from the IMU alone
+#define FALLBACK_PUBLISH_MS 4
+
 #define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
 
 
-inline vr::HmdQuaternion_t HmdQuaternion_Init(double w, double x, double y, double z) {
-	vr::HmdQuaternion_t quat;
-	quat.w = w;
-	quat.x = x;
-	quat.y = y;
-	quat.z = z;
-	return quat;
-}
+namespace {
+	Relativty::ThreadSchedConfig threadSched(const std::string& schedClass, int32_t priority, int32_t cpuMask) {
+		Relativty::ThreadSchedConfig sched;
+		Relativty::ParseSchedClass(schedClass, sched.schedClass); // validated with the settings
+		sched.priority = priority;
+		sched.cpuMask = static_cast<uint32_t>(cpuMask);
+		return sched;
+	}
+
+	// the settings reloaded live are read through these, at Activate and after a reload
+	Relativty::TrackingBudgets trackingBudgets(const Relativty::HmdConfig& cfg) {
+		Relativty::TrackingBudgets budgets;
+		budgets.cameraStaleNs = cfg.cameraStaleMs * 1000000LL;
+		budgets.imuStaleNs = cfg.imuStaleMs * 1000000LL;
+		budgets.disconnectNs = cfg.disconnectAfterMs * 1000000LL;
+		return budgets;
+	}
+
+	Relativty::UpsamplingSettings upsamplingSettings(const Relativty::HmdConfig& cfg) {
+		Relativty::UpsamplingSettings upsampling;
+		upsampling.cameraLatencyNs = cfg.cameraLatencyMs * 1000000LL;
+		upsampling.maxCoastNs = cfg.cameraStaleMs * 1000000LL;
+		return upsampling;
+	}
+
+	Relativty::RelocalizationSettings relocalizationSettings(const Relativty::HmdConfig& cfg) {
+		Relativty::RelocalizationSettings relocalization;
+		relocalization.maxSpeed = cfg.maxHeadSpeed;
+		relocalization.blendNs = cfg.relocalizationBlendMs * 1000000LL;
+		return relocalization;
+	}
 
-inline void Normalize(float norma[3], float v[3], float max[3], float min[3], int up, int down, float scale[3], float offset[3]) {
-	for (int i = 0; i < 4; i++) {
-		norma[i] = (((up - down) * ((v[i] - min[i]) / (max[i] - min[i])) + down) / scale[i])+ offset[i];
+	void logThreadSched(const char* name, const Relativty::ScopedThreadSched& sched) {
+		RELATIVTY_LOG(Info, "%s: scheduling %s", name, sched.Achieved().c_str());
+		if (!sched.Problems().empty())
+			RELATIVTY_LOG(Warning, "%s: %s", name, sched.Problems().c_str());
 	}
 }
 
+// one axis of the camera tracker's coordinate, [min, max] mapped onto [down, up], then to meters
+inline float Normalize(float v, float max, float min, int up, int down, float scale, float offset) {
+	return (((up - down) * ((v - min) / (max - min)) + down) / scale) + offset;
+}
+
 vr::EVRInitError Relativty::HMDDriver::Activate(uint32_t unObjectId) {
 	RelativtyDevice::Activate(unObjectId);
 	this->setProperties();
 
+	// everything but the calibration is taken from the snapshot current at Activate
+	const HmdConfig& cfg = *this->config.read();
 
 
 
 	int result;
-	DriverLog("SERIAL: %s.\n", COMPORT);
-	DriverLog("IS MPU SERIAL: %d\n", isMPUSerial);
+	DriverLog("SERIAL: %s.\n", cfg.COMPORT.c_str());
+	DriverLog("IS MPU SERIAL: %d\n", cfg.isMPUSerial);
 	this->isMPUSerial = true;
 	/*
 	*/
 	if (!isMPUSerial)
 	{
-		this->handle = hid_open((unsigned short)m_iVid, (unsigned short)m_iPid, NULL);
+		this->handle = hid_open((unsigned short)cfg.hmdVid, (unsigned short)cfg.hmdPid, NULL);
 		if (!this->handle) {
 			#ifdef DRIVERLOG_H
-			DriverLog("USB: Unable to open HMD device with pid=%d and vid=%d.\n", m_iPid, m_iVid);
+			DriverLog("USB: Unable to open HMD device with pid=%d and vid=%d.\n", cfg.hmdPid, cfg.hmdVid);
 			#else
-			Relativty::ServerDriver::Log("USB: Unable to open HMD device with pid=" + std::to_string(m_iPid) + " and vid=" + std::to_string(m_iVid) + ".\n");
+			Relativty::ServerDriver::Log("USB: Unable to open HMD device with pid=" + std::to_string(cfg.hmdPid) + " and vid=" + std::to_string(cfg.hmdVid) + ".\n");
 			#endif
 			return vr::VRInitError_Init_InterfaceNotFound;
 		}
@@ -90,9 +135,12 @@ vr::EVRInitError Relativty::HMDDriver::Activate(uint32_t unObjectId) {
 	}
 	else
 	{
-		//relativ.setTimeout(serial::Timeout::simpleTimeout(1000));
-		this->relativ.setPort(COMPORT);
+		// reads give up after kSerialWaitMs so the IMU thread notices Deactivate
+		serial::Timeout timeout = serial::Timeout::simpleTimeout(kSerialWaitMs);
+		this->relativ.setTimeout(timeout);
+		this->relativ.setPort(cfg.COMPORT);
 		relativ.setBaudrate(115200);
+		relativ.setTimestamping(true);
 		while (!this->relativ.isOpen()) {
 			std::this_thread::sleep_for(std::chrono::milliseconds(10));
 			relativ.open();
@@ -101,228 +149,564 @@ vr::EVRInitError Relativty::HMDDriver::Activate(uint32_t unObjectId) {
 	}
 	
 
-	this->retrieve_quaternion_isOn = true;
-	this->retrieve_vector_isOn = true;
-	this->retrieve_quaternion_thread_worker = std::thread(&Relativty::HMDDriver::retrieve_device_quaternion_packet_threaded, this);
+	if (!cfg.tracePath.empty())
+		Trace::Enable(true);
+
+	this->stop_signal.Reset();
+	this->control_requests.Clear();
+	this->imu_takes_commands = isMPUSerial && !cfg.hmdIMUserialBinaryPackets;
+	const TrackingBudgets budgets = trackingBudgets(cfg);
+	this->last_camera_ns = 0;
+	this->tracking_monitor.Reset(budgets, MonotonicNowNs());
+	this->position_upsampler.Reset(upsamplingSettings(cfg));
+	this->upsampling_enabled = cfg.positionUpsampling;
+	this->upsampling_active = false;
+	this->relocalization.Reset(relocalizationSettings(cfg));
+	this->relocalization_config = &cfg;
+	ParsePublishMode(cfg.publishMode, this->publish_mode); // validated with the settings
+	this->frame_clock.Reset(cfg.displayFrequency, cfg.secondsFromVsyncToPhotons);
+	this->publish_pacing.Reset(this->frame_clock.PeriodNs());
+	this->vsync_clock_mismatches = 0;
+	{
+		std::lock_guard<std::mutex> lock(this->predictor_mutex);
+		this->pose_predictor.Reset(cfg.maxPredictionMs * 1000000LL);
+	}
+	this->measured_poses.push(m_Pose);
+	TrackerPublishing publishing;
+	publishing.mode = this->publish_mode;
+	publishing.maxPredictionNs = cfg.maxPredictionMs * 1000000LL;
+	publishing.displayPeriodNs = this->frame_clock.PeriodNs();
+	this->trackers->Configure(cfg.trackerRoles, budgets, publishing);
+	void (Relativty::HMDDriver::*retrieve_quaternion)();
+	if (!isMPUSerial)
+		retrieve_quaternion = cfg.hmdIMUdmpPackets ? &Relativty::HMDDriver::retrieve_device_quaternion_packet_threaded<ImuFormat::MpuDmpQ14>
+		                                     : &Relativty::HMDDriver::retrieve_device_quaternion_packet_threaded<ImuFormat::Mpu9250Float>;
+	else
+		retrieve_quaternion = cfg.hmdIMUserialBinaryPackets ? &Relativty::HMDDriver::retrieve_device_quaternion_packet_threaded<ImuFormat::Bno055Binary>
+		                                           : &Relativty::HMDDriver::retrieve_device_quaternion_packet_threaded<ImuFormat::Bno055Ascii>;
+	this->retrieve_quaternion_thread_worker = std::thread(retrieve_quaternion, this);
 	this->retrieve_vector_thread_worker = std::thread(&Relativty::HMDDriver::retrieve_client_vector_packet_threaded_UDP, this);
-	/*
-	if (this->start_tracking_server) {
-		this->retrieve_vector_isOn = true;
-		this->retrieve_vector_thread_worker = std::thread(&Relativty::HMDDriver::retrieve_client_vector_packet_threaded_UDP, this);
-		while (this->serverNotReady) {
-			// do nothing
-		}
-		this->startPythonTrackingClient_worker = std::thread(startPythonTrackingClient_threaded, this->PyPath);
+	if (!cfg.PyModule.empty()) {
+		// embedded tracker, hands its poses over through the relativty module instead of UDP
+		this->python_tracker_isOn = true;
+		this->python_tracker_exited = false;
+		PythonPoseSink sink = { &Relativty::HMDDriver::submit_python_poses, this, &this->python_tracker_isOn };
+		this->startPythonTrackingClient_worker = std::thread([this, sink, path = cfg.PyPath, module = cfg.PyModule]() {
+			startPythonTrackingClient_threaded(path, module, sink);
+			this->python_tracker_exited = true;
+		});
 	}
-	*/
 	this->update_pose_thread_worker = std::thread(&Relativty::HMDDriver::update_pose_threaded, this);
 
-	return vr::VRInitError_None;
-}
-
-void Relativty::HMDDriver::Deactivate() {
-	this->retrieve_quaternion_isOn = false;
-	this->retrieve_quaternion_thread_worker.join();
-	hid_close(this->handle);
-	hid_exit();
+	TrackerSupervisorConfig trackerConfig;
+	trackerConfig.command = cfg.trackerCommand;
+	trackerConfig.stallTimeoutMs = cfg.trackerStallTimeoutMs;
+	trackerConfig.startupGraceMs = cfg.trackerStartupGraceMs;
+	trackerConfig.cpuMask = static_cast<uint32_t>(cfg.trackerCpuMask);
+	trackerConfig.priority = ClampSchedPriority(cfg.trackerPriority);
+	this->tracker_supervisor.Start(trackerConfig);
 
+	if (!this->settings_path.empty()) {
+		this->config_watch_thread_worker = std::thread(&Relativty::HMDDriver::config_watch_threaded, this);
+	}
 
-	this->retrieve_vector_isOn = false;
-	closesocket(this->sock);
-	this->retrieve_vector_thread_worker.join();
-	WSACleanup();
-	
-	RelativtyDevice::Deactivate();
-	this->update_pose_thread_worker.join();
+	if (!cfg.controlChannel.empty()) {
+		const ControlSink control = { &Relativty::HMDDriver::handle_control, this };
+		std::string problem;
+		if (this->control_channel.Start(cfg.controlChannel, control, problem))
+			RELATIVTY_LOG(Info, "Control: listening on %s", this->control_channel.Path().c_str());
+		else
+			RELATIVTY_LOG(Warning, "Control: %s, recenter and the other commands are unavailable", problem.c_str());
+	}
 
-	Relativty::ServerDriver::Log("Thread0: all threads exit correctly \n");
+	this->frame_publishing = this->publish_mode == PublishMode::Frame;
+	return vr::VRInitError_None;
 }
 
-void Relativty::HMDDriver::update_pose_threaded() {
-	Relativty::ServerDriver::Log("Thread2: successfully started\n");
-	while (m_unObjectId != vr::k_unTrackedDeviceIndexInvalid) {
-		if (this->new_vector_avaiable) {
-			m_Pose.qRotation.w = this->quat[0];
-			m_Pose.qRotation.x = this->quat[1];
-			m_Pose.qRotation.y = this->quat[2];
-			m_Pose.qRotation.z = this->quat[3];
-
-			m_Pose.vecPosition[0] = this->vector_xyz[0];
-			m_Pose.vecPosition[1] = this->vector_xyz[1];
-			m_Pose.vecPosition[2] = this->vector_xyz[2];
+// ServerDriver::RunFrame. In Frame mode the first call in every display
+// frame publishes the headset and the trackers, each predicted to when the
+// frame being rendered now is lit. The vsync phase comes from the
+// compositor's frame timings, whose system time is QueryPerformanceCounter
+// seconds like MonotonicNowNs(); a timing that does not line up with it is
+// ignored and the phase of the first frame is kept.
+void Relativty::HMDDriver::RunFrame(int64_t nowNs) {
+	if (!this->frame_publishing)
+		return;
+	vr::Compositor_FrameTiming timing = {};
+	timing.m_nSize = sizeof(timing);
+	if (vr::VRServerDriverHost()->GetFrameTimings(&timing, 1) == 1 && timing.m_flSystemTimeInSeconds > 0) {
+		const int64_t vsyncNs = static_cast<int64_t>(timing.m_flSystemTimeInSeconds * 1e9);
+		if (vsyncNs > nowNs - 1000000000LL && vsyncNs <= nowNs)
+			this->frame_clock.NoteVsync(vsyncNs);
+		else if (this->vsync_clock_mismatches++ == 0)
+			RELATIVTY_LOG(Warning, "Thread0: compositor vsync time is %lld ms away from the driver clock, pacing frames from the first one instead",
+				static_cast<long long>((vsyncNs - nowNs) / 1000000));
+	}
 
-			vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_unObjectId, m_Pose, sizeof(vr::DriverPose_t));
-			this->new_quaternion_avaiable = false;
-			this->new_vector_avaiable = false;
+	int64_t photonNs;
+	if (!this->frame_clock.BeginFrame(nowNs, photonNs))
+		return;
+	RELATIVTY_TRACE_SCOPE("publish_frame");
+	this->publish_frame(photonNs, nowNs);
+	this->trackers->PublishFrame(photonNs, nowNs);
+}
 
-		}
+void Relativty::HMDDriver::publish_frame(int64_t photonNs, int64_t nowNs) {
+	vr::DriverPose_t pose;
+	if (!this->measured_poses.latest(pose))
+		return; // the pose thread lapped every slot while this one was read, the next frame gets a newer pose
+	PredictedPose predicted;
+	bool have_prediction;
+	{
+		std::lock_guard<std::mutex> lock(this->predictor_mutex);
+		// the IMU fallback already is the newest rotation, the tracker poses are extrapolated
+		have_prediction = this->pose_predictor.Predict(photonNs, predicted) && pose.result == vr::TrackingResult_Running_OK;
 	}
-	Relativty::ServerDriver::Log("Thread2: successfully stopped\n");
+	if (have_prediction) {
+		ApplyPrediction(pose, predicted, photonNs - nowNs);
+		this->publish_pacing.Frame(predicted.newPoses, predicted.horizonNs);
+	}
+	else {
+		this->publish_pacing.Frame(0, 0);
+	}
+	this->publish_pacing.Published(nowNs);
+	PublishPose(pose);
 }
 
-void Relativty::HMDDriver::calibrate_quaternion() {
-	if ((0x01 & GetAsyncKeyState(0x52)) != 0) {
-		qconj[0].store(quat[0]);
-		qconj[1].store(-1 * quat[1]);
-		qconj[2].store(-1 * quat[2]);
-		qconj[3].store(-1 * quat[3]);
+// Every worker waits on stop_signal or with a timeout of at most 100 ms (see
+// Relativty_Workers.h), so one Request() gets them all out in parallel within
+// kShutdownBudgetMs. The pose thread is joined before the base class gives up
+// the device index.
+void Relativty::HMDDriver::Deactivate() {
+	const int64_t stopNs = MonotonicNowNs();
+	this->frame_publishing = false;
+	this->stop_signal.Request();
+	this->python_tracker_isOn = false;
+	this->pose_signal.Wake();
+	// its commands read the state torn down below
+	this->control_channel.Stop();
+
+	JoinWorker(this->update_pose_thread_worker, "Thread2", stopNs);
+	JoinWorker(this->config_watch_thread_worker, "Settings watcher", stopNs);
+	JoinWorker(this->retrieve_quaternion_thread_worker, "Thread1", stopNs);
+	JoinWorker(this->retrieve_vector_thread_worker, "UDP SERVER", stopNs);
+
+	if (this->startPythonTrackingClient_worker.joinable()) {
+		// the tracker only returns once it looks at relativty.running(), give it the budget and then raise SystemExit in it
+		while (!this->python_tracker_exited && (MonotonicNowNs() - stopNs) / 1000000 < kShutdownBudgetMs)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		if (!this->python_tracker_exited) {
+			RELATIVTY_LOG(Warning, "Python: tracker ignored relativty.running() for %lld ms, interrupting it", static_cast<long long>(kShutdownBudgetMs));
+			interruptPythonTrackingClient();
+		}
+		JoinWorker(this->startPythonTrackingClient_worker, "Python", stopNs);
 	}
-	float qres[4];
 
-	qres[0] = qconj[0] * quat[0] - qconj[1] * quat[1] - qconj[2] * quat[2] - qconj[3] * quat[3];
-	qres[1] = qconj[0] * quat[1] + qconj[1] * quat[0] + qconj[2] * quat[3] - qconj[3] * quat[2];
-	qres[2] = qconj[0] * quat[2] - qconj[1] * quat[3] + qconj[2] * quat[0] + qconj[3] * quat[1];
-	qres[3] = qconj[0] * quat[3] + qconj[1] * quat[2] - qconj[2] * quat[1] + qconj[3] * quat[0];
+	// has its own bound, SIGTERM and then SIGKILL / the job object
+	this->tracker_supervisor.Stop();
 
-	this->quat[0] = qres[0];
-	this->quat[1] = qres[1];
-	this->quat[2] = qres[2];
-	this->quat[3] = qres[3];
-}
+	if (this->pose_recorder.Recording()) {
+		const std::string path = this->pose_recorder.Path();
+		const uint64_t recorded = this->pose_recorder.Stop();
+		RELATIVTY_LOG(Info, "Control: recording ended with the driver, %llu poses in %s", static_cast<unsigned long long>(recorded), path.c_str());
+	}
 
-void Relativty::HMDDriver::retrieve_device_quaternion_packet_threaded() {
-	uint8_t packet_buffer[64];
-	int16_t quaternion_packet[4];
-	//this struct is for mpu9250 support
-	#pragma pack(push, 1)
-	struct pak {
-		uint8_t id;
-		float quat[4];
-		uint8_t rest[47];
-	};
-	#pragma pack(pop)
-	int result;
-	Relativty::ServerDriver::Log("Thread1: successfully started\n");
-	while (this->retrieve_quaternion_isOn) {
+	if (!isMPUSerial) {
+		hid_close(this->handle);
+		hid_exit();
+	}
+	else if (this->relativ.isOpen()) {
+		this->relativ.close();
+	}
+	WSACleanup();
 
-		if (!isMPUSerial)
-		{
-			result = hid_read(this->handle, packet_buffer, 64); //Result should be greater than 0.
-			if (result > 0) {
+	RelativtyDevice::Deactivate();
+	DriverLog("Thread0: all workers stopped in %lld ms\n", static_cast<long long>((MonotonicNowNs() - stopNs) / 1000000));
+
+	Relativty::ServerDriver::Log("Thread0: wakeup latency\n" + this->thread_report());
+	Relativty::ServerDriver::Log("Thread2: tracking " + this->tracking_monitor.Report() + "\n");
+	if (this->upsampling_enabled)
+		Relativty::ServerDriver::Log("Thread2: position upsampling " + this->position_upsampler.Report() + "\n");
+	Relativty::ServerDriver::Log("UDP SERVER: relocalization " + this->relocalization.Report() + "\n");
+	Relativty::ServerDriver::Log("Thread0: " + this->publish_report());
+
+	if (!isMPUSerial) {
+		DriverLog("Thread1: HID reports read: %llu, late: %llu, queue overflows: %llu, read errors: %llu, max queue depth: %u\n",
+			this->hid_stats.reportsRead.load(), this->hid_stats.reportsLate.load(), this->hid_stats.queueOverflows.load(),
+			this->hid_stats.readErrors.load(), this->hid_stats.queueDepthMax.load());
+	}
+	DriverLog("Thread0: log lines dropped on full rings: %llu\n", static_cast<unsigned long long>(AsyncLog::DroppedLines()));
+
+	if (Trace::IsEnabled()) {
+		const std::string& tracePath = this->config.read()->tracePath;
+		Trace::Enable(false);
+		if (Trace::Dump(tracePath))
+			DriverLog("Thread0: trace written to %s\n", tracePath.c_str());
+		else
+			DriverLog("Thread0: could not write trace to %s\n", tracePath.c_str());
+	}
 
+	// every thread that could hold an older snapshot has been joined
+	this->config.reclaim();
 
-				if (m_bIMUpktIsDMP) {
+	Relativty::ServerDriver::Log("Thread0: all threads exit correctly \n");
+}
 
-					quaternion_packet[0] = ((packet_buffer[1] << 8) | packet_buffer[2]);
-					quaternion_packet[1] = ((packet_buffer[5] << 8) | packet_buffer[6]);
-					quaternion_packet[2] = ((packet_buffer[9] << 8) | packet_buffer[10]);
-					quaternion_packet[3] = ((packet_buffer[13] << 8) | packet_buffer[14]);
-					//this->quat[0] = static_cast<float>(quaternion_packet[0]) / 16384.0f;
-					//this->quat[1] = static_cast<float>(quaternion_packet[1]) / 16384.0f;
-					//this->quat[2] = static_cast<float>(quaternion_packet[2]) / 16384.0f;
-					//this->quat[3] = static_cast<float>(quaternion_packet[3]) / 16384.0f;
+// "trace_dump <path>" writes what the driver threads recorded so far, the
+// extension picks the format (see Trace::Dump). "thread_stats" returns the
+// wakeup latency of every driver thread, "tracking_stats" the time spent in
+// each tracking state and "tracker_stats" the same for every tracker seen in
+// the pose stream. "publish_stats" tells how evenly poses reached SteamVR in
+// the current publishMode, "upsampling_stats" how far the position upsampling
+// had drifted when the camera poses came in and "relocalization_stats" how
+// often and how far the tracker's position jumped.
+void Relativty::HMDDriver::DebugRequest(const char* pchRequest, char* pchResponseBuffer, uint32_t unResponseBufferSize) {
+	const std::string request = pchRequest;
+	if (request == "thread_stats" || request == "tracking_stats" || request == "tracker_stats" || request == "publish_stats"
+		|| request == "upsampling_stats" || request == "relocalization_stats") {
+		std::string report;
+		if (request == "thread_stats")
+			report = this->thread_report();
+		else if (request == "tracking_stats")
+			report = this->tracking_monitor.Report();
+		else if (request == "tracker_stats")
+			report = this->trackers->Report();
+		else if (request == "upsampling_stats")
+			report = this->position_upsampler.Report();
+		else if (request == "relocalization_stats")
+			report = this->relocalization.Report();
+		else
+			report = this->publish_report();
+		if (unResponseBufferSize >= 1)
+			snprintf(pchResponseBuffer, unResponseBufferSize, "%s", report.c_str());
+		return;
+	}
+	const std::string traceDump = "trace_dump ";
+	if (request.compare(0, traceDump.size(), traceDump) != 0) {
+		RelativtyDevice::DebugRequest(pchRequest, pchResponseBuffer, unResponseBufferSize);
+		return;
+	}
 
-					//float qres[4];
-					//qres[0] = quat[0];
-					//qres[1] = quat[1];
-					//qres[2] = -1 * quat[2];
-					//qres[3] = -1 * quat[3];
+	const std::string path = request.substr(traceDump.size());
+	const char* response;
+	if (!Trace::IsEnabled())
+		response = "tracing is off, set tracePath in the Relativty_hmd settings";
+	else if (Trace::Dump(path))
+		response = "ok";
+	else
+		response = "could not write trace";
+	if (unResponseBufferSize >= 1)
+		snprintf(pchResponseBuffer, unResponseBufferSize, "%s", response);
+}
 
-					//this->quat[0] = qres[0];
-					//this->quat[1] = qres[1];
-					//this->quat[2] = qres[2];
-					//this->quat[3] = qres[3];
+// Commands of the control channel (ControlChannel), run on its thread:
+//   recenter              the next headset pose becomes straight ahead
+//   calibrate_imu         asks the serial IMU firmware for its calibration status
+//   stats                 everything the *_stats debug requests report
+//   record start <path>   writes every pose from the tracker to path, see PoseRecorder
+//   record stop
+//   help
+// Requests that change pipeline state are only posted here, the thread that
+// owns that state takes them between two poses.
+bool Relativty::HMDDriver::handle_control(void* context, const std::string& command, std::string& reply) {
+	HMDDriver* self = static_cast<HMDDriver*>(context);
+	const std::string recordStart = "record start ";
+	RELATIVTY_LOG(Info, "Control: %s", command.c_str());
+
+	if (command == "recenter") {
+		self->control_requests.Post(ControlRequest::Recenter);
+		reply = "recenter requested, applied with the next headset pose";
+		return true;
+	}
+	if (command == "calibrate_imu") {
+		if (!self->imu_takes_commands) {
+			reply = "the IMU only takes commands with the text serial firmware (isMPUSerial, hmdIMUserialBinaryPackets false)";
+			return false;
+		}
+		self->control_requests.Post(ControlRequest::CalibrateImu);
+		reply = "calibration status requested, the firmware's answer goes to the driver log";
+		return true;
+	}
+	if (command == "stats") {
+		reply = self->stats_report();
+		return true;
+	}
+	if (command.compare(0, recordStart.size(), recordStart) == 0) {
+		const std::string path = command.substr(recordStart.size());
+		if (!self->pose_recorder.Start(path)) {
+			reply = "cannot create " + path;
+			return false;
+		}
+		reply = "recording poses to " + path;
+		return true;
+	}
+	if (command == "record stop") {
+		if (!self->pose_recorder.Recording()) {
+			reply = "no recording is running";
+			return false;
+		}
+		const std::string path = self->pose_recorder.Path();
+		const uint64_t recorded = self->pose_recorder.Stop();
+		reply = std::to_string(recorded) + " poses written to " + path;
+		return true;
+	}
+	if (command == "help") {
+		reply = "recenter\ncalibrate_imu\nstats\nrecord start <path>\nrecord stop";
+		return true;
+	}
+	reply = "unknown command \"" + command + "\", try help";
+	return false;
+}
 
-					//this->calibrate_quaternion();
+// the stats command, all of the *_stats debug requests in one
+std::string Relativty::HMDDriver::stats_report() {
+	std::string report = "wakeup latency\n" + this->thread_report()
+		+ "tracking: " + this->tracking_monitor.Report() + "\n"
+		+ "upsampling: " + (this->upsampling_active ? "on, " : "off, ") + this->position_upsampler.Report() + "\n"
+		+ "relocalization: " + this->relocalization.Report() + "\n"
+		+ this->publish_report()
+		+ this->trackers->Report();
+	char counters[256];
+	if (!isMPUSerial) {
+		snprintf(counters, sizeof(counters), "hid: %llu reports read, %llu late, %llu queue overflows, %llu read errors, max queue depth %u\n",
+			static_cast<unsigned long long>(this->hid_stats.reportsRead.load()), static_cast<unsigned long long>(this->hid_stats.reportsLate.load()),
+			static_cast<unsigned long long>(this->hid_stats.queueOverflows.load()), static_cast<unsigned long long>(this->hid_stats.readErrors.load()),
+			this->hid_stats.queueDepthMax.load());
+		report += counters;
+	}
+	snprintf(counters, sizeof(counters), "udp: %llu malformed lines\ncontrol: %llu commands, %s\nlog: %llu lines dropped\n",
+		static_cast<unsigned long long>(this->udp_malformed_lines.load()), static_cast<unsigned long long>(this->control_channel.Commands()),
+		this->pose_recorder.Recording() ? "recording" : "not recording", static_cast<unsigned long long>(AsyncLog::DroppedLines()));
+	return report + counters;
+}
 
-					//this->new_quaternion_avaiable = false;
+// Publishes every camera pose as it arrives. When the camera stalls the IMU
+// keeps the rotation going with the position frozen, rotated into the
+// tracker's frame by the offset seen at the last camera pose (assumed fixed
+// over the short gaps this bridges). State changes are published too, so
+// SteamVR learns about a lost or disconnected headset without a new pose.
+// While tracking with an IMU that sends its acceleration, position_upsampler
+// also publishes a position for every IMU sample between camera poses.
+void Relativty::HMDDriver::update_pose_threaded() {
+	const HmdConfig& cfg = *this->config.read();
+	const ScopedThreadSched sched("relativty_pose", threadSched(cfg.poseThreadSched, cfg.poseThreadPriority, cfg.poseThreadCpuMask));
+	logThreadSched("Thread2", sched);
+	Relativty::ServerDriver::Log("Thread2: successfully started\n");
+	Trace::SetThreadName("update_pose");
+
+	Quatf imu_to_tracker = QuatIdentity();
+	Quatf camera_rotation = QuatIdentity();
+	bool aligned = false;
+	int64_t published_imu_ns = 0;
+	uint64_t imu_upsampled = this->imu_history.count(); // index of the next IMU sample for position_upsampler
+	bool warned_no_accel = false;
+	const HmdConfig* budgets_config = &cfg;
+	ImuSample imu;
+
+	while (!this->stop_signal.Requested()) {
+		if (this->config.read() != budgets_config) {
+			// staleness budgets reloaded, this thread owns the headset's monitor and upsampler
+			budgets_config = this->config.read();
+			const TrackingBudgets budgets = trackingBudgets(*budgets_config);
+			this->tracking_monitor.SetBudgets(budgets);
+			this->position_upsampler.Configure(upsamplingSettings(*budgets_config));
+			this->trackers->SetBudgets(budgets);
+		}
+		int64_t wait_ms = kPoseWaitMs;
+		if (this->tracking_monitor.State() == TrackingState::ImuOnly || this->upsampling_active) {
+			wait_ms = FALLBACK_PUBLISH_MS;
+		}
+		else {
+			const int64_t imu_ns = this->imu_history.latest(imu) ? imu.timestampNs : 0;
+			const int64_t change_ns = this->tracking_monitor.NextChangeInNs(MonotonicNowNs(), this->last_camera_ns, imu_ns);
+			if (change_ns >= 0)
+				wait_ms = (std::min)(wait_ms, change_ns / 1000000 + 1);
+		}
+		if (!this->pose_signal.Wait(this->stop_signal, wait_ms))
+			break;
+
+		const bool fresh = this->pose_signal.Take();
+		const int64_t now_ns = MonotonicNowNs();
+		const bool have_imu = this->imu_history.latest(imu);
+		const TrackingState previous = this->tracking_monitor.State();
+		const TrackingState state = this->tracking_monitor.Update(now_ns, this->last_camera_ns, have_imu ? imu.timestampNs : 0);
+		bool publish = state != previous;
+		if (publish) {
+			RELATIVTY_LOG(Info, "Thread2: tracking state %s -> %s", TrackingStateName(previous), TrackingStateName(state));
+			Trace::Counter("tracking_state", static_cast<double>(state));
+		}
 
+		const bool upsample = this->upsampling_enabled && state == TrackingState::Tracking && have_imu && imu.hasAccel;
+		if (upsample != this->upsampling_active) {
+			// a fresh start either way, the first camera pose after it is taken as is
+			this->position_upsampler.Restart();
+			this->upsampling_active = upsample;
+		}
+		if (this->upsampling_enabled && have_imu && !imu.hasAccel && !warned_no_accel) {
+			RELATIVTY_LOG(Warning, "Thread2: positionUpsampling is on but the IMU sends no acceleration, needs the text serial firmware built with LINEAR_ACCEL_OUTPUT");
+			warned_no_accel = true;
+		}
+		bool upsampled = false;
+		int64_t upsampled_ns = 0;
+		if (upsample) {
+			RELATIVTY_TRACE_SCOPE("upsample_position");
+			// the IMU samples since the last wakeup in order, the camera pose in its place among them
+			const int64_t camera_ns = this->last_camera_ns;
+			const Vec3f camera_position = { this->vector_xyz[0], this->vector_xyz[1], this->vector_xyz[2] };
+			const Quatf tracker_rotation = { this->vector_quat[0], this->vector_quat[1], this->vector_quat[2], this->vector_quat[3] };
+			bool camera_pending = fresh;
+			const uint64_t imu_count = this->imu_history.count();
+			if (imu_count - imu_upsampled > kImuHistory)
+				imu_upsampled = imu_count - kImuHistory; // this thread was late, the older ones are gone
+			ImuSample sample;
+			for (; imu_upsampled < imu_count; imu_upsampled++) {
+				if (!this->imu_history.get(imu_upsampled, sample) || !sample.hasAccel)
+					continue;
+				if (camera_pending && sample.timestampNs > camera_ns) {
+					this->position_upsampler.Camera(camera_ns, camera_position, tracker_rotation);
+					camera_pending = false;
 				}
-				else {
-
-					pak* recv = (pak*)packet_buffer;
-					//this->quat[0] = recv->quat[0];
-					//this->quat[1] = recv->quat[1];
-					//this->quat[2] = recv->quat[2];
-					//this->quat[3] = recv->quat[3];
+				this->position_upsampler.Imu(sample.timestampNs, QuatLoad(sample.quat), Vec3Load(sample.accel));
+				upsampled_ns = sample.timestampNs;
+			}
+			if (camera_pending) {
+				this->position_upsampler.Camera(camera_ns, camera_position, tracker_rotation);
+				upsampled_ns = camera_ns;
+			}
+			// before it is ready a camera pose still anchors it, and is shown as is
+			upsampled = upsampled_ns != 0 && (this->position_upsampler.Ready() || fresh);
+		}
+		else {
+			imu_upsampled = this->imu_history.count();
+		}
 
-					//this->calibrate_quaternion();
+		if (fresh) {
+			this->pose_wakeup.Record(now_ns - this->vector_signal_ns);
+			RELATIVTY_TRACE_SCOPE("publish_pose");
+			if (const uint64_t flow = this->vector_flow_id.exchange(0))
+				Trace::FlowEnd("tracker_pose", flow);
+			const Quatf rotation = { this->quat[0], this->quat[1], this->quat[2], this->quat[3] };
+			m_Pose.qRotation = ToHmdQuaternion(rotation);
+			camera_rotation = rotation;
 
-					//this->new_quaternion_avaiable = false;
+			m_Pose.vecPosition[0] = this->vector_xyz[0];
+			m_Pose.vecPosition[1] = this->vector_xyz[1];
+			m_Pose.vecPosition[2] = this->vector_xyz[2];
 
-				}
+			if (have_imu) {
+				imu_to_tracker = QuatMultiply(rotation, QuatConjugate(QuatLoad(imu.quat)));
+				aligned = QuatNormalize(imu_to_tracker);
+			}
+			publish = true;
+		}
+		else if (state == TrackingState::ImuOnly && imu.timestampNs != published_imu_ns) {
+			RELATIVTY_TRACE_SCOPE("publish_imu_pose");
+			Quatf rotation = QuatLoad(imu.quat);
+			if (aligned)
+				rotation = QuatMultiply(imu_to_tracker, rotation);
+			if (QuatNormalize(rotation)) {
+				m_Pose.qRotation = ToHmdQuaternion(rotation);
+				publish = true;
+			}
+			published_imu_ns = imu.timestampNs;
+		}
 
+		if (upsampled) {
+			// the rotation stays the camera's, only the position is filled in
+			const Vec3f position = this->position_upsampler.Position();
+			m_Pose.vecPosition[0] = position.x;
+			m_Pose.vecPosition[1] = position.y;
+			m_Pose.vecPosition[2] = position.z;
+			TrackerPose pose;
+			pose.timestampNs = upsampled_ns;
+			pose.device = kHeadsetDevice;
+			Vec3Store(position, pose.position);
+			QuatStore(camera_rotation, pose.rotation);
+			{
+				std::lock_guard<std::mutex> lock(this->predictor_mutex);
+				this->pose_predictor.Add(pose);
+			}
+			publish = true;
+		}
 
+		if (publish) {
+			SetPoseTrackingState(m_Pose, state);
+			// in Frame mode RunFrame publishes the latest of these once per display frame
+			if (this->publish_mode == PublishMode::Event) {
+				this->publish_pacing.Published(now_ns);
+				PublishPose(m_Pose);
 			}
 			else {
-				Relativty::ServerDriver::Log("Thread1: Issue while trying to read USB\n");
+				this->measured_poses.push(m_Pose);
 			}
+		}
+	}
+	Relativty::ServerDriver::Log("Thread2: successfully stopped\n");
+}
+
+// A recenter request is taken here, between two poses, so every pose is
+// calibrated entirely against the old reference or entirely against the new.
+Relativty::Quatf Relativty::HMDDriver::calibrate_quaternion(const Quatf& measured) {
+	RELATIVTY_TRACE_SCOPE("calibrate_quaternion");
+	std::lock_guard<std::mutex> lock(this->calibration_mutex);
+	if (this->control_requests.Take(ControlRequest::Recenter)) {
+		this->recenter_offset = QuatConjugate(measured);
+		RELATIVTY_LOG(Info, "Control: recentered on the current headset rotation");
+	}
+	return QuatMultiply(this->recenter_offset, measured);
+}
 
+void Relativty::HMDDriver::push_imu(const ImuSample& sample) {
+	this->imu_history.push(sample);
+	this->pose_recorder.RecordImu(sample);
+}
+
+template<Relativty::ImuFormat Format>
+void Relativty::HMDDriver::retrieve_device_quaternion_packet_threaded() {
+	Relativty::ServerDriver::Log("Thread1: successfully started, decoding " + std::string(ImuCodec<Format>::name) + " packets\n");
+	const HmdConfig& cfg = *this->config.read();
+	const ScopedThreadSched sched("relativty_imu", threadSched(cfg.imuThreadSched, cfg.imuThreadPriority, cfg.imuThreadCpuMask));
+	logThreadSched("Thread1", sched);
+	Trace::SetThreadName("imu");
+
+	// what the readers in Relativty_Workers.h hand over
+	struct Sink {
+		HMDDriver* driver;
+
+		void Sample(const ImuSample& sample) {
+			this->driver->push_imu(sample);
 		}
-		else
-		{
-			//serial::Serial relativ;
-			std::string last_recv;
-			try {
-				while (relativ.isOpen()) {
-					if (last_recv.size() > 0 && last_recv[0] != 0) {
-						if (GetAsyncKeyState(VK_SHIFT) != 0 && GetAsyncKeyState(VK_CONTROL) != 0 && GetAsyncKeyState(0x49) != 0) {
-							relativ.write("C\n");
-						}
-					}
-					last_recv = relativ.readline();
-					std::string raw_str = last_recv;
-					if (raw_str.size() > 0) {
-						if (raw_str[0] != 0) {
-							if (raw_str.size() > 3) {
-								bool valid_reading = true;
-								float read_vals[4] = { 2,2,2,2 }; // Quat values will never be greater/less than 1,-1
-								try {
-									size_t pos = 0;
-									pos = raw_str.find(',');
-									read_vals[0] = std::stof(raw_str.substr(0, pos));
-									raw_str.erase(0, pos + 1);
-
-									pos = raw_str.find(',');
-									read_vals[1] = std::stof(raw_str.substr(0, pos));
-									raw_str.erase(0, pos + 1);
-
-									pos = raw_str.find(',');
-									read_vals[2] = std::stof(raw_str.substr(0, pos));
-									raw_str.erase(0, pos + 1);
-
-									read_vals[3] = std::stof(raw_str);
-								}
-								catch (...) {
-									valid_reading = false;
-								}
-								if (valid_reading) {
-									//this->quat[0] = read_vals[0];
-									//this->quat[1] = read_vals[1];
-									//this->quat[2] = read_vals[2];
-									//this->quat[3] = read_vals[3];
-
-									//this->calibrate_quaternion();
-
-									//this->new_quaternion_avaiable = true;
-
-								}
-							}
-						}
-						else if (raw_str[0] == 'C') {
-							if (raw_str.size() > 3) {
-								std::string raw_str_c = raw_str.substr(2, raw_str.size()); // Remove "C:"
-								Relativty::ServerDriver::Log("Thread1: Calibration: " + raw_str_c);
-							}
-						}
-						else if (raw_str[0] == 'D') {
-							if (raw_str.size() > 3) {
-								std::string raw_str_d = raw_str.substr(2, raw_str.size()); // Remove "D:"
-								Relativty::ServerDriver::Log("Thread1: Info: " + raw_str_d);
-							}
-						}
-						else {
-							// invalid response...
-						}
-					}
-				}
 
-			}
-			catch (...) {
-				Relativty::ServerDriver::Log("Thread1: Connection with SERIAL lost!");
+		void Rejected(const uint8_t* data, size_t size) {
+			const std::string line(reinterpret_cast<const char*>(data), size);
+			if constexpr (ImuCodec<Format>::transport == ImuTransport::SerialLine) {
+				if (line[0] == 'C')
+					RELATIVTY_LOG(Info, "Thread1: Calibration: %s", line.c_str() + 2); // Remove "C:"
+				else if (line[0] == 'D')
+					RELATIVTY_LOG(Info, "Thread1: Info: %s", line.c_str() + 2); // Remove "D:"
 			}
 		}
 
+		bool TakeCommand(std::string& command) {
+			if (!this->driver->control_requests.Take(ControlRequest::CalibrateImu))
+				return false;
+			command = "C\n"; // answered with a "C:" line, logged above
+			return true;
+		}
+
+		void Lost() {
+			RELATIVTY_LOG_EVERY_MS(Error, 1000, "Thread1: Connection with SERIAL lost!");
+		}
+	} sink = { this };
+
+	if constexpr (ImuCodec<Format>::transport == ImuTransport::Hid) {
+		auto read = [this](uint8_t* buffer, size_t length, int timeoutMs) {
+			return hid_read_timeout(this->handle, buffer, length, timeoutMs);
+		};
+		ReadHidImu<Format>(read, this->stop_signal, this->imu_wakeup, this->hid_report_clock, this->hid_stats, sink);
+	}
+	else {
+		ReadSerialImu<Format>(this->relativ, this->stop_signal, this->imu_wakeup, sink);
 	}
 	Relativty::ServerDriver::Log("Thread1: successfully stopped\n");
 }
@@ -332,20 +716,14 @@ void Relativty::HMDDriver::retrieve_client_vector_packet_threaded_UDP()
 {
 	BOOL bNewBehavior = FALSE;
 	DWORD dwBytesReturned = 0;
-	sockaddr_in server, client;
+	sockaddr_in server;
 	WSADATA wsa;
 
-	float normalize_min[3]{ this->normalizeMinX, this->normalizeMinY, this->normalizeMinZ };
-	float normalize_max[3]{ this->normalizeMaxX, this->normalizeMaxY, this->normalizeMaxZ };
-	float scales_coordinate_meter[3]{ this->scalesCoordinateMeterX, this->scalesCoordinateMeterY, this->scalesCoordinateMeterZ };
-	float offset_coordinate[3] = { this->offsetCoordinateX, this->offsetCoordinateY, this->offsetCoordinateZ };
-
-	float coordinate[3];
-	float rotation[4];
-
-
-
+	const HmdConfig& cfg = *this->config.read();
+	const ScopedThreadSched sched("relativty_udp", threadSched(cfg.udpThreadSched, cfg.udpThreadPriority, cfg.udpThreadCpuMask));
+	logThreadSched("UDP SERVER", sched);
 	Relativty::ServerDriver::Log("UDP SERVER: Initialising UDP COMMS.\n");
+	Trace::SetThreadName("udp");
 	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
 	{
 		Relativty::ServerDriver::Log("UDP SERVER: Failed to Init UDP\n");
@@ -370,88 +748,189 @@ void Relativty::HMDDriver::retrieve_client_vector_packet_threaded_UDP()
 	if (bind(server_socket, (sockaddr*)&server, sizeof(server)) == SOCKET_ERROR)
 	{
 		Relativty::ServerDriver::Log("UDP SERVER: Bind failed\n");
+		closesocket(server_socket);
 		return;
 	}
-	puts("UDP SERVER: Bind done.");
+	RELATIVTY_LOG(Info, "UDP SERVER: Bind done.");
 	this->serverNotReady = false;
 	Relativty::ServerDriver::Log("UDP SERVER: Waiting for incoming connections...\n");
 
-	while (this->retrieve_vector_isOn)
-	{
+	auto handle = [this, server_socket](char* message, int message_len, sockaddr_in& client) {
+		// one line per device, see ParsePoseDatagram
+		TrackerPose poses[kMaxTrackers + 1];
+		uint32_t malformed = 0;
+		const size_t count = ParsePoseDatagram(message, static_cast<size_t>(message_len), MonotonicNowNs(), poses, kMaxTrackers + 1, malformed);
+		if (malformed > 0) {
+			this->udp_malformed_lines += malformed;
+			RELATIVTY_LOG_EVERY_MS(Warning, 1000, "UDP SERVER: skipped a malformed pose line (%llu so far): %.64s", this->udp_malformed_lines.load(), message);
+		}
+		RELATIVTY_LOG(Debug, "UDP SERVER: %d poses in %d bytes", int(count), message_len);
 
-		if ((0x01 & GetAsyncKeyState(0x52)) != 0) {
-			this->quat[0] = 0;
-			this->quat[1] = 0;
-			this->quat[2] = 0;
-			this->quat[3] = 0;
-			this->vector_xyz[0] = 0;
-			this->vector_xyz[1] = 0;
-			this->vector_xyz[2] = 0;
-			this->new_vector_avaiable = true;
+		this->route_poses(poses, count);
 
-		}
-		Relativty::ServerDriver::Log("UDP SERVER: Waiting for data...");
-		fflush(stdout);
-		char message[BUFLEN] = {};
-
-		// try to receive some data, this is a blocking call
-		int message_len;
-		int slen = sizeof(sockaddr_in);
-		if (message_len = recvfrom(server_socket, message, BUFLEN, 0, (sockaddr*)&client, &slen) == SOCKET_ERROR)
+		if (sendto(server_socket, message, strlen(message), 0, (sockaddr*)&client, sizeof(sockaddr_in)) == SOCKET_ERROR)
 		{
-			Relativty::ServerDriver::Log("UDP SERVER: recvfrom() failed");
-			exit(0);
+			RELATIVTY_LOG_EVERY_MS(Error, 1000, "UDP SERVER: sendto() failed");
 		}
+	};
+	ServeDatagrams(server_socket, this->stop_signal, this->udp_wakeup, handle);
+	closesocket(server_socket);
+	Relativty::ServerDriver::Log("UDP SERVER: stopped\n");
+}
 
-		// print details of the client/peer and the data received
-		//printf("Received packet from %s:%d\n", inet_ntoa(client.sin_addr), ntohs(client.sin_port));
-		std::string messageString = message;
-		if (isspace(messageString[0])) { messageString.erase(0, 1); }
-		//printf("Data: %s\n", messageString);
-		//std::cout << "DATA: " << messageString << "\n";
-		std::string space_delimiter = " ";
-		std::vector<std::string> words{};
-
-		size_t pos = 0;
-
-		while ((pos = messageString.find(space_delimiter)) != std::string::npos) {
-			words.push_back(messageString.substr(0, pos));
-			messageString.erase(0, pos + space_delimiter.length());
-		}
-			
-		coordinate[0] = std::stof(words[0]);
-		coordinate[1] = std::stof(words[1]);
-		coordinate[2] = std::stof(words[2]);
-		rotation[0] = std::stof(words[3]);
-		rotation[1] = std::stof(words[5]);
-		rotation[2] = std::stof(words[6]);
-		rotation[3] = std::stof(words[4]);
+// One line per driver thread. The IMU threads are measured on the reads that
+// time out (an idle device), the UDP thread on those and, where the network
+// stack stamps datagrams, on the time every datagram waited in the socket.
+// The pose thread is measured from the moment a new pose is handed to it.
+std::string Relativty::HMDDriver::thread_report() {
+	return "imu: " + this->imu_wakeup.Report() + "\n"
+		+ "udp: " + this->udp_wakeup.Report() + "\n"
+		+ "pose: " + this->pose_wakeup.Report() + "\n";
+}
 
-		Relativty::ServerDriver::Log("UDP SERVER: " + words[0] + "," + words[1] + "," + words[2] + "\n");
+// "publishing per frame, 412 frames, 3 missed; headset: 412 poses, every 11.1 ms (sd 0.2, ..."
+std::string Relativty::HMDDriver::publish_report() {
+	std::string report = this->publish_mode == PublishMode::Frame ? "publishing per frame" : "publishing per pose";
+	if (this->publish_mode == PublishMode::Frame)
+		report += ", " + std::to_string(this->frame_clock.Frames()) + " frames, " + std::to_string(this->frame_clock.FramesMissed()) + " missed";
+	return report + "; headset: " + this->publish_pacing.Report() + "\n";
+}
 
-		DriverLog("UDP SERVER: MESSAGE ARRAY COUNT IS: %d", words.size());
+// Polls the driver's settings file and publishes a new snapshot when a
+// live value in it changes (IsLiveHmdSetting). apply_tracker_pose and the
+// pose thread pick the snapshot up with their next pose or wakeup. Only keys whose value differs from the
+// previous version of the file are applied, so overrides in steamvr.vrsettings
+// for keys that were not edited stay in effect.
+void Relativty::HMDDriver::config_watch_threaded() {
+	auto readSection = [this](std::map<std::string, std::string>& values) {
+		std::ifstream file(this->settings_path, std::ios::binary);
+		std::stringstream text;
+		text << file.rdbuf();
+		return file.good() && ParseHmdSettingsSection(text.str(), values);
+	};
 
+	std::map<std::string, std::string> previous;
+	readSection(previous);
 
-		this->vector_xyz[0] = coordinate[0];//1
-		this->vector_xyz[1] = coordinate[1];//2
-		this->vector_xyz[2] = coordinate[2];//0
+	WatchFile(this->settings_path, this->stop_signal, [&] {
+		std::map<std::string, std::string> values;
+		if (!readSection(values)) {
+			// most likely caught half way through a save, try again on the next poll
+			RELATIVTY_LOG_EVERY_MS(Warning, 10000, "Settings: could not parse %s, keeping the current values", this->settings_path.c_str());
+			return false;
+		}
 
-		
+		const HmdConfig& current = *this->config.read();
+		HmdConfig next = current;
+		std::vector<std::string> problems;
+		std::string applied, needsRestart;
+		for (const auto& entry : values) {
+			const auto old = previous.find(entry.first);
+			if (old != previous.end() && old->second == entry.second)
+				continue;
+			std::string problem;
+			if (IsLiveHmdSetting(entry.first)) {
+				if (SetHmdSetting(next, entry.first, entry.second, problem))
+					applied += " " + entry.first;
+				else
+					problems.push_back(problem);
+			}
+			else {
+				HmdConfig scratch;
+				if (SetHmdSetting(scratch, entry.first, entry.second, problem))
+					needsRestart += " " + entry.first;
+			}
+		}
+		previous.swap(values);
+
+		ValidateHmdConfig(next, current, problems);
+		for (const std::string& problem : problems)
+			RELATIVTY_LOG(Warning, "Settings: %s, keeping the previous value", problem.c_str());
+		if (!needsRestart.empty())
+			RELATIVTY_LOG(Info, "Settings: changed%s, restart SteamVR to apply", needsRestart.c_str());
+		if (!applied.empty()) {
+			this->config.publish(std::make_unique<const HmdConfig>(next));
+			RELATIVTY_LOG(Info, "Settings: reloaded%s", applied.c_str());
+		}
+		return true;
+	});
+}
 
-		this->quat[0] = rotation[0];
-		this->quat[1] = rotation[1];
-		this->quat[2] = rotation[2];
-		this->quat[3] = rotation[3];
+// shared by the UDP listener and the embedded Python tracker
+void Relativty::HMDDriver::apply_tracker_pose(const TrackerPose& pose) {
+	// the settings are looked up per pose so a reload applies to the very next one
+	const HmdConfig* cfg = this->config.read();
+	if (cfg != this->relocalization_config) {
+		this->relocalization.Configure(relocalizationSettings(*cfg), pose.timestampNs);
+		this->relocalization_config = cfg;
+	}
+	const uint64_t jumps = this->relocalization.Jumps();
+	const Vec3f position = this->relocalization.Apply(pose.timestampNs, Vec3Load(pose.position), (pose.flags & kPoseReset) != 0);
+	if (this->relocalization.Jumps() != jumps)
+		RELATIVTY_LOG_EVERY_MS(Info, 1000, "UDP SERVER: tracker position jumped%s, %s",
+			(pose.flags & kPoseReset) ? " after a reset" : "", this->relocalization.Report().c_str());
+	this->vector_xyz[0] = position.x;//1
+	this->vector_xyz[1] = position.y;//2
+	this->vector_xyz[2] = position.z;//0
+	for (int i = 0; i < 4; i++)
+		this->vector_quat[i] = pose.rotation[i];
+
+	const Quatf calibrated_rotation = this->calibrate_quaternion(QuatLoad(pose.rotation));
+	this->quat[0] = calibrated_rotation.w;
+	this->quat[1] = calibrated_rotation.x;
+	this->quat[2] = calibrated_rotation.y;
+	this->quat[3] = calibrated_rotation.z;
+	// while upsampling the pose thread adds the upsampled poses instead
+	if (!this->upsampling_active) {
+		TrackerPose calibrated;
+		calibrated.timestampNs = MonotonicNowNs();
+		calibrated.device = kHeadsetDevice;
+		for (int i = 0; i < 3; i++)
+			calibrated.position[i] = this->vector_xyz[i];
+		for (int i = 0; i < 4; i++)
+			calibrated.rotation[i] = this->quat[i];
+		std::lock_guard<std::mutex> lock(this->predictor_mutex);
+		this->pose_predictor.Add(calibrated);
+	}
+	this->tracker_supervisor.NotePose(MonotonicNowNs());
+	if (Trace::IsEnabled()) {
+		const uint64_t flow = Trace::NewFlowId();
+		Trace::FlowBegin("tracker_pose", flow);
+		this->vector_flow_id = flow;
+	}
+	//this->new_quaternion_avaiable = true;
+	const int64_t now_ns = MonotonicNowNs();
+	this->last_camera_ns = now_ns;
+	this->vector_signal_ns = now_ns;
+	this->pose_signal.Post();
+}
 
-		this->calibrate_quaternion();
-		//this->new_quaternion_avaiable = true;
-		this->new_vector_avaiable = true;
+// Trackers share the headset's ingest thread, a device in the stream costs a
+// lookup and a pose copy, not a thread.
+void Relativty::HMDDriver::route_poses(const TrackerPose* poses, size_t count) {
+	std::lock_guard<std::mutex> lock(this->route_mutex);
+	this->pose_recorder.Record(poses, count);
+	for (size_t i = 0; i < count; i++) {
+		if (poses[i].device == kHeadsetDevice)
+			this->apply_tracker_pose(poses[i]);
+		else
+			this->trackers->Submit(poses[i]);
+	}
+}
 
-		if (sendto(server_socket, message, strlen(message), 0, (sockaddr*)&client, sizeof(sockaddr_in)) == SOCKET_ERROR)
-		{
-			Relativty::ServerDriver::Log("sendto() failed");
-			return;
-		}
+// PythonPoseSink::submit, runs on the Python tracker thread without the GIL.
+// Only the newest pose of each device in a batch is published, same as a
+// burst of datagrams.
+void Relativty::HMDDriver::submit_python_poses(void* context, const TrackerPose* poses, size_t count) {
+	HMDDriver* self = static_cast<HMDDriver*>(context);
+	RELATIVTY_TRACE_SCOPE("python_pose");
+	uint32_t seen = 0; // bit per device id, kMaxTrackers + 1 fit
+	for (size_t i = count; i-- > 0;) {
+		const uint32_t bit = 1u << poses[i].device;
+		if (seen & bit)
+			continue;
+		seen |= bit;
+		self->route_poses(&poses[i], 1);
 	}
 }
 
@@ -463,13 +942,7 @@ void Relativty::HMDDriver::retrieve_client_vector_packet_threaded() {
 	char receiveBuffer[12];
 	int resultReceiveLen;
 
-	float normalize_min[3]{ this->normalizeMinX, this->normalizeMinY, this->normalizeMinZ};
-	float normalize_max[3]{ this->normalizeMaxX, this->normalizeMaxY, this->normalizeMaxZ};
-	float scales_coordinate_meter[3]{ this->scalesCoordinateMeterX, this->scalesCoordinateMeterY, this->scalesCoordinateMeterZ};
-	float offset_coordinate[3] = { this->offsetCoordinateX, this->offsetCoordinateY, this->offsetCoordinateZ};
-
 	float coordinate[3]{ 0, 0, 0 };
-	float coordinate_normalized[3];
 
 	Relativty::ServerDriver::Log("Thread3: Initialising Socket.\n");
 	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
@@ -502,28 +975,31 @@ void Relativty::HMDDriver::retrieve_client_vector_packet_threaded() {
 	Relativty::ServerDriver::Log("Thread3: Connection accepted");
 
 	Relativty::ServerDriver::Log("Thread3: successfully started\n");
-	while (this->retrieve_vector_isOn) {
+	while (!this->stop_signal.Requested()) {
 		resultReceiveLen = recv(this->sock_receive, receiveBuffer, receiveBufferLen, NULL);
 		if (resultReceiveLen > 0) {
 			coordinate[0] = *(float*)(receiveBuffer);
 			coordinate[1] = *(float*)(receiveBuffer + 4);
 			coordinate[2] = *(float*)(receiveBuffer + 8);
 
-			Normalize(coordinate_normalized, coordinate, normalize_max, normalize_min, this->upperBound, this->lowerBound, scales_coordinate_meter, offset_coordinate);
-
-			this->vector_xyz[0] = coordinate_normalized[1];
-			this->vector_xyz[1] = coordinate_normalized[2];
-			this->vector_xyz[2] = coordinate_normalized[0];
-			this->new_vector_avaiable = true;
+			// calibration is looked up per packet so a reload applies to the very next one
+			const HmdConfig& cfg = *this->config.read();
+			const Vec3f normalized = {
+				Normalize(coordinate[0], cfg.normalizeMaxX, cfg.normalizeMinX, cfg.upperBound, cfg.lowerBound, cfg.scalesCoordinateMeterX, cfg.offsetCoordinateX),
+				Normalize(coordinate[1], cfg.normalizeMaxY, cfg.normalizeMinY, cfg.upperBound, cfg.lowerBound, cfg.scalesCoordinateMeterY, cfg.offsetCoordinateY),
+				Normalize(coordinate[2], cfg.normalizeMaxZ, cfg.normalizeMinZ, cfg.upperBound, cfg.lowerBound, cfg.scalesCoordinateMeterZ, cfg.offsetCoordinateZ)
+			};
+
+			this->vector_xyz[0] = normalized.y;
+			this->vector_xyz[1] = normalized.z;
+			this->vector_xyz[2] = normalized.x;
+			this->pose_signal.Post();
 		}
 	}
 	Relativty::ServerDriver::Log("Thread3: successfully stopped\n");
 }
 
-Relativty::HMDDriver::HMDDriver(std::string myserial):RelativtyDevice(myserial, "akira_") {
-	// keys for use with the settings API
-	static const char* const Relativty_hmd_section = "Relativty_hmd";
-
+Relativty::HMDDriver::HMDDriver(std::string myserial, TrackerHub* trackers):RelativtyDevice(myserial, "akira_"), trackers(trackers) {
 	// openvr api stuff
 	m_sRenderModelPath = "{Relativty}/rendermodels/generic_hmd";
 	m_sBindPath = "{Relativty}/input/relativty_hmd_profile.json";
@@ -532,50 +1008,31 @@ Relativty::HMDDriver::HMDDriver(std::string myserial):RelativtyDevice(myserial,
 
 	// not openvr api stuff
 	Relativty::ServerDriver::Log("Loading Settings\n");
-	this->IPD = vr::VRSettings()->GetFloat(Relativty_hmd_section, "IPDmeters");
-	this->SecondsFromVsyncToPhotons = vr::VRSettings()->GetFloat(Relativty_hmd_section, "secondsFromVsyncToPhotons");
-	this->DisplayFrequency = vr::VRSettings()->GetFloat(Relativty_hmd_section, "displayFrequency");
-
-	this->start_tracking_server = vr::VRSettings()->GetBool(Relativty_hmd_section, "startTrackingServer");
-	this->upperBound = vr::VRSettings()->GetFloat(Relativty_hmd_section, "upperBound");
-	this->lowerBound = vr::VRSettings()->GetFloat(Relativty_hmd_section, "lowerBound");
-	this->normalizeMinX = vr::VRSettings()->GetFloat(Relativty_hmd_section, "normalizeMinX");
-	this->normalizeMinY = vr::VRSettings()->GetFloat(Relativty_hmd_section, "normalizeMinY");
-	this->normalizeMinZ = vr::VRSettings()->GetFloat(Relativty_hmd_section, "normalizeMinZ");
-	this->normalizeMaxX = vr::VRSettings()->GetFloat(Relativty_hmd_section, "normalizeMaxX");
-	this->normalizeMaxY = vr::VRSettings()->GetFloat(Relativty_hmd_section, "normalizeMaxY");
-	this->normalizeMaxZ = vr::VRSettings()->GetFloat(Relativty_hmd_section, "normalizeMaxZ");
-	this->scalesCoordinateMeterX = vr::VRSettings()->GetFloat(Relativty_hmd_section, "scalesCoordinateMeterX");
-	this->scalesCoordinateMeterY = vr::VRSettings()->GetFloat(Relativty_hmd_section, "scalesCoordinateMeterY");
-	this->scalesCoordinateMeterZ = vr::VRSettings()->GetFloat(Relativty_hmd_section, "scalesCoordinateMeterZ");
-	this->offsetCoordinateX = vr::VRSettings()->GetFloat(Relativty_hmd_section, "offsetCoordinateX");
-	this->offsetCoordinateY = vr::VRSettings()->GetFloat(Relativty_hmd_section, "offsetCoordinateY");
-	this->offsetCoordinateZ = vr::VRSettings()->GetFloat(Relativty_hmd_section, "offsetCoordinateZ");
-
-	this->m_iPid = vr::VRSettings()->GetInt32(Relativty_hmd_section, "hmdPid");
-	this->m_iVid = vr::VRSettings()->GetInt32(Relativty_hmd_section, "hmdVid");
-
-	this->m_bIMUpktIsDMP = vr::VRSettings()->GetBool(Relativty_hmd_section, "hmdIMUdmpPackets");
-
-	this->isMPUSerial = vr::VRSettings()->GetBool(Relativty_hmd_section, "isMPUSerial");
-
-
-	char buffer[1024];
-	vr::VRSettings()->GetString(Relativty_hmd_section, "PyPath", buffer, sizeof(buffer));
-	this->PyPath = buffer;
-	buffer[0] = 0;
-	vr::VRSettings()->GetString(Relativty_hmd_section, "COMPORT", buffer, sizeof(buffer));
-	this->COMPORT = buffer;
-
-	// this is a bad idea, this should be set by the tracking loop
-	m_Pose.result = vr::TrackingResult_Running_OK;
+	std::unique_ptr<HmdConfig> cfg = std::make_unique<HmdConfig>();
+	std::vector<std::string> problems;
+	LoadHmdConfig(*cfg, problems);
+	for (const std::string& problem : problems)
+		Relativty::ServerDriver::Log("Settings: " + problem + ", using the default\n");
+	const uint32_t driverCpuMask = static_cast<uint32_t>(cfg->imuThreadCpuMask | cfg->udpThreadCpuMask | cfg->poseThreadCpuMask);
+	if (static_cast<uint32_t>(cfg->trackerCpuMask) & driverCpuMask)
+		Relativty::ServerDriver::Log("Settings: trackerCpuMask overlaps the driver thread CPU masks, the tracker will compete with pose ingest\n");
+	this->config.publish(std::move(cfg));
+
+	char path[1024] = {};
+	vr::VRResources()->GetResourceFullPath("{Relativty}/resources/settings/default.vrsettings", "", path, sizeof(path));
+	this->settings_path = path;
+
+	// update_pose_threaded keeps these in line with the TrackingMonitor
+	m_Pose.result = vr::TrackingResult_Uninitialized;
+	m_Pose.poseIsValid = false;
 }
 
 inline void Relativty::HMDDriver::setProperties() {
-	vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, vr::Prop_UserIpdMeters_Float, this->IPD);
+	const HmdConfig& cfg = *this->config.read();
+	vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, vr::Prop_UserIpdMeters_Float, cfg.IPDmeters);
 	vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, vr::Prop_UserHeadToEyeDepthMeters_Float, 0.16f);
-	vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, vr::Prop_DisplayFrequency_Float, this->DisplayFrequency);
-	vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, vr::Prop_SecondsFromVsyncToPhotons_Float, this->SecondsFromVsyncToPhotons);
+	vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, vr::Prop_DisplayFrequency_Float, cfg.displayFrequency);
+	vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, vr::Prop_SecondsFromVsyncToPhotons_Float, cfg.secondsFromVsyncToPhotons);
 
 	// avoid "not fullscreen" warnings from vrmonitor
 	vr::VRProperties()->SetBoolProperty(m_ulPropertyContainer, vr::Prop_IsOnDesktop_Bool, false);
@@ -0,0 +1,490 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Relativty_HmdConfig.h"
+#include "Relativty_ThreadTuning.h"
+#include "Relativty_PoseStream.h"
+#include "Relativty_FramePacer.h"
+#include "openvr_driver.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+	const char* const kSection = "Relativty_hmd";
+
+	template<typename T>
+	struct Field {
+		const char* key;
+		T Relativty::HmdConfig::* member;
+		bool live;
+	};
+
+	using Config = Relativty::HmdConfig;
+
+	const Field<float> kFloatFields[] = {
+		{ "secondsFromVsyncToPhotons", &Config::secondsFromVsyncToPhotons, false },
+		{ "displayFrequency", &Config::displayFrequency, false },
+		{ "IPDmeters", &Config::IPDmeters, false },
+		{ "upperBound", &Config::upperBound, true },
+		{ "lowerBound", &Config::lowerBound, true },
+		{ "normalizeMinX", &Config::normalizeMinX, true },
+		{ "normalizeMinY", &Config::normalizeMinY, true },
+		{ "normalizeMinZ", &Config::normalizeMinZ, true },
+		{ "normalizeMaxX", &Config::normalizeMaxX, true },
+		{ "normalizeMaxY", &Config::normalizeMaxY, true },
+		{ "normalizeMaxZ", &Config::normalizeMaxZ, true },
+		{ "scalesCoordinateMeterX", &Config::scalesCoordinateMeterX, true },
+		{ "scalesCoordinateMeterY", &Config::scalesCoordinateMeterY, true },
+		{ "scalesCoordinateMeterZ", &Config::scalesCoordinateMeterZ, true },
+		{ "offsetCoordinateX", &Config::offsetCoordinateX, true },
+		{ "offsetCoordinateY", &Config::offsetCoordinateY, true },
+		{ "offsetCoordinateZ", &Config::offsetCoordinateZ, true },
+		{ "maxHeadSpeed", &Config::maxHeadSpeed, true },
+	};
+
+	const Field<int32_t> kIntFields[] = {
+		{ "hmdPid", &Config::hmdPid, false },
+		{ "hmdVid", &Config::hmdVid, false },
+		{ "trackerStallTimeoutMs", &Config::trackerStallTimeoutMs, false },
+		{ "trackerStartupGraceMs", &Config::trackerStartupGraceMs, false },
+		{ "trackerCpuMask", &Config::trackerCpuMask, false },
+		{ "trackerPriority", &Config::trackerPriority, false },
+		{ "cameraStaleMs", &Config::cameraStaleMs, true },
+		{ "imuStaleMs", &Config::imuStaleMs, true },
+		{ "disconnectAfterMs", &Config::disconnectAfterMs, true },
+		{ "cameraLatencyMs", &Config::cameraLatencyMs, false },
+		{ "relocalizationBlendMs", &Config::relocalizationBlendMs, true },
+		{ "maxPredictionMs", &Config::maxPredictionMs, false },
+		{ "imuThreadPriority", &Config::imuThreadPriority, false },
+		{ "imuThreadCpuMask", &Config::imuThreadCpuMask, false },
+		{ "udpThreadPriority", &Config::udpThreadPriority, false },
+		{ "udpThreadCpuMask", &Config::udpThreadCpuMask, false },
+		{ "poseThreadPriority", &Config::poseThreadPriority, false },
+		{ "poseThreadCpuMask", &Config::poseThreadCpuMask, false },
+	};
+
+	const Field<bool> kBoolFields[] = {
+		{ "startTrackingServer", &Config::startTrackingServer, false },
+		{ "hmdIMUdmpPackets", &Config::hmdIMUdmpPackets, false },
+		{ "hmdIMUserialBinaryPackets", &Config::hmdIMUserialBinaryPackets, false },
+		{ "isMPUSerial", &Config::isMPUSerial, false },
+		{ "positionUpsampling", &Config::positionUpsampling, false },
+	};
+
+	const Field<std::string> kStringFields[] = {
+		{ "COMPORT", &Config::COMPORT, false },
+		{ "PyPath", &Config::PyPath, false },
+		{ "PyModule", &Config::PyModule, false },
+		{ "tracePath", &Config::tracePath, false },
+		{ "trackerCommand", &Config::trackerCommand, false },
+		{ "trackerRoles", &Config::trackerRoles, false },
+		{ "publishMode", &Config::publishMode, false },
+		{ "imuThreadSched", &Config::imuThreadSched, false },
+		{ "udpThreadSched", &Config::udpThreadSched, false },
+		{ "poseThreadSched", &Config::poseThreadSched, false },
+		{ "controlChannel", &Config::controlChannel, false },
+	};
+
+	template<typename T, size_t N>
+	const Field<T>* findField(const Field<T>(&fields)[N], const std::string& key) {
+		for (const Field<T>& field : fields) {
+			if (key == field.key)
+				return &field;
+		}
+		return nullptr;
+	}
+
+	// minimal JSON reader, just enough to pick scalars out of one object
+	struct JsonCursor {
+		const std::string& text;
+		size_t pos = 0;
+
+		explicit JsonCursor(const std::string& source) : text(source) {}
+
+		void skipSpace() {
+			while (this->pos < this->text.size() && std::isspace(static_cast<unsigned char>(this->text[this->pos])))
+				this->pos++;
+		}
+
+		bool consume(char expected) {
+			this->skipSpace();
+			if (this->pos < this->text.size() && this->text[this->pos] == expected) {
+				this->pos++;
+				return true;
+			}
+			return false;
+		}
+
+		char peek() {
+			this->skipSpace();
+			return this->pos < this->text.size() ? this->text[this->pos] : 0;
+		}
+
+		bool string(std::string& out) {
+			out.clear();
+			if (!this->consume('"'))
+				return false;
+			while (this->pos < this->text.size()) {
+				char c = this->text[this->pos++];
+				if (c == '"')
+					return true;
+				if (c == '\\') {
+					if (this->pos >= this->text.size())
+						return false;
+					c = this->text[this->pos++];
+					switch (c) {
+					case 'n': c = '\n'; break;
+					case 't': c = '\t'; break;
+					case 'r': c = '\r'; break;
+					case 'b': c = '\b'; break;
+					case 'f': c = '\f'; break;
+					case 'u': {
+						if (this->pos + 4 > this->text.size())
+							return false;
+						const unsigned long code = std::strtoul(this->text.substr(this->pos, 4).c_str(), nullptr, 16);
+						this->pos += 4;
+						c = code < 0x80 ? static_cast<char>(code) : '?'; // paths and commands are ASCII
+						break;
+					}
+					default: break; // \" \\ \/
+					}
+				}
+				out += c;
+			}
+			return false;
+		}
+
+		// numbers, true, false and null, returned as written
+		bool literal(std::string& out) {
+			this->skipSpace();
+			const size_t start = this->pos;
+			while (this->pos < this->text.size()) {
+				const char c = this->text[this->pos];
+				if (c == ',' || c == '}' || c == ']' || std::isspace(static_cast<unsigned char>(c)))
+					break;
+				this->pos++;
+			}
+			out = this->text.substr(start, this->pos - start);
+			return !out.empty();
+		}
+
+		bool skipValue() {
+			std::string ignored;
+			const char c = this->peek();
+			if (c == '"')
+				return this->string(ignored);
+			if (c == '{' || c == '[') {
+				const char close = c == '{' ? '}' : ']';
+				this->pos++;
+				if (this->consume(close))
+					return true;
+				do {
+					if (close == '}' && (!this->string(ignored) || !this->consume(':')))
+						return false;
+					if (!this->skipValue())
+						return false;
+				} while (this->consume(','));
+				return this->consume(close);
+			}
+			return this->literal(ignored);
+		}
+	};
+
+	bool parseFloat(const std::string& value, float& out) {
+		char* end = nullptr;
+		errno = 0;
+		const double parsed = std::strtod(value.c_str(), &end);
+		if (value.empty() || *end != 0 || errno == ERANGE)
+			return false;
+		out = static_cast<float>(parsed);
+		return true;
+	}
+
+	bool parseInt(const std::string& value, int32_t& out) {
+		char* end = nullptr;
+		errno = 0;
+		const long long parsed = std::strtoll(value.c_str(), &end, 10);
+		if (value.empty() || *end != 0 || errno == ERANGE || parsed < INT32_MIN || parsed > INT32_MAX)
+			return false;
+		out = static_cast<int32_t>(parsed);
+		return true;
+	}
+
+	// resets a group of fields that are only valid together
+	template<typename... Members>
+	void resetFields(Relativty::HmdConfig& config, const Relativty::HmdConfig& fallback, Members... members) {
+		int unused[] = { ((config.*members = fallback.*members), 0)... };
+		(void)unused;
+	}
+
+	// the priority range depends on the class, so the pair is checked and reset together
+	void validateThreadSched(Relativty::HmdConfig& config, const Relativty::HmdConfig& fallback, const std::string& prefix,
+		std::string Relativty::HmdConfig::* sched, int32_t Relativty::HmdConfig::* priority, std::vector<std::string>& problems) {
+		Relativty::SchedClass schedClass;
+		if (!Relativty::ParseSchedClass(config.*sched, schedClass)) {
+			problems.push_back(prefix + "Sched must be \"normal\", \"fifo\" or \"rr\"");
+			resetFields(config, fallback, sched, priority);
+			return;
+		}
+		if (schedClass == Relativty::SchedClass::Normal && (config.*priority < -1 || config.*priority > 2)) {
+			problems.push_back(prefix + "Priority must be -1 (below normal) to 2 (high) for normal scheduling");
+			resetFields(config, fallback, sched, priority);
+		}
+		else if (schedClass != Relativty::SchedClass::Normal
+			&& (config.*priority < Relativty::kMinRealtimePriority || config.*priority > Relativty::kMaxRealtimePriority)) {
+			problems.push_back(prefix + "Priority must be 1 to 99 for real-time scheduling");
+			resetFields(config, fallback, sched, priority);
+		}
+	}
+}
+
+void Relativty::LoadHmdConfig(HmdConfig& config, std::vector<std::string>& problems) {
+	vr::EVRSettingsError error;
+	for (const Field<float>& field : kFloatFields) {
+		const float value = vr::VRSettings()->GetFloat(kSection, field.key, &error);
+		if (error == vr::VRSettingsError_None)
+			config.*field.member = value;
+	}
+	for (const Field<int32_t>& field : kIntFields) {
+		const int32_t value = vr::VRSettings()->GetInt32(kSection, field.key, &error);
+		if (error == vr::VRSettingsError_None)
+			config.*field.member = value;
+	}
+	for (const Field<bool>& field : kBoolFields) {
+		const bool value = vr::VRSettings()->GetBool(kSection, field.key, &error);
+		if (error == vr::VRSettingsError_None)
+			config.*field.member = value;
+	}
+	char buffer[1024];
+	for (const Field<std::string>& field : kStringFields) {
+		buffer[0] = 0;
+		vr::VRSettings()->GetString(kSection, field.key, buffer, sizeof(buffer), &error);
+		if (error == vr::VRSettingsError_None)
+			config.*field.member = buffer;
+	}
+
+	ValidateHmdConfig(config, HmdConfig(), problems);
+}
+
+bool Relativty::SetHmdSetting(HmdConfig& config, const std::string& key, const std::string& value, std::string& problem) {
+	if (const Field<float>* field = findField(kFloatFields, key)) {
+		float parsed;
+		if (parseFloat(value, parsed)) {
+			config.*field->member = parsed;
+			return true;
+		}
+		problem = key + " must be a number, got " + value;
+		return false;
+	}
+	if (const Field<int32_t>* field = findField(kIntFields, key)) {
+		int32_t parsed;
+		if (parseInt(value, parsed)) {
+			config.*field->member = parsed;
+			return true;
+		}
+		problem = key + " must be an integer, got " + value;
+		return false;
+	}
+	if (const Field<bool>* field = findField(kBoolFields, key)) {
+		if (value == "true" || value == "false") {
+			config.*field->member = value == "true";
+			return true;
+		}
+		problem = key + " must be true or false, got " + value;
+		return false;
+	}
+	if (const Field<std::string>* field = findField(kStringFields, key)) {
+		config.*field->member = value;
+		return true;
+	}
+	problem = "unknown setting " + key;
+	return false;
+}
+
+bool Relativty::IsLiveHmdSetting(const std::string& key) {
+	if (const Field<float>* field = findField(kFloatFields, key))
+		return field->live;
+	if (const Field<int32_t>* field = findField(kIntFields, key))
+		return field->live;
+	return false;
+}
+
+bool Relativty::ValidateHmdConfig(HmdConfig& config, const HmdConfig& fallback, std::vector<std::string>& problems) {
+	const size_t before = problems.size();
+
+	for (const Field<float>& field : kFloatFields) {
+		if (!std::isfinite(config.*field.member)) {
+			problems.push_back(std::string(field.key) + " is not a finite number");
+			config.*field.member = fallback.*field.member;
+		}
+	}
+
+	if (!(config.displayFrequency > 0.0f && config.displayFrequency <= 1000.0f)) {
+		problems.push_back("displayFrequency must be in (0, 1000] Hz");
+		resetFields(config, fallback, &HmdConfig::displayFrequency);
+	}
+	if (!(config.IPDmeters > 0.0f && config.IPDmeters <= 0.1f)) {
+		problems.push_back("IPDmeters must be in (0, 0.1] m");
+		resetFields(config, fallback, &HmdConfig::IPDmeters);
+	}
+	if (!(config.secondsFromVsyncToPhotons >= 0.0f && config.secondsFromVsyncToPhotons <= 0.1f)) {
+		problems.push_back("secondsFromVsyncToPhotons must be in [0, 0.1] s");
+		resetFields(config, fallback, &HmdConfig::secondsFromVsyncToPhotons);
+	}
+
+	if (config.upperBound == config.lowerBound) {
+		problems.push_back("upperBound and lowerBound must differ");
+		resetFields(config, fallback, &HmdConfig::upperBound, &HmdConfig::lowerBound);
+	}
+	if (!(config.normalizeMaxX > config.normalizeMinX)) {
+		problems.push_back("normalizeMaxX must be above normalizeMinX");
+		resetFields(config, fallback, &HmdConfig::normalizeMinX, &HmdConfig::normalizeMaxX);
+	}
+	if (!(config.normalizeMaxY > config.normalizeMinY)) {
+		problems.push_back("normalizeMaxY must be above normalizeMinY");
+		resetFields(config, fallback, &HmdConfig::normalizeMinY, &HmdConfig::normalizeMaxY);
+	}
+	if (!(config.normalizeMaxZ > config.normalizeMinZ)) {
+		problems.push_back("normalizeMaxZ must be above normalizeMinZ");
+		resetFields(config, fallback, &HmdConfig::normalizeMinZ, &HmdConfig::normalizeMaxZ);
+	}
+	if (config.scalesCoordinateMeterX == 0.0f) {
+		problems.push_back("scalesCoordinateMeterX must not be 0");
+		resetFields(config, fallback, &HmdConfig::scalesCoordinateMeterX);
+	}
+	if (config.scalesCoordinateMeterY == 0.0f) {
+		problems.push_back("scalesCoordinateMeterY must not be 0");
+		resetFields(config, fallback, &HmdConfig::scalesCoordinateMeterY);
+	}
+	if (config.scalesCoordinateMeterZ == 0.0f) {
+		problems.push_back("scalesCoordinateMeterZ must not be 0");
+		resetFields(config, fallback, &HmdConfig::scalesCoordinateMeterZ);
+	}
+
+	if (config.hmdPid < 0 || config.hmdPid > 0xFFFF) {
+		problems.push_back("hmdPid must be a 16 bit USB id");
+		resetFields(config, fallback, &HmdConfig::hmdPid);
+	}
+	if (config.hmdVid < 0 || config.hmdVid > 0xFFFF) {
+		problems.push_back("hmdVid must be a 16 bit USB id");
+		resetFields(config, fallback, &HmdConfig::hmdVid);
+	}
+	if (config.trackerStallTimeoutMs <= 0) {
+		problems.push_back("trackerStallTimeoutMs must be positive");
+		resetFields(config, fallback, &HmdConfig::trackerStallTimeoutMs);
+	}
+	if (config.trackerStartupGraceMs <= 0) {
+		problems.push_back("trackerStartupGraceMs must be positive");
+		resetFields(config, fallback, &HmdConfig::trackerStartupGraceMs);
+	}
+	if (config.trackerPriority < -1 || config.trackerPriority > 2) {
+		problems.push_back("trackerPriority must be -1 (below normal) to 2 (high)");
+		resetFields(config, fallback, &HmdConfig::trackerPriority);
+	}
+	if (config.cameraStaleMs <= 0 || config.imuStaleMs <= 0) {
+		problems.push_back("cameraStaleMs and imuStaleMs must be positive");
+		resetFields(config, fallback, &HmdConfig::cameraStaleMs, &HmdConfig::imuStaleMs);
+	}
+	if (config.disconnectAfterMs <= (std::max)(config.cameraStaleMs, config.imuStaleMs)) {
+		problems.push_back("disconnectAfterMs must be longer than cameraStaleMs and imuStaleMs");
+		resetFields(config, fallback, &HmdConfig::cameraStaleMs, &HmdConfig::imuStaleMs, &HmdConfig::disconnectAfterMs);
+	}
+	if (config.cameraLatencyMs < 0 || config.cameraLatencyMs > 200) {
+		problems.push_back("cameraLatencyMs must be in [0, 200] ms");
+		resetFields(config, fallback, &HmdConfig::cameraLatencyMs);
+	}
+	if (!(config.maxHeadSpeed > 0.5f && config.maxHeadSpeed <= 20.0f)) {
+		problems.push_back("maxHeadSpeed must be above 0.5 and at most 20 m/s");
+		resetFields(config, fallback, &HmdConfig::maxHeadSpeed);
+	}
+	if (config.relocalizationBlendMs < 0 || config.relocalizationBlendMs > 5000) {
+		problems.push_back("relocalizationBlendMs must be in [0, 5000] ms");
+		resetFields(config, fallback, &HmdConfig::relocalizationBlendMs);
+	}
+	TrackerRole roles[kMaxTrackers];
+	std::string rolesProblem;
+	if (!ParseTrackerRoles(config.trackerRoles, roles, rolesProblem)) {
+		problems.push_back(rolesProblem);
+		resetFields(config, fallback, &HmdConfig::trackerRoles);
+	}
+	PublishMode publishMode;
+	if (!ParsePublishMode(config.publishMode, publishMode)) {
+		problems.push_back("publishMode must be \"event\" or \"frame\"");
+		resetFields(config, fallback, &HmdConfig::publishMode);
+	}
+	if (config.maxPredictionMs < 0 || config.maxPredictionMs > 200) {
+		problems.push_back("maxPredictionMs must be in [0, 200] ms");
+		resetFields(config, fallback, &HmdConfig::maxPredictionMs);
+	}
+	validateThreadSched(config, fallback, "imuThread", &HmdConfig::imuThreadSched, &HmdConfig::imuThreadPriority, problems);
+	validateThreadSched(config, fallback, "udpThread", &HmdConfig::udpThreadSched, &HmdConfig::udpThreadPriority, problems);
+	validateThreadSched(config, fallback, "poseThread", &HmdConfig::poseThreadSched, &HmdConfig::poseThreadPriority, problems);
+	if (config.controlChannel.size() > 100 || config.controlChannel.find('\\') != std::string::npos) {
+		problems.push_back("controlChannel must be a name of at most 100 characters without '\\'");
+		resetFields(config, fallback, &HmdConfig::controlChannel);
+	}
+
+	return problems.size() == before;
+}
+
+bool Relativty::ParseHmdSettingsSection(const std::string& text, std::map<std::string, std::string>& values) {
+	values.clear();
+	JsonCursor cursor(text);
+	std::string key, value;
+
+	if (!cursor.consume('{'))
+		return false;
+	if (cursor.consume('}'))
+		return true;
+	do {
+		if (!cursor.string(key) || !cursor.consume(':'))
+			return false;
+		if (key != kSection || cursor.peek() != '{') {
+			if (!cursor.skipValue())
+				return false;
+			continue;
+		}
+
+		cursor.consume('{');
+		if (cursor.consume('}'))
+			continue;
+		do {
+			if (!cursor.string(key) || !cursor.consume(':'))
+				return false;
+			const char c = cursor.peek();
+			if (c == '"') {
+				if (!cursor.string(value))
+					return false;
+			}
+			else if (c == '{' || c == '[') {
+				if (!cursor.skipValue())
+					return false;
+				continue;
+			}
+			else if (!cursor.literal(value)) {
+				return false;
+			}
+			values[key] = value;
+		} while (cursor.consume(','));
+		if (!cursor.consume('}'))
+			return false;
+	} while (cursor.consume(','));
+	return cursor.consume('}');
+}
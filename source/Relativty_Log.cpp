@@ -0,0 +1,193 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Relativty_Log.h"
+#include "Relativty_Clock.h"
+#include "driverlog.h"
+
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	const size_t kLineLen = 240;
+	const size_t kRingSlots = 256; // per thread, 64KB
+
+	struct Record {
+		Relativty::LogLevel level;
+		char text[kLineLen];
+	};
+
+	// single producer (the owning thread), single consumer (the flush thread)
+	struct Ring {
+		Record slots[kRingSlots];
+		std::atomic<uint64_t> head{ 0 }; // next slot the producer writes
+		std::atomic<uint64_t> tail{ 0 }; // next slot the consumer reads
+		std::atomic<bool> abandoned{ false }; // owning thread exited
+	};
+
+	std::mutex g_registryMutex; // guards g_rings, only taken on registration and by the flush thread
+	std::vector<Ring*> g_rings;
+
+	std::atomic<bool> g_running{ false };
+	std::atomic<uint64_t> g_dropped{ 0 };
+	vr::IVRDriverLog* g_driverLog = nullptr;
+	std::thread g_flushThread;
+	std::mutex g_wakeMutex;
+	std::condition_variable g_wake;
+
+	struct ThreadRing {
+		Ring* ring = nullptr;
+		~ThreadRing() {
+			if (this->ring)
+				this->ring->abandoned = true;
+		}
+	};
+	thread_local ThreadRing t_ring;
+
+	Ring* threadRing() {
+		if (!t_ring.ring) {
+			t_ring.ring = new Ring();
+			std::lock_guard<std::mutex> lock(g_registryMutex);
+			g_rings.push_back(t_ring.ring);
+		}
+		return t_ring.ring;
+	}
+
+	const char* levelTag(Relativty::LogLevel level) {
+		switch (level) {
+		case Relativty::LogLevel::Debug: return "[D] ";
+		case Relativty::LogLevel::Info: return "";
+		case Relativty::LogLevel::Warning: return "[W] ";
+		default: return "[E] ";
+		}
+	}
+
+	// the text of a line, optionally followed by how many similar ones were held back
+	void formatLine(char* out, size_t size, uint32_t suppressed, const char* format, va_list args) {
+		int len = vsnprintf(out, size, format, args);
+		if (len < 0 || size_t(len) >= size)
+			len = int(strlen(out));
+		while (len > 0 && out[len - 1] == '\n')
+			out[--len] = 0;
+		if (suppressed)
+			snprintf(out + len, size - len, " (%u similar lines suppressed)", suppressed);
+	}
+
+	// returns true if anything was written
+	bool drain() {
+		bool any = false;
+		char line[kLineLen + 8];
+		std::lock_guard<std::mutex> lock(g_registryMutex);
+		for (size_t i = 0; i < g_rings.size();) {
+			Ring* ring = g_rings[i];
+			uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+			const uint64_t head = ring->head.load(std::memory_order_acquire);
+			for (; tail != head; tail++) {
+				const Record& record = ring->slots[tail % kRingSlots];
+				snprintf(line, sizeof(line), "%s%s\n", levelTag(record.level), record.text);
+				if (g_driverLog)
+					g_driverLog->Log(line);
+				any = true;
+			}
+			ring->tail.store(tail, std::memory_order_release);
+
+			// the producer is gone and everything it wrote has been flushed
+			if (ring->abandoned && ring->head.load(std::memory_order_acquire) == tail) {
+				delete ring;
+				g_rings[i] = g_rings.back();
+				g_rings.pop_back();
+			}
+			else {
+				i++;
+			}
+		}
+		return any;
+	}
+
+	void flushThreaded() {
+		while (g_running) {
+			if (!drain()) {
+				std::unique_lock<std::mutex> lock(g_wakeMutex);
+				g_wake.wait_for(lock, std::chrono::milliseconds(5));
+			}
+		}
+		drain();
+	}
+}
+
+void Relativty::AsyncLog::Start(vr::IVRDriverLog* driverLog) {
+	if (g_running)
+		return;
+	g_driverLog = driverLog;
+	g_running = true;
+	g_flushThread = std::thread(flushThreaded);
+}
+
+void Relativty::AsyncLog::Stop() {
+	if (!g_running)
+		return;
+	g_running = false;
+	g_wake.notify_one();
+	g_flushThread.join();
+	g_driverLog = nullptr;
+}
+
+void Relativty::AsyncLog::Write(LogLevel level, uint32_t suppressed, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+
+	if (!g_running) {
+		char line[kLineLen];
+		formatLine(line, sizeof(line), suppressed, format, args);
+		DriverLog("%s%s\n", levelTag(level), line);
+		va_end(args);
+		return;
+	}
+
+	Ring* ring = threadRing();
+	const uint64_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= kRingSlots) {
+		g_dropped++;
+		va_end(args);
+		return;
+	}
+
+	Record& record = ring->slots[head % kRingSlots];
+	record.level = level;
+	formatLine(record.text, sizeof(record.text), suppressed, format, args);
+	ring->head.store(head + 1, std::memory_order_release);
+
+	va_end(args);
+}
+
+uint64_t Relativty::AsyncLog::DroppedLines() {
+	return g_dropped;
+}
+
+bool Relativty::AsyncLog::RateLimit::Allow(int64_t intervalNs, uint32_t& suppressedOut) {
+	const int64_t now = MonotonicNowNs();
+	int64_t next = this->nextNs.load(std::memory_order_relaxed);
+	if (now < next || !this->nextNs.compare_exchange_strong(next, now + intervalNs, std::memory_order_relaxed)) {
+		this->suppressed++;
+		return false;
+	}
+	suppressedOut = this->suppressed.exchange(0);
+	return true;
+}
@@ -19,6 +19,9 @@
 
 #include "Relativty_ServerDriver.hpp"
 #include "Relativty_HMDDriver.hpp"
+#include "Relativty_TrackerDevice.h"
+#include "Relativty_Clock.h"
+#include "Relativty_Log.h"
 
 vr::EVRInitError Relativty::ServerDriver::Init(vr::IVRDriverContext* DriverContext) {
 
@@ -28,6 +31,7 @@ vr::EVRInitError Relativty::ServerDriver::Init(vr::IVRDriverContext* DriverConte
 	}
 	#ifdef DRIVERLOG_H
 	InitDriverLog(vr::VRDriverLog());
+	Relativty::AsyncLog::Start(vr::VRDriverLog());
 	DriverLog("Relativty driver version 0.1.1"); // report driver version
 	DriverLog("Thread1: hid quaternion packet listener loop");
 	DriverLog("Thread2: update driver pose loop");
@@ -36,7 +40,8 @@ vr::EVRInitError Relativty::ServerDriver::Init(vr::IVRDriverContext* DriverConte
 
 	this->Log("Relativty Init successful.\n");
 	
-	this->HMDDriver = new Relativty::HMDDriver("zero");
+	this->Trackers = new Relativty::TrackerHub();
+	this->HMDDriver = new Relativty::HMDDriver("zero", this->Trackers);
 	vr::VRServerDriverHost()->TrackedDeviceAdded(HMDDriver->GetSerialNumber().c_str(), vr::ETrackedDeviceClass::TrackedDeviceClass_HMD, this->HMDDriver);
 	// GetSerialNumber() is there for a reason!
 
@@ -46,7 +51,11 @@ vr::EVRInitError Relativty::ServerDriver::Init(vr::IVRDriverContext* DriverConte
 void Relativty::ServerDriver::Cleanup() {
 	delete this->HMDDriver;
 	this->HMDDriver = NULL;
+	// after the headset, whose threads fed it
+	delete this->Trackers;
+	this->Trackers = NULL;
 
+	Relativty::AsyncLog::Stop();
 	#ifdef DRIVERLOG_H
 	CleanupDriverLog();
 	#endif
@@ -58,7 +67,17 @@ const char* const* Relativty::ServerDriver::GetInterfaceVersions() {
 	return vr::k_InterfaceVersions;
 }
 
-void Relativty::ServerDriver::RunFrame() {} // if ur not using it don't populate it with garbage!
+// Trackers have no thread of their own, devices announced by the pose stream
+// are added and stale ones aged here. With publishMode "frame" every device
+// is also published from here, once per display frame.
+void Relativty::ServerDriver::RunFrame() {
+	vr::VREvent_t event;
+	while (vr::VRServerDriverHost()->PollNextEvent(&event, sizeof(event)))
+		this->Trackers->ProcessEvent(event);
+	const int64_t nowNs = Relativty::MonotonicNowNs();
+	this->Trackers->RunFrame(nowNs);
+	this->HMDDriver->RunFrame(nowNs);
+}
 
 bool Relativty::ServerDriver::ShouldBlockStandbyMode() {
 	return false;
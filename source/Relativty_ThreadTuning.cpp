@@ -0,0 +1,130 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Relativty_ThreadTuning.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <avrt.h>
+#pragma comment(lib, "Avrt.lib")
+#else
+#include <cstring>
+#endif
+
+namespace {
+	void appendProblem(std::string& problems, const std::string& problem) {
+		if (!problems.empty())
+			problems += "; ";
+		problems += problem;
+	}
+
+	int clampRealtimePriority(int priority) {
+		if (priority < Relativty::kMinRealtimePriority)
+			return Relativty::kMinRealtimePriority;
+		if (priority > Relativty::kMaxRealtimePriority)
+			return Relativty::kMaxRealtimePriority;
+		return priority;
+	}
+}
+
+void Relativty::SetCurrentThreadName(const char* name) {
+#ifdef _WIN32
+	// looked up at runtime, SetThreadDescription is missing before Windows 10 1607
+	typedef HRESULT(WINAPI* SetThreadDescriptionFn)(HANDLE, PCWSTR);
+	static const SetThreadDescriptionFn setThreadDescription = reinterpret_cast<SetThreadDescriptionFn>(
+		GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription"));
+	if (setThreadDescription == nullptr)
+		return;
+	wchar_t wideName[64];
+	const int length = MultiByteToWideChar(CP_UTF8, 0, name, -1, wideName, 64);
+	if (length > 0)
+		setThreadDescription(GetCurrentThread(), wideName);
+#else
+	char shortName[16];
+	snprintf(shortName, sizeof(shortName), "%s", name);
+	pthread_setname_np(pthread_self(), shortName);
+#endif
+}
+
+Relativty::ScopedThreadSched::ScopedThreadSched(const char* name, const ThreadSchedConfig& config) {
+	SetCurrentThreadName(name);
+
+	char description[96];
+	if (config.schedClass == SchedClass::Normal) {
+		const SchedPriority priority = ClampSchedPriority(config.priority);
+		if (priority != SchedPriority::Normal && !SetCurrentThreadPriority(priority)) {
+			appendProblem(this->problems, "could not change thread priority");
+			snprintf(description, sizeof(description), "normal");
+		}
+		else {
+			snprintf(description, sizeof(description), "normal %d", static_cast<int>(priority));
+		}
+	}
+	else {
+		const int priority = clampRealtimePriority(config.priority);
+#ifdef _WIN32
+		DWORD taskIndex = 0;
+		this->mmcssHandle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+		if (this->mmcssHandle != nullptr) {
+			const AVRT_PRIORITY level = priority >= 66 ? AVRT_PRIORITY_CRITICAL
+			                          : priority >= 33 ? AVRT_PRIORITY_HIGH : AVRT_PRIORITY_NORMAL;
+			AvSetMmThreadPriority(this->mmcssHandle, level);
+			snprintf(description, sizeof(description), "mmcss Pro Audio, level %d", static_cast<int>(level));
+		}
+		else {
+			// MMCSS service stopped or disabled, the best plain thread priority will have to do
+			appendProblem(this->problems, "MMCSS registration failed (error " + std::to_string(GetLastError()) + "), using time critical priority");
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+			snprintf(description, sizeof(description), "time critical");
+		}
+#else
+		pthread_getschedparam(pthread_self(), &this->previousPolicy, &this->previousParam);
+		const int policy = config.schedClass == SchedClass::Fifo ? SCHED_FIFO : SCHED_RR;
+		sched_param param = {};
+		param.sched_priority = priority;
+		const int error = pthread_setschedparam(pthread_self(), policy, &param);
+		if (error == 0) {
+			this->realtime = true;
+			snprintf(description, sizeof(description), "%s %d", SchedClassName(config.schedClass), priority);
+		}
+		else {
+			appendProblem(this->problems, std::string("real-time scheduling refused (") + strerror(error)
+				+ "), needs CAP_SYS_NICE or an RLIMIT_RTPRIO of at least " + std::to_string(priority));
+			snprintf(description, sizeof(description), "normal");
+		}
+#endif
+	}
+	this->achieved = description;
+
+	if (config.cpuMask != 0) {
+		char mask[32];
+		snprintf(mask, sizeof(mask), "0x%llx", static_cast<unsigned long long>(config.cpuMask));
+		if (PinCurrentThread(config.cpuMask))
+			this->achieved += std::string(", cpu mask ") + mask;
+		else
+			appendProblem(this->problems, std::string("could not pin to CPU mask ") + mask);
+	}
+}
+
+Relativty::ScopedThreadSched::~ScopedThreadSched() {
+#ifdef _WIN32
+	if (this->mmcssHandle != nullptr)
+		AvRevertMmThreadCharacteristics(this->mmcssHandle);
+#else
+	if (this->realtime)
+		pthread_setschedparam(pthread_self(), this->previousPolicy, &this->previousParam);
+#endif
+}
@@ -0,0 +1,450 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Relativty_Trace.h"
+#include "Relativty_Clock.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Relativty::Trace::g_enabled{ false };
+
+namespace {
+	enum EventType : uint8_t {
+		Event_Begin,
+		Event_End,
+		Event_Counter,
+		Event_FlowBegin,
+		Event_FlowEnd
+	};
+
+	struct Event {
+		int64_t timeNs;
+		const char* name;
+		uint64_t arg; // flow id, or the bits of the counter value
+		EventType type;
+	};
+
+	const size_t kEventsPerThread = 16384; // 512KB per buffer
+
+	// Written by its thread only. The lock is uncontended except while a dump
+	// copies the buffer out, so recording stays a few tens of nanoseconds.
+	struct ThreadBuffer {
+		uint32_t tid;
+		char name[32] = "";
+		bool exited = false; // under g_registryMutex
+		std::atomic<bool> locked{ false };
+		uint64_t written = 0;
+		Event events[kEventsPerThread];
+
+		void lock() {
+			while (this->locked.exchange(true, std::memory_order_acquire)) {}
+		}
+		void unlock() {
+			this->locked.store(false, std::memory_order_release);
+		}
+	};
+
+	std::mutex g_registryMutex;
+	std::vector<ThreadBuffer*> g_buffers; // one per thread recording at the same time, never freed
+	uint32_t g_nextTid = 1;               // under g_registryMutex
+	std::atomic<uint64_t> g_nextFlowId{ 1 };
+	thread_local char t_name[32] = "";
+
+	// The buffer of an exited thread stays in the dumps until a thread that
+	// starts recording later takes it over, so restarting the driver threads
+	// does not add buffers.
+	struct ThreadSlot {
+		ThreadBuffer* buffer = nullptr;
+
+		~ThreadSlot() {
+			if (this->buffer) {
+				std::lock_guard<std::mutex> lock(g_registryMutex);
+				this->buffer->exited = true;
+			}
+		}
+	};
+	thread_local ThreadSlot t_slot;
+
+	ThreadBuffer* threadBuffer() {
+		if (!t_slot.buffer) {
+			std::lock_guard<std::mutex> lock(g_registryMutex);
+			ThreadBuffer* buffer = nullptr;
+			for (ThreadBuffer* candidate : g_buffers) {
+				if (candidate->exited) {
+					buffer = candidate;
+					break;
+				}
+			}
+			if (!buffer) {
+				buffer = new ThreadBuffer();
+				g_buffers.push_back(buffer);
+			}
+			buffer->lock();
+			buffer->tid = g_nextTid++;
+			buffer->exited = false;
+			buffer->written = 0;
+			snprintf(buffer->name, sizeof(buffer->name), "%s", t_name);
+			buffer->unlock();
+			t_slot.buffer = buffer;
+		}
+		return t_slot.buffer;
+	}
+
+	void record(EventType type, const char* name, uint64_t arg) {
+		ThreadBuffer* buffer = threadBuffer();
+		buffer->lock();
+		Event& event = buffer->events[buffer->written % kEventsPerThread];
+		event.timeNs = Relativty::MonotonicNowNs();
+		event.name = name;
+		event.arg = arg;
+		event.type = type;
+		buffer->written++;
+		buffer->unlock();
+	}
+
+	struct ThreadSnapshot {
+		uint32_t tid;
+		std::string name;
+		std::vector<Event> events;
+	};
+
+	std::vector<ThreadSnapshot> snapshot() {
+		std::vector<ThreadSnapshot> threads;
+		std::lock_guard<std::mutex> lock(g_registryMutex);
+		for (ThreadBuffer* buffer : g_buffers) {
+			ThreadSnapshot thread;
+			thread.tid = buffer->tid;
+			buffer->lock();
+			thread.name = buffer->name;
+			const uint64_t count = (std::min)(buffer->written, uint64_t(kEventsPerThread));
+			for (uint64_t i = buffer->written - count; i < buffer->written; i++)
+				thread.events.push_back(buffer->events[i % kEventsPerThread]);
+			buffer->unlock();
+
+			// the ring may have wrapped in the middle of a slice, drop unmatched ends
+			int depth = 0;
+			std::vector<Event> balanced;
+			for (const Event& event : thread.events) {
+				if (event.type == Event_End && depth == 0)
+					continue;
+				if (event.type == Event_Begin)
+					depth++;
+				else if (event.type == Event_End)
+					depth--;
+				balanced.push_back(event);
+			}
+			thread.events.swap(balanced);
+			threads.push_back(std::move(thread));
+		}
+		return threads;
+	}
+
+	double counterValue(uint64_t bits) {
+		double value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	std::string jsonEscape(const char* text) {
+		std::string out;
+		for (; *text; text++) {
+			if (*text == '"' || *text == '\\')
+				out += '\\';
+			if (static_cast<unsigned char>(*text) >= 0x20)
+				out += *text;
+		}
+		return out;
+	}
+
+	// minimal protobuf writer, enough for the Perfetto trace packets below
+	void putVarint(std::string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out += char(uint8_t(value) | 0x80);
+			value >>= 7;
+		}
+		out += char(uint8_t(value));
+	}
+	void putVarintField(std::string& out, uint32_t field, uint64_t value) {
+		putVarint(out, (uint64_t(field) << 3) | 0);
+		putVarint(out, value);
+	}
+	void putFixed64Field(std::string& out, uint32_t field, uint64_t value) {
+		putVarint(out, (uint64_t(field) << 3) | 1);
+		for (int i = 0; i < 8; i++)
+			out += char(uint8_t(value >> (8 * i)));
+	}
+	void putDoubleField(std::string& out, uint32_t field, double value) {
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		putFixed64Field(out, field, bits);
+	}
+	void putBytesField(std::string& out, uint32_t field, const std::string& bytes) {
+		putVarint(out, (uint64_t(field) << 3) | 2);
+		putVarint(out, bytes.size());
+		out += bytes;
+	}
+
+	// field numbers from perfetto/protos/perfetto/trace/
+	namespace pb {
+		const uint32_t Trace_packet = 1;
+		const uint32_t TracePacket_timestamp = 8;
+		const uint32_t TracePacket_trusted_packet_sequence_id = 10;
+		const uint32_t TracePacket_track_event = 11;
+		const uint32_t TracePacket_track_descriptor = 60;
+		const uint32_t TrackDescriptor_uuid = 1;
+		const uint32_t TrackDescriptor_name = 2;
+		const uint32_t TrackDescriptor_process = 3;
+		const uint32_t TrackDescriptor_thread = 4;
+		const uint32_t TrackDescriptor_parent_uuid = 5;
+		const uint32_t TrackDescriptor_counter = 8;
+		const uint32_t ProcessDescriptor_pid = 1;
+		const uint32_t ProcessDescriptor_process_name = 6;
+		const uint32_t ThreadDescriptor_pid = 1;
+		const uint32_t ThreadDescriptor_tid = 2;
+		const uint32_t ThreadDescriptor_thread_name = 5;
+		const uint32_t TrackEvent_type = 9;
+		const uint32_t TrackEvent_track_uuid = 11;
+		const uint32_t TrackEvent_name = 23;
+		const uint32_t TrackEvent_double_counter_value = 44;
+		const uint32_t TrackEvent_flow_ids = 47;
+		const uint32_t TrackEvent_terminating_flow_ids = 48;
+		const uint64_t Type_SliceBegin = 1;
+		const uint64_t Type_SliceEnd = 2;
+		const uint64_t Type_Instant = 3;
+		const uint64_t Type_Counter = 4;
+	}
+
+	const uint32_t kPid = 1;
+	const uint32_t kSequenceId = 1;
+	const uint64_t kProcessUuid = 1;
+
+	void putPacket(std::string& trace, const std::string& packet) {
+		putBytesField(trace, pb::Trace_packet, packet);
+	}
+
+	uint64_t counterUuid(const char* name) {
+		uint64_t hash = 14695981039346656037ull;
+		for (; *name; name++)
+			hash = (hash ^ uint8_t(*name)) * 1099511628211ull;
+		return hash | (1ull << 63); // keep clear of the small thread uuids
+	}
+
+	bool writeFile(const std::string& path, const std::string& data) {
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+		const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+		return fclose(file) == 0 && written;
+	}
+}
+
+void Relativty::Trace::Enable(bool enabled) {
+	g_enabled = enabled;
+}
+
+void Relativty::Trace::SetThreadName(const char* name) {
+	snprintf(t_name, sizeof(t_name), "%s", name);
+	if (!t_slot.buffer && !IsEnabled())
+		return;
+	ThreadBuffer* buffer = threadBuffer();
+	buffer->lock();
+	snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+	buffer->unlock();
+}
+
+void Relativty::Trace::Begin(const char* name) {
+	record(Event_Begin, name, 0);
+}
+
+void Relativty::Trace::End() {
+	record(Event_End, nullptr, 0);
+}
+
+void Relativty::Trace::Counter(const char* name, double value) {
+	if (!IsEnabled())
+		return;
+	uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	record(Event_Counter, name, bits);
+}
+
+size_t Relativty::Trace::BufferCount() {
+	std::lock_guard<std::mutex> lock(g_registryMutex);
+	return g_buffers.size();
+}
+
+uint64_t Relativty::Trace::NewFlowId() {
+	return g_nextFlowId++;
+}
+
+void Relativty::Trace::FlowBegin(const char* name, uint64_t id) {
+	if (IsEnabled())
+		record(Event_FlowBegin, name, id);
+}
+
+void Relativty::Trace::FlowEnd(const char* name, uint64_t id) {
+	if (IsEnabled())
+		record(Event_FlowEnd, name, id);
+}
+
+bool Relativty::Trace::Dump(const std::string& path) {
+	const std::string json = ".json";
+	if (path.size() >= json.size() && path.compare(path.size() - json.size(), json.size(), json) == 0)
+		return DumpChromeJson(path);
+	return DumpPerfetto(path);
+}
+
+bool Relativty::Trace::DumpChromeJson(const std::string& path) {
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	char line[512];
+	bool first = true;
+	auto append = [&](const char* text) {
+		if (!first)
+			out += ",\n";
+		out += text;
+		first = false;
+	};
+
+	snprintf(line, sizeof(line), "{\"ph\":\"M\",\"pid\":%u,\"name\":\"process_name\",\"args\":{\"name\":\"Relativty driver\"}}", kPid);
+	append(line);
+	for (const ThreadSnapshot& thread : snapshot()) {
+		if (!thread.name.empty()) {
+			snprintf(line, sizeof(line), "{\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+				kPid, thread.tid, jsonEscape(thread.name.c_str()).c_str());
+			append(line);
+		}
+		for (const Event& event : thread.events) {
+			const double ts = event.timeNs / 1000.0;
+			switch (event.type) {
+			case Event_Begin:
+				snprintf(line, sizeof(line), "{\"ph\":\"B\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"}",
+					kPid, thread.tid, ts, jsonEscape(event.name).c_str());
+				break;
+			case Event_End:
+				snprintf(line, sizeof(line), "{\"ph\":\"E\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f}", kPid, thread.tid, ts);
+				break;
+			case Event_Counter:
+				snprintf(line, sizeof(line), "{\"ph\":\"C\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\",\"args\":{\"value\":%.17g}}",
+					kPid, thread.tid, ts, jsonEscape(event.name).c_str(), counterValue(event.arg));
+				break;
+			case Event_FlowBegin:
+			case Event_FlowEnd:
+				snprintf(line, sizeof(line), "{\"ph\":\"%s\",\"bp\":\"e\",\"cat\":\"flow\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\",\"id\":%llu}",
+					event.type == Event_FlowBegin ? "s" : "f", kPid, thread.tid, ts, jsonEscape(event.name).c_str(),
+					static_cast<unsigned long long>(event.arg));
+				break;
+			}
+			append(line);
+		}
+	}
+	out += "\n]}\n";
+	return writeFile(path, out);
+}
+
+bool Relativty::Trace::DumpPerfetto(const std::string& path) {
+	std::string trace;
+	std::string packet;
+	std::string message;
+	std::string nested;
+
+	// process track
+	nested.clear();
+	putVarintField(nested, pb::ProcessDescriptor_pid, kPid);
+	putBytesField(nested, pb::ProcessDescriptor_process_name, "Relativty driver");
+	message.clear();
+	putVarintField(message, pb::TrackDescriptor_uuid, kProcessUuid);
+	putBytesField(message, pb::TrackDescriptor_process, nested);
+	packet.clear();
+	putBytesField(packet, pb::TracePacket_track_descriptor, message);
+	putPacket(trace, packet);
+
+	const std::vector<ThreadSnapshot> threads = snapshot();
+	std::map<uint64_t, const char*> counters;
+
+	for (const ThreadSnapshot& thread : threads) {
+		const uint64_t threadUuid = 2 + thread.tid;
+		nested.clear();
+		putVarintField(nested, pb::ThreadDescriptor_pid, kPid);
+		putVarintField(nested, pb::ThreadDescriptor_tid, thread.tid);
+		if (!thread.name.empty())
+			putBytesField(nested, pb::ThreadDescriptor_thread_name, thread.name);
+		message.clear();
+		putVarintField(message, pb::TrackDescriptor_uuid, threadUuid);
+		putVarintField(message, pb::TrackDescriptor_parent_uuid, kProcessUuid);
+		putBytesField(message, pb::TrackDescriptor_thread, nested);
+		packet.clear();
+		putBytesField(packet, pb::TracePacket_track_descriptor, message);
+		putPacket(trace, packet);
+
+		for (const Event& event : thread.events) {
+			if (event.type == Event_Counter)
+				counters[counterUuid(event.name)] = event.name;
+		}
+	}
+
+	for (const auto& counter : counters) {
+		message.clear();
+		putVarintField(message, pb::TrackDescriptor_uuid, counter.first);
+		putVarintField(message, pb::TrackDescriptor_parent_uuid, kProcessUuid);
+		putBytesField(message, pb::TrackDescriptor_name, counter.second);
+		putBytesField(message, pb::TrackDescriptor_counter, std::string());
+		packet.clear();
+		putBytesField(packet, pb::TracePacket_track_descriptor, message);
+		putPacket(trace, packet);
+	}
+
+	for (const ThreadSnapshot& thread : threads) {
+		const uint64_t threadUuid = 2 + thread.tid;
+		for (const Event& event : thread.events) {
+			message.clear();
+			switch (event.type) {
+			case Event_Begin:
+				putVarintField(message, pb::TrackEvent_type, pb::Type_SliceBegin);
+				putVarintField(message, pb::TrackEvent_track_uuid, threadUuid);
+				putBytesField(message, pb::TrackEvent_name, event.name);
+				break;
+			case Event_End:
+				putVarintField(message, pb::TrackEvent_type, pb::Type_SliceEnd);
+				putVarintField(message, pb::TrackEvent_track_uuid, threadUuid);
+				break;
+			case Event_Counter:
+				putVarintField(message, pb::TrackEvent_type, pb::Type_Counter);
+				putVarintField(message, pb::TrackEvent_track_uuid, counterUuid(event.name));
+				putDoubleField(message, pb::TrackEvent_double_counter_value, counterValue(event.arg));
+				break;
+			case Event_FlowBegin:
+			case Event_FlowEnd:
+				// an instant inside the current slice carries the flow
+				putVarintField(message, pb::TrackEvent_type, pb::Type_Instant);
+				putVarintField(message, pb::TrackEvent_track_uuid, threadUuid);
+				putBytesField(message, pb::TrackEvent_name, event.name);
+				putFixed64Field(message, event.type == Event_FlowBegin ? pb::TrackEvent_flow_ids : pb::TrackEvent_terminating_flow_ids, event.arg);
+				break;
+			}
+			packet.clear();
+			putVarintField(packet, pb::TracePacket_timestamp, uint64_t(event.timeNs));
+			putVarintField(packet, pb::TracePacket_trusted_packet_sequence_id, kSequenceId);
+			putBytesField(packet, pb::TracePacket_track_event, message);
+			putPacket(trace, packet);
+		}
+	}
+
+	return writeFile(path, trace);
+}
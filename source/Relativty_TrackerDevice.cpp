@@ -0,0 +1,232 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "openvr_driver.h"
+
+#include "driverlog.h"
+
+#include "Relativty_TrackerDevice.h"
+#include "Relativty_Clock.h"
+#include "Relativty_Log.h"
+
+#include <cstdio>
+#include <string>
+
+Relativty::TrackerDevice::TrackerDevice(uint32_t id, TrackerRole role, const TrackingBudgets& budgets, const TrackerPublishing& publishing)
+	: RelativtyDevice("tracker" + std::to_string(id), std::string("relativty_") + TrackerRoleName(role) + "_"), id(id), role(role),
+	publish_mode(publishing.mode) {
+	const bool hand = role == TrackerRole::LeftHand || role == TrackerRole::RightHand;
+	m_sRenderModelPath = hand ? "vr_controller_vive_1_5" : "{htc}vr_tracker_vive_1_0";
+	m_sBindPath = "{Relativty}/input/relativty_tracker_profile.json";
+
+	this->tracking_monitor.Reset(budgets, MonotonicNowNs());
+	this->pose_predictor.Reset(publishing.maxPredictionNs);
+	this->publish_pacing.Reset(publishing.displayPeriodNs);
+	SetPoseTrackingState(m_Pose, TrackingState::Uninitialized);
+	// trackers report absolute poses, there is no IMU to drift
+	m_Pose.willDriftInYaw = false;
+}
+
+vr::EVRInitError Relativty::TrackerDevice::Activate(vr::TrackedDeviceIndex_t unObjectId) {
+	std::lock_guard<std::mutex> lock(this->publish_mutex);
+	RelativtyDevice::Activate(unObjectId);
+
+	vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, vr::Prop_ControllerType_String, "relativty_tracker");
+	vr::ETrackedControllerRole hint = vr::TrackedControllerRole_OptOut;
+	if (this->role == TrackerRole::LeftHand)
+		hint = vr::TrackedControllerRole_LeftHand;
+	else if (this->role == TrackerRole::RightHand)
+		hint = vr::TrackedControllerRole_RightHand;
+	vr::VRProperties()->SetInt32Property(m_ulPropertyContainer, vr::Prop_ControllerRoleHint_Int32, hint);
+	return vr::VRInitError_None;
+}
+
+void Relativty::TrackerDevice::Deactivate() {
+	std::lock_guard<std::mutex> lock(this->publish_mutex);
+	RelativtyDevice::Deactivate();
+	DriverLog("Tracker %u: %s\n", this->id, this->Report().c_str());
+}
+
+// "tracking_stats" returns the time spent in each tracking state
+void Relativty::TrackerDevice::DebugRequest(const char* pchRequest, char* pchResponseBuffer, uint32_t unResponseBufferSize) {
+	if (std::string(pchRequest) != "tracking_stats") {
+		RelativtyDevice::DebugRequest(pchRequest, pchResponseBuffer, unResponseBufferSize);
+		return;
+	}
+	if (unResponseBufferSize >= 1)
+		snprintf(pchResponseBuffer, unResponseBufferSize, "%s", this->Report().c_str());
+}
+
+vr::ETrackedDeviceClass Relativty::TrackerDevice::DeviceClass() const {
+	if (this->role == TrackerRole::LeftHand || this->role == TrackerRole::RightHand)
+		return vr::TrackedDeviceClass_Controller;
+	return vr::TrackedDeviceClass_GenericTracker;
+}
+
+void Relativty::TrackerDevice::SubmitPose(const TrackerPose& pose) {
+	std::lock_guard<std::mutex> lock(this->publish_mutex);
+	// aged from arrival like the headset's camera poses, whatever clock the sender stamped them with
+	const int64_t nowNs = MonotonicNowNs();
+	this->last_pose_ns = nowNs;
+	this->poses_received++;
+	TrackerPose arrived = pose;
+	arrived.timestampNs = nowNs;
+	this->pose_predictor.Add(arrived);
+	m_Pose.vecPosition[0] = pose.position[0];
+	m_Pose.vecPosition[1] = pose.position[1];
+	m_Pose.vecPosition[2] = pose.position[2];
+	m_Pose.qRotation = ToHmdQuaternion(QuatLoad(pose.rotation));
+	const TrackingState state = this->tracking_monitor.Update(nowNs, this->last_pose_ns, 0);
+	if (this->publish_mode == PublishMode::Event)
+		this->publish_locked(state, nowNs);
+}
+
+void Relativty::TrackerDevice::Refresh(int64_t nowNs) {
+	std::lock_guard<std::mutex> lock(this->publish_mutex);
+	const TrackingState previous = this->tracking_monitor.State();
+	const TrackingState state = this->tracking_monitor.Update(nowNs, this->last_pose_ns, 0);
+	if (state != previous) {
+		RELATIVTY_LOG(Info, "Tracker %u: tracking state %s -> %s", this->id, TrackingStateName(previous), TrackingStateName(state));
+		if (this->publish_mode == PublishMode::Event)
+			this->publish_locked(state, nowNs);
+	}
+}
+
+void Relativty::TrackerDevice::PublishFrame(int64_t photonNs, int64_t nowNs) {
+	std::lock_guard<std::mutex> lock(this->publish_mutex);
+	if (m_unObjectId == vr::k_unTrackedDeviceIndexInvalid)
+		return;
+	const TrackingState state = this->tracking_monitor.Update(nowNs, this->last_pose_ns, 0);
+	SetPoseTrackingState(m_Pose, state);
+	vr::DriverPose_t pose = m_Pose;
+	PredictedPose predicted;
+	if (state == TrackingState::Tracking && this->pose_predictor.Predict(photonNs, predicted)) {
+		ApplyPrediction(pose, predicted, photonNs - nowNs);
+		this->publish_pacing.Frame(predicted.newPoses, predicted.horizonNs);
+	}
+	else {
+		this->publish_pacing.Frame(0, 0);
+	}
+	this->publish_pacing.Published(nowNs);
+	PublishPose(pose);
+}
+
+void Relativty::TrackerDevice::SetBudgets(const TrackingBudgets& budgets) {
+	std::lock_guard<std::mutex> lock(this->publish_mutex);
+	this->tracking_monitor.SetBudgets(budgets);
+}
+
+void Relativty::TrackerDevice::publish_locked(TrackingState state, int64_t nowNs) {
+	SetPoseTrackingState(m_Pose, state);
+	// m_unObjectId only changes under publish_mutex
+	if (m_unObjectId != vr::k_unTrackedDeviceIndexInvalid)
+		this->publish_pacing.Published(nowNs);
+	PublishPose(m_Pose);
+}
+
+std::string Relativty::TrackerDevice::Report() const {
+	return std::string(TrackerRoleName(this->role)) + ", " + std::to_string(this->poses_received.load()) + " poses received, "
+		+ this->tracking_monitor.Report() + "; published " + this->publish_pacing.Report();
+}
+
+Relativty::TrackerHub::~TrackerHub() {
+	for (std::atomic<TrackerDevice*>& device : this->devices)
+		delete device.exchange(nullptr);
+}
+
+void Relativty::TrackerHub::Configure(const std::string& roles, const TrackingBudgets& budgets, const TrackerPublishing& publishing) {
+	std::lock_guard<std::mutex> lock(this->config_mutex);
+	std::string problem;
+	if (!ParseTrackerRoles(roles, this->roles, problem))
+		RELATIVTY_LOG(Warning, "Trackers: %s", problem.c_str());
+	this->budgets = budgets;
+	this->publishing = publishing;
+}
+
+// under config_mutex, so a device add_device is creating gets them too
+void Relativty::TrackerHub::SetBudgets(const TrackingBudgets& budgets) {
+	std::lock_guard<std::mutex> lock(this->config_mutex);
+	this->budgets = budgets;
+	for (std::atomic<TrackerDevice*>& slot : this->devices) {
+		if (TrackerDevice* device = slot.load(std::memory_order_acquire))
+			device->SetBudgets(budgets);
+	}
+}
+
+void Relativty::TrackerHub::Submit(const TrackerPose& pose) {
+	if (pose.device < 1 || pose.device > kMaxTrackers) {
+		this->poses_unknown_device++;
+		return;
+	}
+	const uint32_t index = pose.device - 1;
+	TrackerDevice* device = this->devices[index].load(std::memory_order_acquire);
+	if (device == nullptr) {
+		// SteamVR wants devices added from its own thread, RunFrame does it and the next pose gets through
+		this->wanted[index].store(true, std::memory_order_relaxed);
+		this->poses_before_added++;
+		return;
+	}
+	device->SubmitPose(pose);
+}
+
+void Relativty::TrackerHub::RunFrame(int64_t nowNs) {
+	for (uint32_t index = 0; index < kMaxTrackers; index++) {
+		if (TrackerDevice* device = this->devices[index].load(std::memory_order_acquire))
+			device->Refresh(nowNs);
+		else if (this->wanted[index].exchange(false, std::memory_order_relaxed))
+			this->add_device(index);
+	}
+}
+
+void Relativty::TrackerHub::PublishFrame(int64_t photonNs, int64_t nowNs) {
+	for (std::atomic<TrackerDevice*>& slot : this->devices) {
+		if (TrackerDevice* device = slot.load(std::memory_order_acquire))
+			device->PublishFrame(photonNs, nowNs);
+	}
+}
+
+void Relativty::TrackerHub::ProcessEvent(const vr::VREvent_t& event) {
+	for (std::atomic<TrackerDevice*>& slot : this->devices) {
+		if (TrackerDevice* device = slot.load(std::memory_order_acquire))
+			device->ProcessEvent(event);
+	}
+}
+
+void Relativty::TrackerHub::add_device(uint32_t index) {
+	TrackerDevice* device;
+	{
+		std::lock_guard<std::mutex> lock(this->config_mutex);
+		device = new TrackerDevice(index + 1, this->roles[index], this->budgets, this->publishing);
+		this->devices[index].store(device, std::memory_order_release);
+	}
+	// kept even if SteamVR refuses it, it then never publishes and is not retried every frame
+	if (!vr::VRServerDriverHost()->TrackedDeviceAdded(device->GetSerialNumber().c_str(), device->DeviceClass(), device))
+		RELATIVTY_LOG(Warning, "Trackers: SteamVR did not add %s", device->GetSerialNumber().c_str());
+	else
+		RELATIVTY_LOG(Info, "Trackers: added %s as %s", device->GetSerialNumber().c_str(), device->Report().c_str());
+}
+
+// one line per tracker that was seen, "tracker3: left_hand, 8120 poses, now tracking; ..."
+std::string Relativty::TrackerHub::Report() const {
+	std::string report;
+	for (const std::atomic<TrackerDevice*>& slot : this->devices) {
+		if (const TrackerDevice* device = slot.load(std::memory_order_acquire))
+			report += device->GetSerialNumber() + ": " + device->Report() + "\n";
+	}
+	char totals[128];
+	snprintf(totals, sizeof(totals), "poses dropped: %llu before the device was added, %llu for an unknown device\n",
+		static_cast<unsigned long long>(this->poses_before_added.load()), static_cast<unsigned long long>(this->poses_unknown_device.load()));
+	return report + totals;
+}
@@ -0,0 +1,266 @@
+// Copyright (C) 2020  Max Coutte, Gabriel Combe
+// Copyright (C) 2020  Relativty.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Relativty_TrackerSupervisor.h"
+#include "Relativty_Clock.h"
+#include "Relativty_Log.h"
+
+#include <algorithm>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#endif
+
+namespace {
+	const int64_t kPollMs = 50;
+	const int64_t kTerminateGraceMs = 2000; // between the polite and the forced kill
+}
+
+void Relativty::TrackerSupervisor::Start(const TrackerSupervisorConfig& config) {
+	if (this->running || config.command.empty())
+		return;
+	this->config = config;
+	if (this->config.backoffMaxMs < this->config.backoffMinMs)
+		this->config.backoffMaxMs = this->config.backoffMinMs;
+	this->running = true;
+	this->worker = std::thread(&TrackerSupervisor::superviseThreaded, this);
+}
+
+void Relativty::TrackerSupervisor::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(this->stopMutex);
+		if (!this->running)
+			return;
+		this->running = false;
+	}
+	this->stopWake.notify_all();
+	this->worker.join();
+	RELATIVTY_LOG(Info, "Tracker: supervisor stopped after %llu launches, %llu crashes, %llu stalls",
+		this->launches.load(), this->crashes.load(), this->stalls.load());
+}
+
+bool Relativty::TrackerSupervisor::waitStop(int64_t ms) {
+	std::unique_lock<std::mutex> lock(this->stopMutex);
+	return this->stopWake.wait_for(lock, std::chrono::milliseconds(ms), [this] { return !this->running; });
+}
+
+void Relativty::TrackerSupervisor::superviseThreaded() {
+	int64_t backoffMs = this->config.backoffMinMs;
+	while (this->running) {
+		if (!this->launch()) {
+			RELATIVTY_LOG(Error, "Tracker: could not start \"%s\", retrying in %lld ms", this->config.command.c_str(), backoffMs);
+			if (this->waitStop(backoffMs))
+				break;
+			backoffMs = (std::min)(backoffMs * 2, this->config.backoffMaxMs);
+			continue;
+		}
+		this->launches++;
+		const int64_t startedNs = MonotonicNowNs();
+		RELATIVTY_LOG(Info, "Tracker: started \"%s\" (launch %llu)", this->config.command.c_str(), this->launches.load());
+
+		int exitCode = 0;
+		bool stopped = false;
+		for (;;) {
+			if (this->waitStop(kPollMs)) {
+				this->terminate();
+				stopped = true;
+				break;
+			}
+			if (this->hasExited(exitCode)) {
+				this->crashes++;
+				RELATIVTY_LOG(Warning, "Tracker: exited with code %d", exitCode);
+				break;
+			}
+
+			// a pose from the previous run does not count for this one
+			const int64_t now = MonotonicNowNs();
+			const int64_t lastPose = this->lastPoseNs.load(std::memory_order_relaxed);
+			const bool hadPose = lastPose > startedNs;
+			const int64_t silenceMs = (now - (hadPose ? lastPose : startedNs)) / 1000000;
+			const int64_t allowedMs = hadPose ? this->config.stallTimeoutMs : this->config.startupGraceMs;
+			if (silenceMs > allowedMs) {
+				this->stalls++;
+				RELATIVTY_LOG(Warning, "Tracker: no pose for %lld ms, restarting it", silenceMs);
+				this->terminate();
+				break;
+			}
+		}
+		if (stopped)
+			break;
+
+		if ((MonotonicNowNs() - startedNs) / 1000000 >= this->config.healthyResetMs)
+			backoffMs = this->config.backoffMinMs;
+		RELATIVTY_LOG(Info, "Tracker: restarting in %lld ms", backoffMs);
+		if (this->waitStop(backoffMs))
+			break;
+		backoffMs = (std::min)(backoffMs * 2, this->config.backoffMaxMs);
+	}
+
+#ifdef _WIN32
+	if (this->job != NULL) {
+		CloseHandle(this->job);
+		this->job = NULL;
+	}
+#endif
+}
+
+#ifdef _WIN32
+
+bool Relativty::TrackerSupervisor::launch() {
+	DWORD priorityClass = NORMAL_PRIORITY_CLASS;
+	switch (this->config.priority) {
+	case SchedPriority::BelowNormal: priorityClass = BELOW_NORMAL_PRIORITY_CLASS; break;
+	case SchedPriority::AboveNormal: priorityClass = ABOVE_NORMAL_PRIORITY_CLASS; break;
+	case SchedPriority::High: priorityClass = HIGH_PRIORITY_CLASS; break;
+	default: break;
+	}
+
+	// The tracker is a child of cmd.exe, SetPriorityClass on the process we
+	// start would only reach cmd.exe. The job's limits apply to every
+	// process in it, the tracker included.
+	if (this->job == NULL) {
+		this->job = CreateJobObjectA(NULL, NULL);
+		if (this->job != NULL) {
+			JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+			limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE | JOB_OBJECT_LIMIT_PRIORITY_CLASS;
+			limits.BasicLimitInformation.PriorityClass = priorityClass;
+			if (this->config.cpuMask != 0) {
+				limits.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_AFFINITY;
+				limits.BasicLimitInformation.Affinity = static_cast<ULONG_PTR>(this->config.cpuMask);
+			}
+			this->jobLimits = SetInformationJobObject(this->job, JobObjectExtendedLimitInformation, &limits, sizeof(limits)) != FALSE;
+			if (!this->jobLimits) {
+				RELATIVTY_LOG(Warning, "Tracker: could not set the job's priority and CPU affinity, only cmd.exe gets them");
+				limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+				SetInformationJobObject(this->job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+			}
+		}
+	}
+
+	std::string commandLine = "cmd.exe /c " + this->config.command;
+	std::vector<char> mutableCommandLine(commandLine.begin(), commandLine.end());
+	mutableCommandLine.push_back(0);
+
+	STARTUPINFOA startup = {};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION info = {};
+	if (!CreateProcessA(NULL, mutableCommandLine.data(), NULL, NULL, FALSE, CREATE_NO_WINDOW | CREATE_SUSPENDED,
+	                    NULL, NULL, &startup, &info))
+		return false;
+
+	// set everything up before the tracker runs a single instruction
+	const bool inJob = this->job != NULL && AssignProcessToJobObject(this->job, info.hProcess);
+	if (!inJob || !this->jobLimits) {
+		if (this->config.cpuMask != 0 && !SetProcessAffinityMask(info.hProcess, static_cast<DWORD_PTR>(this->config.cpuMask)))
+			RELATIVTY_LOG(Warning, "Tracker: could not set CPU affinity 0x%llx", static_cast<unsigned long long>(this->config.cpuMask));
+		SetPriorityClass(info.hProcess, priorityClass);
+	}
+	ResumeThread(info.hThread);
+	CloseHandle(info.hThread);
+
+	this->process = info.hProcess;
+	return true;
+}
+
+bool Relativty::TrackerSupervisor::hasExited(int& exitCode) {
+	if (WaitForSingleObject(this->process, 0) != WAIT_OBJECT_0)
+		return false;
+	DWORD code = 0;
+	GetExitCodeProcess(this->process, &code);
+	exitCode = static_cast<int>(code);
+	CloseHandle(this->process);
+	this->process = NULL;
+	return true;
+}
+
+void Relativty::TrackerSupervisor::terminate() {
+	if (this->process == NULL)
+		return;
+	// the job also holds whatever cmd.exe started
+	if (this->job != NULL)
+		TerminateJobObject(this->job, 1);
+	else
+		TerminateProcess(this->process, 1);
+	WaitForSingleObject(this->process, static_cast<DWORD>(kTerminateGraceMs));
+	CloseHandle(this->process);
+	this->process = NULL;
+}
+
+#else
+
+bool Relativty::TrackerSupervisor::launch() {
+	// everything the child needs is prepared here, after fork() it may only
+	// make async-signal-safe calls
+	const std::string command = "exec " + this->config.command;
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for (int cpu = 0; cpu < 64; cpu++) {
+		if (this->config.cpuMask & (uint64_t(1) << cpu))
+			CPU_SET(cpu, &cpus);
+	}
+	const int nice = NiceForPriority(this->config.priority);
+	const pid_t parent = getpid();
+
+	const pid_t child = fork();
+	if (child < 0)
+		return false;
+	if (child == 0) {
+		setpgid(0, 0); // own group, so terminate() also reaches anything it spawns
+		prctl(PR_SET_PDEATHSIG, SIGTERM); // dies with the supervisor thread
+		if (getppid() != parent)
+			_exit(127);
+		if (this->config.cpuMask != 0)
+			sched_setaffinity(0, sizeof(cpus), &cpus);
+		if (nice != 0)
+			setpriority(PRIO_PROCESS, 0, nice);
+		execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+		_exit(127);
+	}
+	setpgid(child, child); // also from this side, whichever runs first wins
+
+	this->pid = child;
+	return true;
+}
+
+bool Relativty::TrackerSupervisor::hasExited(int& exitCode) {
+	int status = 0;
+	if (waitpid(this->pid, &status, WNOHANG) != this->pid)
+		return false;
+	exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	this->pid = -1;
+	return true;
+}
+
+void Relativty::TrackerSupervisor::terminate() {
+	if (this->pid <= 0)
+		return;
+	kill(-this->pid, SIGTERM);
+	int status = 0;
+	for (int64_t waited = 0; waited < kTerminateGraceMs; waited += 10) {
+		if (waitpid(this->pid, &status, WNOHANG) == this->pid) {
+			this->pid = -1;
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	kill(-this->pid, SIGKILL);
+	waitpid(this->pid, &status, 0);
+	this->pid = -1;
+}
+
+#endif
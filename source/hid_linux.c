@@ -0,0 +1,683 @@
+/*******************************************************
+ HIDAPI - Multi-Platform library for
+ communication with HID devices.
+
+ Linux hidraw backend.
+
+ Implements the API in hidapi/hidapi.h on top of the kernel's hidraw
+ interface. Devices are enumerated straight from sysfs
+ (/sys/class/hidraw/hidrawN/device/uevent), so there is no dependency
+ on libudev. Reads go through poll() on the hidraw file descriptor, which
+ can be fetched with hid_hidraw_get_fd() to be waited on together with
+ other descriptors.
+
+ At the discretion of the user of this library,
+ this software may be licensed under the terms of the
+ GNU General Public License v3, a BSD-Style license, or the
+ original HIDAPI license as outlined in the LICENSE.txt,
+ LICENSE-gpl3.txt, LICENSE-bsd.txt, and LICENSE-orig.txt
+ files located at the root of the source distribution.
+ These files may also be found in the public source
+ code repository located at:
+        https://github.com/libusb/hidapi .
+********************************************************/
+
+#if defined(__linux__)
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <linux/hidraw.h>
+#include <linux/input.h>
+
+#include "hidapi/hidapi.h"
+#include "hidapi/hidapi_hidraw.h"
+
+#define HIDRAW_SYSFS_CLASS "/sys/class/hidraw"
+
+/* Bus type from linux/input.h, repeated for older kernel headers. */
+#ifndef BUS_USB
+#define BUS_USB 0x03
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hid_device_ {
+	int device_handle;
+	int blocking;
+	wchar_t *last_error_str;
+};
+
+static wchar_t *last_global_error_str = NULL;
+
+static hid_device *new_hid_device()
+{
+	hid_device *dev = (hid_device*) calloc(1, sizeof(hid_device));
+	dev->device_handle = -1;
+	dev->blocking = 1;
+	dev->last_error_str = NULL;
+
+	return dev;
+}
+
+static void free_hid_device(hid_device *dev)
+{
+	free(dev->last_error_str);
+	free(dev);
+}
+
+/* Converts a UTF-8 C string to a newly allocated wide string. */
+static wchar_t *utf8_to_wchar_t(const char *utf8)
+{
+	wchar_t *ret = NULL;
+
+	if (utf8) {
+		size_t wlen = mbstowcs(NULL, utf8, 0);
+		if ((size_t) -1 == wlen) {
+			return wcsdup(L"");
+		}
+		ret = (wchar_t*) calloc(wlen+1, sizeof(wchar_t));
+		mbstowcs(ret, utf8, wlen+1);
+		ret[wlen] = 0x0000;
+	}
+
+	return ret;
+}
+
+static void register_error_str(wchar_t **error_str, const char *op)
+{
+	char msg[256];
+
+	free(*error_str);
+	if (op == NULL) {
+		*error_str = NULL;
+		return;
+	}
+	snprintf(msg, sizeof(msg), "%s: %s", op, strerror(errno));
+	*error_str = utf8_to_wchar_t(msg);
+}
+
+static void register_error(hid_device *dev, const char *op)
+{
+	register_error_str(dev ? &dev->last_error_str : &last_global_error_str, op);
+}
+
+/* Reads a whole (small) sysfs attribute into buf, NUL terminated.
+   Returns the number of bytes read or -1 on error. */
+static ssize_t read_sysfs_file(const char *path, char *buf, size_t buf_size)
+{
+	ssize_t res;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	res = read(fd, buf, buf_size - 1);
+	close(fd);
+	if (res < 0)
+		return -1;
+
+	buf[res] = '\0';
+	/* Strip the trailing newline sysfs attributes end with. */
+	if (res > 0 && buf[res-1] == '\n')
+		buf[--res] = '\0';
+
+	return res;
+}
+
+/*
+ * Parses the uevent of a hid device, which looks like:
+ *   HID_ID=0003:0000046D:0000C077
+ *   HID_NAME=Logitech USB Optical Mouse
+ *   HID_UNIQ=
+ * The strings returned through serial_number_utf8 and product_name_utf8
+ * must be freed by the caller.
+ */
+static int parse_uevent_info(const char *uevent, unsigned *bus_type,
+	unsigned short *vendor_id, unsigned short *product_id,
+	char **serial_number_utf8, char **product_name_utf8)
+{
+	char *tmp = strdup(uevent);
+	char *saveptr = NULL;
+	char *line;
+	char *key;
+	char *value;
+
+	int found_id = 0;
+	int found_serial = 0;
+	int found_name = 0;
+
+	line = strtok_r(tmp, "\n", &saveptr);
+	while (line != NULL) {
+		key = line;
+		value = strchr(line, '=');
+		if (!value)
+			goto next_line;
+		*value = '\0';
+		value++;
+
+		if (strcmp(key, "HID_ID") == 0) {
+			unsigned int vid, pid;
+			int ret = sscanf(value, "%x:%x:%x", bus_type, &vid, &pid);
+			if (ret == 3) {
+				*vendor_id = (unsigned short) vid;
+				*product_id = (unsigned short) pid;
+				found_id = 1;
+			}
+		} else if (strcmp(key, "HID_NAME") == 0) {
+			*product_name_utf8 = strdup(value);
+			found_name = 1;
+		} else if (strcmp(key, "HID_UNIQ") == 0) {
+			*serial_number_utf8 = strdup(value);
+			found_serial = 1;
+		}
+
+next_line:
+		line = strtok_r(NULL, "\n", &saveptr);
+	}
+
+	free(tmp);
+	return (found_id && found_name && found_serial);
+}
+
+/* Walks up from the hid device directory to the USB device directory
+   (the first ancestor with an idVendor attribute) and reads attr from it. */
+static char *read_usb_parent_attribute(const char *device_dir, const char *attr)
+{
+	char path[PATH_MAX + 64];
+	char dir[PATH_MAX];
+	char value[256];
+	char *slash;
+
+	strncpy(dir, device_dir, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+
+	while ((slash = strrchr(dir, '/')) != NULL && slash != dir) {
+		*slash = '\0';
+		snprintf(path, sizeof(path), "%s/idVendor", dir);
+		if (access(path, R_OK) == 0) {
+			snprintf(path, sizeof(path), "%s/%s", dir, attr);
+			if (read_sysfs_file(path, value, sizeof(value)) < 0)
+				return NULL;
+			return strdup(value);
+		}
+	}
+
+	return NULL;
+}
+
+/* The USB interface directory is the parent of the hid device directory,
+   named like 1-1.2:1.0 where the digit after the last dot is the
+   interface number. */
+static int get_usb_interface_number(const char *device_dir)
+{
+	const char *parent_end = strrchr(device_dir, '/');
+	const char *p;
+	const char *dot = NULL;
+
+	if (!parent_end)
+		return -1;
+	for (p = parent_end - 1; p > device_dir && *p != '/'; p--) {
+		if (*p == '.' && dot == NULL)
+			dot = p;
+		if (*p == ':')
+			break;
+	}
+	if (*p != ':' || dot == NULL)
+		return -1;
+
+	return (int) strtol(dot + 1, NULL, 10);
+}
+
+/* Pulls the top level Usage Page and Usage out of a report descriptor. */
+static void get_usage_from_report_descriptor(const unsigned char *rpt, size_t size,
+	unsigned short *usage_page, unsigned short *usage)
+{
+	size_t i = 0;
+	int found_page = 0;
+	int found_usage = 0;
+
+	while (i < size && !(found_page && found_usage)) {
+		unsigned char key = rpt[i];
+		size_t data_len;
+		unsigned int value = 0;
+		size_t j;
+
+		/* Long items carry their size in the next byte, skip them. */
+		if ((key & 0xf0) == 0xf0) {
+			if (i + 1 >= size)
+				break;
+			i += 3 + rpt[i+1];
+			continue;
+		}
+
+		data_len = key & 0x3;
+		if (data_len == 3)
+			data_len = 4;
+		if (i + data_len >= size)
+			break;
+		for (j = 0; j < data_len; j++)
+			value |= (unsigned int) rpt[i+1+j] << (8*j);
+
+		switch (key & 0xfc) {
+		case 0x04: /* Usage Page */
+			*usage_page = (unsigned short) value;
+			found_page = 1;
+			break;
+		case 0x08: /* Usage */
+			*usage = (unsigned short) value;
+			found_usage = 1;
+			break;
+		}
+
+		i += 1 + data_len;
+	}
+}
+
+static struct hid_device_info *create_device_info(const char *hidraw_name,
+	unsigned short vendor_id, unsigned short product_id)
+{
+	struct hid_device_info *cur_dev;
+	char path[PATH_MAX + 64];
+	char device_dir[PATH_MAX];
+	char uevent[2048];
+	unsigned char report_descriptor[HID_MAX_DESCRIPTOR_SIZE];
+	unsigned bus_type = 0;
+	unsigned short dev_vid = 0;
+	unsigned short dev_pid = 0;
+	char *serial_number_utf8 = NULL;
+	char *product_name_utf8 = NULL;
+	char *manufacturer_utf8 = NULL;
+	char *product_utf8 = NULL;
+	char *release_utf8 = NULL;
+	ssize_t report_descriptor_len;
+	int fd;
+
+	snprintf(path, sizeof(path), HIDRAW_SYSFS_CLASS "/%s/device", hidraw_name);
+	if (!realpath(path, device_dir))
+		return NULL;
+
+	snprintf(path, sizeof(path), "%s/uevent", device_dir);
+	if (read_sysfs_file(path, uevent, sizeof(uevent)) < 0)
+		return NULL;
+
+	if (!parse_uevent_info(uevent, &bus_type, &dev_vid, &dev_pid,
+			&serial_number_utf8, &product_name_utf8)) {
+		free(serial_number_utf8);
+		free(product_name_utf8);
+		return NULL;
+	}
+
+	if ((vendor_id != 0x0 && vendor_id != dev_vid) ||
+	    (product_id != 0x0 && product_id != dev_pid)) {
+		free(serial_number_utf8);
+		free(product_name_utf8);
+		return NULL;
+	}
+
+	cur_dev = (struct hid_device_info*) calloc(1, sizeof(struct hid_device_info));
+
+	snprintf(path, sizeof(path), "/dev/%s", hidraw_name);
+	cur_dev->path = strdup(path);
+	cur_dev->vendor_id = dev_vid;
+	cur_dev->product_id = dev_pid;
+	cur_dev->serial_number = utf8_to_wchar_t(serial_number_utf8);
+	cur_dev->interface_number = -1;
+
+	if (bus_type == BUS_USB) {
+		manufacturer_utf8 = read_usb_parent_attribute(device_dir, "manufacturer");
+		product_utf8 = read_usb_parent_attribute(device_dir, "product");
+		release_utf8 = read_usb_parent_attribute(device_dir, "bcdDevice");
+		cur_dev->interface_number = get_usb_interface_number(device_dir);
+	}
+	cur_dev->manufacturer_string = utf8_to_wchar_t(manufacturer_utf8 ? manufacturer_utf8 : "");
+	cur_dev->product_string = utf8_to_wchar_t(product_utf8 ? product_utf8 : product_name_utf8);
+	cur_dev->release_number = release_utf8 ? (unsigned short) strtol(release_utf8, NULL, 16) : 0;
+
+	/* The report descriptor is world readable in sysfs, unlike the device
+	   node, so usage information is available without opening it. */
+	snprintf(path, sizeof(path), "%s/report_descriptor", device_dir);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		report_descriptor_len = read(fd, report_descriptor, sizeof(report_descriptor));
+		if (report_descriptor_len > 0)
+			get_usage_from_report_descriptor(report_descriptor, (size_t) report_descriptor_len,
+				&cur_dev->usage_page, &cur_dev->usage);
+		close(fd);
+	}
+
+	free(serial_number_utf8);
+	free(product_name_utf8);
+	free(manufacturer_utf8);
+	free(product_utf8);
+	free(release_utf8);
+
+	return cur_dev;
+}
+
+int HID_API_EXPORT hid_init(void)
+{
+	register_error(NULL, NULL);
+	return 0;
+}
+
+int HID_API_EXPORT hid_exit(void)
+{
+	register_error(NULL, NULL);
+	return 0;
+}
+
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+	struct hid_device_info *root = NULL; /* return object */
+	struct hid_device_info *cur_dev = NULL;
+	struct hid_device_info *tmp;
+	struct dirent *entry;
+	DIR *dir;
+
+	hid_init();
+
+	dir = opendir(HIDRAW_SYSFS_CLASS);
+	if (!dir) {
+		register_error(NULL, "opendir " HIDRAW_SYSFS_CLASS);
+		return NULL;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "hidraw", 6) != 0)
+			continue;
+
+		tmp = create_device_info(entry->d_name, vendor_id, product_id);
+		if (!tmp)
+			continue;
+
+		if (cur_dev) {
+			cur_dev->next = tmp;
+		}
+		else {
+			root = tmp;
+		}
+		cur_dev = tmp;
+	}
+	closedir(dir);
+
+	return root;
+}
+
+void  HID_API_EXPORT HID_API_CALL hid_free_enumeration(struct hid_device_info *devs)
+{
+	/* TODO: Merge this with the Windows version. */
+	struct hid_device_info *d = devs;
+	while (d) {
+		struct hid_device_info *next = d->next;
+		free(d->path);
+		free(d->serial_number);
+		free(d->manufacturer_string);
+		free(d->product_string);
+		free(d);
+		d = next;
+	}
+}
+
+HID_API_EXPORT hid_device * HID_API_CALL hid_open(unsigned short vendor_id, unsigned short product_id, const wchar_t *serial_number)
+{
+	/* TODO: Merge this functions with the Windows version. */
+	struct hid_device_info *devs, *cur_dev;
+	const char *path_to_open = NULL;
+	hid_device *handle = NULL;
+
+	devs = hid_enumerate(vendor_id, product_id);
+	cur_dev = devs;
+	while (cur_dev) {
+		if (cur_dev->vendor_id == vendor_id &&
+		    cur_dev->product_id == product_id) {
+			if (serial_number) {
+				if (cur_dev->serial_number && wcscmp(serial_number, cur_dev->serial_number) == 0) {
+					path_to_open = cur_dev->path;
+					break;
+				}
+			}
+			else {
+				path_to_open = cur_dev->path;
+				break;
+			}
+		}
+		cur_dev = cur_dev->next;
+	}
+
+	if (path_to_open) {
+		/* Open the device */
+		handle = hid_open_path(path_to_open);
+	}
+
+	hid_free_enumeration(devs);
+
+	return handle;
+}
+
+HID_API_EXPORT hid_device * HID_API_CALL hid_open_path(const char *path)
+{
+	hid_device *dev = NULL;
+
+	hid_init();
+
+	dev = new_hid_device();
+
+	/* The descriptor is always non-blocking, blocking reads are emulated
+	   with poll() so that hid_read_timeout() works in both modes. */
+	dev->device_handle = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (dev->device_handle < 0) {
+		register_error(NULL, "open");
+		free_hid_device(dev);
+		return NULL;
+	}
+
+	return dev;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *data, size_t length)
+{
+	ssize_t bytes_written;
+
+	bytes_written = write(dev->device_handle, data, length);
+	if (bytes_written < 0) {
+		register_error(dev, "write");
+		return -1;
+	}
+
+	return (int) bytes_written;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+	ssize_t bytes_read;
+
+	if (milliseconds != 0) {
+		/* milliseconds is -1 or > 0. In both cases, we want to
+		   call poll() and wait for data to arrive. Don't rely on
+		   the descriptor being blocking, it never is. */
+		struct pollfd fds;
+		int ret;
+
+		fds.fd = dev->device_handle;
+		fds.events = POLLIN;
+		fds.revents = 0;
+		do {
+			ret = poll(&fds, 1, milliseconds);
+		} while (ret < 0 && errno == EINTR);
+
+		if (ret < 0) {
+			register_error(dev, "poll");
+			return -1;
+		}
+		if (ret == 0) {
+			/* Timeout */
+			return 0;
+		}
+		if (fds.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			/* Error or hang up, the device is most likely unplugged. */
+			errno = ENODEV;
+			register_error(dev, "poll");
+			return -1;
+		}
+	}
+
+	bytes_read = read(dev->device_handle, data, length);
+	if (bytes_read < 0) {
+		if (errno == EAGAIN || errno == EINPROGRESS)
+			return 0;
+		register_error(dev, "read");
+		return -1;
+	}
+
+	return (int) bytes_read;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read(hid_device *dev, unsigned char *data, size_t length)
+{
+	return hid_read_timeout(dev, data, length, (dev->blocking)? -1: 0);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_set_nonblocking(hid_device *dev, int nonblock)
+{
+	dev->blocking = !nonblock;
+	return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
+{
+	int res = ioctl(dev->device_handle, HIDIOCSFEATURE(length), data);
+	if (res < 0)
+		register_error(dev, "ioctl (SFEATURE)");
+
+	return res;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+	int res = ioctl(dev->device_handle, HIDIOCGFEATURE(length), data);
+	if (res < 0)
+		register_error(dev, "ioctl (GFEATURE)");
+
+	return res;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_input_report(hid_device *dev, unsigned char *data, size_t length)
+{
+#ifdef HIDIOCGINPUT
+	int res = ioctl(dev->device_handle, HIDIOCGINPUT(length), data);
+	if (res < 0)
+		register_error(dev, "ioctl (GINPUT)");
+
+	return res;
+#else
+	(void) data;
+	(void) length;
+	errno = ENOSYS;
+	register_error(dev, "ioctl (GINPUT)");
+	return -1;
+#endif
+}
+
+void HID_API_EXPORT HID_API_CALL hid_close(hid_device *dev)
+{
+	if (!dev)
+		return;
+	close(dev->device_handle);
+	free_hid_device(dev);
+}
+
+/* Looks up the cached enumeration info of an open device by its node. */
+static int get_device_string(hid_device *dev, int which, wchar_t *string, size_t maxlen)
+{
+	struct stat s;
+	char hidraw_name[32];
+	struct hid_device_info *info;
+	const wchar_t *value = NULL;
+	int ret = -1;
+
+	if (fstat(dev->device_handle, &s) < 0) {
+		register_error(dev, "fstat");
+		return -1;
+	}
+	snprintf(hidraw_name, sizeof(hidraw_name), "hidraw%u", minor(s.st_rdev));
+
+	info = create_device_info(hidraw_name, 0, 0);
+	if (!info) {
+		errno = ENODEV;
+		register_error(dev, "sysfs");
+		return -1;
+	}
+
+	switch (which) {
+	case 0: value = info->manufacturer_string; break;
+	case 1: value = info->product_string; break;
+	case 2: value = info->serial_number; break;
+	}
+	if (value && maxlen > 0) {
+		wcsncpy(string, value, maxlen);
+		string[maxlen-1] = L'\0';
+		ret = 0;
+	}
+
+	hid_free_enumeration(info);
+	return ret;
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_manufacturer_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	return get_device_string(dev, 0, string, maxlen);
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_product_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	return get_device_string(dev, 1, string, maxlen);
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_serial_number_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	return get_device_string(dev, 2, string, maxlen);
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_indexed_string(hid_device *dev, int string_index, wchar_t *string, size_t maxlen)
+{
+	/* hidraw does not expose USB string descriptors by index. */
+	(void) string_index;
+	(void) string;
+	(void) maxlen;
+	errno = ENOSYS;
+	register_error(dev, "hid_get_indexed_string");
+	return -1;
+}
+
+HID_API_EXPORT const wchar_t * HID_API_CALL  hid_error(hid_device *dev)
+{
+	if (dev)
+		return dev->last_error_str;
+	return last_global_error_str;
+}
+
+int HID_API_EXPORT_CALL hid_hidraw_get_fd(hid_device *dev)
+{
+	return dev ? dev->device_handle : -1;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __linux__ */
@@ -0,0 +1,82 @@
+/*******************************************************
+ Relativty BNO055 firmware emulator, standalone.
+
+ Opens a pty, prints the path of its serial end and plays the TinyPICO
+ firmware on it (see bno055_emulator.h) until --seconds pass or it is
+ killed. Point anything that reads the firmware at the printed path.
+
+   --rate 60         samples per second, 0 for as fast as the reader takes them
+   --binary          BINARY_OUTPUT frames instead of text lines
+   --turn 30         degrees per second about the vertical
+   --noise 0         degrees, standard deviation per sample
+   --drift 0         degrees of extra yaw per minute
+   --corrupt 0       share of the samples damaged
+   --disconnect 0    ms until the port goes away, 0 never
+   --status 0        ms between unrequested "C:" lines, 0 only on "C\n"
+   --seconds 0       0 for until killed
+   --seed 1
+
+ Build:
+   g++ -std=c++17 -O2 -Iinclude -Iserial/tests trackertest/bno055_emulator.cpp -lpthread -o bno055_emulator
+********************************************************/
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "bno055_emulator.h"
+
+int main(int argc, char** argv) {
+	Relativty::Bno055Options options;
+	double seconds = 0;
+	for (int i = 1; i < argc; i++) {
+		const std::string key = argv[i];
+		if (key == "--binary") {
+			options.binary = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			std::fprintf(stderr, "usage: %s [--option value ...], see the top of bno055_emulator.cpp\n", argv[0]);
+			return 2;
+		}
+		const double value = std::atof(argv[++i]);
+		if (key == "--rate")
+			options.rateHz = value;
+		else if (key == "--turn")
+			options.turnDegPerS = value;
+		else if (key == "--noise")
+			options.noiseDeg = value;
+		else if (key == "--drift")
+			options.driftDegPerMin = value;
+		else if (key == "--corrupt")
+			options.corruptRate = value;
+		else if (key == "--disconnect")
+			options.disconnectAfterMs = static_cast<int>(value);
+		else if (key == "--status")
+			options.statusEveryMs = static_cast<int>(value);
+		else if (key == "--seconds")
+			seconds = value;
+		else if (key == "--seed")
+			options.seed = static_cast<uint32_t>(value);
+		else {
+			std::fprintf(stderr, "unknown option %s\n", key.c_str());
+			return 2;
+		}
+	}
+
+	Relativty::Bno055Emulator emulator(options);
+	std::printf("%s\n", emulator.Port().c_str());
+	std::fflush(stdout);
+	emulator.Start();
+	for (double waited = 0; (seconds <= 0 || waited < seconds) && !emulator.Disconnected(); waited += 0.1)
+		usleep(100000);
+	emulator.Stop();
+	std::printf("sent %llu samples, %llu corrupted, %llu status lines, %llu C commands%s\n",
+		static_cast<unsigned long long>(emulator.SamplesSent()), static_cast<unsigned long long>(emulator.Corrupted()),
+		static_cast<unsigned long long>(emulator.StatusLines()), static_cast<unsigned long long>(emulator.Commands()),
+		emulator.Disconnected() ? ", then disconnected" : "");
+	return 0;
+}
@@ -0,0 +1,271 @@
+/*******************************************************
+ Relativty BNO055 firmware emulator.
+
+ Plays MICROCONTROLLER/tinypico_bno055.ino on the master side of a pty,
+ so the serial IMU ingest can be tested and benchmarked without a
+ TinyPICO. Open Port() like the COM port the firmware shows up as.
+
+   - text mode sends "w,y,z,x\r\n" lines with 4 decimals, the way
+     Serial.print(value, 4) / Serial.println() do; binary mode sends the
+     11 byte BINARY_OUTPUT frames (ImuCodec<Bno055Binary>::encode)
+   - the orientation turns about the vertical at turnDegPerS, with
+     gaussian noise and a slow yaw drift on top
+   - text mode starts with a "D:" info line, answers "C\n" (what the
+     driver sends on Ctrl+Shift+I) with a "C:sys,gyro,accel,mag"
+     calibration line that climbs to 3 over the first seconds, and can
+     repeat that line every statusEveryMs
+   - corruptRate of the samples are damaged so they can never decode: a
+     stray character in a text line, one flipped bit in a binary frame,
+     which then also gets a few garbage bytes in front for the sync hunt
+   - disconnectAfterMs closes the master, the port then reads like an
+     unplugged USB serial adapter
+
+ Every sample is recorded with its send time and the four numbers as they
+ went out, in wire order, for the test to compare against.
+********************************************************/
+
+#ifndef RELATIVTY_TRACKERTEST_BNO055_EMULATOR_H
+#define RELATIVTY_TRACKERTEST_BNO055_EMULATOR_H
+
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Relativty_ImuCodec.h"
+#include "pty_pair.h"
+
+namespace Relativty {
+	struct Bno055Options {
+		double rateHz = 60.0;          // the firmware's 16 ms delay plus the I2C read, 0 for as fast as the pty takes it
+		bool binary = false;           // BINARY_OUTPUT
+		double turnDegPerS = 30.0;
+		double noiseDeg = 0.0;         // standard deviation per sample, about every axis
+		double driftDegPerMin = 0.0;   // yaw that creeps in on top of the turn
+		double corruptRate = 0.0;
+		int disconnectAfterMs = 0;     // 0 never
+		int statusEveryMs = 0;         // text mode, 0 only on "C\n"
+		uint32_t seed = 1;
+	};
+
+	class Bno055Emulator {
+	public:
+		struct Sample {
+			int64_t sentNs;
+			float wire[4];  // w, y, z, x, what decode() gives back
+			bool corrupted;
+		};
+
+		explicit Bno055Emulator(const Bno055Options& options) : options(options), random(options.seed) {}
+		~Bno055Emulator() { this->Stop(); }
+
+		const std::string& Port() const { return this->pty.slaveName(); }
+
+		void Start() {
+			// writes give up on Stop instead of blocking on a pty nobody drains
+			fcntl(this->pty.master(), F_SETFL, fcntl(this->pty.master(), F_GETFL) | O_NONBLOCK);
+			this->running = true;
+			this->worker = std::thread(&Bno055Emulator::run, this);
+		}
+
+		void Stop() {
+			this->running = false;
+			if (this->worker.joinable())
+				this->worker.join();
+		}
+
+		std::vector<Sample> Samples() const {
+			std::lock_guard<std::mutex> lock(this->samplesMutex);
+			return this->samples;
+		}
+
+		uint64_t SamplesSent() const { return this->sent.load(); }
+		uint64_t Corrupted() const { return this->corrupted.load(); }
+		uint64_t StatusLines() const { return this->statusLines.load(); }
+		uint64_t Commands() const { return this->commands.load(); }
+		bool Disconnected() const { return this->disconnected.load(); }
+
+	private:
+		static int64_t nowNs() {
+			timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+		}
+
+		static void sleepUntil(int64_t deadlineNs) {
+			timespec ts;
+			ts.tv_sec = static_cast<time_t>(deadlineNs / 1000000000LL);
+			ts.tv_nsec = static_cast<long>(deadlineNs % 1000000000LL);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+		}
+
+		void run() {
+			const int64_t start = nowNs();
+			const int64_t periodNs = this->options.rateHz > 0 ? static_cast<int64_t>(1e9 / this->options.rateHz) : 0;
+			int64_t lastStatusNs = start;
+			std::string commandLine;
+			if (!this->options.binary)
+				this->status("D:BNO055 emulator, temp 27 C");
+
+			for (uint64_t index = 0; this->running; index++) {
+				if (periodNs > 0)
+					sleepUntil(start + static_cast<int64_t>(index) * periodNs);
+				const int64_t now = nowNs();
+				if (this->options.disconnectAfterMs > 0 && now - start >= this->options.disconnectAfterMs * 1000000LL) {
+					this->pty.close();
+					this->disconnected = true;
+					return;
+				}
+
+				// the driver only ever sends "C\n"
+				char input[64];
+				const size_t got = this->pty.readSome(input, sizeof(input), 0);
+				for (size_t i = 0; i < got; i++) {
+					if (input[i] != '\n') {
+						commandLine += input[i];
+						continue;
+					}
+					if (commandLine == "C" || commandLine == "C\r") {
+						this->commands++;
+						this->calibration(now - start);
+					}
+					commandLine.clear();
+				}
+				if (this->options.statusEveryMs > 0 && now - lastStatusNs >= this->options.statusEveryMs * 1000000LL) {
+					this->calibration(now - start);
+					lastStatusNs = now;
+				}
+
+				this->sample(now, (now - start) * 1e-9);
+			}
+		}
+
+		// sys, gyro, accel and mag calibration climb from 0 to 3 over the first seconds
+		void calibration(int64_t upNs) {
+			if (this->options.binary)
+				return;
+			const int level = upNs >= 3000000000LL ? 3 : static_cast<int>(upNs / 1000000000LL);
+			char line[32];
+			std::snprintf(line, sizeof(line), "C:%d,%d,%d,%d", level, 3, level, level > 0 ? level - 1 : 0);
+			this->status(line);
+		}
+
+		void status(const std::string& text) {
+			const std::string line = text + "\r\n";
+			this->write(line.data(), line.size());
+			this->statusLines++;
+		}
+
+		// PtyPair::writeAll, but stops trying once Stop was called. False if
+		// not all of it went out.
+		bool write(const void* data, size_t length) {
+			const char* cursor = static_cast<const char*>(data);
+			while (length > 0 && this->running) {
+				const ssize_t written = ::write(this->pty.master(), cursor, length);
+				if (written < 0) {
+					if (errno != EINTR && errno != EAGAIN)
+						return false;
+					pollfd waiting = { this->pty.master(), POLLOUT, 0 };
+					poll(&waiting, 1, 10);
+					continue;
+				}
+				cursor += written;
+				length -= static_cast<size_t>(written);
+			}
+			return length == 0;
+		}
+
+		void sample(int64_t now, double t) {
+			const double degToRad = M_PI / 180.0;
+			std::normal_distribution<double> noise(0.0, this->options.noiseDeg * degToRad);
+			const double yaw = (this->options.turnDegPerS * t + this->options.driftDegPerMin * t / 60.0) * degToRad
+				+ (this->options.noiseDeg > 0 ? noise(this->random) : 0.0);
+			const double roll = this->options.noiseDeg > 0 ? noise(this->random) : 0.0;
+			const double pitch = this->options.noiseDeg > 0 ? noise(this->random) : 0.0;
+			// yaw about y, then small pitch about x and roll about z
+			const double cy = std::cos(yaw / 2), sy = std::sin(yaw / 2);
+			const double cp = std::cos(pitch / 2), sp = std::sin(pitch / 2);
+			const double cr = std::cos(roll / 2), sr = std::sin(roll / 2);
+			const double w = cy * cp * cr + sy * sp * sr;
+			const double x = cy * sp * cr + sy * cp * sr;
+			const double y = sy * cp * cr - cy * sp * sr;
+			const double z = cy * cp * sr - sy * sp * cr;
+
+			Sample out;
+			out.sentNs = now;
+			out.corrupted = std::uniform_real_distribution<double>(0.0, 1.0)(this->random) < this->options.corruptRate;
+			const double wire[4] = { w, y, z, x };
+
+			if (this->options.binary) {
+				float values[4];
+				for (int i = 0; i < 4; i++)
+					values[i] = static_cast<float>(wire[i]);
+				uint8_t frame[ImuCodec<ImuFormat::Bno055Binary>::packetLen];
+				ImuCodec<ImuFormat::Bno055Binary>::encode(values, frame);
+				for (int i = 0; i < 4; i++)
+					out.wire[i] = static_cast<int16_t>(frame[2 + 2 * i] | (frame[3 + 2 * i] << 8)) / 16384.0f;
+				if (out.corrupted) {
+					std::uniform_int_distribution<int> bit(2 * 8, 10 * 8 - 1);
+					const int flip = bit(this->random);
+					frame[flip / 8] ^= static_cast<uint8_t>(1 << (flip % 8));
+					const uint8_t garbage[3] = { 0x55, 0xAA, 0x13 };
+					this->write(garbage, sizeof(garbage));
+				}
+				if (!this->write(frame, sizeof(frame)))
+					return;
+			}
+			else {
+				char line[64];
+				int length = std::snprintf(line, sizeof(line), "%.4f,%.4f,%.4f,%.4f", wire[0], wire[1], wire[2], wire[3]);
+				for (int i = 0; i < 4; i++)
+					out.wire[i] = static_cast<float>(std::round(wire[i] * 10000.0) / 10000.0);
+				if (out.corrupted) {
+					// anywhere in the line, a stray character never leaves four clean numbers
+					const int at = std::uniform_int_distribution<int>(0, length)(this->random);
+					for (int i = length; i >= at; i--)
+						line[i + 1] = line[i];
+					line[at] = '#';
+					length++;
+				}
+				line[length++] = '\r';
+				line[length++] = '\n';
+				if (!this->write(line, static_cast<size_t>(length)))
+					return; // cut short by Stop, the reader drops the partial line
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(this->samplesMutex);
+				this->samples.push_back(out);
+			}
+			this->sent++;
+			if (out.corrupted)
+				this->corrupted++;
+		}
+
+		const Bno055Options options;
+		std::mt19937 random;
+		PtyPair pty;
+		std::thread worker;
+		std::atomic<bool> running{ false };
+		mutable std::mutex samplesMutex;
+		std::vector<Sample> samples;
+		std::atomic<uint64_t> sent{ 0 };
+		std::atomic<uint64_t> corrupted{ 0 };
+		std::atomic<uint64_t> statusLines{ 0 };
+		std::atomic<uint64_t> commands{ 0 };
+		std::atomic<bool> disconnected{ false };
+	};
+}
+
+#endif // RELATIVTY_TRACKERTEST_BNO055_EMULATOR_H
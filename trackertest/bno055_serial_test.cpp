@@ -0,0 +1,263 @@
+/*******************************************************
+ Relativty serial IMU test and benchmark.
+
+ Runs ReadSerialImu from Relativty_Workers.h, the serial IMU thread of
+ HMDDriver, against the BNO055 emulator (bno055_emulator.h) on a pty, in
+ both firmware formats:
+   - every clean sample decodes to exactly what the firmware sent, in
+     order, and every corrupted one is rejected without losing the
+     samples around it
+   - text mode: the "D:" line comes first, "C\n" gets a "C:" line back
+   - text lines with the linear acceleration (LINEAR_ACCEL_OUTPUT) decode
+     it, lines with part of it are rejected
+   - binary mode: the sync hunt skips garbage between frames
+   - a disconnect reaches the sink as Lost(), within two read timeouts
+ then streams each format flat out for samples/s, and at 1 kHz for the
+ delay from the emulator's write to the read that returned the sample.
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude -Iserial/tests trackertest/bno055_serial_test.cpp \
+       source/Relativty_Log.cpp source/driverlog.cpp source/Relativty_Trace.cpp \
+       serial/src/serial.cc serial/src/impl/unix.cc -lpthread -o bno055_serial_test
+   ./bno055_serial_test
+********************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Relativty_Workers.h"
+#include "bno055_emulator.h"
+#include "serial/serial.h"
+
+using Relativty::Bno055Emulator;
+using Relativty::Bno055Options;
+using Relativty::ImuCodec;
+using Relativty::ImuFormat;
+using Relativty::kSerialWaitMs;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	struct Decoded {
+		int64_t readNs;
+		float quat[4];
+	};
+
+	// the sink ReadSerialImu hands the port's samples and status lines to
+	struct Reader {
+		std::vector<Decoded> samples;
+		std::vector<std::string> status;
+		uint64_t rejected = 0;
+		bool lost = false;
+		bool sendCommand = false; // "C\n" once ten samples are in
+		bool commandSent = false;
+		Relativty::StopSignal stop;
+		Relativty::WakeupStats wakeup;
+
+		void Sample(const Relativty::ImuSample& sample) {
+			Decoded decoded;
+			decoded.readNs = sample.timestampNs;
+			for (int i = 0; i < 4; i++)
+				decoded.quat[i] = sample.quat[i];
+			this->samples.push_back(decoded);
+		}
+
+		void Rejected(const uint8_t* data, size_t size) {
+			const std::string line(reinterpret_cast<const char*>(data), size);
+			if (line[0] == 'C' || line[0] == 'D')
+				this->status.push_back(line.substr(0, line.find_first_of("\r\n")));
+			else
+				this->rejected++;
+		}
+
+		bool TakeCommand(std::string& command) {
+			if (!this->sendCommand || this->commandSent || this->samples.size() < 10)
+				return false;
+			this->commandSent = true;
+			command = "C\n";
+			return true;
+		}
+
+		void Lost() {
+			this->lost = true;
+			this->stop.Request();
+		}
+	};
+
+	void openPort(serial::Serial& port, const std::string& name) {
+		serial::Timeout timeout = serial::Timeout::simpleTimeout(kSerialWaitMs);
+		port.setTimeout(timeout);
+		port.setPort(name);
+		port.setBaudrate(115200);
+		port.setTimestamping(true);
+		port.open();
+	}
+
+	// the driver's IMU thread for forMs, or until the port is lost
+	template<ImuFormat Format>
+	void read(serial::Serial& port, Reader& reader, uint32_t forMs) {
+		reader.stop.Reset();
+		std::thread timer([&reader, forMs] {
+			reader.stop.WaitFor(forMs);
+			reader.stop.Request();
+		});
+		Relativty::ReadSerialImu<Format>(port, reader.stop, reader.wakeup, reader);
+		timer.join();
+	}
+
+	// every clean sample, in order and to the last digit the format carries
+	bool matches(const std::vector<Bno055Emulator::Sample>& sent, const std::vector<Decoded>& decoded, float tolerance, uint64_t& clean) {
+		clean = 0;
+		size_t next = 0;
+		bool ok = true;
+		for (const Bno055Emulator::Sample& sample : sent) {
+			if (sample.corrupted)
+				continue;
+			clean++;
+			if (next >= decoded.size())
+				continue; // still in flight when the reader stopped
+			for (int i = 0; i < 4; i++)
+				ok = ok && std::fabs(sample.wire[i] - decoded[next].quat[i]) <= tolerance;
+			next++;
+		}
+		return ok && next == decoded.size();
+	}
+
+	double percentileUs(std::vector<int64_t> values, double p) {
+		if (values.empty())
+			return 0;
+		std::sort(values.begin(), values.end());
+		return values[static_cast<size_t>(p * (values.size() - 1))] / 1e3;
+	}
+
+	// rateHz 0 is flat out, the pty then stays full and the delay is mostly queueing
+	void benchmark(bool binary, double rateHz) {
+		Bno055Options options;
+		options.binary = binary;
+		options.rateHz = rateHz;
+		Bno055Emulator emulator(options);
+		serial::Serial port;
+		openPort(port, emulator.Port());
+		Reader reader;
+		const int64_t start = Relativty::MonotonicNowNs();
+		emulator.Start();
+		if (binary)
+			read<ImuFormat::Bno055Binary>(port, reader, 1000);
+		else
+			read<ImuFormat::Bno055Ascii>(port, reader, 1000);
+		emulator.Stop();
+		const double seconds = (Relativty::MonotonicNowNs() - start) * 1e-9;
+
+		const std::vector<Bno055Emulator::Sample> sent = emulator.Samples();
+		std::vector<int64_t> delays;
+		for (size_t i = 0; i < reader.samples.size() && i < sent.size(); i++)
+			delays.push_back(reader.samples[i].readNs - sent[i].sentNs);
+		char pace[32];
+		std::snprintf(pace, sizeof(pace), rateHz > 0 ? "at %.0f Hz" : "flat out", rateHz);
+		std::printf("      %s %s: %.0f samples/s read (%.0f sent), write to read p50 %.1f us, p99 %.1f us\n",
+			binary ? "binary" : "text", pace, reader.samples.size() / seconds, sent.size() / seconds,
+			percentileUs(delays, 0.5), percentileUs(delays, 0.99));
+	}
+}
+
+int main() {
+	{
+		using Codec = ImuCodec<ImuFormat::Bno055Ascii>;
+		float quat[4], accel[3];
+		bool hasAccel;
+		auto decode = [&](const std::string& line) {
+			return Codec::decode(reinterpret_cast<const uint8_t*>(line.data()), line.size(), quat, accel, hasAccel);
+		};
+		check(decode("0.7071,0.0000,0.7071,0.0000,-1.250,0.031,9.500\r\n") && hasAccel, "text: line with acceleration decodes");
+		check(quat[0] == 0.7071f && quat[2] == 0.7071f && accel[0] == -1.25f && accel[1] == 0.031f && accel[2] == 9.5f,
+			"text: quaternion and acceleration in the order sent");
+		check(decode("1.0000,0.0000,0.0000,0.0000\r\n") && !hasAccel, "text: line without acceleration still decodes");
+		check(!decode("1.0000,0.0000,0.0000,0.0000,1.0\r\n") && !decode("1.0000,0.0000,0.0000,0.0000,1.0,2.0\r\n")
+			&& !decode("1.0000,0.0000,0.0000,0.0000,1.0,2.0,3.0,4.0\r\n"), "text: partial or extra acceleration rejected");
+		check(!decode("1.0000,0.0000,0.0000,0.0000,200.0,0.0,0.0\r\n"), "text: acceleration past the sensor's range rejected");
+	}
+
+	{
+		Bno055Options options;
+		options.rateHz = 1000;
+		options.noiseDeg = 0.5;
+		options.driftDegPerMin = 5;
+		options.corruptRate = 0.05;
+		Bno055Emulator emulator(options);
+		serial::Serial port;
+		openPort(port, emulator.Port());
+		Reader reader;
+		reader.sendCommand = true;
+		emulator.Start();
+		read<ImuFormat::Bno055Ascii>(port, reader, 800);
+		emulator.Stop();
+		read<ImuFormat::Bno055Ascii>(port, reader, 200); // what is still in the pty
+
+		uint64_t clean;
+		check(matches(emulator.Samples(), reader.samples, 0.00005f, clean), "text: every clean line decodes to what was sent, in order");
+		check(reader.samples.size() == clean && clean > 500, "text: no clean line lost");
+		check(reader.rejected == emulator.Corrupted() && reader.rejected > 0, "text: every corrupted line rejected");
+		check(!reader.status.empty() && reader.status.front().compare(0, 2, "D:") == 0, "text: D: info line first");
+		const bool answered = emulator.Commands() == 1 && reader.status.size() == 2 && reader.status[1].compare(0, 2, "C:") == 0;
+		check(answered, "text: C command answered with a C: calibration line");
+		std::printf("      %zu samples, %llu corrupted, status: %s / %s\n", reader.samples.size(),
+			static_cast<unsigned long long>(emulator.Corrupted()), reader.status.empty() ? "" : reader.status.front().c_str(),
+			reader.status.size() > 1 ? reader.status[1].c_str() : "");
+	}
+
+	{
+		Bno055Options options;
+		options.binary = true;
+		options.rateHz = 1000;
+		options.noiseDeg = 0.5;
+		options.corruptRate = 0.05;
+		Bno055Emulator emulator(options);
+		serial::Serial port;
+		openPort(port, emulator.Port());
+		Reader reader;
+		emulator.Start();
+		read<ImuFormat::Bno055Binary>(port, reader, 800);
+		emulator.Stop();
+		read<ImuFormat::Bno055Binary>(port, reader, 200);
+
+		uint64_t clean;
+		check(matches(emulator.Samples(), reader.samples, 1.0f / 16384 + 1e-6f, clean), "binary: every clean frame decodes to what was sent, in order");
+		check(reader.samples.size() == clean && clean > 500, "binary: garbage between frames loses no clean frame");
+		check(reader.rejected == emulator.Corrupted() && reader.rejected > 0, "binary: every flipped bit caught by the checksum");
+	}
+
+	{
+		Bno055Options options;
+		options.rateHz = 200;
+		options.disconnectAfterMs = 300;
+		Bno055Emulator emulator(options);
+		serial::Serial port;
+		openPort(port, emulator.Port());
+		Reader reader;
+		emulator.Start();
+		const int64_t start = Relativty::MonotonicNowNs();
+		read<ImuFormat::Bno055Ascii>(port, reader, 2000);
+		const int64_t noticedMs = (Relativty::MonotonicNowNs() - start) / 1000000;
+		check(emulator.Disconnected() && reader.lost, "disconnect surfaces as Lost() from the reader");
+		check(noticedMs < 300 + 2 * static_cast<int64_t>(kSerialWaitMs), "noticed within two read timeouts");
+		std::printf("      %zu samples before the disconnect, noticed after %lld ms\n", reader.samples.size(), static_cast<long long>(noticedMs));
+	}
+
+	benchmark(false, 0);
+	benchmark(true, 0);
+	benchmark(false, 1000);
+	benchmark(true, 1000);
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
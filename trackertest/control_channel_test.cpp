@@ -0,0 +1,238 @@
+/*******************************************************
+ Relativty control channel test.
+
+ Talks to a ControlChannel over its Unix socket the way
+ python/relativty_control.py does and checks:
+   - the handler's output comes back with an "ok" status line, a
+     refused command with "error: <why>", empty and overlong commands
+     are refused without reaching the handler
+   - a client that connects and says nothing is dropped after
+     kClientTimeoutMs and the next client is served
+   - the socket is created open to its owner only, whatever the umask,
+     without Start touching the umask, and the private directory it is
+     bound in is gone once it listens
+   - a socket file left behind is replaced, a live channel is not
+   - Stop returns promptly with a silent client connected and removes
+     the socket file
+ that ControlRequests hands each request out once, and that what
+ PoseRecorder writes reads back through ParsePoseDatagram, IMU samples
+ in between.
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude trackertest/control_channel_test.cpp source/Relativty_ControlChannel.cpp -lpthread -o control_channel_test
+   ./control_channel_test
+********************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Relativty_ControlChannel.h"
+#include "Relativty_PoseRecorder.h"
+#include "Relativty_PoseStream.h"
+
+using Relativty::ControlChannel;
+using Relativty::ControlRequest;
+using Relativty::ControlRequests;
+using Relativty::ControlSink;
+using Relativty::PoseRecorder;
+using Relativty::TrackerPose;
+
+namespace {
+	int g_failures = 0;
+	int g_handled = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	double msSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool handle(void*, const std::string& command, std::string& reply) {
+		g_handled++;
+		if (command == "echo two lines") {
+			reply = "first\nsecond";
+			return true;
+		}
+		reply = "unknown command \"" + command + "\"";
+		return false;
+	}
+
+	int connectTo(const std::string& path) {
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+		const int client = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			close(client);
+			return -1;
+		}
+		return client;
+	}
+
+	// everything the channel answers until it closes the connection
+	std::string request(const std::string& path, const std::string& text) {
+		const int client = connectTo(path);
+		if (client < 0)
+			return "<no connection>";
+		(void)!send(client, text.data(), text.size(), MSG_NOSIGNAL);
+		std::string reply;
+		char buffer[256];
+		ssize_t got;
+		while ((got = recv(client, buffer, sizeof(buffer), 0)) > 0)
+			reply.append(buffer, static_cast<size_t>(got));
+		close(client);
+		return reply;
+	}
+}
+
+int main() {
+	char directory[] = "/tmp/relativty_control_test.XXXXXX";
+	check(mkdtemp(directory) != nullptr, "test directory created");
+	const std::string path = std::string(directory) + "/control.sock";
+	const ControlSink sink = { &handle, nullptr };
+	std::string problem;
+
+	{
+		ControlChannel channel;
+		const mode_t mask = umask(0);
+		check(channel.Start(path, sink, problem), "listens on a path given with a '/'");
+		check(umask(mask) == 0, "Start leaves the umask alone");
+		check(channel.Path() == path, "Path is where it listens");
+		struct stat info;
+		check(stat(path.c_str(), &info) == 0 && (info.st_mode & 0777) == 0600, "socket only open to its owner under an open umask");
+		int entries = 0;
+		if (DIR* listing = opendir(directory)) {
+			while (const dirent* entry = readdir(listing))
+				entries += entry->d_name[0] != '.' || std::strncmp(entry->d_name, ".relativty-", 11) == 0;
+			closedir(listing);
+		}
+		check(entries == 1, "only the socket is left next to it");
+
+		check(request(path, "echo two lines\n") == "first\nsecond\nok\n", "output then ok");
+		check(request(path, "  echo two lines \r\n") == "first\nsecond\nok\n", "blanks and CR around the command are dropped");
+		check(request(path, "nonsense\n") == "error: unknown command \"nonsense\"\n", "refused command says why");
+		const int handled = g_handled;
+		check(request(path, "\n").compare(0, 7, "error: ") == 0, "empty command is an error");
+		check(request(path, std::string(ControlChannel::kMaxCommandLen + 40, 'x') + "\n").find("longer than") != std::string::npos,
+			"overlong command is an error");
+		check(g_handled == handled, "neither reaches the handler");
+		check(channel.Commands() == 5, "every command counted");
+
+		// a client that holds the channel without a line end
+		const int silent = connectTo(path);
+		const auto start = std::chrono::steady_clock::now();
+		const std::string next = request(path, "echo two lines\n");
+		const double waitedMs = msSince(start);
+		std::printf("      next client answered after %.0f ms\n", waitedMs);
+		check(next == "first\nsecond\nok\n", "silent client does not block the next one for good");
+		check(waitedMs >= ControlChannel::kClientTimeoutMs * 0.8 && waitedMs < ControlChannel::kClientTimeoutMs * 2.0, "dropped after kClientTimeoutMs");
+		close(silent);
+
+		// a second driver must not steal a live endpoint
+		ControlChannel second;
+		check(!second.Start(path, sink, problem), "live channel is not replaced");
+		std::printf("      %s\n", problem.c_str());
+		check(request(path, "echo two lines\n") == "first\nsecond\nok\n", "first channel still answers");
+
+		const int hanging = connectTo(path);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		const auto stopStart = std::chrono::steady_clock::now();
+		channel.Stop();
+		const double stopMs = msSince(stopStart);
+		std::printf("      Stop took %.2f ms\n", stopMs);
+		check(stopMs < 100.0, "Stop does not wait for a silent client");
+		check(access(path.c_str(), F_OK) != 0, "Stop removes the socket file");
+		close(hanging);
+	}
+
+	{
+		// what a driver that crashed leaves behind: a bound socket nobody listens on
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+		const int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+		const bool bound = bind(stale, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+		close(stale);
+		check(bound && access(path.c_str(), F_OK) == 0, "stale socket file in place");
+
+		ControlChannel channel;
+		check(channel.Start(path, sink, problem), "stale socket file is replaced");
+		check(request(path, "echo two lines\n") == "first\nsecond\nok\n", "and the new channel answers");
+	}
+
+	{
+		ControlRequests requests;
+		check(!requests.Take(ControlRequest::Recenter), "nothing pending at first");
+		requests.Post(ControlRequest::Recenter);
+		requests.Post(ControlRequest::Recenter);
+		requests.Post(ControlRequest::CalibrateImu);
+		check(requests.Take(ControlRequest::Recenter), "posted request is taken");
+		check(!requests.Take(ControlRequest::Recenter), "once, however often it was posted");
+		check(requests.Take(ControlRequest::CalibrateImu), "requests are independent");
+		requests.Post(ControlRequest::Recenter);
+		requests.Clear();
+		check(!requests.Take(ControlRequest::Recenter), "Clear drops what is pending");
+	}
+
+	{
+		const std::string file = "/tmp/relativty_poses_test." + std::to_string(getpid()) + ".txt";
+		PoseRecorder recorder;
+		TrackerPose poses[2] = {
+			{ 1000, { 0.1f, 1.6f, -0.3f }, { 0.7071068f, 0.0f, 0.7071068f, 0.0f }, Relativty::kHeadsetDevice },
+			{ 2000, { -0.25f, 1.1f, 0.2f }, { 0.5f, 0.5f, -0.5f, 0.5f }, 3, Relativty::kPoseReset },
+		};
+		recorder.Record(poses, 2); // not recording yet
+		check(recorder.Start(file), "recording starts");
+		recorder.Record(poses, 2);
+		Relativty::ImuSample imu = { 1500, { 1, 0, 0, 0 }, { 0.5f, -0.25f, 9.75f }, true };
+		recorder.RecordImu(imu);
+		recorder.Record(poses + 1, 1);
+		check(recorder.Stop() == 3, "Stop reports the poses written");
+		recorder.Record(poses, 2); // stopped
+		check(!recorder.Recording() && recorder.Stop() == 0, "second Stop has nothing to report");
+
+		std::ifstream in(file);
+		std::stringstream text;
+		text << in.rdbuf();
+		TrackerPose read[4];
+		uint32_t malformed = 0;
+		const std::string recorded = text.str();
+		const size_t count = Relativty::ParsePoseDatagram(recorded.data(), recorded.size(), 0, read, 4, malformed);
+		check(count == 3 && malformed == 0, "recording reads back as datagram lines");
+		bool same = count == 3;
+		for (size_t i = 0; i < count && same; i++) {
+			const TrackerPose& want = i < 2 ? poses[i] : poses[1];
+			same = read[i].device == want.device && read[i].flags == want.flags;
+			for (int k = 0; k < 3; k++)
+				same = same && std::fabs(read[i].position[k] - want.position[k]) < 1e-6f;
+			for (int k = 0; k < 4; k++)
+				same = same && std::fabs(read[i].rotation[k] - want.rotation[k]) < 1e-6f;
+		}
+		check(same, "devices, flags, positions and rotations survive the round trip");
+		check(recorded.find(" 2000\n") != std::string::npos, "arrival time written after the pose");
+		check(recorded.find("#imu 1500 1.00000 0.00000 0.00000 0.00000 0.5000 -0.2500 9.7500\n") != std::string::npos,
+			"IMU sample written as a comment the parser skips");
+		check(!recorder.Start("/nonexistent/dir/poses.txt"), "unwritable path refused");
+		std::remove(file.c_str());
+	}
+
+	rmdir(directory);
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
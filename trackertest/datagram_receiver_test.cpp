@@ -0,0 +1,97 @@
+/*******************************************************
+ Relativty datagram receiver test.
+
+ Binds a UDP socket on the loopback the way the UDP server does, and checks
+   - the stack stamps datagrams (SO_TIMESTAMPNS)
+   - a datagram left in the socket for 20 ms comes back with at least that
+     long queued, and one read right away with well under it
+   - the payload and the sender's address arrive intact
+   - a datagram that comes without a stamp is still delivered, with a
+     queued time of -1
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude trackertest/datagram_receiver_test.cpp -o datagram_receiver_test
+   ./datagram_receiver_test
+********************************************************/
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "Relativty_DatagramReceiver.h"
+
+using Relativty::DatagramReceiver;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	int boundSocket(sockaddr_in& address) {
+		const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+		address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(address);
+		bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+		getsockname(sock, reinterpret_cast<sockaddr*>(&address), &length);
+		return sock;
+	}
+
+	void send(int from, const sockaddr_in& to, const char* text) {
+		sendto(from, text, std::strlen(text), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+	}
+}
+
+int main() {
+	const int64_t kMs = 1000000;
+	sockaddr_in server, client, from;
+	const int serverSocket = boundSocket(server);
+	const int clientSocket = boundSocket(client);
+	char message[64];
+	int64_t queuedNs;
+
+	{
+		DatagramReceiver receiver(serverSocket);
+		check(receiver.Stamped(), "loopback datagrams are stamped");
+
+		send(clientSocket, server, "1.5 2.5 3.5");
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		const int received = receiver.Receive(message, sizeof(message) - 1, from, queuedNs);
+		std::printf("      queued %.2f ms after a 20 ms sleep\n", queuedNs / 1e6);
+		check(received == 11 && std::memcmp(message, "1.5 2.5 3.5", 11) == 0, "payload intact");
+		check(from.sin_port == client.sin_port && from.sin_addr.s_addr == client.sin_addr.s_addr, "sender address filled in");
+		check(queuedNs >= 20 * kMs && queuedNs < 500 * kMs, "time left in the socket measured");
+
+		send(clientSocket, server, "x");
+		const int64_t sentNs = Relativty::MonotonicNowNs();
+		while (Relativty::MonotonicNowNs() - sentNs < kMs) {
+		}
+		receiver.Receive(message, sizeof(message) - 1, from, queuedNs);
+		std::printf("      queued %.3f ms read at once\n", queuedNs / 1e6);
+		check(queuedNs >= 0 && queuedNs < 20 * kMs, "a datagram read at once is not late");
+	}
+
+	{
+		// stamping switched off behind the receiver's back
+		DatagramReceiver receiver(serverSocket);
+		const int off = 0;
+		setsockopt(serverSocket, SOL_SOCKET, SO_TIMESTAMPNS, &off, sizeof(off));
+		send(clientSocket, server, "abc");
+		const int received = receiver.Receive(message, sizeof(message) - 1, from, queuedNs);
+		check(received == 3 && std::memcmp(message, "abc", 3) == 0 && queuedNs == -1, "unstamped datagram delivered with -1");
+	}
+
+	close(serverSocket);
+	close(clientSocket);
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+/*******************************************************
+ Relativty distortion cache test.
+
+ Writes DistortionLut grids through DistortionCache the way the display
+ component does when UseDistortionLut is on, and checks
+   - Write then Open maps the same nodes, and a table attached to them
+     looks up what the built one does
+   - Open refuses a missing file, and a file whose settings hash is out
+     of date (other coefficients, other grid size)
+   - Open refuses a file of the wrong size: truncated, grown, or written
+     for another grid size
+   - Open refuses a corrupt file: a flipped payload byte, a wrong magic,
+     version or node layout
+   - a refused Open leaves no mapping behind, and Write replaces a bad
+     file so the next Open succeeds
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude trackertest/distortion_cache_test.cpp -o distortion_cache_test
+   ./distortion_cache_test
+********************************************************/
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Relativty_DistortionCache.h"
+
+using Relativty::ChromaticDistortionModel;
+using Relativty::DistortionCache;
+using Relativty::DistortionCacheHeader;
+using Relativty::DistortionLut;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	ChromaticDistortionModel model(float k1, float k2) {
+		ChromaticDistortionModel result;
+		for (int c = 0; c < Relativty::DistortionChannel_Count; c++)
+			result.channels[c] = { k1 * (1.0f + 0.02f * c), k2, 1.0f, 1.0f };
+		return result;
+	}
+
+	std::vector<char> readFile(const std::string& path) {
+		std::vector<char> bytes;
+		if (FILE* file = std::fopen(path.c_str(), "rb")) {
+			char chunk[4096];
+			size_t got;
+			while ((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+				bytes.insert(bytes.end(), chunk, chunk + got);
+			std::fclose(file);
+		}
+		return bytes;
+	}
+
+	void writeFile(const std::string& path, const std::vector<char>& bytes) {
+		FILE* file = std::fopen(path.c_str(), "wb");
+		std::fwrite(bytes.data(), 1, bytes.size(), file);
+		std::fclose(file);
+	}
+
+	// a copy of the good file with one change, then whether Open takes it
+	template<typename Damage>
+	bool opensDamaged(const std::vector<char>& good, const std::string& path, uint64_t hash, uint32_t gridSize, Damage damage) {
+		std::vector<char> bytes = good;
+		damage(bytes);
+		writeFile(path, bytes);
+		DistortionCache cache;
+		// refused but still mapped counts as taken
+		return cache.Open(path, hash, gridSize) || cache.Nodes() != nullptr;
+	}
+}
+
+int main() {
+	const char* tmp = std::getenv("TMPDIR");
+	const std::string path = std::string(tmp ? tmp : "/tmp") + "/relativty_distortion_cache_test.cache";
+	std::remove(path.c_str());
+
+	const uint32_t grid = 65;
+	const ChromaticDistortionModel shipped = model(0.4f, 0.5f);
+	const uint64_t hash = DistortionCache::HashSettings(shipped, grid);
+	DistortionLut built;
+	built.Build(shipped, grid);
+
+	{
+		DistortionCache cache;
+		check(!cache.Open(path, hash, grid) && cache.Nodes() == nullptr, "a missing file is refused");
+		check(!DistortionCache::Write("", hash, built) && !cache.Open("", hash, grid), "an empty path is neither written nor opened");
+		DistortionLut unbuilt;
+		check(!DistortionCache::Write(path, hash, unbuilt), "an unbuilt table is not written");
+	}
+
+	check(DistortionCache::Write(path, hash, built), "written");
+	const std::vector<char> good = readFile(path);
+	check(good.size() == sizeof(DistortionCacheHeader) + built.NodeCount() * DistortionLut::k_unFloatsPerNode * sizeof(float),
+		"header and every node on disk");
+	check(readFile(path + ".tmp").empty(), "the temporary file renamed away");
+
+	{
+		DistortionCache cache;
+		check(cache.Open(path, hash, grid), "opened with the hash it was written for");
+		check(cache.Nodes() != nullptr
+			&& std::memcmp(cache.Nodes(), built.Nodes(), built.NodeCount() * DistortionLut::k_unFloatsPerNode * sizeof(float)) == 0,
+			"the mapped nodes are the built ones");
+		DistortionLut attached;
+		attached.Attach(shipped, grid, cache.Nodes());
+		bool same = true;
+		for (int i = 0; i <= 100; i++) {
+			float a[DistortionLut::k_unFloatsPerNode], b[DistortionLut::k_unFloatsPerNode];
+			attached.Lookup(i / 100.0f, 1.0f - i / 137.0f, a);
+			built.Lookup(i / 100.0f, 1.0f - i / 137.0f, b);
+			same = same && std::memcmp(a, b, sizeof(a)) == 0;
+		}
+		check(same, "a table attached to the cache looks up like the built one");
+		cache.Close();
+		check(cache.Nodes() == nullptr, "Close drops the nodes");
+	}
+
+	{
+		DistortionCache cache;
+		const uint64_t otherModel = DistortionCache::HashSettings(model(0.41f, 0.5f), grid);
+		const uint64_t otherGrid = DistortionCache::HashSettings(shipped, grid + 1);
+		check(otherModel != hash && otherGrid != hash, "coefficients and grid size change the hash");
+		check(!cache.Open(path, otherModel, grid) && cache.Nodes() == nullptr, "a file for other coefficients is refused");
+		check(!cache.Open(path, otherGrid, grid), "a file for another grid size is refused");
+	}
+
+	{
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) { b.pop_back(); }), "a truncated file is refused");
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) { b.resize(b.size() / 2); }), "half a file is refused");
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) { b.push_back(0); }), "a grown file is refused");
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) { b.clear(); }), "an empty file is refused");
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) { b[0] = 'X'; }), "a wrong magic is refused");
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) {
+			b[offsetof(DistortionCacheHeader, version)]++;
+		}), "another format version is refused");
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) {
+			b[offsetof(DistortionCacheHeader, floatsPerNode)]++;
+		}), "another node layout is refused");
+		check(!opensDamaged(good, path, hash, grid, [](std::vector<char>& b) {
+			b[offsetof(DistortionCacheHeader, settingsHash)] ^= 1;
+		}), "a damaged settings hash is refused");
+
+		bool flips = true;
+		for (size_t at = sizeof(DistortionCacheHeader); at < good.size(); at += 997) {
+			flips = !opensDamaged(good, path, hash, grid, [at](std::vector<char>& b) { b[at] ^= 0x10; }) && flips;
+		}
+		check(flips, "a flipped payload byte anywhere is refused by the checksum");
+	}
+
+	{
+		// a grid written for another size, opened as if the settings hash
+		// matched: the file size alone gives it away
+		DistortionLut other;
+		other.Build(shipped, grid + 2);
+		check(DistortionCache::Write(path, hash, other), "another grid size written under the same hash");
+		DistortionCache cache;
+		check(!cache.Open(path, hash, grid), "refused on its size");
+	}
+
+	{
+		writeFile(path, std::vector<char>(good.begin(), good.begin() + 100));
+		DistortionCache cache;
+		check(!cache.Open(path, hash, grid), "a bad file is refused");
+		check(DistortionCache::Write(path, hash, built) && cache.Open(path, hash, grid), "and rewritten so the next Open takes it");
+	}
+
+	std::remove(path.c_str());
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+/*******************************************************
+ Relativty lens distortion test and benchmark.
+
+ Checks Relativty_Distortion.h against the lens formula the display
+ component used before the trig free rewrite:
+   - Evaluate matches the atan2/sin/cos form over the whole texture and a
+     margin around it, for the shipped and for stronger coefficients
+   - EvaluateBatch matches Evaluate for every count from 0 to 40, so the
+     scalar tail after the 4 or 8 wide loop is covered, and writes nothing
+     past the count
+   - DistortionLut interpolates within the error its header claims
+     (~3e-5 for the shipped coefficients at the default grid), hits the
+     nodes exactly, and hands points outside [0, 1] to the exact model
+ then times the original form, Evaluate, EvaluateBatch and Lookup over a
+ distortion mesh.
+
+ Build and run (Linux), the second line for the AVX path:
+   g++ -std=c++17 -O2 -Iinclude trackertest/distortion_test.cpp -o distortion_test
+   g++ -std=c++17 -O2 -mavx -Iinclude trackertest/distortion_test.cpp -o distortion_test
+   ./distortion_test
+********************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "Relativty_Distortion.h"
+
+using Relativty::ChromaticDistortionModel;
+using Relativty::DistortionLut;
+using Relativty::RadialDistortionModel;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	// as ComputeDistortion had it, in double like the original
+	void original(const RadialDistortionModel& model, float fU, float fV, float* pfX, float* pfY) {
+		const double rr = std::sqrt((fU - 0.5f) * (fU - 0.5f) + (fV - 0.5f) * (fV - 0.5f));
+		const double r2 = rr * (1 + model.k1 * (rr * rr) + model.k2 * (rr * rr * rr * rr));
+		const double theta = std::atan2(fU - 0.5f, fV - 0.5f);
+		*pfX = float(std::sin(theta) * r2) * model.zoomWidth + 0.5f;
+		*pfY = float(std::cos(theta) * r2) * model.zoomHeight + 0.5f;
+	}
+
+	const RadialDistortionModel kShipped = { 0.4f, 0.5f, 1.0f, 1.0f }; // default.vrsettings
+	const RadialDistortionModel kStrong = { 1.2f, -0.8f, 0.9f, 1.1f };
+
+	ChromaticDistortionModel chromatic(const RadialDistortionModel& green) {
+		ChromaticDistortionModel model;
+		model.channels[Relativty::DistortionChannel_Red] = { green.k1 * 1.02f, green.k2 * 1.03f, green.zoomWidth, green.zoomHeight };
+		model.channels[Relativty::DistortionChannel_Green] = green;
+		model.channels[Relativty::DistortionChannel_Blue] = { green.k1 * 0.97f, green.k2 * 0.96f, green.zoomWidth, green.zoomHeight };
+		return model;
+	}
+
+	template<typename Body>
+	double nsPerPoint(size_t count, Body body) {
+		const int rounds = 2000;
+		const auto begin = std::chrono::steady_clock::now();
+		for (int r = 0; r < rounds; r++)
+			body();
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / (double(rounds) * count);
+	}
+}
+
+int main() {
+	std::mt19937 random(31);
+
+	{
+		std::uniform_real_distribution<float> coordinate(-0.25f, 1.25f);
+		for (const RadialDistortionModel& model : { kShipped, kStrong }) {
+			float worst = 0;
+			for (int i = 0; i < 100000; i++) {
+				const float u = coordinate(random), v = coordinate(random);
+				float x, y, ox, oy;
+				model.Evaluate(u, v, &x, &y);
+				original(model, u, v, &ox, &oy);
+				worst = std::fmax(worst, std::fmax(std::fabs(x - ox), std::fabs(y - oy)));
+			}
+			std::printf("      k1 %.1f k2 %.1f: worst difference to atan2/sin/cos %.2e\n", model.k1, model.k2, worst);
+			check(worst < 2e-6f, "Evaluate matches the original formula");
+		}
+		float x, y;
+		kShipped.Evaluate(0.5f, 0.5f, &x, &y);
+		check(x == 0.5f && y == 0.5f, "the centre, where atan2 has no angle, stays put");
+	}
+
+	{
+		std::uniform_real_distribution<float> coordinate(0.0f, 1.0f);
+		const size_t kMax = 40, kGuard = 8;
+		std::vector<float> u(kMax), v(kMax);
+		for (size_t i = 0; i < kMax; i++) {
+			u[i] = coordinate(random);
+			v[i] = coordinate(random);
+		}
+		bool same = true, untouched = true;
+		for (size_t count = 0; count <= kMax; count++) {
+			std::vector<float> x(count + kGuard, -7.0f), y(count + kGuard, -7.0f);
+			kStrong.EvaluateBatch(u.data(), v.data(), count, x.data(), y.data());
+			for (size_t i = 0; i < count; i++) {
+				float ex, ey;
+				kStrong.Evaluate(u[i], v[i], &ex, &ey);
+				same = same && std::fabs(x[i] - ex) <= 1e-6f && std::fabs(y[i] - ey) <= 1e-6f;
+			}
+			for (size_t i = count; i < count + kGuard; i++)
+				untouched = untouched && x[i] == -7.0f && y[i] == -7.0f;
+		}
+		check(same, "EvaluateBatch matches Evaluate for counts 0 to 40, tails included");
+		check(untouched, "and writes nothing past the count");
+	}
+
+	{
+		DistortionLut lut;
+		check(!lut.IsBuilt(), "not built until Build");
+		const ChromaticDistortionModel model = chromatic(kShipped);
+		lut.Build(model);
+		check(lut.IsBuilt() && lut.GridSize() == DistortionLut::k_unDefaultGridSize
+			&& lut.NodeCount() == size_t(lut.GridSize()) * lut.GridSize(), "built at the default grid size");
+
+		float out[DistortionLut::k_unFloatsPerNode], exact[DistortionLut::k_unFloatsPerNode];
+		const uint32_t last = lut.GridSize() - 1;
+		bool nodes = true;
+		for (uint32_t y = 0; y <= last; y += 16) {
+			for (uint32_t x = 0; x <= last; x += 16) {
+				const float u = x / float(last), v = y / float(last);
+				lut.Lookup(u, v, out);
+				model.Evaluate(u, v, exact);
+				for (uint32_t c = 0; c < DistortionLut::k_unFloatsPerNode; c++)
+					nodes = nodes && std::fabs(out[c] - exact[c]) <= 1e-6f;
+			}
+		}
+		check(nodes, "nodes looked up as evaluated");
+
+		// the worst case sits between nodes, sample well off them
+		float worst = 0;
+		const int kSamples = 1000;
+		for (int y = 0; y <= kSamples; y++) {
+			for (int x = 0; x <= kSamples; x++) {
+				const float u = x / float(kSamples), v = y / float(kSamples);
+				lut.Lookup(u, v, out);
+				model.Evaluate(u, v, exact);
+				for (uint32_t c = 0; c < DistortionLut::k_unFloatsPerNode; c++)
+					worst = std::fmax(worst, std::fabs(out[c] - exact[c]));
+			}
+		}
+		std::printf("      worst interpolation error %.2e (%.3f px on 1920)\n", worst, worst * 1920);
+		check(worst <= 4e-5f, "interpolation error within the ~3e-5 the header claims");
+
+		const float outside[][2] = { { -0.1f, 0.5f }, { 0.5f, 1.2f }, { 1.0001f, 1.0f }, { -2.0f, -3.0f } };
+		bool exactOutside = true;
+		for (const auto& point : outside) {
+			lut.Lookup(point[0], point[1], out);
+			model.Evaluate(point[0], point[1], exact);
+			for (uint32_t c = 0; c < DistortionLut::k_unFloatsPerNode; c++)
+				exactOutside = exactOutside && out[c] == exact[c];
+		}
+		lut.Lookup(NAN, 0.5f, out);
+		check(exactOutside && std::isnan(out[0]), "outside [0, 1] and NaN go to the exact model");
+		lut.Lookup(1.0f, 1.0f, out);
+		model.Evaluate(1.0f, 1.0f, exact);
+		check(std::fabs(out[0] - exact[0]) <= 1e-6f && std::fabs(out[5] - exact[5]) <= 1e-6f, "the far corner is the last node");
+
+		DistortionLut small;
+		small.Build(model, 17);
+		float smallWorst = 0;
+		for (int i = 0; i <= 1000; i++) {
+			small.Lookup(i / 1000.0f, 0.37f, out);
+			model.Evaluate(i / 1000.0f, 0.37f, exact);
+			smallWorst = std::fmax(smallWorst, std::fabs(out[0] - exact[0]));
+		}
+		check(smallWorst > worst, "a coarser grid interpolates worse");
+	}
+
+	{
+		// a 43x43 mesh per eye like the compositor asks for, as rows
+		const size_t side = 43, count = side * side;
+		std::vector<float> u(count), v(count), x(count), y(count);
+		for (size_t i = 0; i < count; i++) {
+			u[i] = (i % side) / float(side - 1);
+			v[i] = (i / side) / float(side - 1);
+		}
+		const ChromaticDistortionModel model = chromatic(kShipped);
+		DistortionLut lut;
+		lut.Build(model);
+		volatile float sink = 0;
+		float out[DistortionLut::k_unFloatsPerNode];
+
+		const double originalNs = nsPerPoint(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				for (int c = 0; c < Relativty::DistortionChannel_Count; c++)
+					original(model.channels[c], u[i], v[i], &x[i], &y[i]);
+			sink = sink + x[count / 2];
+		});
+		const double evaluateNs = nsPerPoint(count, [&] {
+			for (size_t i = 0; i < count; i++) {
+				model.Evaluate(u[i], v[i], out);
+				x[i] = out[0];
+			}
+			sink = sink + x[count / 2];
+		});
+		std::vector<float> channelX[3] = { x, x, x }, channelY[3] = { y, y, y };
+		float* const ppfX[3] = { channelX[0].data(), channelX[1].data(), channelX[2].data() };
+		float* const ppfY[3] = { channelY[0].data(), channelY[1].data(), channelY[2].data() };
+		const double batchNs = nsPerPoint(count, [&] {
+			model.EvaluateBatch(u.data(), v.data(), count, ppfX, ppfY);
+			sink = sink + ppfX[1][count / 2];
+		});
+		const double lookupNs = nsPerPoint(count, [&] {
+			for (size_t i = 0; i < count; i++) {
+				lut.Lookup(u[i], v[i], out);
+				x[i] = out[0];
+			}
+			sink = sink + x[count / 2];
+		});
+		std::printf("      ns per point, three channels, over %zu: original %.2f, Evaluate %.2f, EvaluateBatch %.2f, Lookup %.2f\n",
+			count, originalNs, evaluateNs, batchNs, lookupNs);
+		check(batchNs < originalNs, "the batch path beats the original formula");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+/*******************************************************
+ Dummy tracker for trackertest/tracker_supervisor_test.cpp.
+
+ Streams pose datagrams in the driver's UDP format to 127.0.0.1:<port>
+ at 100 Hz. Every datagram also carries the process id, the CPU mask
+ and the nice value the process runs with, so the test can check what
+ the supervisor set up. The mode decides how it misbehaves:
+
+   run           stream until killed
+   crash <ms>    stream, then exit(3) after <ms>
+   stall <ms>    stream, then stay alive but go silent after <ms>
+   silent        never send anything
+   stubborn      stream and ignore SIGTERM
+
+ Build:
+   gcc -std=c99 -O2 trackertest/dummy_tracker.c -o dummy_tracker
+********************************************************/
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned long long cpu_mask(void)
+{
+	cpu_set_t set;
+	unsigned long long mask = 0;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(set), &set) != 0)
+		return 0;
+	for (cpu = 0; cpu < 64; cpu++) {
+		if (CPU_ISSET(cpu, &set))
+			mask |= 1ull << cpu;
+	}
+	return mask;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in to;
+	const char *mode;
+	long long after_ms = 0, start;
+	char message[256];
+	int sock;
+	unsigned seq = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <port> run|crash <ms>|stall <ms>|silent|stubborn\n", argv[0]);
+		return 2;
+	}
+	mode = argv[2];
+	if (argc > 3)
+		after_ms = atoll(argv[3]);
+	if (strcmp(mode, "stubborn") == 0)
+		signal(SIGTERM, SIG_IGN);
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_port = htons((unsigned short)atoi(argv[1]));
+	to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	start = now_ms();
+	for (;;) {
+		long long elapsed = now_ms() - start;
+
+		if (strcmp(mode, "crash") == 0 && elapsed >= after_ms)
+			return 3;
+		if (strcmp(mode, "silent") != 0 && !(strcmp(mode, "stall") == 0 && elapsed >= after_ms)) {
+			/* x y z qw qx qy qz, then what the test checks */
+			snprintf(message, sizeof(message), "0 1.6 0 1 0 0 0 pid=%d mask=%llx nice=%d seq=%u ",
+				(int)getpid(), cpu_mask(), getpriority(PRIO_PROCESS, 0), seq++);
+			sendto(sock, message, strlen(message), 0, (struct sockaddr *)&to, sizeof(to));
+		}
+		usleep(10000);
+	}
+}
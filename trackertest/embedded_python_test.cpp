@@ -0,0 +1,201 @@
+/*******************************************************
+ Relativty embedded Python tracker test.
+
+ Stands in for HMDDriver with a pose sink of its own and runs trackers
+ through startPythonTrackingClient_threaded the way Activate/Deactivate
+ do, and checks
+   - python/standin_tracker.py delivers headset poses through both
+     submit_pose and submit_poses, and poses for trackers 1 and 2, all
+     finite and with unit quaternions
+   - the sink is called without the GIL held
+   - the tracker returns once relativty.running() turns false, and the
+     interpreter takes a second Activate with the path in sys.path once
+   - submit_pose/submit_poses refuse malformed input with a Python
+     exception instead of delivering it, and a tracker raising returns
+   - a module that does not exist returns instead of hanging
+   - interruptPythonTrackingClient stops a tracker that ignores running()
+
+ Build and run (Linux, the source names the Windows Python.h path):
+   sed 's|<C:.*Python.h>|<Python.h>|' source/Relativty_EmbeddedPython.cpp > embedded_python.cpp
+   g++ -std=c++17 -O2 -Iinclude $(python3-config --includes) trackertest/embedded_python_test.cpp \
+       embedded_python.cpp source/Relativty_Log.cpp source/driverlog.cpp \
+       $(python3-config --embed --ldflags) -lpthread -o embedded_python_test
+   ./embedded_python_test python
+********************************************************/
+
+#include <Python.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Relativty_EmbeddedPython.h"
+
+using Relativty::PythonPoseSink;
+using Relativty::TrackerPose;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	struct Sink {
+		std::mutex mutex;
+		std::vector<TrackerPose> poses;
+		size_t calls = 0;
+		size_t batches = 0; // calls with more than one pose
+		size_t withGil = 0;
+		std::atomic<bool> running{ true };
+
+		static void submit(void* context, const TrackerPose* poses, size_t count) {
+			Sink* self = static_cast<Sink*>(context);
+			const bool gil = PyGILState_Check() != 0;
+			std::lock_guard<std::mutex> lock(self->mutex);
+			self->calls++;
+			if (count > 1)
+				self->batches++;
+			if (gil)
+				self->withGil++;
+			self->poses.insert(self->poses.end(), poses, poses + count);
+		}
+
+		PythonPoseSink sink() { return PythonPoseSink{ &Sink::submit, this, &this->running }; }
+	};
+
+	// runs the tracker for runMs, then turns running() off; false if it did
+	// not return within returnMs after that
+	bool runTracker(Sink& sink, const std::string& path, const std::string& module, int runMs, int returnMs, bool interrupt = false) {
+		std::atomic<bool> returned{ false };
+		sink.running = true;
+		std::thread tracker([&] {
+			startPythonTrackingClient_threaded(path, module, sink.sink());
+			returned = true;
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(runMs));
+		sink.running = false;
+		if (interrupt)
+			interruptPythonTrackingClient();
+		for (int waited = 0; waited < returnMs && !returned; waited += 10)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		const bool stopped = returned;
+		if (!stopped)
+			interruptPythonTrackingClient(); // so the test can still end
+		tracker.join();
+		return stopped;
+	}
+
+	long pathEntries(const std::string& path) {
+		PyGILState_STATE gil = PyGILState_Ensure();
+		PyObject* sys_path = PySys_GetObject("path");
+		PyObject* entry = PyUnicode_FromString(path.c_str());
+		long count = 0;
+		for (Py_ssize_t i = 0; sys_path != nullptr && i < PyList_Size(sys_path); i++)
+			count += PyObject_RichCompareBool(PyList_GetItem(sys_path, i), entry, Py_EQ) == 1;
+		Py_XDECREF(entry);
+		PyGILState_Release(gil);
+		return count;
+	}
+
+	void writeModule(const std::string& dir, const std::string& name, const char* source) {
+		std::ofstream file(dir + "/" + name + ".py");
+		file << source;
+	}
+
+	// every refused call adds one to the y of the pose it reports at the end
+	const char* kMalformed = R"(
+import relativty
+from array import array
+
+class relativty_malformed:
+    def run(self):
+        calls = (
+            lambda: relativty.submit_poses(b"x" * 64),
+            lambda: relativty.submit_poses(array('f', [0] * 8)),
+            lambda: relativty.submit_poses(array('d', [0] * 7)),
+            lambda: relativty.submit_pose(0, (1, 2), (1, 0, 0, 0)),
+            lambda: relativty.submit_pose(0, (1, 2, 'a'), (1, 0, 0, 0)),
+            lambda: relativty.submit_pose(0, (1, 2, 3), (1, 0, 0, 0), 99),
+        )
+        refused = 0
+        for call in calls:
+            try:
+                call()
+            except (ValueError, TypeError, BufferError):
+                refused += 1
+        relativty.submit_pose(relativty.now_ns(), (0.0, float(refused), 0.0), (1.0, 0.0, 0.0, 0.0))
+        raise KeyError("the tracker failed")
+)";
+
+	const char* kStubborn = R"(
+import time
+
+class relativty_stubborn:
+    def run(self):
+        while True:
+            time.sleep(0.01)
+)";
+}
+
+int main(int argc, char** argv) {
+	const std::string path = argc > 1 ? argv[1] : "python";
+
+	for (int activation = 0; activation < 2; activation++) {
+		Sink sink;
+		const bool stopped = runTracker(sink, path, "standin_tracker", 2500, 1000);
+		size_t headset = 0, hands = 0;
+		bool valid = true;
+		for (const TrackerPose& pose : sink.poses) {
+			(pose.device == 0 ? headset : hands)++;
+			const float norm = std::sqrt(pose.rotation[0] * pose.rotation[0] + pose.rotation[1] * pose.rotation[1]
+				+ pose.rotation[2] * pose.rotation[2] + pose.rotation[3] * pose.rotation[3]);
+			valid = valid && std::isfinite(pose.position[0]) && std::isfinite(pose.position[1]) && std::isfinite(pose.position[2])
+				&& std::fabs(norm - 1.0f) < 1e-4f && pose.device <= 2;
+		}
+		std::printf("      activation %d: %zu headset poses, %zu hand poses in %zu calls, %zu batched\n",
+			activation + 1, headset, hands, sink.calls, sink.batches);
+		check(stopped, "stand-in tracker returns once running() turns false");
+		check(headset > 150 && hands > 300, "headset and hand poses arrive at about 90 Hz");
+		check(sink.batches > 0 && sink.batches < sink.calls, "through submit_pose and batched submit_poses");
+		check(valid, "finite positions, unit quaternions, known devices");
+		check(sink.withGil == 0, "the sink runs without the GIL");
+	}
+	check(pathEntries(path) == 1, "two activations leave the tracker path in sys.path once");
+
+	const char* tmp = std::getenv("TMPDIR");
+	const std::string dir = tmp ? tmp : "/tmp";
+	writeModule(dir, "relativty_malformed", kMalformed);
+	writeModule(dir, "relativty_stubborn", kStubborn);
+
+	{
+		Sink sink;
+		const bool returned = runTracker(sink, dir, "relativty_malformed", 200, 1000);
+		check(returned, "a tracker raising returns");
+		check(sink.poses.size() == 1 && sink.poses[0].position[1] == 6.0f, "all six malformed submissions refused, nothing of them delivered");
+	}
+
+	{
+		Sink sink;
+		check(runTracker(sink, dir, "relativty_no_such_module", 0, 1000) && sink.poses.empty(), "a missing module returns");
+	}
+
+	{
+		Sink sink;
+		check(runTracker(sink, dir, "relativty_stubborn", 200, 1000, true), "interrupt stops a tracker that ignores running()");
+	}
+
+	std::remove((dir + "/relativty_malformed.py").c_str());
+	std::remove((dir + "/relativty_stubborn.py").c_str());
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
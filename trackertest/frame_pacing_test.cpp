@@ -0,0 +1,149 @@
+/*******************************************************
+ Relativty frame pacing test.
+
+ Checks the pieces of publishMode "frame":
+   - FrameClock begins each display frame once, counts frames RunFrame
+     missed and follows the vsync the compositor reports
+   - PosePredictor extrapolates position and rotation at constant velocity
+     and never further than maxPredictionMs
+ and replays a 30 Hz camera whose poses arrive in bursts against a 90 Hz
+ display, publishing them once as they arrive (Event) and once per frame
+ (Frame), and prints how evenly each mode reached SteamVR.
+
+ Build and run:
+   g++ -std=c++17 -O2 -Iinclude trackertest/frame_pacing_test.cpp -o frame_pacing_test
+   ./frame_pacing_test
+********************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "Relativty_FramePacer.h"
+#include "Relativty_PosePredictor.h"
+
+using Relativty::FrameClock;
+using Relativty::PosePredictor;
+using Relativty::PredictedPose;
+using Relativty::PublishPacing;
+using Relativty::TrackerPose;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	const int64_t kMs = 1000000;
+
+	TrackerPose pose(int64_t timestampNs, float x, float yawRadians) {
+		TrackerPose out = {};
+		out.timestampNs = timestampNs;
+		out.position[0] = x;
+		out.rotation[0] = std::cos(yawRadians / 2);
+		out.rotation[2] = std::sin(yawRadians / 2);
+		return out;
+	}
+
+	bool near(double a, double b, double tolerance) {
+		return std::fabs(a - b) <= tolerance;
+	}
+}
+
+int main() {
+	{
+		FrameClock clock;
+		clock.Reset(100.0, 0.005);
+		int64_t photonNs = 0;
+		// without a reported vsync the first frame is taken to have begun half a period ago
+		check(clock.BeginFrame(1000 * kMs, photonNs) && photonNs == 1010 * kMs, "first frame, photons a period and vsyncToPhotons after its vsync");
+		check(!clock.BeginFrame(1004 * kMs, photonNs), "only once per frame");
+		check(!clock.BeginFrame(996 * kMs + 1, photonNs), "a call a little earlier in the frame is the same frame");
+		check(clock.BeginFrame(1011 * kMs, photonNs) && photonNs == 1020 * kMs, "next frame on the grid of the first");
+		check(clock.BeginFrame(1042 * kMs, photonNs) && clock.FramesMissed() == 2, "two frames without a RunFrame are missed");
+		clock.NoteVsync(1046 * kMs);
+		check(clock.BeginFrame(1057 * kMs, photonNs) && photonNs == 1071 * kMs, "phase follows the reported vsync");
+		check(clock.Frames() == 4, "frames counted");
+	}
+
+	{
+		PosePredictor predictor;
+		PredictedPose out;
+		predictor.Reset(50 * kMs);
+		check(!predictor.Predict(0, out), "nothing to predict from");
+		predictor.Add(pose(100 * kMs, 1.0f, 0.0f));
+		check(predictor.Predict(120 * kMs, out) && out.position[0] == 1.0f && out.velocity[0] == 0.0f, "a single pose is held");
+
+		// 1 m/s along x and 90 degrees/s of yaw, at 30 Hz
+		predictor.Reset(50 * kMs);
+		const float yawRate = 3.14159265f / 2;
+		for (int i = 0; i <= 3; i++)
+			predictor.Add(pose((100 + 33 * i) * kMs, 0.033f * i, yawRate * 0.033f * i));
+		check(predictor.Predict(219 * kMs, out) && out.newPoses == 4, "prediction counts the poses since the last one");
+		check(near(out.velocity[0], 1.0, 1e-3) && near(out.position[0], 0.099 + 0.02, 1e-3), "position extrapolated at constant velocity");
+		check(near(out.angularVelocity[1], yawRate, 1e-3), "angular velocity about the yaw axis");
+		const double yaw = 2 * std::atan2(out.rotation[2], out.rotation[0]);
+		check(near(yaw, yawRate * 0.119, 1e-3), "rotation extrapolated at constant rate");
+		check(predictor.Predict(400 * kMs, out) && out.horizonNs == 50 * kMs && near(out.position[0], 0.099 + 0.05, 1e-3) && out.newPoses == 0,
+			"horizon clamped to maxPredictionMs");
+		check(predictor.Predict(50 * kMs, out) && out.horizonNs == 0 && out.position[0] == 0.099f, "never predicted into the past");
+	}
+
+	{
+		// 30 Hz camera, poses delivered 0 to 8 ms late and now and then two in one
+		// datagram burst, against a 90 Hz display whose RunFrame jitters by 0.5 ms
+		const int64_t period = 11111111;
+		std::mt19937 random(7);
+		std::uniform_int_distribution<int64_t> late(0, 8 * kMs);
+		std::uniform_int_distribution<int64_t> jitter(0, kMs / 2);
+		std::uniform_int_distribution<int> burst(0, 9);
+
+		PublishPacing event, frame;
+		event.Reset(period);
+		frame.Reset(period);
+		FrameClock clock;
+		clock.Reset(1e9 / period, 0.011);
+		PosePredictor predictor;
+		predictor.Reset(50 * kMs);
+
+		int64_t arrivals[400];
+		int count = 0;
+		for (int64_t captured = 0; captured < 3000 * kMs && count < 400; captured += 33333333) {
+			int64_t arrival = captured + late(random);
+			if (count > 0 && burst(random) == 0)
+				arrival = arrivals[count - 1]; // arrives with the previous one
+			if (count > 0 && arrival < arrivals[count - 1])
+				arrival = arrivals[count - 1];
+			arrivals[count++] = arrival;
+		}
+
+		int next = 0;
+		for (int64_t vsync = 0; vsync < 3000 * kMs; vsync += period) {
+			const int64_t runFrame = vsync + jitter(random);
+			for (; next < count && arrivals[next] <= runFrame; next++) {
+				event.Published(arrivals[next]);
+				predictor.Add(pose(arrivals[next], 0.0f, 0.0f));
+			}
+			int64_t photonNs;
+			if (clock.BeginFrame(runFrame, photonNs)) {
+				PredictedPose out;
+				if (predictor.Predict(photonNs, out))
+					frame.Frame(out.newPoses, out.horizonNs);
+				else
+					frame.Frame(0, 0);
+				frame.Published(runFrame);
+			}
+		}
+
+		std::printf("      event: %s\n", event.Report().c_str());
+		std::printf("      frame: %s\n", frame.Report().c_str());
+		check(frame.Gaps() == 0 && frame.Bursts() == 0, "frame mode publishes once every display frame");
+		check(event.Bursts() > 0 && event.Gaps() > 0, "event mode publishes in bursts and gaps");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
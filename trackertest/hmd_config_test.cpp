@@ -0,0 +1,211 @@
+/*******************************************************
+ Relativty settings test.
+
+ Runs the pieces the settings watcher (config_watch_threaded) chains
+ together on a reload, and checks
+   - ParseHmdSettingsSection collects the scalars of "Relativty_hmd" from
+     a .vrsettings text, skipping nested values and other sections, and
+     unescapes strings
+   - a file caught half way through being saved, or otherwise not well
+     formed, is refused
+   - SetHmdSetting takes numbers, integers, booleans and strings, and
+     leaves the config alone on a wrong type or an unknown key
+   - IsLiveHmdSetting is true for the settings the pose path picks up
+     without a restart and false for the ones read once at Activate
+   - ValidateHmdConfig resets each invalid live value to the fallback
+     and says why
+   - RcuCell hands readers the published snapshot, and an older one
+     stays valid until reclaim
+   - RelocalizationBlender::Configure keeps the output continuous when
+     the blend time changes half way through a blend
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude trackertest/hmd_config_test.cpp source/Relativty_HmdConfig.cpp -o hmd_config_test
+   ./hmd_config_test
+********************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Relativty_HmdConfig.h"
+#include "Relativty_RelocalizationBlender.h"
+#include "Relativty_Rcu.h"
+
+using Relativty::HmdConfig;
+using Relativty::RcuCell;
+using Relativty::RelocalizationBlender;
+using Relativty::RelocalizationSettings;
+using Relativty::Vec3f;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	const char* kSettings = R"({
+   "driver_Relativty" : {
+      "enable" : true,
+      "ManualUpdateURL" : "https://example.com/{not a brace}"
+   },
+   "Relativty_hmd" : {
+      "IPDmeters" : 0.063,
+      "normalizeMinX" : -200.0,
+      "hmdPid" : 9,
+      "hmdIMUdmpPackets":  true,
+      "COMPORT": "COM\"12\"",
+      "render" : { "width" : 1920, "eyes" : [ 1, 2 ] },
+      "maxHeadSpeed" : 3.5e0,
+      "cameraStaleMs" : 200
+   },
+   "steamvr" : { "activateMultipleDrivers" : true }
+})";
+
+	bool parses(const std::string& text) {
+		std::map<std::string, std::string> values;
+		return Relativty::ParseHmdSettingsSection(text, values);
+	}
+}
+
+int main() {
+	{
+		std::map<std::string, std::string> values;
+		check(Relativty::ParseHmdSettingsSection(kSettings, values), "settings file parses");
+		check(values.size() == 7, "seven scalars collected, the nested object and array skipped");
+		check(values["IPDmeters"] == "0.063" && values["hmdPid"] == "9" && values["hmdIMUdmpPackets"] == "true",
+			"numbers and booleans come as written");
+		check(values["COMPORT"] == "COM\"12\"", "strings come unescaped");
+		check(values.count("enable") == 0 && values.count("activateMultipleDrivers") == 0, "other sections are ignored");
+
+		HmdConfig config;
+		std::string problem;
+		bool all = true;
+		for (const auto& entry : values)
+			all = Relativty::SetHmdSetting(config, entry.first, entry.second, problem) && all;
+		check(all, "every collected key is a known setting");
+		check(config.maxHeadSpeed == 3.5f && config.cameraStaleMs == 200 && config.COMPORT == "COM\"12\"", "and lands in its field");
+	}
+
+	{
+		const std::string text = kSettings;
+		bool refused = true;
+		for (size_t cut = 0; cut < text.size(); cut += 7)
+			refused = !parses(text.substr(0, cut)) && refused;
+		check(refused, "every truncation of the file is refused");
+		check(!parses(R"({ "Relativty_hmd" : { "maxHeadSpeed" : } })"), "missing value refused");
+		check(!parses(R"({ "Relativty_hmd" : { "maxHeadSpeed" : 3 "cameraStaleMs" : 2 } })"), "missing comma refused");
+		check(!parses(R"({ "Relativty_hmd" : { "COMPORT" : "COM3 } })"), "unterminated string refused");
+		std::map<std::string, std::string> values;
+		check(Relativty::ParseHmdSettingsSection("{}", values) && values.empty(), "empty file has no settings");
+	}
+
+	{
+		HmdConfig config;
+		const HmdConfig defaults;
+		std::string problem;
+		check(Relativty::SetHmdSetting(config, "hmdIMUdmpPackets", "false", problem) && !config.hmdIMUdmpPackets, "boolean set");
+		check(!Relativty::SetHmdSetting(config, "maxHeadSpeed", "fast", problem) && config.maxHeadSpeed == defaults.maxHeadSpeed,
+			"float from text refused, field untouched");
+		check(problem.find("maxHeadSpeed") != std::string::npos, "and the problem names the key");
+		check(!Relativty::SetHmdSetting(config, "cameraStaleMs", "150.5", problem) && config.cameraStaleMs == defaults.cameraStaleMs,
+			"fraction for an integer refused");
+		check(!Relativty::SetHmdSetting(config, "hmdIMUdmpPackets", "1", problem), "number for a boolean refused");
+		check(!Relativty::SetHmdSetting(config, "noSuchSetting", "1", problem) && problem.find("unknown") != std::string::npos,
+			"unknown key refused");
+	}
+
+	{
+		const char* live[] = { "maxHeadSpeed", "relocalizationBlendMs", "cameraStaleMs", "imuStaleMs", "disconnectAfterMs",
+			"normalizeMinX", "scalesCoordinateMeterY", "offsetCoordinateZ" };
+		const char* fixed[] = { "hmdPid", "hmdVid", "COMPORT", "IPDmeters", "displayFrequency", "hmdIMUdmpPackets", "noSuchSetting" };
+		bool allLive = true, noneLive = true;
+		for (const char* key : live)
+			allLive = Relativty::IsLiveHmdSetting(key) && allLive;
+		for (const char* key : fixed)
+			noneLive = !Relativty::IsLiveHmdSetting(key) && noneLive;
+		check(allLive, "relocalization, staleness budgets and TCP calibration are live");
+		check(noneLive, "device ids, port, display and packet format are not");
+	}
+
+	{
+		HmdConfig fallback;
+		fallback.maxHeadSpeed = 5.0f;
+		fallback.relocalizationBlendMs = 300;
+
+		HmdConfig config = fallback;
+		std::vector<std::string> problems;
+		check(Relativty::ValidateHmdConfig(config, fallback, problems) && problems.empty(), "valid config passes untouched");
+
+		config.maxHeadSpeed = 0.1f;
+		config.relocalizationBlendMs = 9000;
+		check(!Relativty::ValidateHmdConfig(config, fallback, problems), "out of range values are reported");
+		check(problems.size() == 2, "one problem per value");
+		check(config.maxHeadSpeed == 5.0f && config.relocalizationBlendMs == 300, "both reset to the fallback");
+
+		config = fallback;
+		config.cameraStaleMs = 400;
+		config.disconnectAfterMs = 300;
+		problems.clear();
+		Relativty::ValidateHmdConfig(config, fallback, problems);
+		check(problems.size() == 1 && config.cameraStaleMs == fallback.cameraStaleMs && config.disconnectAfterMs == fallback.disconnectAfterMs,
+			"disconnect before stale resets the budgets together");
+
+		config = fallback;
+		config.maxHeadSpeed = std::nanf("");
+		problems.clear();
+		check(!Relativty::ValidateHmdConfig(config, fallback, problems) && config.maxHeadSpeed == 5.0f, "NaN reset");
+	}
+
+	{
+		RcuCell<HmdConfig> cell;
+		check(cell.read() == nullptr, "nothing to read before the first publish");
+
+		std::unique_ptr<HmdConfig> first(new HmdConfig());
+		first->maxHeadSpeed = 3.0f;
+		cell.publish(std::move(first));
+		const HmdConfig* snapshot = cell.read();
+		check(snapshot != nullptr && snapshot->maxHeadSpeed == 3.0f, "readers get the published snapshot");
+
+		std::unique_ptr<HmdConfig> second(new HmdConfig(*snapshot));
+		second->maxHeadSpeed = 6.0f;
+		cell.publish(std::move(second));
+		check(cell.read() != snapshot && cell.read()->maxHeadSpeed == 6.0f, "a reload swaps the snapshot");
+		check(snapshot->maxHeadSpeed == 3.0f, "the one a reader holds stays valid until reclaim");
+
+		cell.reclaim();
+		check(cell.read()->maxHeadSpeed == 6.0f, "reclaim keeps the current snapshot");
+	}
+
+	{
+		// a 40 cm jump blended over 500 ms, shortened to 100 ms a quarter of
+		// the way through; the output must not step at the change
+		const int64_t kMs = 1000000;
+		RelocalizationSettings settings;
+		RelocalizationBlender blender;
+		blender.Reset(settings);
+		blender.Apply(0, Vec3f{ 0, 0, 0 }, false);
+		blender.Apply(10 * kMs, Vec3f{ 0.4f, 0, 0 }, true);
+		const Vec3f before = blender.Apply(135 * kMs, Vec3f{ 0.4f, 0, 0 }, false);
+
+		RelocalizationSettings shorter = settings;
+		shorter.blendNs = 100 * kMs;
+		blender.Configure(shorter, 135 * kMs);
+		const Vec3f at = blender.Apply(135 * kMs, Vec3f{ 0.4f, 0, 0 }, false);
+		const Vec3f after = blender.Apply(240 * kMs, Vec3f{ 0.4f, 0, 0 }, false);
+		std::printf("      offset %.1f mm before the change, %.1f mm at it, %.1f mm 105 ms later\n",
+			(0.4f - before.x) * 1000, (0.4f - at.x) * 1000, (0.4f - after.x) * 1000);
+		check(before.x < 0.4f && std::fabs(at.x - before.x) < 1e-6f, "new blend time starts from what is left");
+		check(after.x == 0.4f, "and works it off within the new blend time");
+		check(blender.Jumps() == 1, "no jump is made of the change");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+/*******************************************************
+ Relativty IMU codec test and benchmark.
+
+ Checks every codec of Relativty_ImuCodec.h:
+   - MpuDmpQ14 against hand built big endian Q14 reports, including the
+     extremes of int16, and refuses reports too short for the quaternion
+   - Mpu9250Float against packed floats at the report's offset, refuses
+     short reports and non finite components
+   - Bno055Ascii on quaternion lines with and without the acceleration,
+     line endings, and refuses status lines, values out of range, missing
+     or extra fields, stray characters and every truncation of a line
+     that leaves a field missing
+   - Bno055Binary encode/decode round trips within half an LSB, and refuses
+     short frames, a wrong sync and every single bit flip of a frame
+ then times decode() of each codec over a buffer of packets.
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude trackertest/imu_codec_test.cpp -o imu_codec_test
+   ./imu_codec_test
+********************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Relativty_ImuCodec.h"
+
+using Relativty::ImuCodec;
+using Relativty::ImuFormat;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	using Q14 = ImuCodec<ImuFormat::MpuDmpQ14>;
+	using Float = ImuCodec<ImuFormat::Mpu9250Float>;
+	using Ascii = ImuCodec<ImuFormat::Bno055Ascii>;
+	using Binary = ImuCodec<ImuFormat::Bno055Binary>;
+
+	bool near(const float a[4], const float b[4], float tolerance) {
+		for (int i = 0; i < 4; i++) {
+			if (!(std::fabs(a[i] - b[i]) <= tolerance))
+				return false;
+		}
+		return true;
+	}
+
+	// report id, then w x y z as big endian int16, the rest padding
+	std::vector<uint8_t> q14Report(const int16_t raw[4]) {
+		std::vector<uint8_t> report(Q14::packetLen, 0xEE);
+		report[0] = 1;
+		for (int i = 0; i < 4; i++) {
+			report[1 + 4 * i] = static_cast<uint8_t>(static_cast<uint16_t>(raw[i]) >> 8);
+			report[2 + 4 * i] = static_cast<uint8_t>(raw[i] & 0xff);
+		}
+		return report;
+	}
+
+	std::vector<uint8_t> floatReport(const float quat[4]) {
+		std::vector<uint8_t> report(Float::packetLen, 0);
+		report[0] = 1;
+		std::memcpy(report.data() + Float::quatOffset, quat, 4 * sizeof(float));
+		return report;
+	}
+
+	bool ascii(const std::string& line, float quat[4]) {
+		return Ascii::decode(reinterpret_cast<const uint8_t*>(line.data()), line.size(), quat);
+	}
+
+	bool ascii(const std::string& line, float quat[4], float accel[3], bool& hasAccel) {
+		return Ascii::decode(reinterpret_cast<const uint8_t*>(line.data()), line.size(), quat, accel, hasAccel);
+	}
+
+	template<typename Body>
+	double nsPerPacket(size_t count, Body body) {
+		const int rounds = 2000;
+		const auto begin = std::chrono::steady_clock::now();
+		for (int r = 0; r < rounds; r++)
+			body();
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / (double(rounds) * count);
+	}
+}
+
+int main() {
+	std::mt19937 random(30);
+	std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+	float quat[4];
+
+	{
+		const int16_t raw[4] = { 16384, -8192, 32767, -32768 };
+		const std::vector<uint8_t> report = q14Report(raw);
+		const float expected[4] = { 1.0f, -0.5f, 32767.0f / 16384.0f, -2.0f };
+		check(Q14::decode(report.data(), report.size(), quat) && near(quat, expected, 0.0f), "Q14 big endian components, int16 extremes");
+		check(Q14::decode(report.data(), 15, quat), "Q14 needs 15 bytes");
+		check(!Q14::decode(report.data(), 14, quat) && !Q14::decode(report.data(), 0, quat), "Q14 refuses shorter reports");
+	}
+
+	{
+		const float sent[4] = { 0.5f, -0.25f, 0.125f, 0.8125f };
+		std::vector<uint8_t> report = floatReport(sent);
+		check(Float::decode(report.data(), report.size(), quat) && near(quat, sent, 0.0f), "float report decoded as sent");
+		check(Float::decode(report.data(), Float::quatOffset + 16, quat), "float needs the id and four floats");
+		check(!Float::decode(report.data(), Float::quatOffset + 15, quat), "float refuses a shorter report");
+		const float bad[][4] = { { NAN, 0, 0, 1 }, { 1, INFINITY, 0, 0 }, { 1, 0, -INFINITY, 0 }, { 1, 0, 0, NAN } };
+		bool refused = true;
+		for (const auto& components : bad) {
+			report = floatReport(components);
+			refused = !Float::decode(report.data(), report.size(), quat) && refused;
+		}
+		check(refused, "float refuses non finite components");
+	}
+
+	{
+		float accel[3];
+		bool hasAccel = true;
+		const float expected[4] = { 0.9998f, -0.0123f, 0.5f, -1.0f };
+		check(ascii("0.9998,-0.0123,0.5000,-1.0000", quat, accel, hasAccel) && near(quat, expected, 1e-6f) && !hasAccel,
+			"ASCII quaternion line");
+		check(ascii("0.9998,-0.0123,0.5000,-1.0000\r\n", quat) && ascii("0.9998,-0.0123,0.5000,-1.0000\n", quat), "with either line ending");
+		check(ascii("1,0,+0,-0", quat) && ascii(".5,0.,0,0", quat), "integers, signs and bare points");
+		check(ascii("0.7071,0.0000,0.7071,0.0000,1.2500,-9.8100,0.0300", quat, accel, hasAccel) && hasAccel
+			&& std::fabs(accel[0] - 1.25f) < 1e-5f && std::fabs(accel[1] + 9.81f) < 1e-5f && std::fabs(accel[2] - 0.03f) < 1e-5f,
+			"ASCII line with linear acceleration");
+		check(ascii("0.00000000000000001,1.0,0,0", quat) && quat[0] < 1e-7f, "long fractions do not overflow");
+
+		const char* malformed[] = {
+			"", "\n", "C:3,3,3,3", "D:BNO055 ready", "1.0001,0,0,0", "0,0,-1.5,0", "0,0,0", "0,0,0,", "0,,0,0",
+			"0,0,0,0,", "0,0,0,0,1", "0,0,0,0,1,2", "0,0,0,0,1,2,3,4", "0,0,0,0,170,0,0", "0,0,0,0,0,0,-160.5",
+			"0;0;0;0", "0,0,0,0x", "0,0,0,0 ", " 0,0,0,0", "-,0,0,0", "0,0,1e-3,0", "nan,0,0,0",
+		};
+		bool refused = true;
+		for (const char* line : malformed) {
+			if (ascii(line, quat, accel, hasAccel)) {
+				std::printf("      accepted \"%s\"\n", line);
+				refused = false;
+			}
+		}
+		check(refused, "ASCII refuses status lines, out of range values, wrong field counts and stray characters");
+
+		const std::string line = "0.7071,-0.7071,0.0012,-0.0034,1.2500,-9.8100,0.0300";
+		bool truncations = true;
+		for (size_t cut = 0; cut < line.size(); cut++) {
+			// a cut inside a number still parses as a shorter number, only the
+			// field count can tell; a line cut after the quaternion is a valid
+			// quaternion line
+			const std::string part = line.substr(0, cut);
+			const size_t commas = static_cast<size_t>(std::count(part.begin(), part.end(), ','));
+			const bool complete = (commas == 3 || commas == 6) && part.back() != ',' && part.back() != '-';
+			if (ascii(part, quat, accel, hasAccel) != complete)
+				truncations = false;
+		}
+		check(truncations, "every truncation of a line is refused unless it ends on a complete quaternion");
+	}
+
+	{
+		uint8_t frame[Binary::packetLen];
+		float worst = 0;
+		for (int i = 0; i < 10000; i++) {
+			const float sent[4] = { component(random), component(random), component(random), component(random) };
+			Binary::encode(sent, frame);
+			if (!Binary::decode(frame, sizeof(frame), quat)) {
+				worst = 1;
+				break;
+			}
+			for (int c = 0; c < 4; c++)
+				worst = std::fmax(worst, std::fabs(quat[c] - sent[c]));
+		}
+		check(worst <= 0.5f / 16384.0f + 1e-7f, "binary round trip within half an LSB");
+
+		const float corners[4] = { 1.0f, -1.0f, 0.0f, -0.0f };
+		Binary::encode(corners, frame);
+		check(Binary::decode(frame, sizeof(frame), quat) && near(quat, corners, 0.0f), "binary +1 and -1 exact");
+		check(!Binary::decode(frame, sizeof(frame) - 1, quat), "binary refuses a short frame");
+
+		bool flips = true;
+		for (size_t bit = 0; bit < 8 * sizeof(frame); bit++) {
+			uint8_t damaged[Binary::packetLen];
+			std::memcpy(damaged, frame, sizeof(frame));
+			damaged[bit / 8] ^= static_cast<uint8_t>(1 << (bit % 8));
+			flips = !Binary::decode(damaged, sizeof(damaged), quat) && flips;
+		}
+		check(flips, "binary refuses every single bit flip of sync, data and checksum");
+	}
+
+	{
+		const size_t count = 1024;
+		std::vector<uint8_t> q14(count * Q14::packetLen), floats(count * Float::packetLen), binary(count * Binary::packetLen);
+		std::vector<std::string> lines(count);
+		for (size_t i = 0; i < count; i++) {
+			const float sent[4] = { component(random), component(random), component(random), component(random) };
+			const int16_t raw[4] = { int16_t(sent[0] * 16384), int16_t(sent[1] * 16384), int16_t(sent[2] * 16384), int16_t(sent[3] * 16384) };
+			const std::vector<uint8_t> report = q14Report(raw);
+			std::memcpy(&q14[i * Q14::packetLen], report.data(), Q14::packetLen);
+			const std::vector<uint8_t> packed = floatReport(sent);
+			std::memcpy(&floats[i * Float::packetLen], packed.data(), Float::packetLen);
+			Binary::encode(sent, &binary[i * Binary::packetLen]);
+			char line[64];
+			snprintf(line, sizeof(line), "%.4f,%.4f,%.4f,%.4f\n", sent[0], sent[1], sent[2], sent[3]);
+			lines[i] = line;
+		}
+
+		volatile float sink = 0;
+		size_t decoded = 0;
+		const double q14Ns = nsPerPacket(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				decoded += Q14::decode(&q14[i * Q14::packetLen], Q14::packetLen, quat);
+			sink = sink + quat[0];
+		});
+		const double floatNs = nsPerPacket(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				decoded += Float::decode(&floats[i * Float::packetLen], Float::packetLen, quat);
+			sink = sink + quat[0];
+		});
+		const double asciiNs = nsPerPacket(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				decoded += Ascii::decode(reinterpret_cast<const uint8_t*>(lines[i].data()), lines[i].size(), quat);
+			sink = sink + quat[0];
+		});
+		const double binaryNs = nsPerPacket(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				decoded += Binary::decode(&binary[i * Binary::packetLen], Binary::packetLen, quat);
+			sink = sink + quat[0];
+		});
+		check(decoded == 4 * 2000 * count, "every benchmark packet decoded");
+		std::printf("      ns per packet over %zu: %s %.2f, %s %.2f, %s %.2f, %s %.2f\n", count,
+			Q14::name, q14Ns, Float::name, floatNs, Ascii::name, asciiNs, Binary::name, binaryNs);
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
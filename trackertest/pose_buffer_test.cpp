@@ -0,0 +1,131 @@
+/*******************************************************
+ Relativty published pose stress test.
+
+ RelativtyDevice::PublishPose pushes every vr::DriverPose_t into a
+ SampleHistory<vr::DriverPose_t, 4> and GetPose copies the newest slot out
+ of it without a lock. Here one writer publishes poses as fast as it can
+ while several readers take GetPose copies, and every copy must be one
+ whole pose: all its fields are derived from the same counter, a torn copy
+ mixes two. Readers must also never see the counter go backwards.
+
+ Build it with ThreadSanitizer, which must stay quiet, and run:
+   g++ -std=c++17 -O1 -g -fsanitize=thread -Iinclude trackertest/pose_buffer_test.cpp -o pose_buffer_test -pthread
+   ./pose_buffer_test
+ Without -fsanitize=thread it also prints what a GetPose copy costs.
+********************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "openvr_driver.h"
+#include "Relativty_PoseHistory.h"
+
+using Relativty::SampleHistory;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	vr::DriverPose_t makePose(uint64_t n) {
+		vr::DriverPose_t pose;
+		std::memset(&pose, 0, sizeof(pose));
+		const double value = static_cast<double>(n);
+		pose.poseTimeOffset = value;
+		for (int i = 0; i < 3; i++) {
+			pose.vecPosition[i] = value + i;
+			pose.vecVelocity[i] = value * 2 + i;
+			pose.vecAngularVelocity[i] = value * 3 + i;
+		}
+		pose.qRotation.w = value;
+		pose.qRotation.x = value + 1;
+		pose.qRotation.y = value + 2;
+		pose.qRotation.z = value + 3;
+		pose.poseIsValid = (n & 1) != 0;
+		pose.deviceIsConnected = (n & 1) == 0;
+		return pose;
+	}
+
+	bool whole(const vr::DriverPose_t& pose) {
+		const double value = pose.poseTimeOffset;
+		const uint64_t n = static_cast<uint64_t>(value);
+		for (int i = 0; i < 3; i++) {
+			if (pose.vecPosition[i] != value + i || pose.vecVelocity[i] != value * 2 + i || pose.vecAngularVelocity[i] != value * 3 + i)
+				return false;
+		}
+		return pose.qRotation.w == value && pose.qRotation.x == value + 1 && pose.qRotation.y == value + 2 && pose.qRotation.z == value + 3
+			&& pose.poseIsValid == ((n & 1) != 0) && pose.deviceIsConnected == ((n & 1) == 0);
+	}
+
+	// what RelativtyDevice::PublishedPose does
+	vr::DriverPose_t publishedPose(const SampleHistory<vr::DriverPose_t, 4>& poses) {
+		vr::DriverPose_t pose;
+		while (!poses.latest(pose)) {}
+		return pose;
+	}
+}
+
+int main() {
+	SampleHistory<vr::DriverPose_t, 4> poses;
+	poses.push(makePose(0));
+
+	const int readerCount = 3;
+	const auto duration = std::chrono::milliseconds(500);
+	std::atomic<bool> done = false;
+	std::atomic<uint64_t> torn = 0, backwards = 0, reads = 0;
+	uint64_t written = 0;
+
+	std::vector<std::thread> readers;
+	for (int r = 0; r < readerCount; r++) {
+		readers.emplace_back([&] {
+			uint64_t last = 0, count = 0;
+			while (!done.load(std::memory_order_relaxed)) {
+				const vr::DriverPose_t pose = publishedPose(poses);
+				if (!whole(pose))
+					torn++;
+				const uint64_t n = static_cast<uint64_t>(pose.poseTimeOffset);
+				if (n < last)
+					backwards++;
+				last = n;
+				count++;
+			}
+			reads += count;
+		});
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	while (std::chrono::steady_clock::now() - start < duration)
+		poses.push(makePose(++written));
+	done = true;
+	for (std::thread& reader : readers)
+		reader.join();
+
+	std::printf("      %llu poses published, %llu copies read by %d readers\n",
+		static_cast<unsigned long long>(written), static_cast<unsigned long long>(reads.load()), readerCount);
+	check(written > 1000 && reads.load() > 1000, "writer and readers overlapped");
+	check(torn.load() == 0, "every copy is one whole pose");
+	check(backwards.load() == 0, "no reader sees an older pose after a newer one");
+	check(static_cast<uint64_t>(publishedPose(poses).poseTimeOffset) == written, "the newest pose is the one returned");
+
+	{
+		// an uncontended copy, what SteamVR pays for GetPose
+		const int rounds = 1000000;
+		double sink = 0;
+		const auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < rounds; i++)
+			sink += publishedPose(poses).vecPosition[0];
+		const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / rounds;
+		std::printf("      %zu byte pose, %.1f ns per copy (%g)\n", sizeof(vr::DriverPose_t), ns, sink > 0 ? 1.0 : 0.0);
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,435 @@
+/*******************************************************
+ Relativty pose stream simulator.
+
+ Stands in for the tracker on the UDP pose stream, to load and time the
+ driver's ingest without a camera, and doubles as the headless receiving
+ end for measuring that path on Linux.
+
+   pose_simulator send [options]
+     Sends pose datagrams in the driver's text format (see
+     ParsePoseDatagram) to --host:--port, one datagram per tick with a
+     "@<id> x y z qw qz qx qy" line for every device. Each line ends with
+     the datagram's sequence number and its CLOCK_MONOTONIC send time in
+     ns, which the driver skips over as it only reads seven numbers.
+
+       --host 127.0.0.1     --port 50000
+       --rate 90            datagrams per second, 30 to 10000
+       --seconds 10         how long to send, 0 for until killed
+       --devices 0          ids to send, "0,1,2" for the headset and two trackers
+       --trajectory sine    static, sine, or file:<path> to replay a
+                            recording in the same text format, a frame
+                            ending where a device repeats
+       --amplitude 0.2      sine: metres and radians of yaw
+       --frequency 0.5      sine: Hz
+       --relocalize 0       every this many seconds the tracker's map moves
+                            by 0.3 m (back and forth) and the first pose
+                            after it carries the '!' reset flag
+       --jitter-us 0        every datagram leaves up to this late
+       --loss 0             probability a datagram is dropped
+       --duplicate 0        probability it is sent twice
+       --reorder 0          probability it is held back behind the next one
+       --seed 1
+       --unstamped          no sequence number and send time, the exact
+                            format the tracker sends
+
+   pose_simulator receive [options]
+     Binds --port, parses every datagram with ParsePoseDatagram and
+     reports the end-to-end latency from the embedded send time and how
+     many datagrams were lost, duplicated and reordered. Stops after
+     --seconds, or --idle seconds without a datagram once one arrived.
+
+       --port 50000   --seconds 0   --idle 2
+
+ The two only share a clock on one machine, run them side by side:
+   ./pose_simulator receive --seconds 6 &
+   ./pose_simulator send --rate 1000 --seconds 5 --loss 0.01 --reorder 0.01
+
+ Build:
+   g++ -std=c++17 -O2 -Iinclude trackertest/pose_simulator.cpp -o pose_simulator
+********************************************************/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Relativty_PoseStream.h"
+
+using Relativty::kMaxTrackers;
+using Relativty::kPoseReset;
+using Relativty::ParsePoseDatagram;
+using Relativty::TrackerPose;
+
+namespace {
+	int64_t nowNs() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+	}
+
+	// sleeps to within 50 us of deadlineNs and spins the rest, the kernel's
+	// wakeup alone is too coarse for 10 kHz
+	void waitUntil(int64_t deadlineNs) {
+		const int64_t sleepUntil = deadlineNs - 50000;
+		if (sleepUntil > nowNs()) {
+			timespec ts;
+			ts.tv_sec = static_cast<time_t>(sleepUntil / 1000000000LL);
+			ts.tv_nsec = static_cast<long>(sleepUntil % 1000000000LL);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+		}
+		while (nowNs() < deadlineNs) {}
+	}
+
+	// "--key value" pairs, flags get "1"
+	bool parseOptions(int argc, char** argv, std::map<std::string, std::string>& options) {
+		for (int i = 2; i < argc; i++) {
+			const std::string key = argv[i];
+			if (key.compare(0, 2, "--") != 0) {
+				std::fprintf(stderr, "unexpected argument %s\n", argv[i]);
+				return false;
+			}
+			if (key == "--unstamped")
+				options[key.substr(2)] = "1";
+			else if (i + 1 < argc)
+				options[key.substr(2)] = argv[++i];
+			else {
+				std::fprintf(stderr, "%s needs a value\n", argv[i]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::string option(const std::map<std::string, std::string>& options, const char* key, const char* fallback) {
+		const auto found = options.find(key);
+		return found == options.end() ? fallback : found->second;
+	}
+
+	double numberOption(const std::map<std::string, std::string>& options, const char* key, double fallback) {
+		const auto found = options.find(key);
+		return found == options.end() ? fallback : std::atof(found->second.c_str());
+	}
+
+	typedef std::vector<TrackerPose> Frame;
+
+	// a recording in the datagram format, one pose per line; a frame ends
+	// where a device that is already in it comes up again
+	bool loadRecording(const std::string& path, std::vector<Frame>& frames) {
+		std::ifstream file(path);
+		if (!file) {
+			std::fprintf(stderr, "cannot open %s\n", path.c_str());
+			return false;
+		}
+		std::stringstream text;
+		text << file.rdbuf();
+		const std::string contents = text.str();
+		std::vector<TrackerPose> poses(contents.size() / 14 + 1);
+		uint32_t malformed = 0;
+		poses.resize(ParsePoseDatagram(contents.data(), contents.size(), 0, poses.data(), poses.size(), malformed));
+		if (malformed != 0)
+			std::fprintf(stderr, "%s: skipped %u malformed lines\n", path.c_str(), malformed);
+
+		Frame frame;
+		for (const TrackerPose& pose : poses) {
+			for (const TrackerPose& earlier : frame) {
+				if (earlier.device == pose.device) {
+					frames.push_back(frame);
+					frame.clear();
+					break;
+				}
+			}
+			frame.push_back(pose);
+		}
+		if (!frame.empty())
+			frames.push_back(frame);
+		return !frames.empty();
+	}
+
+	// device id d stands 0.3 m to the side of the headset per id
+	TrackerPose synthesize(uint32_t device, double t, bool moving, double amplitude, double frequency) {
+		TrackerPose pose = {};
+		pose.device = device;
+		const double phase = moving ? std::sin(2 * M_PI * frequency * t) : 0.0;
+		pose.position[0] = static_cast<float>(0.3 * device + amplitude * phase);
+		pose.position[1] = static_cast<float>(1.6 + 0.5 * amplitude * phase);
+		pose.position[2] = 0.0f;
+		const double yaw = amplitude * phase;
+		pose.rotation[0] = static_cast<float>(std::cos(yaw / 2));
+		pose.rotation[2] = static_cast<float>(std::sin(yaw / 2));
+		return pose;
+	}
+
+	// rotation goes out as w z x y, the order the tracker has always used
+	std::string datagramFor(const Frame& frame, uint64_t sequence, int64_t sentNs, bool stamped) {
+		std::string datagram;
+		char line[160];
+		for (const TrackerPose& pose : frame) {
+			int length = std::snprintf(line, sizeof(line), "@%u%s %.5f %.5f %.5f %.6f %.6f %.6f %.6f", pose.device, (pose.flags & kPoseReset) ? " !" : "",
+				pose.position[0], pose.position[1], pose.position[2], pose.rotation[0], pose.rotation[3], pose.rotation[1], pose.rotation[2]);
+			if (stamped)
+				length += std::snprintf(line + length, sizeof(line) - length, " %llu %lld",
+					static_cast<unsigned long long>(sequence), static_cast<long long>(sentNs));
+			datagram.append(line, length);
+			datagram += '\n';
+		}
+		return datagram;
+	}
+
+	int send(const std::map<std::string, std::string>& options) {
+		const double rate = numberOption(options, "rate", 90);
+		const double seconds = numberOption(options, "seconds", 10);
+		const double amplitude = numberOption(options, "amplitude", 0.2);
+		const double frequency = numberOption(options, "frequency", 0.5);
+		const double relocalize = numberOption(options, "relocalize", 0);
+		const double loss = numberOption(options, "loss", 0);
+		const double duplicate = numberOption(options, "duplicate", 0);
+		const double reorder = numberOption(options, "reorder", 0);
+		const int64_t jitterNs = static_cast<int64_t>(numberOption(options, "jitter-us", 0) * 1000);
+		const bool stamped = options.count("unstamped") == 0;
+		const std::string trajectory = option(options, "trajectory", "sine");
+		if (rate < 30 || rate > 10000) {
+			std::fprintf(stderr, "--rate must be 30 to 10000\n");
+			return 2;
+		}
+
+		std::vector<uint32_t> devices;
+		std::stringstream list(option(options, "devices", "0"));
+		for (std::string id; std::getline(list, id, ',');) {
+			const unsigned long value = std::strtoul(id.c_str(), nullptr, 10);
+			if (value > kMaxTrackers) {
+				std::fprintf(stderr, "device ids go up to %u\n", kMaxTrackers);
+				return 2;
+			}
+			devices.push_back(static_cast<uint32_t>(value));
+		}
+		std::vector<Frame> recording;
+		if (trajectory.compare(0, 5, "file:") == 0) {
+			if (!loadRecording(trajectory.substr(5), recording))
+				return 2;
+		}
+		else if (trajectory != "static" && trajectory != "sine") {
+			std::fprintf(stderr, "--trajectory must be static, sine or file:<path>\n");
+			return 2;
+		}
+
+		const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+		sockaddr_in to = {};
+		to.sin_family = AF_INET;
+		to.sin_port = htons(static_cast<uint16_t>(numberOption(options, "port", 50000)));
+		if (sock < 0 || inet_pton(AF_INET, option(options, "host", "127.0.0.1").c_str(), &to.sin_addr) != 1) {
+			std::fprintf(stderr, "bad --host or no socket\n");
+			return 2;
+		}
+
+		std::mt19937_64 random(static_cast<uint64_t>(numberOption(options, "seed", 1)));
+		std::uniform_real_distribution<double> chance(0.0, 1.0);
+		std::uniform_int_distribution<int64_t> jitter(0, jitterNs);
+
+		const int64_t periodNs = static_cast<int64_t>(1e9 / rate);
+		const int64_t start = nowNs();
+		const int64_t end = seconds > 0 ? start + static_cast<int64_t>(seconds * 1e9) : INT64_MAX;
+		uint64_t sent = 0, dropped = 0, duplicated = 0, reordered = 0, sendErrors = 0;
+		std::vector<int64_t> lateness;
+		std::string held; // a datagram held back to go out after the next one
+		Frame frame;
+		int64_t relocalizations = 0;
+
+		auto transmit = [&](const std::string& datagram) {
+			if (sendto(sock, datagram.data(), datagram.size(), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) < 0)
+				sendErrors++;
+			else
+				sent++;
+		};
+
+		for (uint64_t sequence = 0;; sequence++) {
+			const int64_t due = start + static_cast<int64_t>(sequence) * periodNs;
+			if (due >= end)
+				break;
+			const int64_t target = due + (jitterNs > 0 ? jitter(random) : 0);
+			waitUntil(target);
+			const int64_t sentNs = nowNs();
+			lateness.push_back(sentNs - target);
+
+			frame.clear();
+			if (!recording.empty()) {
+				frame = recording[sequence % recording.size()];
+			}
+			else {
+				const double t = (due - start) * 1e-9;
+				for (uint32_t device : devices)
+					frame.push_back(synthesize(device, t, trajectory == "sine", amplitude, frequency));
+			}
+			if (relocalize > 0) {
+				const int64_t count = static_cast<int64_t>((due - start) * 1e-9 / relocalize);
+				for (TrackerPose& pose : frame) {
+					pose.position[0] += (count % 2) * 0.3f;
+					if (count != relocalizations)
+						pose.flags |= kPoseReset;
+				}
+				relocalizations = count;
+			}
+			const std::string datagram = datagramFor(frame, sequence, sentNs, stamped);
+
+			if (chance(random) < loss) {
+				dropped++;
+				continue;
+			}
+			if (held.empty() && chance(random) < reorder) {
+				held = datagram;
+				reordered++;
+				continue;
+			}
+			transmit(datagram);
+			if (chance(random) < duplicate) {
+				transmit(datagram);
+				duplicated++;
+			}
+			if (!held.empty()) {
+				transmit(held);
+				held.clear();
+			}
+		}
+		if (!held.empty())
+			transmit(held);
+		close(sock);
+
+		std::sort(lateness.begin(), lateness.end());
+		const double elapsed = (nowNs() - start) * 1e-9;
+		std::printf("sent %llu datagrams in %.2f s (%.0f/s), dropped %llu, duplicated %llu, reordered %llu, send errors %llu\n",
+			static_cast<unsigned long long>(sent), elapsed, sent / elapsed, static_cast<unsigned long long>(dropped),
+			static_cast<unsigned long long>(duplicated), static_cast<unsigned long long>(reordered), static_cast<unsigned long long>(sendErrors));
+		if (!lateness.empty())
+			std::printf("left late by: median %.1f us, p99 %.1f us, max %.1f us\n", lateness[lateness.size() / 2] / 1e3,
+				lateness[lateness.size() * 99 / 100] / 1e3, lateness.back() / 1e3);
+		return 0;
+	}
+
+	// the sequence number and send time after the seven numbers of the first line
+	bool readStamp(const char* text, uint64_t& sequence, int64_t& sentNs) {
+		const char* cursor = text;
+		while (*cursor == ' ' || *cursor == '\t')
+			cursor++;
+		if (*cursor == '@')
+			std::strtoul(cursor + 1, const_cast<char**>(&cursor), 10);
+		while (*cursor == ' ' || *cursor == '\t')
+			cursor++;
+		if (*cursor == '!')
+			cursor++;
+		for (int i = 0; i < 7; i++) {
+			char* end;
+			std::strtof(cursor, &end);
+			if (end == cursor)
+				return false;
+			cursor = end;
+		}
+		char* end;
+		sequence = std::strtoull(cursor, &end, 10);
+		if (end == cursor)
+			return false;
+		cursor = end;
+		sentNs = std::strtoll(cursor, &end, 10);
+		return end != cursor;
+	}
+
+	int receive(const std::map<std::string, std::string>& options) {
+		const double seconds = numberOption(options, "seconds", 0);
+		const int64_t idleNs = static_cast<int64_t>(numberOption(options, "idle", 2) * 1e9);
+
+		const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+		int buffer = 4 << 20;
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+		sockaddr_in at = {};
+		at.sin_family = AF_INET;
+		at.sin_addr.s_addr = htonl(INADDR_ANY);
+		at.sin_port = htons(static_cast<uint16_t>(numberOption(options, "port", 50000)));
+		if (sock < 0 || bind(sock, reinterpret_cast<const sockaddr*>(&at), sizeof(at)) != 0) {
+			std::perror("bind");
+			return 2;
+		}
+
+		const int64_t start = nowNs();
+		const int64_t end = seconds > 0 ? start + static_cast<int64_t>(seconds * 1e9) : INT64_MAX;
+		int64_t lastNs = 0;
+		uint64_t datagrams = 0, poses = 0, unstamped = 0, duplicates = 0, reordered = 0, highest = 0;
+		uint32_t malformed = 0;
+		std::vector<uint8_t> seen;
+		std::vector<int64_t> latencies;
+		char text[Relativty::kMaxTrackers * 160 + 1];
+		TrackerPose parsed[kMaxTrackers + 1];
+
+		for (;;) {
+			const int64_t now = nowNs();
+			if (now >= end || (lastNs != 0 && now - lastNs >= idleNs))
+				break;
+			pollfd waiting = { sock, POLLIN, 0 };
+			if (poll(&waiting, 1, 100) <= 0)
+				continue;
+			const ssize_t length = recv(sock, text, sizeof(text) - 1, 0);
+			const int64_t arrived = nowNs();
+			if (length <= 0)
+				continue;
+			text[length] = '\0';
+			lastNs = arrived;
+			datagrams++;
+			poses += ParsePoseDatagram(text, static_cast<size_t>(length), arrived, parsed, kMaxTrackers + 1, malformed);
+
+			uint64_t sequence;
+			int64_t sentNs;
+			if (!readStamp(text, sequence, sentNs)) {
+				unstamped++;
+				continue;
+			}
+			if (sequence >= seen.size())
+				seen.resize(sequence + 1 + seen.size() / 2);
+			if (seen[sequence]) {
+				duplicates++;
+				continue;
+			}
+			seen[sequence] = 1;
+			if (sequence < highest)
+				reordered++;
+			highest = (std::max)(highest, sequence);
+			latencies.push_back(arrived - sentNs);
+		}
+		close(sock);
+
+		const uint64_t unique = latencies.size();
+		const uint64_t expected = unique == 0 ? 0 : highest + 1;
+		std::printf("received %llu datagrams, %llu poses, %u malformed lines, %llu unstamped\n",
+			static_cast<unsigned long long>(datagrams), static_cast<unsigned long long>(poses), malformed, static_cast<unsigned long long>(unstamped));
+		if (unique == 0)
+			return 0;
+		std::printf("of %llu sent: %llu lost (%.2f%%), %llu duplicates, %llu out of order\n", static_cast<unsigned long long>(expected),
+			static_cast<unsigned long long>(expected - unique), 100.0 * (expected - unique) / expected,
+			static_cast<unsigned long long>(duplicates), static_cast<unsigned long long>(reordered));
+		std::sort(latencies.begin(), latencies.end());
+		std::printf("latency: median %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n", latencies[unique / 2] / 1e3,
+			latencies[unique * 9 / 10] / 1e3, latencies[unique * 99 / 100] / 1e3, latencies.back() / 1e3);
+		return 0;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::map<std::string, std::string> options;
+	const std::string mode = argc > 1 ? argv[1] : "";
+	if ((mode != "send" && mode != "receive") || !parseOptions(argc, argv, options)) {
+		std::fprintf(stderr, "usage: %s send|receive [--option value ...], see the top of pose_simulator.cpp\n", argv[0]);
+		return 2;
+	}
+	return mode == "send" ? send(options) : receive(options);
+}
@@ -0,0 +1,131 @@
+/*******************************************************
+ Relativty pose stream test.
+
+ Checks the datagram format the UDP thread parses (ParsePoseDatagram):
+   - the original anonymous line is the headset, with its w z x y order
+   - "@<id>" lines address trackers, several in one datagram
+   - malformed lines and ids past kMaxTrackers are skipped and counted
+     without losing the good lines around them, '#' comment lines are
+     skipped without counting
+   - a '!' before the numbers sets kPoseReset
+ and the trackerRoles setting (ParseTrackerRoles). Prints how long a
+ datagram with the headset and a dozen trackers takes to parse.
+
+ Build and run:
+   g++ -std=c++17 -O2 -Iinclude trackertest/pose_stream_test.cpp -o pose_stream_test
+   ./pose_stream_test
+********************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Relativty_PoseStream.h"
+
+using Relativty::kMaxTrackers;
+using Relativty::ParsePoseDatagram;
+using Relativty::ParseTrackerRoles;
+using Relativty::TrackerPose;
+using Relativty::TrackerRole;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	size_t parse(const std::string& text, TrackerPose* poses, size_t capacity, uint32_t& malformed) {
+		malformed = 0;
+		return ParsePoseDatagram(text.data(), text.size(), 42, poses, capacity, malformed);
+	}
+}
+
+int main() {
+	TrackerPose poses[kMaxTrackers + 1];
+	uint32_t malformed;
+
+	{
+		// as the tracker sends it: leading space, trailing space, terminating zero
+		const char legacy[] = " 0.1 0.2 0.3 1 0.4 0.5 0.6 ";
+		const size_t count = ParsePoseDatagram(legacy, sizeof(legacy), 42, poses, kMaxTrackers + 1, malformed = 0);
+		check(count == 1 && malformed == 0 && poses[0].device == Relativty::kHeadsetDevice, "anonymous line is the headset");
+		check(poses[0].position[0] == 0.1f && poses[0].position[1] == 0.2f && poses[0].position[2] == 0.3f, "position x y z");
+		check(poses[0].rotation[0] == 1.0f && poses[0].rotation[1] == 0.5f && poses[0].rotation[2] == 0.6f && poses[0].rotation[3] == 0.4f,
+			"rotation sent as w z x y");
+		check(poses[0].timestampNs == 42, "stamped with the arrival time");
+	}
+
+	{
+		const size_t count = parse("@0 1 2 3 1 0 0 0\n@3 4 5 6 1 0 0 0\r\n@12 7 8 9 1 0 0 0", poses, kMaxTrackers + 1, malformed);
+		check(count == 3 && malformed == 0, "three devices in one datagram");
+		check(poses[0].device == 0 && poses[1].device == 3 && poses[2].device == 12, "device ids");
+		check(poses[1].position[0] == 4.0f && poses[2].position[2] == 9.0f, "each line keeps its own pose");
+	}
+
+	{
+		const size_t count = parse("@2 1 2 3 1 0 0\n@17 1 2 3 1 0 0 0\n@x 1 2 3 1 0 0 0\n@4 1 2 nan 1 0 0 0\n\n@5 1 2 3 1 0 0 0\n",
+			poses, kMaxTrackers + 1, malformed);
+		check(count == 1 && poses[0].device == 5, "only the good line gets through");
+		check(malformed == 4, "short line, unknown id, bad id and nan are counted");
+	}
+
+	{
+		const size_t count = parse("#imu 12 1 0 0 0 0.1 0.2 9.8\n@1 1 2 3 1 0 0 0\n  # comment\n", poses, kMaxTrackers + 1, malformed);
+		check(count == 1 && poses[0].device == 1 && malformed == 0, "'#' lines are comments, not malformed");
+	}
+
+	{
+		const size_t count = parse("! 1 2 3 1 0 0 0\n@3 !4 5 6 1 0 0 0\n@4 7 8 9 1 0 0 0\n@5 ! ! 1 2 3 1 0 0 0\n", poses, kMaxTrackers + 1, malformed);
+		check(count == 3 && malformed == 1, "'!' lines parse, a second '!' is malformed");
+		check(poses[0].device == 0 && poses[0].flags == Relativty::kPoseReset && poses[0].position[0] == 1.0f, "'!' on a headset line sets kPoseReset");
+		check(poses[1].device == 3 && poses[1].flags == Relativty::kPoseReset && poses[1].position[0] == 4.0f, "and after an id");
+		check(poses[2].flags == 0, "lines without it have no flags");
+	}
+
+	{
+		std::string many;
+		for (int i = 0; i < 5; i++)
+			many += "@1 1 2 3 1 0 0 0\n";
+		check(parse(many, poses, 3, malformed) == 3, "never writes past capacity");
+	}
+
+	{
+		TrackerRole roles[kMaxTrackers];
+		std::string problem;
+		check(ParseTrackerRoles("1:left_hand, 2:right_hand,5: waist ,", roles, problem), "roles parse");
+		check(roles[0] == TrackerRole::LeftHand && roles[1] == TrackerRole::RightHand && roles[4] == TrackerRole::Waist
+			&& roles[2] == TrackerRole::Tracker, "listed ids get their role, the others are trackers");
+		check(ParseTrackerRoles("", roles, problem) && roles[0] == TrackerRole::Tracker, "empty setting means plain trackers");
+		roles[0] = TrackerRole::Chest;
+		check(!ParseTrackerRoles("1:chest,17:waist", roles, problem) && roles[0] == TrackerRole::Chest, "id out of range is rejected, roles untouched");
+		std::printf("      %s\n", problem.c_str());
+		check(!ParseTrackerRoles("3:elbow", roles, problem), "unknown role is rejected");
+		check(!ParseTrackerRoles("left_hand", roles, problem), "missing id is rejected");
+	}
+
+	{
+		// the headset and a dozen trackers in every datagram
+		std::string datagram = "0.1 0.2 0.3 1 0 0 0\n";
+		char line[96];
+		for (int id = 1; id <= 12; id++) {
+			std::snprintf(line, sizeof(line), "@%d %.6f %.6f %.6f 0.707107 0.000000 0.707107 0.000000\n", id, id * 0.1, 1.5, -id * 0.2);
+			datagram += line;
+		}
+		const int rounds = 100000;
+		size_t total = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < rounds; i++)
+			total += parse(datagram, poses, kMaxTrackers + 1, malformed);
+		const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+		check(total == size_t(rounds) * 13, "thirteen devices per datagram");
+		std::printf("      %zu byte datagram, 13 poses: %.2f us to parse\n", datagram.size(), us);
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,350 @@
+/*******************************************************
+ Relativty position upsampler test.
+
+ Without arguments, simulates a session with a known head path: a 30 Hz
+ camera that sees each pose 30 ms before it arrives, with 1 mm of noise,
+ and a 100 Hz IMU whose linear acceleration is noisy and biased. At every
+ IMU sample it compares PositionUpsampler and what the driver shows without
+ it (the newest camera position) to the true position, and checks
+   - the upsampled error is well below the held camera position's
+   - the output has no steps beyond the head's own motion
+   - with the camera gone the position is held instead of drifting
+   - a camera pose far off the estimate is jumped to and counted
+   - Restart takes the next camera pose as is
+
+ With a recording made by the driver's "record start" control command
+ (headset poses and "#imu" lines with acceleration, text serial firmware
+ built with LINEAR_ACCEL_OUTPUT), every <decimate>th headset pose is used
+ as a camera pose and the others, held out, as ground truth:
+   ./position_upsampler_test poses.txt [decimate] [cameraLatencyMs]
+
+ Build and run:
+   g++ -std=c++17 -O2 -Iinclude trackertest/position_upsampler_test.cpp -o position_upsampler_test
+   ./position_upsampler_test
+********************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Relativty_PositionUpsampler.h"
+
+using Relativty::PositionUpsampler;
+using Relativty::Quatf;
+using Relativty::UpsamplingSettings;
+using Relativty::Vec3f;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	const int64_t kMs = 1000000;
+	const float kPi = 3.14159265f;
+
+	// errors of one position source against the truth
+	struct ErrorStats {
+		double sumSquares = 0;
+		double max = 0;
+		uint64_t count = 0;
+
+		void Add(const Vec3f& shown, const Vec3f& truth) {
+			const double error = Relativty::Vec3Length(Relativty::Vec3Sub(shown, truth));
+			this->sumSquares += error * error;
+			this->max = error > this->max ? error : this->max;
+			this->count++;
+		}
+		double Rms() const { return this->count > 0 ? std::sqrt(this->sumSquares / static_cast<double>(this->count)) : 0; }
+	};
+
+	void printStats(const char* name, const ErrorStats& stats) {
+		std::printf("      %-22s rms %6.2f mm, max %6.2f mm over %llu samples\n", name, stats.Rms() * 1000, stats.max * 1000,
+			static_cast<unsigned long long>(stats.count));
+	}
+
+	// Slow sway on every axis with quick 25 cm head moves every 1.5 s, and the
+	// head turning side to side. Position, acceleration and rotation at t.
+	struct HeadPath {
+		static float smoothstep(float x) {
+			return x <= 0 ? 0 : x >= 1 ? 1 : x * x * (3 - 2 * x);
+		}
+
+		static void at(double t, Vec3f& position, Vec3f& acceleration, Quatf& rotation) {
+			const float w1 = 2 * kPi * 0.4f, w2 = 2 * kPi * 0.7f;
+			const float s = static_cast<float>(t);
+			position = { 0.1f * std::sin(w1 * s), 1.6f + 0.03f * std::sin(w2 * s), 0.08f * std::cos(w1 * 0.5f * s) };
+			acceleration = { -0.1f * w1 * w1 * std::sin(w1 * s), -0.03f * w2 * w2 * std::sin(w2 * s),
+				-0.08f * 0.25f * w1 * w1 * std::cos(w1 * 0.5f * s) };
+
+			// the quick moves, x(t) = 0.25 m * smoothstep over 0.3 s, second derivative by hand
+			const float period = 1.5f, duration = 0.3f, distance = 0.25f;
+			const int moves = static_cast<int>(s / period);
+			const float phase = (s - moves * period) / duration;
+			const float sign = moves % 2 == 0 ? 1.0f : -1.0f;
+			// the moves alternate, so every pair cancels out and the offset is 0 or distance
+			const float done = moves % 2 == 0 ? 0.0f : distance;
+			position.x += done + sign * distance * smoothstep(phase);
+			if (phase > 0 && phase < 1)
+				acceleration.x += sign * distance * (6 - 12 * phase) / (duration * duration);
+
+			const float yaw = 0.6f * std::sin(2 * kPi * 0.3f * s);
+			rotation = { std::cos(yaw * 0.5f), 0, std::sin(yaw * 0.5f), 0 };
+		}
+	};
+
+	// What to do with the camera in the simulated session.
+	struct CameraPlan {
+		double dropFrom = 1e9, dropTo = 1e9; // no camera poses in between
+		double jumpAt = 1e9;                 // the tracker relocalizes 1 m away from then on
+	};
+
+	struct SessionResult {
+		ErrorStats upsampled, held;
+		double maxExtraStep = 0;          // largest output step beyond the true motion in that step
+		double maxDriftWhileDropped = 0;  // how far the output moved once held, while the camera was gone
+		uint64_t snaps = 0;
+	};
+
+	SessionResult simulate(const UpsamplingSettings& settings, const CameraPlan& plan, double seconds, int64_t latencyNs) {
+		std::mt19937 random(42);
+		std::normal_distribution<float> cameraNoise(0, 0.001f);
+		std::normal_distribution<float> accelNoise(0, 0.08f);
+		const Vec3f accelBias = { 0.05f, -0.03f, 0.04f };
+		// the IMU's reference frame is turned against the tracker's
+		const Quatf trackerToImu = { std::cos(0.4f), 0, std::sin(0.4f), 0 };
+
+		PositionUpsampler upsampler;
+		upsampler.Reset(settings);
+		SessionResult result;
+		const int64_t imuPeriod = 10 * kMs, cameraPeriod = 33333333;
+		int64_t nextImu = imuPeriod, nextCamera = cameraPeriod;
+		Vec3f held = { 0, 0, 0 }, previousShown = { 0, 0, 0 }, previousTruth = { 0, 0, 0 }, shownAtHold = { 0, 0, 0 };
+		bool haveHeld = false, havePrevious = false, holding = false;
+		const int64_t endNs = static_cast<int64_t>(seconds * 1e9);
+
+		while (nextImu < endNs) {
+			if (nextCamera <= nextImu) {
+				// the camera pose describes the head latencyNs before it arrives
+				const double seen = static_cast<double>(nextCamera - latencyNs) * 1e-9;
+				const bool dropped = seen >= plan.dropFrom && seen < plan.dropTo;
+				if (!dropped && seen > 0) {
+					Vec3f position, acceleration;
+					Quatf rotation;
+					HeadPath::at(seen, position, acceleration, rotation);
+					position = Relativty::Vec3Add(position, Vec3f{ cameraNoise(random), cameraNoise(random), cameraNoise(random) });
+					if (seen >= plan.jumpAt)
+						position.z += 1.0f;
+					upsampler.Camera(nextCamera, position, rotation);
+					held = position;
+					haveHeld = true;
+				}
+				nextCamera += cameraPeriod;
+				continue;
+			}
+
+			const double t = static_cast<double>(nextImu) * 1e-9;
+			Vec3f truth, acceleration;
+			Quatf rotation;
+			HeadPath::at(t, truth, acceleration, rotation);
+			if (t >= plan.jumpAt)
+				truth.z += 1.0f;
+			// measured in the IMU's axes: the head rotation undone, plus noise and bias
+			const Vec3f body = Relativty::QuatRotate(Relativty::QuatConjugate(rotation), acceleration);
+			const Vec3f measured = Relativty::Vec3Add(Relativty::Vec3Add(body, accelBias), Vec3f{ accelNoise(random), accelNoise(random), accelNoise(random) });
+			upsampler.Imu(nextImu, Relativty::QuatMultiply(trackerToImu, rotation), measured);
+			nextImu += imuPeriod;
+			if (!upsampler.Ready() || !haveHeld)
+				continue;
+
+			const Vec3f shown = upsampler.Position();
+			const bool dropped = t >= plan.dropFrom + 0.2 && t < plan.dropTo;
+			// the first 2 s settle the velocity, the jump and the drop are judged on their own
+			if (t > 2.0 && t < plan.jumpAt && !dropped && !(t >= plan.dropFrom && t < plan.dropTo + 0.5)) {
+				result.upsampled.Add(shown, truth);
+				result.held.Add(held, truth);
+				if (havePrevious) {
+					const double step = Relativty::Vec3Length(Relativty::Vec3Sub(shown, previousShown));
+					const double moved = Relativty::Vec3Length(Relativty::Vec3Sub(truth, previousTruth));
+					if (step - moved > result.maxExtraStep)
+						result.maxExtraStep = step - moved;
+				}
+			}
+			if (dropped) {
+				if (!holding)
+					shownAtHold = shown;
+				holding = true;
+				const double drift = Relativty::Vec3Length(Relativty::Vec3Sub(shown, shownAtHold));
+				if (drift > result.maxDriftWhileDropped)
+					result.maxDriftWhileDropped = drift;
+			}
+			previousShown = shown;
+			previousTruth = truth;
+			havePrevious = true;
+		}
+		result.snaps = upsampler.Snaps();
+		std::printf("      %s\n", upsampler.Report().c_str());
+		return result;
+	}
+
+	// A driver recording: "@0 x y z qw qz qx qy ts" headset poses and
+	// "#imu ts qw qx qy qz ax ay az" IMU samples, see PoseRecorder.
+	struct Recorded {
+		int64_t timestampNs;
+		bool imu;
+		Vec3f position;
+		Quatf rotation;
+		Vec3f acceleration;
+	};
+
+	int evaluateRecording(const char* path, int decimate, int64_t latencyNs) {
+		std::ifstream in(path);
+		if (!in) {
+			std::fprintf(stderr, "cannot read %s\n", path);
+			return 2;
+		}
+		std::vector<Recorded> events;
+		uint64_t imuWithoutAccel = 0;
+		for (std::string line; std::getline(in, line);) {
+			Recorded event = {};
+			long long ts;
+			if (line.compare(0, 5, "#imu ") == 0) {
+				const int fields = std::sscanf(line.c_str() + 5, "%lld %f %f %f %f %f %f %f", &ts, &event.rotation.w, &event.rotation.x,
+					&event.rotation.y, &event.rotation.z, &event.acceleration.x, &event.acceleration.y, &event.acceleration.z);
+				if (fields != 8) {
+					imuWithoutAccel += fields == 5;
+					continue;
+				}
+				event.imu = true;
+			}
+			else if (line.compare(0, 3, "@0 ") == 0) {
+				if (std::sscanf(line.c_str() + 3, "%f %f %f %f %f %f %f %lld", &event.position.x, &event.position.y, &event.position.z,
+					&event.rotation.w, &event.rotation.z, &event.rotation.x, &event.rotation.y, &ts) != 8)
+					continue;
+			}
+			else {
+				continue;
+			}
+			event.timestampNs = ts;
+			events.push_back(event);
+		}
+		// the IMU and the pose threads write in turns, close to but not always in time order
+		std::stable_sort(events.begin(), events.end(), [](const Recorded& a, const Recorded& b) { return a.timestampNs < b.timestampNs; });
+
+		UpsamplingSettings settings;
+		settings.cameraLatencyNs = latencyNs;
+		PositionUpsampler upsampler;
+		upsampler.Reset(settings);
+		ErrorStats upsampled, held;
+		Vec3f heldPosition = { 0, 0, 0 };
+		uint64_t poses = 0, imuSamples = 0;
+		int64_t settledNs = 0; // the first second after the first camera pose settles the velocity
+		for (const Recorded& event : events) {
+			if (event.imu) {
+				upsampler.Imu(event.timestampNs, event.rotation, event.acceleration);
+				imuSamples++;
+			}
+			else if (poses++ % decimate == 0) {
+				upsampler.Camera(event.timestampNs, event.position, event.rotation);
+				heldPosition = event.position;
+				if (settledNs == 0)
+					settledNs = event.timestampNs + 1000 * kMs;
+			}
+			else if (upsampler.Ready() && event.timestampNs >= settledNs) {
+				upsampled.Add(upsampler.Position(), event.position);
+				held.Add(heldPosition, event.position);
+			}
+		}
+
+		std::printf("%s: %llu headset poses, %llu IMU samples with acceleration, %llu without\n", path,
+			static_cast<unsigned long long>(poses), static_cast<unsigned long long>(imuSamples), static_cast<unsigned long long>(imuWithoutAccel));
+		if (imuSamples == 0 || upsampled.count == 0) {
+			std::printf("nothing to evaluate, the recording needs headset poses and IMU acceleration\n");
+			return 1;
+		}
+		std::printf("every %d%s pose as camera pose, the others as ground truth\n", decimate, decimate == 2 ? "nd" : decimate == 3 ? "rd" : "th");
+		printStats("upsampled", upsampled);
+		printStats("newest camera pose", held);
+		std::printf("      %s\n", upsampler.Report().c_str());
+		return 0;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		const int decimate = argc > 2 ? std::atoi(argv[2]) : 2;
+		const int64_t latencyNs = argc > 3 ? std::atoll(argv[3]) * kMs : 0;
+		if (decimate < 2) {
+			std::fprintf(stderr, "decimate must be 2 or more\n");
+			return 2;
+		}
+		return evaluateRecording(argv[1], decimate, latencyNs);
+	}
+
+	const int64_t latencyNs = 30 * kMs;
+	UpsamplingSettings settings;
+	settings.cameraLatencyNs = latencyNs;
+
+	{
+		const SessionResult result = simulate(settings, CameraPlan(), 20.0, latencyNs);
+		printStats("upsampled", result.upsampled);
+		printStats("newest camera pose", result.held);
+		std::printf("      largest step beyond the head's motion %.2f mm\n", result.maxExtraStep * 1000);
+		check(result.upsampled.Rms() < 0.5 * result.held.Rms(), "upsampled error under half the held camera position's");
+		check(result.upsampled.max < result.held.max, "and so is the worst case");
+		check(result.maxExtraStep < 0.006, "no output step 6 mm beyond the head's motion");
+		check(result.snaps == 0, "no snaps on a continuous path");
+	}
+
+	{
+		UpsamplingSettings unaware = settings;
+		unaware.cameraLatencyNs = 0;
+		const SessionResult aware = simulate(settings, CameraPlan(), 20.0, latencyNs);
+		const SessionResult result = simulate(unaware, CameraPlan(), 20.0, latencyNs);
+		printStats("latency not set", result.upsampled);
+		check(aware.upsampled.Rms() < result.upsampled.Rms(), "cameraLatencyNs pays off when the camera lags");
+	}
+
+	{
+		CameraPlan plan;
+		plan.dropFrom = 5.0;
+		plan.dropTo = 6.0;
+		const SessionResult result = simulate(settings, plan, 8.0, latencyNs);
+		std::printf("      output moved %.2f mm while held\n", result.maxDriftWhileDropped * 1000);
+		check(result.maxDriftWhileDropped < 0.002, "position held once the camera is gone for maxCoastNs");
+		check(result.upsampled.Rms() < 0.5 * result.held.Rms(), "and tracks again once it is back");
+	}
+
+	{
+		CameraPlan plan;
+		plan.jumpAt = 4.0;
+		const SessionResult result = simulate(settings, plan, 5.0, latencyNs);
+		check(result.snaps == 1, "1 m jump of the camera is snapped to and counted");
+	}
+
+	{
+		PositionUpsampler upsampler;
+		upsampler.Reset(settings);
+		const Quatf identity = Relativty::QuatIdentity();
+		upsampler.Camera(10 * kMs, Vec3f{ 1, 2, 3 }, identity);
+		check(!upsampler.Ready(), "not ready before an IMU sample aligned the frames");
+		upsampler.Imu(20 * kMs, identity, Vec3f{ 0, 0, 0 });
+		upsampler.Camera(40 * kMs, Vec3f{ 1, 2, 3 }, identity);
+		check(upsampler.Ready(), "ready with a camera pose after an IMU sample");
+		upsampler.Restart();
+		upsampler.Camera(50 * kMs, Vec3f{ 0.2f, 0.2f, 0.2f }, identity);
+		const Vec3f shown = upsampler.Position();
+		check(shown.x == 0.2f && shown.y == 0.2f && shown.z == 0.2f && upsampler.Snaps() == 0, "Restart takes the next camera pose as is");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+/*******************************************************
+ Relativty quaternion math test and benchmark.
+
+ Checks Relativty_Quaternion.h:
+   - the constexpr pieces (products, rotate, poses) at compile time
+   - exp/log round trips, slerp/nlerp end points and rates, rotate against
+     q v q*, pose compose and inverse
+   - the batch functions against the scalar ones, on both sides of the
+     4 wide blocks and with rejected quaternions in the normalize input
+ then times the batch functions against a loop over the scalar ones, and
+ the product against the hand written one calibrate_quaternion used.
+
+ Build and run (SSE2 on x86-64 and NEON on 64 bit ARM need no flags):
+   g++ -std=c++17 -O2 -Iinclude trackertest/quaternion_test.cpp -o quaternion_test
+   ./quaternion_test
+********************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "Relativty_Quaternion.h"
+
+using namespace Relativty;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	constexpr bool equal(const Quatf& a, const Quatf& b) { return a.w == b.w && a.x == b.x && a.y == b.y && a.z == b.z; }
+	constexpr bool equal(const Vec3f& a, const Vec3f& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+	// 90 degrees about y, exact in float up to the square root
+	constexpr float kHalfSqrt2 = 0.70710678f;
+	constexpr Quatf kYaw90 = { kHalfSqrt2, 0, kHalfSqrt2, 0 };
+
+	static_assert(equal(QuatMultiply(QuatIdentity(), kYaw90), kYaw90), "identity on the left");
+	static_assert(equal(QuatMultiply(kYaw90, QuatIdentity()), kYaw90), "identity on the right");
+	static_assert(equal(QuatMultiply(Quatf{ 0, 1, 0, 0 }, Quatf{ 0, 0, 1, 0 }), Quatf{ 0, 0, 0, 1 }), "i j = k");
+	static_assert(equal(QuatMultiply(Quatf{ 0, 0, 1, 0 }, Quatf{ 0, 1, 0, 0 }), Quatf{ 0, 0, 0, -1 }), "j i = -k");
+	static_assert(equal(QuatConjugate(Quatf{ 1, 2, 3, 4 }), Quatf{ 1, -2, -3, -4 }), "conjugate");
+	static_assert(QuatDot(Quatf{ 1, 2, 3, 4 }, Quatf{ 1, 2, 3, 4 }) == 30, "dot");
+	static_assert(equal(Vec3Cross(Vec3f{ 1, 0, 0 }, Vec3f{ 0, 1, 0 }), Vec3f{ 0, 0, 1 }), "x cross y = z");
+	static_assert(equal(QuatRotate(Quatf{ 0, 0, 0, 1 }, Vec3f{ 1, 2, 3 }), Vec3f{ -1, -2, 3 }), "180 degrees about z");
+	static_assert(equal(PoseTransform(Pose{ { 1, 2, 3 }, QuatIdentity() }, Vec3f{ 1, 1, 1 }), Vec3f{ 2, 3, 4 }), "translation");
+	static_assert(equal(PoseCompose(PoseIdentity(), PoseIdentity()).rotation, QuatIdentity()), "identity poses compose");
+
+	bool near(float a, float b, float tolerance) { return std::fabs(a - b) <= tolerance; }
+
+	bool near(const Quatf& a, const Quatf& b, float tolerance) {
+		// q and -q are the same rotation
+		const float sign = QuatDot(a, b) < 0 ? -1.0f : 1.0f;
+		return near(a.w, b.w * sign, tolerance) && near(a.x, b.x * sign, tolerance) && near(a.y, b.y * sign, tolerance) && near(a.z, b.z * sign, tolerance);
+	}
+
+	bool near(const Vec3f& a, const Vec3f& b, float tolerance) {
+		return near(a.x, b.x, tolerance) && near(a.y, b.y, tolerance) && near(a.z, b.z, tolerance);
+	}
+
+	Quatf randomRotation(std::mt19937& random) {
+		std::normal_distribution<float> gaussian(0.0f, 1.0f);
+		Quatf q = { gaussian(random), gaussian(random), gaussian(random), gaussian(random) };
+		QuatNormalize(q);
+		return q;
+	}
+
+	// the product calibrate_quaternion wrote out by hand on its atomics
+	void handWritten(const float c[4], const float q[4], float out[4]) {
+		out[0] = c[0] * q[0] - c[1] * q[1] - c[2] * q[2] - c[3] * q[3];
+		out[1] = c[0] * q[1] + c[1] * q[0] + c[2] * q[3] - c[3] * q[2];
+		out[2] = c[0] * q[2] - c[1] * q[3] + c[2] * q[0] + c[3] * q[1];
+		out[3] = c[0] * q[3] + c[1] * q[2] - c[2] * q[1] + c[3] * q[0];
+	}
+
+	template<typename Body>
+	double nsPerQuaternion(size_t count, Body body) {
+		const int rounds = 2000;
+		const auto begin = std::chrono::steady_clock::now();
+		for (int r = 0; r < rounds; r++)
+			body();
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / (double(rounds) * count);
+	}
+}
+
+int main() {
+	std::mt19937 random(7);
+
+	{
+		bool roundTrip = true, shortWay = true, rotates = true, handMatches = true;
+		for (int i = 0; i < 1000; i++) {
+			const Quatf q = randomRotation(random);
+			const Vec3f r = QuatLog(q);
+			roundTrip = roundTrip && near(QuatExp(r), q, 1e-5f);
+			shortWay = shortWay && Vec3Length(r) <= 3.14159274f + 1e-5f && near(QuatLog(Quatf{ -q.w, -q.x, -q.y, -q.z }), r, 1e-5f);
+
+			// against the full q v q* product
+			const Vec3f v = { 0.3f, -1.2f, 2.0f };
+			const Quatf product = QuatMultiply(QuatMultiply(q, Quatf{ 0, v.x, v.y, v.z }), QuatConjugate(q));
+			rotates = rotates && near(QuatRotate(q, v), Vec3f{ product.x, product.y, product.z }, 1e-5f);
+
+			float c[4], m[4], expected[4];
+			QuatStore(QuatConjugate(randomRotation(random)), c);
+			QuatStore(q, m);
+			handWritten(c, m, expected);
+			const Quatf result = QuatMultiply(QuatLoad(c), QuatLoad(m));
+			handMatches = handMatches && near(result, QuatLoad(expected), 1e-6f); // bit for bit unless the compiler fuses into FMAs
+		}
+		check(roundTrip, "QuatExp(QuatLog(q)) is q");
+		check(shortWay, "QuatLog takes the short way, q and -q give the same vector");
+		check(rotates, "QuatRotate matches q v q*");
+		check(handMatches, "QuatMultiply matches calibrate_quaternion's old product");
+		check(near(QuatExp(Vec3f{ 0, 1.5707963f, 0 }), kYaw90, 1e-6f), "QuatExp of 90 degrees about y");
+		check(near(QuatLog(QuatIdentity()), Vec3f{ 0, 0, 0 }, 0), "QuatLog of the identity is zero");
+		check(near(QuatExp(Vec3f{ 1e-8f, 0, 0 }), QuatIdentity(), 1e-7f), "QuatExp of a tiny vector");
+	}
+
+	{
+		const Quatf a = QuatExp(Vec3f{ 0, 0.2f, 0 });
+		const Quatf b = QuatExp(Vec3f{ 0, 1.4f, 0 });
+		const Quatf bFlipped = { -b.w, -b.x, -b.y, -b.z };
+		check(near(QuatSlerp(a, b, 0), a, 1e-6f) && near(QuatSlerp(a, b, 1), b, 1e-6f), "slerp end points");
+		check(near(QuatLog(QuatSlerp(a, b, 0.25f)).y, 0.5f, 1e-5f), "slerp turns at a constant rate");
+		check(near(QuatSlerp(a, bFlipped, 0.25f), QuatSlerp(a, b, 0.25f), 1e-6f), "slerp takes the short way round");
+		check(near(QuatNlerp(a, bFlipped, 0.5f), QuatSlerp(a, b, 0.5f), 1e-6f), "nlerp meets slerp half way");
+		const float nlerpQuarter = QuatLog(QuatNlerp(a, b, 0.25f)).y;
+		check(!near(nlerpQuarter, 0.5f, 1e-4f) && near(nlerpQuarter, 0.5f, 1e-2f), "nlerp is close to slerp, not equal");
+		check(near(QuatSlerp(a, a, 0.3f), a, 1e-6f), "slerp between equal rotations");
+	}
+
+	{
+		bool inverse = true, compose = true;
+		for (int i = 0; i < 1000; i++) {
+			const Pose p = { { 1.0f, -2.0f, 0.5f }, randomRotation(random) };
+			const Pose q = { { -0.3f, 0.2f, 4.0f }, randomRotation(random) };
+			const Vec3f point = { 0.7f, 0.1f, -0.9f };
+			const Pose none = PoseCompose(p, PoseInverse(p));
+			inverse = inverse && near(none.position, Vec3f{ 0, 0, 0 }, 1e-5f) && near(none.rotation, QuatIdentity(), 1e-6f);
+			compose = compose && near(PoseTransform(PoseCompose(p, q), point), PoseTransform(p, PoseTransform(q, point)), 1e-5f);
+		}
+		check(inverse, "a pose composed with its inverse is the identity");
+		check(compose, "composed poses transform like one after the other");
+	}
+
+	const size_t count = 1027; // not a multiple of 4, the scalar tail runs too
+	std::vector<Quatf> a(count), b(count), batch(count), scalar(count);
+	for (size_t i = 0; i < count; i++) {
+		a[i] = randomRotation(random);
+		b[i] = randomRotation(random);
+	}
+
+	{
+		QuatMultiplyBatch(a.data(), b.data(), batch.data(), count);
+		bool same = true;
+		for (size_t i = 0; i < count; i++)
+			same = same && near(batch[i], QuatMultiply(a[i], b[i]), 1e-6f);
+		check(same, "QuatMultiplyBatch matches QuatMultiply");
+
+		QuatMultiplyBatch(a[0], b.data(), batch.data(), count);
+		same = true;
+		for (size_t i = 0; i < count; i++)
+			same = same && near(batch[i], QuatMultiply(a[0], b[i]), 1e-6f);
+		check(same, "QuatMultiplyBatch with one left side matches QuatMultiply");
+
+		std::vector<Quatf> inPlace = a;
+		QuatMultiplyBatch(inPlace.data(), b.data(), inPlace.data(), count);
+		same = true;
+		for (size_t i = 0; i < count; i++)
+			same = same && near(inPlace[i], QuatMultiply(a[i], b[i]), 1e-6f);
+		check(same, "QuatMultiplyBatch in place");
+
+		for (size_t i = 0; i < count; i++) {
+			batch[i] = { a[i].w * 3, a[i].x * 3, a[i].y * 3, a[i].z * 3 };
+			scalar[i] = batch[i];
+		}
+		batch[1] = scalar[1] = { 0, 0, 0, 0 };
+		batch[6] = scalar[6] = { NAN, 1, 0, 0 };
+		batch[count - 1] = scalar[count - 1] = { INFINITY, 0, 0, 0 };
+		QuatNormalizeBatch(batch.data(), count);
+		same = true;
+		for (size_t i = 0; i < count; i++) {
+			const bool accepted = QuatNormalize(scalar[i]);
+			same = same && (accepted ? near(batch[i], scalar[i], 1e-6f) : equal(batch[i], scalar[i]) || std::isnan(batch[i].w));
+		}
+		check(same, "QuatNormalizeBatch matches QuatNormalize, rejected ones untouched");
+		check(batch[1].w == 0 && std::isinf(batch[count - 1].w), "zero and infinite quaternions left as they were");
+
+		QuatNlerpBatch(a.data(), b.data(), 0.3f, batch.data(), count);
+		same = true;
+		for (size_t i = 0; i < count; i++)
+			same = same && near(batch[i], QuatNlerp(a[i], b[i], 0.3f), 1e-6f);
+		check(same, "QuatNlerpBatch matches QuatNlerp");
+	}
+
+	{
+#if defined(RELATIVTY_QUATERNION_SSE2)
+		const char* isa = "SSE2";
+#elif defined(RELATIVTY_QUATERNION_NEON)
+		const char* isa = "NEON";
+#else
+		const char* isa = "scalar only";
+#endif
+		volatile float sink = 0;
+		const double scalarMultiply = nsPerQuaternion(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				scalar[i] = QuatMultiply(a[i], b[i]);
+			sink = sink + scalar[count / 2].w;
+		});
+		const double handMultiply = nsPerQuaternion(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				handWritten(&a[i].w, &b[i].w, &scalar[i].w);
+			sink = sink + scalar[count / 2].w;
+		});
+		const double batchMultiply = nsPerQuaternion(count, [&] {
+			QuatMultiplyBatch(a.data(), b.data(), batch.data(), count);
+			sink = sink + batch[count / 2].w;
+		});
+		const double scalarNormalize = nsPerQuaternion(count, [&] {
+			for (size_t i = 0; i < count; i++) {
+				scalar[i] = a[i];
+				QuatNormalize(scalar[i]);
+			}
+			sink = sink + scalar[count / 2].w;
+		});
+		const double batchNormalize = nsPerQuaternion(count, [&] {
+			batch = a;
+			QuatNormalizeBatch(batch.data(), count);
+			sink = sink + batch[count / 2].w;
+		});
+		const double scalarNlerp = nsPerQuaternion(count, [&] {
+			for (size_t i = 0; i < count; i++)
+				scalar[i] = QuatNlerp(a[i], b[i], 0.3f);
+			sink = sink + scalar[count / 2].w;
+		});
+		const double batchNlerp = nsPerQuaternion(count, [&] {
+			QuatNlerpBatch(a.data(), b.data(), 0.3f, batch.data(), count);
+			sink = sink + batch[count / 2].w;
+		});
+		std::printf("      %s, ns per quaternion over %zu:\n", isa, count);
+		std::printf("      multiply   hand written %.2f, scalar %.2f, batch %.2f\n", handMultiply, scalarMultiply, batchMultiply);
+		std::printf("      normalize  scalar %.2f, batch %.2f (copy included in both)\n", scalarNormalize, batchNormalize);
+		std::printf("      nlerp      scalar %.2f, batch %.2f\n", scalarNlerp, batchNlerp);
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+/*******************************************************
+ Relativty relocalization blender test.
+
+ Feeds RelocalizationBlender a 60 Hz head path with quick moves and 1 mm
+ of noise, the way the tracker's positions reach apply_tracker_pose, and
+ checks
+   - head motion, however quick, is not taken for a jump and passes
+     through untouched
+   - a relocalization jump, flagged or not, is counted with its size and
+     the output only moves by the head's motion at the jump
+   - while it is blended the output follows every step of the input
+     within the blend's own bounded slope, and equals the input exactly
+     once blendNs has passed
+   - a move across a tracking gap or poses arriving bunched are no jumps
+   - a second jump while blending adds to what is left
+   - with blendNs 0 jumps are counted and shown as they come
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude trackertest/relocalization_blender_test.cpp -o relocalization_blender_test
+   ./relocalization_blender_test
+********************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "Relativty_RelocalizationBlender.h"
+
+using Relativty::RelocalizationBlender;
+using Relativty::RelocalizationSettings;
+using Relativty::Vec3f;
+using Relativty::Vec3Add;
+using Relativty::Vec3Length;
+using Relativty::Vec3Sub;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	const int64_t kMs = 1000000;
+	const int64_t kPeriodNs = 16666667; // 60 Hz
+	const float kPi = 3.14159265f;
+
+	// slow sway with a quick 30 cm move every second, back and forth,
+	// peaking near 2 m/s
+	Vec3f headAt(int64_t tNs) {
+		const float t = static_cast<float>(tNs) * 1e-9f;
+		const float phase = t - std::floor(t);
+		const float move = phase < 0.25f ? phase / 0.25f : 1.0f;
+		const float eased = move * move * (3 - 2 * move);
+		const float step = 0.3f * (static_cast<int>(t) % 2 == 0 ? eased : 1 - eased);
+		return Vec3f{ 0.2f * std::sin(kPi * t) + step, 1.6f + 0.05f * std::sin(2 * kPi * t), 0.1f * std::cos(kPi * t) };
+	}
+
+	struct Run {
+		RelocalizationBlender blender;
+		std::mt19937 random{ 7 };
+		std::normal_distribution<float> noise{ 0.0f, 0.001f };
+		Vec3f lastIn = { 0, 0, 0 };
+		Vec3f lastOut = { 0, 0, 0 };
+
+		explicit Run(const RelocalizationSettings& settings) { this->blender.Reset(settings); }
+
+		Vec3f feed(int64_t tNs, const Vec3f& shift, bool reset) {
+			const Vec3f head = headAt(tNs);
+			this->lastIn = Vec3Add(Vec3Add(head, shift), Vec3f{ this->noise(this->random), this->noise(this->random), this->noise(this->random) });
+			this->lastOut = this->blender.Apply(tNs, this->lastIn, reset);
+			return this->lastOut;
+		}
+	};
+
+	float distance(const Vec3f& a, const Vec3f& b) { return Vec3Length(Vec3Sub(a, b)); }
+}
+
+int main() {
+	const RelocalizationSettings settings; // 4 m/s, 5 cm, 500 ms
+	const float blendS = static_cast<float>(settings.blendNs) * 1e-9f;
+
+	{
+		Run run(settings);
+		float worst = 0;
+		for (int64_t t = 0; t < 10000 * kMs; t += kPeriodNs) {
+			const Vec3f out = run.feed(t, Vec3f{ 0, 0, 0 }, false);
+			worst = std::fmax(worst, distance(out, run.lastIn));
+		}
+		check(run.blender.Jumps() == 0, "10 s of head motion with quick moves has no jumps");
+		check(worst == 0.0f, "and passes through untouched");
+	}
+
+	{
+		Run run(settings);
+		const Vec3f shift = { 0.25f, -0.1f, 0.3f }; // 40 cm
+		const int64_t jumpNs = 123 * kPeriodNs; // 2.05 s, during a quick move
+		Vec3f previousIn = { 0, 0, 0 }, previousOut = { 0, 0, 0 };
+		float jumpStep = 0, headStep = 0, worstExcess = 0, afterBlend = 0;
+		bool first = true;
+		for (int64_t t = 0; t < 4000 * kMs; t += kPeriodNs) {
+			const Vec3f out = run.feed(t, t >= jumpNs ? shift : Vec3f{ 0, 0, 0 }, false);
+			if (!first) {
+				// what the output moved beyond what the input moved, the blend's own share
+				const float excess = Vec3Length(Vec3Sub(Vec3Sub(out, previousOut), Vec3Sub(run.lastIn, previousIn)));
+				if (t == jumpNs) {
+					jumpStep = distance(out, previousOut);
+					headStep = distance(headAt(t), headAt(t - kPeriodNs));
+				}
+				else if (t > jumpNs) {
+					worstExcess = std::fmax(worstExcess, excess);
+				}
+				if (t >= jumpNs + settings.blendNs)
+					afterBlend = std::fmax(afterBlend, distance(out, run.lastIn));
+			}
+			first = false;
+			previousIn = run.lastIn;
+			previousOut = out;
+		}
+		const float size = Vec3Length(shift);
+		// smoothstep is steepest at half time, 1.5 times the mean slope
+		const float bound = 1.5f * size / blendS * static_cast<float>(kPeriodNs) * 1e-9f;
+		std::printf("      jump of %.0f mm: output moved %.1f mm (head %.1f mm), blend adds up to %.1f mm per pose (bound %.1f)\n",
+			size * 1000, jumpStep * 1000, headStep * 1000, worstExcess * 1000, bound * 1000);
+		std::printf("      %s\n", run.blender.Report().c_str());
+		check(run.blender.Jumps() == 1 && run.blender.Flagged() == 0, "unflagged jump detected once");
+		check(run.blender.Report().find("max 4") != std::string::npos, "its size is reported");
+		check(jumpStep < headStep + 0.01f, "output moves with the head at the jump, not with the tracker");
+		check(worstExcess <= bound + 0.0005f, "every step of the input passes, the blend adds a bounded slope");
+		check(afterBlend < 1e-6f, "output is the input once blendNs has passed");
+	}
+
+	{
+		Run run(settings);
+		Vec3f before = { 0, 0, 0 };
+		const int64_t jumpNs = 1500 * kMs;
+		for (int64_t t = 0; t < 3000 * kMs; t += kPeriodNs) {
+			const bool at = t >= jumpNs && t < jumpNs + kPeriodNs;
+			const Vec3f out = run.feed(t, t >= jumpNs ? Vec3f{ 0.02f, 0, 0 } : Vec3f{ 0, 0, 0 }, at);
+			if (at)
+				check(distance(out, before) < distance(headAt(t), headAt(t - kPeriodNs)) + 0.005f, "flagged 2 cm jump is blended too");
+			before = out;
+		}
+		check(run.blender.Jumps() == 1 && run.blender.Flagged() == 1, "and counted as flagged");
+	}
+
+	{
+		// the camera lost the headset for a second while it moved half a meter
+		Run run(settings);
+		for (int64_t t = 0; t < 1000 * kMs; t += kPeriodNs)
+			run.feed(t, Vec3f{ 0, 0, 0 }, false);
+		run.feed(2000 * kMs, Vec3f{ 0.5f, 0, 0 }, false);
+		// the same pose twice in a burst, then one 1 ms behind it
+		run.feed(2000 * kMs, Vec3f{ 0.5f, 0, 0 }, false);
+		run.feed(2001 * kMs, Vec3f{ 0.5f, 0, 0 }, false);
+		check(run.blender.Jumps() == 0, "moves across a tracking gap and bunched poses are no jumps");
+	}
+
+	{
+		Run run(settings);
+		Vec3f before = { 0, 0, 0 }, lastShift = { 0, 0, 0 };
+		float worst = 0;
+		for (int64_t t = 0; t < 3000 * kMs; t += kPeriodNs) {
+			Vec3f shift = { 0, 0, 0 };
+			if (t >= 1000 * kMs)
+				shift.x += 0.3f;
+			if (t >= 1200 * kMs)
+				shift.z -= 0.3f;
+			const Vec3f out = run.feed(t, shift, false);
+			if (distance(shift, lastShift) > 0)
+				worst = std::fmax(worst, distance(out, before) - distance(headAt(t), headAt(t - kPeriodNs)));
+			before = out;
+			lastShift = shift;
+		}
+		check(run.blender.Jumps() == 2, "second jump while blending detected");
+		check(worst < 0.01f, "output stays put at both");
+		check(distance(run.lastOut, run.lastIn) < 1e-6f, "and both are worked off");
+	}
+
+	{
+		RelocalizationSettings off = settings;
+		off.blendNs = 0;
+		Run run(off);
+		float worst = 0;
+		for (int64_t t = 0; t < 2000 * kMs; t += kPeriodNs) {
+			const Vec3f out = run.feed(t, t >= 1000 * kMs ? Vec3f{ 0.4f, 0, 0 } : Vec3f{ 0, 0, 0 }, false);
+			worst = std::fmax(worst, distance(out, run.lastIn));
+		}
+		check(run.blender.Jumps() == 1 && worst == 0.0f, "blendNs 0 counts the jump and shows it as it came");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
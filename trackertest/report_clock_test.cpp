@@ -0,0 +1,122 @@
+/*******************************************************
+ Relativty report clock test.
+
+ Replays HID drains through ReportClock the way drain_hid_reports does and
+ checks
+   - before the period is known only the newest report of a drain gets a
+     time, the ones queued behind it get -1
+   - the period is learnt from two wakeups in a row that found a single
+     report, not from one right after a drain of several, nor from a gap
+     across a timed out wait
+   - queued reports are back-dated a period apart, oldest first, and the
+     newest keeps the drain time
+   - stamps never go back past the previous drain's newest one, and stay
+     strictly increasing
+   - a 1 kHz device drained every 4 ms gets stamps within the jitter of
+     when its reports came in
+
+ Build and run:
+   g++ -std=c++17 -O2 -Iinclude trackertest/report_clock_test.cpp -o report_clock_test
+   ./report_clock_test
+********************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "Relativty_ReportClock.h"
+
+using Relativty::ReportClock;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	const int64_t kMs = 1000000;
+}
+
+int main() {
+	int64_t stamps[64];
+
+	{
+		ReportClock clock;
+		clock.Stamp(10 * kMs, 3, stamps);
+		check(stamps[0] == -1 && stamps[1] == -1 && stamps[2] == 10 * kMs, "period unknown, only the newest is stamped");
+		check(clock.PeriodNs() == 0, "a drain of several reports teaches no period");
+		clock.Stamp(10 * kMs + 300000, 1, stamps);
+		check(stamps[0] == 10 * kMs + 300000 && clock.PeriodNs() == 0, "nor does a single report right after one");
+		clock.Stamp(11 * kMs + 300000, 1, stamps);
+		check(clock.PeriodNs() == kMs, "two single reports in a row give the period");
+		clock.Stamp(15 * kMs + 300000, 4, stamps);
+		check(stamps[0] == 12 * kMs + 300000 && stamps[1] == 13 * kMs + 300000 && stamps[2] == 14 * kMs + 300000
+			&& stamps[3] == 15 * kMs + 300000,
+			"queued reports back-dated a period apart");
+		check(clock.PeriodNs() == kMs, "and do not move the period");
+	}
+
+	{
+		ReportClock clock;
+		clock.Stamp(10 * kMs, 1, stamps);
+		clock.Stamp(12 * kMs, 1, stamps);
+		clock.Gap();
+		clock.Stamp(500 * kMs, 1, stamps);
+		check(clock.PeriodNs() == 2 * kMs, "a gap across a timed out wait is no period");
+		clock.Stamp(502 * kMs, 1, stamps);
+		clock.Stamp(504 * kMs, 1, stamps);
+		check(clock.PeriodNs() == 2 * kMs, "steady single reports keep it");
+	}
+
+	{
+		ReportClock clock;
+		clock.Stamp(10 * kMs, 1, stamps);
+		clock.Stamp(11 * kMs, 1, stamps);
+		// eight reports in 2 ms: a burst, the period would put them before the last drain
+		clock.Stamp(13 * kMs, 8, stamps);
+		bool after = true, increasing = true;
+		for (int i = 0; i < 8; i++) {
+			after = after && stamps[i] > 11 * kMs;
+			increasing = increasing && (i == 0 || stamps[i] > stamps[i - 1]);
+		}
+		check(after && increasing && stamps[7] == 13 * kMs, "a burst is spread after the previous newest, strictly increasing");
+	}
+
+	{
+		// a 1 kHz device, the reader mostly woken on every report and now and
+		// then 3 to 4.5 ms late
+		std::mt19937 random(29);
+		std::uniform_int_distribution<int64_t> jitter(0, 1500000);
+		ReportClock clock;
+		int64_t next = 0, previous = -1, worst = 0;
+		bool increasing = true;
+		for (int wake = 0; wake < 2000; wake++) {
+			const int64_t nowNs = wake % 4 == 3 ? next + 3 * kMs + jitter(random) : next + 20000;
+			uint32_t count = 0;
+			int64_t arrivals[64];
+			while (next <= nowNs) {
+				arrivals[count++] = next;
+				next += kMs;
+			}
+			clock.Stamp(nowNs, count, stamps);
+			for (uint32_t i = 0; i < count; i++) {
+				if (stamps[i] < 0)
+					continue;
+				increasing = increasing && stamps[i] > previous;
+				previous = stamps[i];
+				if (wake > 100)
+					worst = std::max<int64_t>(worst, std::llabs(stamps[i] - arrivals[i]));
+			}
+		}
+		std::printf("      period %.3f ms, worst stamp error %.3f ms\n", clock.PeriodNs() / 1e6, worst / 1e6);
+		check(increasing, "stamps strictly increasing over the whole run");
+		check(worst <= 2 * kMs, "stamps within the wakeup jitter of the arrivals");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,291 @@
+/*******************************************************
+ Relativty driver shutdown test.
+
+ Runs the worker loops of HMDDriver from Relativty_Workers.h, the same code
+ the driver runs, against a pty, a fake HID device, a UDP socket and a
+ settings file, and starts and stops them through a StopSignal over and
+ over the way Activate and Deactivate do. It checks that:
+   - the UDP loop blocked on an idle socket (ServeDatagrams) wakes at once
+   - the serial reader (ReadSerialImu) stops within one kSerialWaitMs read
+     timeout and reassembles a line split across a timeout
+   - the HID drain (ReadHidImu) stops within one kHidWaitMs read
+   - the pose thread waiting on PoseSignal and WatchFile sleeping in
+     StopSignal::WaitFor stop at once
+   - every worker is joined by JoinWorker within kShutdownBudgetMs, idle or
+     streaming
+ and prints the Activate -> Deactivate -> Activate cycle times.
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude -Iserial/tests trackertest/shutdown_test.cpp \
+       source/Relativty_Log.cpp source/driverlog.cpp source/Relativty_Trace.cpp \
+       serial/src/serial.cc serial/src/impl/unix.cc -lpthread -o shutdown_test
+   ./shutdown_test
+********************************************************/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Relativty_Workers.h"
+#include "pty_pair.h"
+#include "serial/serial.h"
+
+using Relativty::ImuFormat;
+using Relativty::ImuSample;
+using Relativty::MonotonicNowNs;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	int64_t msSince(int64_t startNs) {
+		return (MonotonicNowNs() - startNs) / 1000000;
+	}
+
+	// stands in for hid_read_timeout: blocks up to the timeout for a queued report
+	class FakeHid {
+	public:
+		int operator()(uint8_t* buffer, size_t length, int timeoutMs) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->queued.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return !this->reports.empty(); });
+			if (this->reports.empty())
+				return 0;
+			const size_t size = std::min(length, this->reports.front().size());
+			std::memcpy(buffer, this->reports.front().data(), size);
+			this->reports.pop_front();
+			return static_cast<int>(size);
+		}
+
+		void Push() {
+			std::vector<uint8_t> report(Relativty::kHidReportLen, 0);
+			report[1] = 0x40; // w = 1.0 in Q14
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->reports.push_back(report);
+			}
+			this->queued.notify_one();
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable queued;
+		std::deque<std::vector<uint8_t>> reports;
+	};
+
+	struct CountingSink {
+		std::atomic<int> samples{ 0 };
+		std::atomic<int> rejected{ 0 };
+		std::atomic<int> lost{ 0 };
+
+		void Sample(const ImuSample&) { this->samples++; }
+		void Rejected(const uint8_t*, size_t) { this->rejected++; }
+		bool TakeCommand(std::string&) { return false; }
+		void Lost() { this->lost++; }
+	};
+
+	class HarnessDevice {
+	public:
+		HarnessDevice(const std::string& serialPort, int udpSocket, const std::string& settings)
+			: port(serialPort), sock(udpSocket), settingsPath(settings) {}
+
+		void Activate() {
+			this->stop.Reset();
+			serial::Timeout timeout = serial::Timeout::simpleTimeout(Relativty::kSerialWaitMs);
+			this->serialPort.setTimeout(timeout);
+			this->serialPort.setPort(this->port);
+			this->serialPort.setBaudrate(115200);
+			this->serialPort.open();
+
+			this->poseWorker = std::thread([this] {
+				while (this->poseSignal.Wait(this->stop, Relativty::kPoseWaitMs))
+					if (this->poseSignal.Take())
+						this->poses++;
+			});
+			this->watchWorker = std::thread([this] {
+				Relativty::WatchFile(this->settingsPath, this->stop, [this] { this->reloads++; return true; });
+			});
+			this->serialWorker = std::thread([this] {
+				Relativty::ReadSerialImu<ImuFormat::Bno055Ascii>(this->serialPort, this->stop, this->serialWakeup, this->serialSink);
+			});
+			this->hidWorker = std::thread([this] {
+				Relativty::ReadHidImu<ImuFormat::MpuDmpQ14>(this->hid, this->stop, this->hidWakeup, this->hidClock, this->hidStats, this->hidSink);
+			});
+			this->udpWorker = std::thread([this] {
+				auto handle = [this](char*, int, sockaddr_in&) {
+					this->datagrams++;
+					this->poseSignal.Post();
+				};
+				Relativty::ServeDatagrams(this->sock, this->stop, this->udpWakeup, handle);
+			});
+		}
+
+		// the slowest worker's time from the stop request to its join, in the order Deactivate joins them
+		int64_t Deactivate() {
+			const int64_t stopNs = MonotonicNowNs();
+			this->stop.Request();
+			this->poseSignal.Wake();
+			int64_t slowestMs = Relativty::JoinWorker(this->poseWorker, "pose", stopNs);
+			slowestMs = std::max(slowestMs, Relativty::JoinWorker(this->watchWorker, "settings", stopNs));
+			slowestMs = std::max(slowestMs, Relativty::JoinWorker(this->serialWorker, "serial", stopNs));
+			slowestMs = std::max(slowestMs, Relativty::JoinWorker(this->hidWorker, "hid", stopNs));
+			slowestMs = std::max(slowestMs, Relativty::JoinWorker(this->udpWorker, "udp", stopNs));
+			this->serialPort.close();
+			return slowestMs;
+		}
+
+		FakeHid hid;
+		CountingSink serialSink, hidSink;
+		Relativty::HidIngestStats hidStats;
+		std::atomic<int> datagrams{ 0 };
+		std::atomic<int> poses{ 0 };
+		std::atomic<int> reloads{ 0 };
+
+	private:
+		Relativty::StopSignal stop;
+		std::string port;
+		int sock;
+		std::string settingsPath;
+		serial::Serial serialPort;
+		Relativty::PoseSignal poseSignal;
+		Relativty::WakeupStats serialWakeup, hidWakeup, udpWakeup;
+		Relativty::ReportClock hidClock;
+		std::thread poseWorker, watchWorker, serialWorker, hidWorker, udpWorker;
+	};
+
+	// plays the IMUs and the tracker: quaternion lines on the pty, HID reports, datagrams on the socket
+	class Feeder {
+	public:
+		Feeder(PtyPair& ptyPair, FakeHid& fakeHid, int udpPort) : pty(ptyPair), hid(fakeHid) {
+			this->sock = socket(AF_INET, SOCK_DGRAM, 0);
+			this->target.sin_family = AF_INET;
+			this->target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			this->target.sin_port = htons(static_cast<uint16_t>(udpPort));
+			this->worker = std::thread([this] {
+				int tick = 0;
+				while (this->running) {
+					this->pty.writeAll("1.0000,0.0000,0.0000,0.0000\n");
+					this->hid.Push();
+					if (tick++ % 2 == 0) {
+						const char pose[] = "0.1 0.2 0.3 1 0 0 0 ";
+						sendto(this->sock, pose, sizeof(pose), 0, reinterpret_cast<sockaddr*>(&this->target), sizeof(this->target));
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(8));
+				}
+			});
+		}
+		~Feeder() {
+			this->running = false;
+			this->worker.join();
+			close(this->sock);
+		}
+
+	private:
+		PtyPair& pty;
+		FakeHid& hid;
+		int sock;
+		sockaddr_in target = {};
+		std::atomic<bool> running{ true };
+		std::thread worker;
+	};
+
+	void drainPty(PtyPair& pty) {
+		char discard[4096];
+		while (pty.readSome(discard, sizeof(discard), 0) > 0) {
+		}
+	}
+}
+
+int main() {
+	PtyPair pty;
+	const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+	socklen_t length = sizeof(address);
+	getsockname(sock, reinterpret_cast<sockaddr*>(&address), &length);
+	const int udpPort = ntohs(address.sin_port);
+
+	char settingsPath[] = "/tmp/relativty_shutdown_XXXXXX";
+	close(mkstemp(settingsPath));
+
+	HarnessDevice device(pty.slaveName(), sock, settingsPath);
+
+	{
+		// nothing arrives: every worker sits in its blocking wait when the stop comes
+		device.Activate();
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		const int64_t tookMs = device.Deactivate();
+		std::printf("      idle Deactivate: %lld ms\n", static_cast<long long>(tookMs));
+		check(tookMs <= Relativty::kSerialWaitMs + 50, "idle workers stop within one serial read timeout");
+	}
+
+	{
+		// half a line, a read timeout, then the rest
+		device.Activate();
+		pty.writeAll("1.0000,0.0000,");
+		std::this_thread::sleep_for(std::chrono::milliseconds(Relativty::kSerialWaitMs * 2));
+		pty.writeAll("0.0000,0.0000\n");
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		device.Deactivate();
+		check(device.serialSink.samples == 1 && device.serialSink.rejected == 0, "a line split by a read timeout is put back together");
+	}
+
+	{
+		// the settings file changes while the watcher runs
+		device.Activate();
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		std::ofstream(settingsPath) << "{}\n";
+		std::this_thread::sleep_for(std::chrono::milliseconds(Relativty::kSettingsPollMs * 2));
+		device.Deactivate();
+		check(device.reloads == 1, "a settings change is seen once");
+	}
+
+	{
+		Feeder feeder(pty, device.hid, udpPort);
+		std::vector<int64_t> deactivateMs, cycleMs;
+		for (int cycle = 0; cycle < 20; cycle++) {
+			const int64_t cycleStartNs = MonotonicNowNs();
+			device.Activate();
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			deactivateMs.push_back(device.Deactivate());
+			cycleMs.push_back(msSince(cycleStartNs));
+		}
+		std::sort(deactivateMs.begin(), deactivateMs.end());
+		std::sort(cycleMs.begin(), cycleMs.end());
+		std::printf("      streaming Deactivate: median %lld ms, max %lld ms\n",
+			static_cast<long long>(deactivateMs[deactivateMs.size() / 2]), static_cast<long long>(deactivateMs.back()));
+		std::printf("      Activate -> 50 ms of streaming -> Deactivate: median %lld ms, max %lld ms\n",
+			static_cast<long long>(cycleMs[cycleMs.size() / 2]), static_cast<long long>(cycleMs.back()));
+		check(deactivateMs.back() <= Relativty::kShutdownBudgetMs, "every Deactivate stays within the shutdown budget");
+		check(device.datagrams > 0 && device.poses > 0, "datagrams are received and handed to the pose thread");
+		check(device.serialSink.samples > 0, "serial IMU lines are decoded");
+		check(device.hidStats.reportsRead > 0 && device.hidSink.samples > 0, "HID reports are drained");
+		check(device.serialSink.lost == 0 && device.hidStats.readErrors == 0, "no read errors");
+	}
+	drainPty(pty);
+
+	close(sock);
+	unlink(settingsPath);
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
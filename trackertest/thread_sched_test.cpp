@@ -0,0 +1,156 @@
+/*******************************************************
+ Relativty driver thread scheduling test.
+
+ Checks ScopedThreadSched and WakeupStats the way the driver threads use
+ them:
+   - the thread gets its name and CPU mask
+   - "fifo" either switches the thread to SCHED_FIFO and restores the old
+     policy when the scope ends, or (without CAP_SYS_NICE / RLIMIT_RTPRIO)
+     leaves it alone and says why
+   - WakeupStats percentiles land in the right power of two bucket
+ and prints the wakeup latency of a condition variable handoff, the same
+ pattern the pose thread uses, for normal and fifo scheduling.
+
+ Build and run (Linux), as root or with an rtprio limit to see fifo work:
+   g++ -std=c++17 -O2 -Iinclude trackertest/thread_sched_test.cpp \
+       source/Relativty_ThreadTuning.cpp -lpthread -o thread_sched_test
+   ./thread_sched_test
+********************************************************/
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Relativty_Clock.h"
+#include "Relativty_ThreadTuning.h"
+#include "Relativty_WakeupStats.h"
+
+using Relativty::SchedClass;
+using Relativty::ScopedThreadSched;
+using Relativty::ThreadSchedConfig;
+using Relativty::WakeupStats;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	// producer hands 500 events to a consumer configured with sched, like apply_tracker_pose -> update_pose_threaded
+	std::string measureHandoff(const ThreadSchedConfig& sched) {
+		WakeupStats stats;
+		std::mutex mutex;
+		std::condition_variable signal;
+		std::atomic<bool> pending{ false };
+		std::atomic<bool> running{ true };
+		std::atomic<int64_t> signalNs{ 0 };
+
+		std::thread consumer([&] {
+			const ScopedThreadSched scoped("handoff", sched);
+			while (running) {
+				std::unique_lock<std::mutex> lock(mutex);
+				signal.wait_for(lock, std::chrono::milliseconds(100), [&] { return pending.load(); });
+				if (pending) {
+					stats.Record(Relativty::MonotonicNowNs() - signalNs);
+					pending = false;
+				}
+			}
+		});
+
+		for (int i = 0; i < 500; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			signalNs = Relativty::MonotonicNowNs();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending = true;
+			}
+			signal.notify_one();
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		running = false;
+		signal.notify_one();
+		consumer.join();
+		return stats.Report();
+	}
+}
+
+int main() {
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	const uint64_t lastCpu = cpus >= 2 ? (uint64_t(1) << (cpus - 1)) : 1;
+
+	{
+		WakeupStats stats;
+		for (int i = 0; i < 98; i++)
+			stats.Record(20000); // 20 us, bucket [16, 32)
+		stats.Record(300000); // 300 us, bucket [256, 512)
+		stats.Record(-5);
+		check(stats.Count() == 100, "every sample is counted");
+		check(stats.PercentileUs(0.5) == 32, "p50 is the upper edge of the 20 us bucket");
+		check(stats.PercentileUs(1.0) == 512, "p100 is the upper edge of the 300 us bucket");
+		check(stats.MaxNs() == 300000, "max is exact");
+		check(WakeupStats().Report() == "no wakeups measured", "empty report");
+	}
+
+	std::thread([&] {
+		ThreadSchedConfig config;
+		config.cpuMask = lastCpu;
+		const ScopedThreadSched scoped("relativty_imu", config);
+		char name[16] = {};
+		pthread_getname_np(pthread_self(), name, sizeof(name));
+		check(std::strcmp(name, "relativty_imu") == 0, "thread is named");
+		cpu_set_t set;
+		sched_getaffinity(0, sizeof(set), &set);
+		check(CPU_COUNT(&set) == 1 && CPU_ISSET(__builtin_ctzll(lastCpu), &set), "thread is pinned to its CPU mask");
+		check(scoped.Problems().empty(), "normal scheduling reports no problem");
+	}).join();
+
+	bool fifoWorks = false;
+	std::thread([&] {
+		ThreadSchedConfig config;
+		config.schedClass = SchedClass::Fifo;
+		config.priority = 10;
+		{
+			const ScopedThreadSched scoped("relativty_pose", config);
+			int policy;
+			sched_param param;
+			pthread_getschedparam(pthread_self(), &policy, &param);
+			fifoWorks = policy == SCHED_FIFO;
+			if (fifoWorks) {
+				check(param.sched_priority == 10 && scoped.Achieved() == "fifo 10", "fifo runs at the configured priority");
+			}
+			else {
+				std::printf("      (%s)\n", scoped.Problems().c_str());
+				check(!scoped.Problems().empty() && scoped.Achieved() == "normal", "refused fifo is reported, thread stays normal");
+			}
+		}
+		int policy;
+		sched_param param;
+		pthread_getschedparam(pthread_self(), &policy, &param);
+		check(policy == SCHED_OTHER, "scheduling policy is restored when the scope ends");
+	}).join();
+
+	ThreadSchedConfig normal;
+	normal.cpuMask = lastCpu;
+	std::printf("handoff, normal: %s\n", measureHandoff(normal).c_str());
+	if (fifoWorks) {
+		ThreadSchedConfig fifo = normal;
+		fifo.schedClass = SchedClass::Fifo;
+		fifo.priority = 50;
+		std::printf("handoff, fifo 50: %s\n", measureHandoff(fifo).c_str());
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
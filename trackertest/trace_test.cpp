@@ -0,0 +1,425 @@
+/*******************************************************
+ Relativty trace recorder test.
+
+ Runs the driver's thread pattern against Relativty_Trace, Activate and
+ Deactivate starting and joining named threads over and over, and checks
+   - with tracing off, naming threads allocates no buffer
+   - with tracing on, threads that exited hand their buffer to the next
+     ones, so restarts do not add buffers
+   - a name set before tracing was on reaches the thread's buffer, a
+     thread taking over a buffer shows under its own name
+   - the Chrome JSON dump is well formed JSON, has the thread names, a
+     begin for every end on each thread, the counters and both ends of
+     every flow
+   - the Perfetto dump is a well formed protobuf Trace, every track event
+     is on a track described before it, slices balance per track,
+     timestamps do not go back on a track and every flow terminates
+
+ Build and run (Linux):
+   g++ -std=c++17 -O2 -Iinclude trackertest/trace_test.cpp source/Relativty_Trace.cpp -lpthread -o trace_test
+   ./trace_test
+********************************************************/
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Relativty_Trace.h"
+
+namespace Trace = Relativty::Trace;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	const char* kThreadNames[] = { "update_pose", "imu", "udp" };
+
+	// the three driver threads all run until Deactivate, whatever they record
+	struct Latch {
+		std::mutex mutex;
+		std::condition_variable wake;
+		int waiting = 0;
+
+		void arriveAndWait(int count) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+			if (++this->waiting == count)
+				this->wake.notify_all();
+			this->wake.wait(lock, [&] { return this->waiting == count; });
+		}
+	};
+
+	// what one driver thread does between Activate and Deactivate
+	void driverThread(const char* name, int round, Latch& deactivate) {
+		Trace::SetThreadName(name);
+		for (int i = 0; i < 50; i++) {
+			RELATIVTY_TRACE_SCOPE("work");
+			{
+				RELATIVTY_TRACE_SCOPE("inner");
+				Trace::Counter("queue_depth", i + round);
+			}
+		}
+		deactivate.arriveAndWait(3);
+	}
+
+	void activateDeactivate(int round) {
+		Latch deactivate;
+		std::vector<std::thread> threads;
+		for (const char* name : kThreadNames)
+			threads.emplace_back(driverThread, name, round, std::ref(deactivate));
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+	std::string readFile(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		std::stringstream text;
+		text << file.rdbuf();
+		return text.str();
+	}
+
+	// just enough JSON to read the dump back
+	struct Json {
+		enum Kind { Null, Bool, Number, String, Array, Object } kind = Null;
+		double number = 0;
+		std::string text;
+		std::vector<Json> items;
+		std::map<std::string, Json> members;
+
+		const Json* member(const char* key) const {
+			const auto found = this->members.find(key);
+			return found == this->members.end() ? nullptr : &found->second;
+		}
+		std::string str(const char* key) const {
+			const Json* value = this->member(key);
+			return value && value->kind == String ? value->text : std::string();
+		}
+	};
+
+	class JsonReader {
+	public:
+		explicit JsonReader(const std::string& text) : text(text) {}
+
+		bool document(Json& value) {
+			if (!this->value(value))
+				return false;
+			this->space();
+			return this->at == this->text.size();
+		}
+
+	private:
+		void space() {
+			while (this->at < this->text.size() && std::strchr(" \t\r\n", this->text[this->at]))
+				this->at++;
+		}
+		bool consume(char c) {
+			this->space();
+			if (this->at < this->text.size() && this->text[this->at] == c) {
+				this->at++;
+				return true;
+			}
+			return false;
+		}
+		bool string(std::string& out) {
+			if (!this->consume('"'))
+				return false;
+			out.clear();
+			while (this->at < this->text.size() && this->text[this->at] != '"') {
+				char c = this->text[this->at++];
+				if (static_cast<unsigned char>(c) < 0x20)
+					return false;
+				if (c == '\\') {
+					if (this->at >= this->text.size())
+						return false;
+					c = this->text[this->at++];
+					if (!std::strchr("\"\\/", c))
+						return false; // the dump only escapes quotes and backslashes
+				}
+				out += c;
+			}
+			return this->consume('"');
+		}
+		bool value(Json& out) {
+			this->space();
+			if (this->at >= this->text.size())
+				return false;
+			const char c = this->text[this->at];
+			if (c == '{') {
+				out.kind = Json::Object;
+				this->at++;
+				if (this->consume('}'))
+					return true;
+				do {
+					std::string key;
+					if (!this->string(key) || !this->consume(':') || !this->value(out.members[key]))
+						return false;
+				} while (this->consume(','));
+				return this->consume('}');
+			}
+			if (c == '[') {
+				out.kind = Json::Array;
+				this->at++;
+				if (this->consume(']'))
+					return true;
+				do {
+					out.items.emplace_back();
+					if (!this->value(out.items.back()))
+						return false;
+				} while (this->consume(','));
+				return this->consume(']');
+			}
+			if (c == '"') {
+				out.kind = Json::String;
+				return this->string(out.text);
+			}
+			for (const char* word : { "true", "false", "null" }) {
+				if (this->text.compare(this->at, std::strlen(word), word) == 0) {
+					out.kind = word[0] == 'n' ? Json::Null : Json::Bool;
+					this->at += std::strlen(word);
+					return true;
+				}
+			}
+			const char* start = this->text.c_str() + this->at;
+			char* end;
+			out.kind = Json::Number;
+			out.number = std::strtod(start, &end);
+			this->at += end - start;
+			return end != start;
+		}
+
+		const std::string& text;
+		size_t at = 0;
+	};
+
+	// protobuf wire format, one message level at a time
+	struct Field {
+		uint32_t number;
+		uint32_t wireType;
+		uint64_t value;     // varint or fixed64
+		std::string bytes;  // length delimited
+	};
+
+	bool varint(const std::string& data, size_t& at, uint64_t& value) {
+		value = 0;
+		for (int shift = 0; shift < 64 && at < data.size(); shift += 7) {
+			const uint8_t byte = static_cast<uint8_t>(data[at++]);
+			value |= uint64_t(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	bool fields(const std::string& data, std::vector<Field>& out) {
+		out.clear();
+		size_t at = 0;
+		while (at < data.size()) {
+			uint64_t key;
+			if (!varint(data, at, key))
+				return false;
+			Field field;
+			field.number = uint32_t(key >> 3);
+			field.wireType = uint32_t(key & 7);
+			field.value = 0;
+			if (field.wireType == 0) {
+				if (!varint(data, at, field.value))
+					return false;
+			}
+			else if (field.wireType == 1) {
+				if (data.size() - at < 8)
+					return false;
+				for (int i = 0; i < 8; i++)
+					field.value |= uint64_t(static_cast<uint8_t>(data[at + i])) << (8 * i);
+				at += 8;
+			}
+			else if (field.wireType == 2) {
+				uint64_t size;
+				if (!varint(data, at, size) || size > data.size() - at)
+					return false;
+				field.bytes = data.substr(at, size_t(size));
+				at += size_t(size);
+			}
+			else {
+				return false; // the dump writes no other wire types
+			}
+			out.push_back(field);
+		}
+		return true;
+	}
+
+	const Field* find(const std::vector<Field>& message, uint32_t number) {
+		for (const Field& field : message) {
+			if (field.number == number)
+				return &field;
+		}
+		return nullptr;
+	}
+
+	std::string tempPath(const char* name) {
+		const char* dir = std::getenv("TMPDIR");
+		return std::string(dir ? dir : "/tmp") + "/" + name;
+	}
+}
+
+int main() {
+	for (int round = 0; round < 5; round++)
+		activateDeactivate(round);
+	check(Trace::BufferCount() == 0, "with tracing off, five restarts of three named threads allocate no buffer");
+
+	Trace::Enable(true);
+	for (int round = 0; round < 5; round++)
+		activateDeactivate(round);
+	std::printf("      %zu buffers after five restarts\n", Trace::BufferCount());
+	check(Trace::BufferCount() == 3, "with tracing on, restarted threads reuse the buffers of the exited ones");
+
+	// a thread named while tracing was off, that records once it is on
+	Trace::Enable(false);
+	bool named = false, proceed = false;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::thread late([&] {
+		Trace::SetThreadName("control");
+		std::unique_lock<std::mutex> lock(mutex);
+		named = true;
+		wake.notify_all();
+		wake.wait(lock, [&] { return proceed; });
+		RELATIVTY_TRACE_SCOPE("command");
+		const uint64_t flow = Trace::NewFlowId();
+		Trace::FlowBegin("request", flow);
+		std::thread([flow] {
+			Trace::SetThreadName("worker");
+			RELATIVTY_TRACE_SCOPE("handle");
+			Trace::FlowEnd("request", flow);
+		}).join();
+	});
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [&] { return named; });
+		Trace::Enable(true);
+		proceed = true;
+		wake.notify_all();
+	}
+	late.join();
+	check(Trace::BufferCount() == 3, "and so do threads started later");
+
+	{
+		const std::string path = tempPath("relativty_trace_test.json");
+		check(Trace::Dump(path), "Chrome JSON dump written");
+		const std::string text = readFile(path);
+		Json root;
+		check(JsonReader(text).document(root) && root.kind == Json::Object, "it is well formed JSON");
+		const Json* events = root.member("traceEvents");
+		check(events && events->kind == Json::Array && !events->items.empty(), "with a traceEvents array");
+
+		std::set<std::string> names;
+		std::map<double, int> depth;
+		std::set<double> flowStarts, flowEnds;
+		bool balanced = true, counters = false, complete = true;
+		for (const Json& event : events ? events->items : std::vector<Json>()) {
+			const std::string phase = event.str("ph");
+			const Json* tid = event.member("tid");
+			if (phase != "M" && (!tid || !event.member("ts") || !event.member("pid")))
+				complete = false;
+			if (phase == "M" && event.str("name") == "thread_name")
+				names.insert(event.member("args") ? event.member("args")->str("name") : std::string());
+			else if (phase == "B")
+				depth[tid->number]++;
+			else if (phase == "E")
+				balanced = --depth[tid->number] >= 0 && balanced;
+			else if (phase == "C")
+				counters = counters || event.str("name") == "queue_depth";
+			else if (phase == "s" || phase == "f")
+				(phase == "s" ? flowStarts : flowEnds).insert(event.member("id") ? event.member("id")->number : -1);
+		}
+		for (const auto& thread : depth)
+			balanced = thread.second == 0 && balanced;
+		check(complete, "every event has pid, tid and ts");
+		check(names.size() == 3 && (names.count("update_pose") || names.count("imu") || names.count("udp")),
+			"the thread still holding a buffer from the restarts is named");
+		check(names.count("control") && names.count("worker"), "a name set while tracing was off is kept");
+		check(balanced, "every end has its begin on the same thread");
+		check(counters, "counters are in");
+		check(!flowStarts.empty() && flowStarts == flowEnds, "every flow has both ends");
+	}
+
+	{
+		const std::string path = tempPath("relativty_trace_test.perfetto-trace");
+		check(Trace::Dump(path), "Perfetto dump written");
+		const std::string data = readFile(path);
+
+		std::vector<Field> packets, packet, message, nested;
+		bool wellFormed = fields(data, packets) && !packets.empty();
+		std::set<uint64_t> tracks;
+		std::set<std::string> threadNames;
+		std::map<uint64_t, int> depth;
+		std::map<uint64_t, uint64_t> lastTime;
+		std::set<uint64_t> flowStarts, flowEnds;
+		bool described = true, balanced = true, ordered = true;
+		int events = 0;
+		for (const Field& trace : packets) {
+			if (trace.number != 1 || trace.wireType != 2 || !fields(trace.bytes, packet)) {
+				wellFormed = false;
+				break;
+			}
+			if (const Field* descriptor = find(packet, 60)) {
+				if (!fields(descriptor->bytes, message) || !find(message, 1)) {
+					wellFormed = false;
+					break;
+				}
+				tracks.insert(find(message, 1)->value);
+				const Field* thread = find(message, 4);
+				if (thread && fields(thread->bytes, nested) && find(nested, 5))
+					threadNames.insert(find(nested, 5)->bytes);
+				continue;
+			}
+			const Field* event = find(packet, 11);
+			const Field* timestamp = find(packet, 8);
+			if (!event || !timestamp || !find(packet, 10) || !fields(event->bytes, message) || !find(message, 9) || !find(message, 11)) {
+				wellFormed = false;
+				break;
+			}
+			events++;
+			const uint64_t track = find(message, 11)->value;
+			described = tracks.count(track) > 0 && described;
+			ordered = timestamp->value >= lastTime[track] && ordered;
+			lastTime[track] = timestamp->value;
+			const uint64_t type = find(message, 9)->value;
+			if (type == 1)
+				depth[track]++;
+			else if (type == 2)
+				balanced = --depth[track] >= 0 && balanced;
+			for (const Field& field : message) {
+				if (field.number == 47)
+					flowStarts.insert(field.value);
+				else if (field.number == 48)
+					flowEnds.insert(field.value);
+			}
+		}
+		for (const auto& track : depth)
+			balanced = track.second == 0 && balanced;
+		std::printf("      %zu bytes, %d track events on %zu tracks\n", data.size(), events, tracks.size());
+		check(wellFormed, "it is a well formed protobuf Trace of track descriptors and track events");
+		check(threadNames.size() == 3 && threadNames.count("control") && threadNames.count("worker"), "thread tracks are named");
+		check(described, "every event is on a track described before it");
+		check(balanced, "slices balance on every track");
+		check(ordered, "timestamps do not go back on a track");
+		check(!flowStarts.empty() && flowStarts == flowEnds, "every flow terminates");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
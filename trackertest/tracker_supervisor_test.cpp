@@ -0,0 +1,232 @@
+/*******************************************************
+ Relativty tracker supervisor test.
+
+ Runs TrackerSupervisor against trackertest/dummy_tracker.c and checks
+ that it:
+   - restarts a tracker that exits, with growing backoff
+   - kills and restarts a tracker whose pose stream goes silent
+   - gives a tracker that never sends the startup grace, then restarts it
+   - falls back to SIGKILL for a tracker that ignores SIGTERM, and Stop()
+     leaves no process behind
+   - starts the tracker with the configured CPU mask and nice value
+ The receiving thread plays the driver's ingest thread: it is pinned with
+ PinCurrentThread and reports every datagram through NotePose().
+
+ Build and run (Linux):
+   gcc -std=c99 -O2 trackertest/dummy_tracker.c -o dummy_tracker
+   g++ -std=c++17 -O2 -Iinclude trackertest/tracker_supervisor_test.cpp \
+       source/Relativty_TrackerSupervisor.cpp source/Relativty_Log.cpp \
+       source/driverlog.cpp -lpthread -o tracker_supervisor_test
+   ./tracker_supervisor_test ./dummy_tracker
+********************************************************/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "Relativty_Clock.h"
+#include "Relativty_ThreadTuning.h"
+#include "Relativty_TrackerSupervisor.h"
+
+using Relativty::TrackerSupervisor;
+using Relativty::TrackerSupervisorConfig;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	void sleepMs(int ms) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	}
+
+	// what the dummy reported in its most recent datagram
+	struct Report {
+		int pid = 0;
+		unsigned long long mask = 0;
+		int nice = 0;
+	};
+
+	class Receiver {
+	public:
+		explicit Receiver(uint64_t pinMask) {
+			this->sock = socket(AF_INET, SOCK_DGRAM, 0);
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			bind(this->sock, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+			socklen_t length = sizeof(address);
+			getsockname(this->sock, reinterpret_cast<sockaddr*>(&address), &length);
+			this->port = ntohs(address.sin_port);
+			timeval timeout = { 0, 50000 };
+			setsockopt(this->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			this->worker = std::thread(&Receiver::receiveThreaded, this, pinMask);
+		}
+		~Receiver() {
+			this->running = false;
+			this->worker.join();
+			close(this->sock);
+		}
+
+		void attach(TrackerSupervisor* target) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->supervisor = target;
+			this->pids.clear();
+		}
+		Report last() {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->report;
+		}
+		size_t distinctPids() {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->pids.size();
+		}
+
+		int port = 0;
+		std::atomic<bool> pinned{ false };
+
+	private:
+		void receiveThreaded(uint64_t pinMask) {
+			if (Relativty::PinCurrentThread(pinMask)) {
+				cpu_set_t set;
+				sched_getaffinity(0, sizeof(set), &set);
+				this->pinned = CPU_COUNT(&set) == 1 && CPU_ISSET(__builtin_ctzll(pinMask), &set);
+			}
+			char message[256];
+			while (this->running) {
+				const ssize_t length = recv(this->sock, message, sizeof(message) - 1, 0);
+				if (length <= 0)
+					continue;
+				message[length] = 0;
+				Report parsed;
+				const char* fields = std::strstr(message, "pid=");
+				if (fields == nullptr || std::sscanf(fields, "pid=%d mask=%llx nice=%d", &parsed.pid, &parsed.mask, &parsed.nice) != 3)
+					continue;
+
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->report = parsed;
+				this->pids.insert(parsed.pid);
+				if (this->supervisor != nullptr)
+					this->supervisor->NotePose(Relativty::MonotonicNowNs());
+			}
+		}
+
+		int sock;
+		std::atomic<bool> running{ true };
+		std::thread worker;
+		std::mutex mutex;
+		TrackerSupervisor* supervisor = nullptr;
+		Report report;
+		std::set<int> pids;
+	};
+
+	TrackerSupervisorConfig testConfig(const std::string& dummy, int port, const char* mode) {
+		TrackerSupervisorConfig config;
+		config.command = dummy + " " + std::to_string(port) + " " + mode;
+		config.stallTimeoutMs = 300;
+		config.startupGraceMs = 600;
+		config.backoffMinMs = 100;
+		config.backoffMaxMs = 400;
+		return config;
+	}
+
+	bool processGone(int pid) {
+		return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <path to dummy_tracker>\n", argv[0]);
+		return 2;
+	}
+	const std::string dummy = argv[1];
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	// ingest on the last CPU, the tracker on the first, as a driver would configure it
+	const uint64_t ingestMask = cpus >= 2 ? (uint64_t(1) << (cpus - 1)) : 1;
+	const uint64_t trackerMask = 1;
+	Receiver receiver(ingestMask);
+	sleepMs(50);
+	check(receiver.pinned, "ingest thread pinned to its own CPU");
+
+	{
+		TrackerSupervisor supervisor;
+		receiver.attach(&supervisor);
+		supervisor.Start(testConfig(dummy, receiver.port, "crash 200"));
+		sleepMs(1500);
+		check(supervisor.Crashes() >= 2, "exiting tracker is noticed");
+		check(supervisor.Launches() >= 3 && supervisor.Launches() <= 5, "restarts back off (3..5 launches in 1.5 s)");
+		check(receiver.distinctPids() >= 2, "a new process streams after each restart");
+		receiver.attach(nullptr);
+		supervisor.Stop();
+	}
+
+	{
+		TrackerSupervisor supervisor;
+		receiver.attach(&supervisor);
+		supervisor.Start(testConfig(dummy, receiver.port, "stall 200"));
+		sleepMs(1200);
+		check(supervisor.Stalls() >= 1, "silent pose stream counts as a stall");
+		check(supervisor.Crashes() == 0, "stalled tracker is not reported as crashed");
+		check(supervisor.Launches() >= 2, "stalled tracker is restarted");
+		receiver.attach(nullptr);
+		const int lastPid = receiver.last().pid;
+		supervisor.Stop();
+		check(processGone(lastPid), "Stop() reaps the stalled tracker");
+	}
+
+	{
+		TrackerSupervisor supervisor;
+		receiver.attach(&supervisor);
+		supervisor.Start(testConfig(dummy, receiver.port, "silent"));
+		sleepMs(400);
+		check(supervisor.Stalls() == 0, "startup grace covers a tracker that has not sent yet");
+		sleepMs(600);
+		check(supervisor.Stalls() >= 1, "tracker that never sends is restarted after the grace");
+		receiver.attach(nullptr);
+		supervisor.Stop();
+	}
+
+	{
+		TrackerSupervisor supervisor;
+		receiver.attach(&supervisor);
+		TrackerSupervisorConfig config = testConfig(dummy, receiver.port, "stubborn");
+		config.cpuMask = trackerMask;
+		config.priority = Relativty::SchedPriority::BelowNormal;
+		supervisor.Start(config);
+		sleepMs(300);
+		const Report report = receiver.last();
+		check(report.pid > 0, "tracker streams");
+		check(report.mask == trackerMask, "tracker runs on the configured CPU mask");
+		check(report.nice == 5, "tracker runs at the configured priority");
+
+		receiver.attach(nullptr);
+		const auto before = std::chrono::steady_clock::now();
+		supervisor.Stop();
+		const auto tookMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - before).count();
+		check(processGone(report.pid), "tracker ignoring SIGTERM is killed");
+		check(tookMs < 3000, "Stop() is bounded for a tracker ignoring SIGTERM");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
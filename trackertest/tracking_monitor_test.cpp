@@ -0,0 +1,146 @@
+/*******************************************************
+ Relativty tracking monitor test.
+
+ Replays camera and IMU sample times through TrackingMonitor and checks
+ the state the pose thread would publish:
+   - uninitialized until the first sample, disconnected if none comes
+   - tracking while camera poses are fresh, IMU only once they stall,
+     lost when the IMU stalls too, disconnected after disconnectNs
+   - back to tracking as soon as a camera pose arrives
+   - time in each state and the number of entries add up
+   - NextChangeInNs points at the next budget to run out
+ and that the IMU to tracker offset taken at the last camera pose carries
+ the rotation on while the camera is stalled.
+
+ Build and run:
+   g++ -std=c++17 -O2 -Iinclude trackertest/tracking_monitor_test.cpp -o tracking_monitor_test
+   ./tracking_monitor_test
+********************************************************/
+
+#include <cmath>
+#include <cstdio>
+
+#include "Relativty_Quaternion.h"
+#include "Relativty_TrackingMonitor.h"
+
+using Relativty::TrackingBudgets;
+using Relativty::TrackingMonitor;
+using Relativty::TrackingState;
+
+namespace {
+	int g_failures = 0;
+
+	void check(bool condition, const char* what) {
+		std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+		if (!condition)
+			g_failures++;
+	}
+
+	const int64_t kMs = 1000000;
+
+	// rotation of angle radians around the vertical axis
+	void yaw(float angle, float out[4]) {
+		out[0] = std::cos(angle / 2);
+		out[1] = 0;
+		out[2] = std::sin(angle / 2);
+		out[3] = 0;
+	}
+
+	bool near(const float a[4], const float b[4]) {
+		// q and -q are the same rotation
+		const float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		return std::fabs(std::fabs(dot) - 1.0f) < 1e-5f;
+	}
+}
+
+int main() {
+	TrackingBudgets budgets;
+	budgets.cameraStaleNs = 150 * kMs;
+	budgets.imuStaleNs = 50 * kMs;
+	budgets.disconnectNs = 3000 * kMs;
+
+	{
+		TrackingMonitor monitor;
+		const int64_t start = 1000 * kMs;
+		monitor.Reset(budgets, start);
+		check(monitor.Update(start + 100 * kMs, 0, 0) == TrackingState::Uninitialized, "uninitialized before any sample");
+		check(monitor.NextChangeInNs(start + 100 * kMs, 0, 0) == 2900 * kMs + 1, "next change is the disconnect budget");
+		check(monitor.Update(start + 3100 * kMs, 0, 0) == TrackingState::Disconnected, "disconnected when nothing ever arrives");
+	}
+
+	TrackingMonitor monitor;
+	int64_t now = 1000 * kMs;
+	monitor.Reset(budgets, now);
+	int64_t camera = 0, imu = 0;
+
+	// 1 s of camera at 30 Hz and IMU at 100 Hz
+	bool stayed = true;
+	for (int i = 0; i < 100; i++) {
+		now += 10 * kMs;
+		imu = now;
+		if (i % 3 == 0)
+			camera = now;
+		stayed &= monitor.Update(now, camera, imu) == TrackingState::Tracking;
+	}
+	check(stayed, "tracking while camera and IMU are fresh");
+	check(monitor.NextChangeInNs(now, camera, imu) == imu + 50 * kMs - now + 1, "next change is the IMU budget, the nearest one");
+
+	// camera stops, IMU carries on
+	const int64_t cameraStopped = camera;
+	for (; now - cameraStopped <= 150 * kMs; now += 10 * kMs) {
+		imu = now;
+		monitor.Update(now, camera, imu);
+	}
+	imu = now;
+	check(monitor.Update(now, camera, imu) == TrackingState::ImuOnly, "imu only once the camera misses its budget");
+
+	// IMU stops as well
+	const int64_t imuStopped = imu;
+	now = imuStopped + 60 * kMs;
+	check(monitor.Update(now, camera, imu) == TrackingState::Lost, "lost when the IMU misses its budget too");
+	now = imuStopped + 3001 * kMs;
+	check(monitor.Update(now, camera, imu) == TrackingState::Disconnected, "disconnected after disconnectNs without samples");
+
+	now += 10 * kMs;
+	camera = now;
+	imu = now;
+	check(monitor.Update(now, camera, imu) == TrackingState::Tracking, "a camera pose brings tracking back at once");
+
+	check(monitor.Entries(TrackingState::Tracking) == 2 && monitor.Entries(TrackingState::ImuOnly) == 1
+		&& monitor.Entries(TrackingState::Lost) == 1 && monitor.Entries(TrackingState::Disconnected) == 1, "state entries are counted");
+	int64_t total = 0;
+	for (int i = 0; i < static_cast<int>(TrackingState::Count); i++)
+		total += monitor.TimeInStateNs(static_cast<TrackingState>(i));
+	check(total == now - 1000 * kMs, "time in states adds up to the elapsed time");
+	check(monitor.TimeInStateNs(TrackingState::Lost) == 2941 * kMs && monitor.TimeInStateNs(TrackingState::Disconnected) == 10 * kMs,
+		"time goes to the state observed at the previous update");
+	std::printf("      %s\n", monitor.Report().c_str());
+
+	{
+		// the IMU reports in its own frame, 90 degrees off the tracker
+		float offset[4], trackerAtLastPose[4], imuAtLastPose[4];
+		yaw(1.5708f, offset);
+		yaw(0.3f, trackerAtLastPose);
+		float offsetInverse[4];
+		Relativty::QuatConjugate(offset, offsetInverse);
+		Relativty::QuatMultiply(offsetInverse, trackerAtLastPose, imuAtLastPose);
+
+		// as update_pose_threaded: offset from the last camera pose, applied to later IMU samples
+		float imuInverse[4], imuToTracker[4];
+		Relativty::QuatConjugate(imuAtLastPose, imuInverse);
+		Relativty::QuatMultiply(trackerAtLastPose, imuInverse, imuToTracker);
+		check(Relativty::QuatNormalize(imuToTracker), "offset is a valid rotation");
+
+		float headTurned[4], imuLater[4], carried[4];
+		yaw(0.8f, headTurned);
+		Relativty::QuatMultiply(offsetInverse, headTurned, imuLater);
+		Relativty::QuatMultiply(imuToTracker, imuLater, carried);
+		check(near(carried, headTurned), "IMU rotation carried into the tracker frame");
+
+		float zero[4] = { 0, 0, 0, 0 };
+		check(!Relativty::QuatNormalize(zero), "zero quaternion is rejected");
+	}
+
+	std::printf("%s\n", g_failures == 0 ? "PASS" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}